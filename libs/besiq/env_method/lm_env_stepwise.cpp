@@ -1,134 +1,262 @@
+#include <algorithm>
+#include <cmath>
+
 #include <besiq/env_method/lm_env_stepwise.hpp>
 
-#include <glm/models/normal.hpp>
 #include <dcdflib/libdcdf.hpp>
 
+/**
+ * Computes the log-likelihood of a linear model from the cross
+ * products of its design matrix, this gives the same value as lm.
+ *
+ * The cross products are factorized with a Cholesky decomposition,
+ * and the model is rejected if any column is nearly a linear
+ * combination of the previous ones, see LM_ENV_COLLINEAR_TOLERANCE.
+ *
+ * @param xx The cross products of the design matrix of the full model.
+ * @param xy The cross products of the design matrix and the phenotype.
+ * @param yy The sum of squared phenotypes.
+ * @param n The number of samples.
+ * @param cols The columns of the full model that are in the model.
+ * @param logl The log-likelihood will be stored here.
+ *
+ * @return True if the model could be fitted, false otherwise.
+ */
+static bool
+lm_logl(const arma::mat &xx, const arma::vec &xy, double yy, double n, const arma::uvec &cols, double &logl)
+{
+    arma::mat cov = xx.submat( cols, cols );
+    arma::vec cov_y = xy.elem( cols );
+    arma::mat R;
+    if( !cov.is_finite( ) || !arma::chol( R, cov ) )
+    {
+        return false;
+    }
+
+    /* R( i, i )^2 is the residual sum of squares of column i regressed on the previous columns */
+    for(unsigned int i = 0; i < R.n_rows; i++)
+    {
+        if( R( i, i ) * R( i, i ) <= LM_ENV_COLLINEAR_TOLERANCE * cov( i, i ) )
+        {
+            return false;
+        }
+    }
+
+    double k = cols.n_elem;
+    if( n <= k )
+    {
+        return false;
+    }
+
+    /* The explained sum of squares is |R^-T X'y|^2 */
+    arma::vec z = arma::solve( arma::trimatl( R.t( ) ), cov_y );
+    double rss = std::max( yy - arma::dot( z, z ), 0.0 );
+    double sigma_square = rss / ( n - k );
+    logl = -n/2*log( 2*arma::datum::pi ) - n/2*log( sigma_square ) - rss/( 2*sigma_square );
+
+    return true;
+}
+
+/**
+ * Returns the range [first, last) of column indices.
+ */
+static arma::uvec
+column_range(unsigned int first, unsigned int last)
+{
+    arma::uvec cols( last - first );
+    for(unsigned int i = first; i < last; i++)
+    {
+        cols[ i - first ] = i;
+    }
+
+    return cols;
+}
+
 lm_env_stepwise::lm_env_stepwise(method_data_ptr data, const arma::mat &E)
-: method_env_type::method_env_type( data ),
-  m_null_matrix( data->phenotype.n_elem, data->covariate_matrix.n_cols + 1 ),
-  m_snp_matrix( data->phenotype.n_elem, data->covariate_matrix.n_cols + 1 + 2 ),
-  m_env_matrix( data->phenotype.n_elem, data->covariate_matrix.n_cols + 1 + E.n_cols ),
-  m_add_matrix( data->phenotype.n_elem, data->covariate_matrix.n_cols + 1 + 2 + E.n_cols ),
-  m_alt_matrix( data->phenotype.n_elem, data->covariate_matrix.n_cols + 1 + 2 + E.n_cols + E.n_cols*2 ),
+: single_method_type::single_method_type( data ),
+  m_base( data->phenotype.n_elem, 1 + E.n_cols + data->covariate_matrix.n_cols ),
   m_E( E )
 {
+    size_t num_env = E.n_cols;
+    size_t num_base = m_base.n_cols;
+
     /*
-     * Null matrix.
+     * Intercept, environment and covariates.
      */
-    m_null_matrix.col( 0 ) = arma::ones<arma::vec>( data->phenotype.n_elem );
-    m_snp_matrix.col( 0 ) = arma::ones<arma::vec>( data->phenotype.n_elem );
-    m_env_matrix.col( 0 ) = arma::ones<arma::vec>( data->phenotype.n_elem );
-    m_add_matrix.col( 0 ) = arma::ones<arma::vec>( data->phenotype.n_elem );
-    m_alt_matrix.col( 0 ) = arma::ones<arma::vec>( data->phenotype.n_elem );
+    m_base.col( 0 ) = arma::ones<arma::vec>( data->phenotype.n_elem );
+    if( num_env > 0 )
+    {
+        m_base.cols( 1, num_env ) = m_E;
+    }
     for(int i = 0; i < data->covariate_matrix.n_cols; i++)
     {
-        m_null_matrix.col( i + 1 ) = data->covariate_matrix.col( i );
-        m_snp_matrix.col( i + 1 + 2 ) = data->covariate_matrix.col( i );
-        m_env_matrix.col( i + 1 + E.n_cols ) = data->covariate_matrix.col( i );
-        m_add_matrix.col( i + 1 + 2 + E.n_cols ) = data->covariate_matrix.col( i );
-        m_alt_matrix.col( i + 1 + 2 + E.n_cols + E.n_cols*2 ) = data->covariate_matrix.col( i );
+        m_base.col( i + 1 + num_env ) = data->covariate_matrix.col( i );
     }
+    m_y = data->phenotype;
 
-    m_env_matrix.cols( 1, 1 + m_E.n_cols - 1 ) = m_E;
-    m_add_matrix.cols( 1 + 2, 1 + 2 + m_E.n_cols - 1 ) = m_E;
-    m_alt_matrix.cols( 1 + 2, 1 + 2 + m_E.n_cols - 1 ) = m_E;
+    arma::uvec missing = arma::find( data->missing != 0 );
+    m_base.rows( missing ).zeros( );
+    m_y.elem( missing ).zeros( );
+
+    /*
+     * Columns of the hypotheses, the snp indicators are the first
+     * columns of each of the two genotype blocks.
+     */
+    arma::uvec snp_cols( 2 );
+    snp_cols[ 0 ] = num_base;
+    snp_cols[ 1 ] = num_base + 1 + num_env;
+
+    m_null_cols = arma::join_cols( column_range( 0, 1 ), column_range( 1 + num_env, num_base ) );
+    m_snp_cols = arma::join_cols( m_null_cols, snp_cols );
+    m_env_cols = column_range( 0, num_base );
+    m_add_cols = arma::join_cols( m_env_cols, snp_cols );
+
+    /*
+     * Models that do not depend on the snp.
+     */
+    m_base_xx = m_base.t( ) * m_base;
+    m_base_xy = m_base.t( ) * m_y;
+    m_base_yy = arma::dot( m_y, m_y );
+    m_base_n = data->missing.n_elem - arma::accu( data->missing != 0 );
+    m_base_success = lm_logl( m_base_xx, m_base_xy, m_base_yy, m_base_n, m_null_cols, m_null_logl ) &&
+                     lm_logl( m_base_xx, m_base_xy, m_base_yy, m_base_n, m_env_cols, m_env_logl );
 }
 
-void
-lm_env_stepwise::init(std::ostream &output)
+std::vector<std::string>
+lm_env_stepwise::init()
 {
-    output << "P_null\tP_snp\tP_env\tP_add\t";
+    std::vector<std::string> header;
+    header.push_back( "P_null" );
+    header.push_back( "P_snp" );
+    header.push_back( "P_env" );
+    header.push_back( "P_add" );
+
+    return header;
 }
 
-void
-lm_env_stepwise::init_matrix_with_snp(const snp_row &row, arma::uvec &missing, bool *valid)
+double
+lm_env_stepwise::run(const snp_row &row, float *output)
 {
-    arma::uvec counts = arma::zeros<arma::uvec>( 2 + 2*m_E.n_cols );
+    const arma::uvec &missing = get_data( )->missing;
+    size_t num_env = m_E.n_cols;
+    size_t num_base = m_base.n_cols;
+    size_t num_block = 1 + num_env;
 
+    /*
+     * Samples with each genotype, the number of samples in each
+     * cell is counted over all samples with a genotype.
+     */
+    std::vector<arma::uword> samples[ 4 ];
+    arma::uvec counts = arma::zeros<arma::uvec>( 2 + 2*num_env );
     for(int i = 0; i < row.size( ); i++)
     {
-        if( row[ i ] == 3 )
+        unsigned char g = row[ i ];
+        if( missing[ i ] == 0 && g != 0 )
         {
-            missing[ i ] = 1;
-            continue;
+            samples[ g ].push_back( i );
+        }
+        if( g == 1 || g == 2 )
+        {
+            counts[ g - 1 ]++;
+            for(int j = 0; j < num_env; j++)
+            {
+                if( std::abs( m_E( i, j ) ) > 0.0 )
+                {
+                    counts[ 2 + ( g - 1 ) * num_env + j ]++;
+                }
+            }
         }
+    }
+    bool valid = counts.min( ) >= 20;
 
-        double s1 = row[ i ] == 1 ? 1.0 : 0.0;
-        double s2 = row[ i ] == 2 ? 1.0 : 0.0;
+    /*
+     * Cross products of the full design matrix, the samples with a
+     * missing genotype are removed from the precomputed base.
+     */
+    size_t num_cols = num_base + 2 * num_block;
+    arma::mat xx = arma::zeros<arma::mat>( num_cols, num_cols );
+    arma::vec xy = arma::zeros<arma::vec>( num_cols );
+    double yy = m_base_yy;
+    double n = m_base_n;
+    xx.submat( 0, 0, num_base - 1, num_base - 1 ) = m_base_xx;
+    xy.subvec( 0, num_base - 1 ) = m_base_xy;
+    for(int g = 1; g < 4; g++)
+    {
+        if( samples[ g ].empty( ) )
+        {
+            continue;
+        }
 
-        m_snp_matrix( i, 1 ) = s1;
-        m_snp_matrix( i, 2 ) = s2;
+        arma::uvec rows = arma::conv_to<arma::uvec>::from( samples[ g ] );
+        arma::mat X = m_base.rows( rows );
+        arma::vec y = m_y.elem( rows );
+        arma::vec cross_y = X.t( ) * y;
+        if( g == 3 )
+        {
+            xx.submat( 0, 0, num_base - 1, num_base - 1 ) -= X.t( ) * X;
+            xy.subvec( 0, num_base - 1 ) -= cross_y;
+            yy -= arma::dot( y, y );
+            n -= rows.n_elem;
+            continue;
+        }
 
-        m_add_matrix( i, 1 ) = s1;
-        m_add_matrix( i, 2 ) = s2;
+        arma::mat cross = X.t( ) * X.cols( 0, num_block - 1 );
+        size_t first = num_base + ( g - 1 ) * num_block;
+        size_t last = first + num_block - 1;
+        xx.submat( 0, first, num_base - 1, last ) = cross;
+        xx.submat( first, 0, last, num_base - 1 ) = cross.t( );
+        xx.submat( first, first, last, last ) = cross.rows( 0, num_block - 1 );
+        xy.subvec( first, last ) = cross_y.subvec( 0, num_block - 1 );
+    }
 
-        m_alt_matrix( i, 1 ) = s1;
-        m_alt_matrix( i, 2 ) = s2;
+    bool success = true;
+    double null_logl = m_null_logl;
+    double env_logl = m_env_logl;
+    if( samples[ 3 ].empty( ) )
+    {
+        success = m_base_success;
+    }
+    else
+    {
+        success = lm_logl( xx, xy, yy, n, m_null_cols, null_logl ) &&
+                  lm_logl( xx, xy, yy, n, m_env_cols, env_logl );
+    }
 
-        m_alt_matrix.row( i ).cols( 1 + 2 + m_E.n_cols, 1 + 2 + 2*m_E.n_cols - 1 ) = m_E.row( i ) * s1;
-        m_alt_matrix.row( i ).cols( 1 + 2 + 2*m_E.n_cols, 1+ 2 + 3*m_E.n_cols - 1 ) = m_E.row( i ) * s2;
+    double snp_logl;
+    double add_logl;
+    double alt_logl;
+    success = success && lm_logl( xx, xy, yy, n, m_snp_cols, snp_logl ) &&
+                         lm_logl( xx, xy, yy, n, m_add_cols, add_logl ) &&
+                         lm_logl( xx, xy, yy, n, column_range( 0, num_cols ), alt_logl );
 
-        counts[ 0 ] += s1;
-        counts[ 1 ] += s2;
-        for(int j = 0; j < m_E.n_cols; j++)
-        {
-            double e = ( std::abs( m_E( i, j ) ) > 0.0 ) ? 1.0 : 0.0;
-            counts[ 2 + j ] += e * s1;
-            counts[ 2 + m_E.n_cols + j ] += e * s2;
-        }
+    if( !success || !valid )
+    {
+        return -9;
     }
 
-    *valid = counts.min( ) >= 20;
-}
-
-void lm_env_stepwise::run(const snp_row &row, std::ostream &output)
-{
-    arma::uvec missing = get_data( )->missing;
-
-    bool valid;
-    init_matrix_with_snp( row, missing, &valid );
-
-    normal model( "identity" ); 
-    glm_info null_info;
-    glm_fit( m_null_matrix, get_data( )->phenotype, missing, model, null_info );
-    
-    glm_info snp_info;
-    glm_fit( m_snp_matrix, get_data( )->phenotype, missing, model, snp_info );
-    
-    glm_info env_info;
-    glm_fit( m_env_matrix, get_data( )->phenotype, missing, model, env_info );
-    
-    glm_info add_info;
-    glm_fit( m_add_matrix, get_data( )->phenotype, missing, model, add_info );
-
-    glm_info alt_info;
-    glm_fit( m_alt_matrix, get_data( )->phenotype, missing, model, alt_info );
-
-    if( null_info.success && snp_info.success && env_info.success && add_info.success && alt_info.success && valid )
+    try
     {
-        try
-        {
-            double LR_null = -2 *( null_info.logl - alt_info.logl );
-            double p_null = 1.0 - chi_square_cdf( LR_null, m_alt_matrix.n_cols - m_null_matrix.n_cols );
+        double LR_null = -2 *( null_logl - alt_logl );
+        double p_null = 1.0 - chi_square_cdf( LR_null, num_cols - m_null_cols.n_elem );
 
-            double LR_snp = -2 *( snp_info.logl - alt_info.logl );
-            double p_snp = 1.0 - chi_square_cdf( LR_snp, m_alt_matrix.n_cols - m_snp_matrix.n_cols );
+        double LR_snp = -2 *( snp_logl - alt_logl );
+        double p_snp = 1.0 - chi_square_cdf( LR_snp, num_cols - m_snp_cols.n_elem );
 
-            double LR_env = -2 *( env_info.logl - alt_info.logl );
-            double p_env = 1.0 - chi_square_cdf( LR_env, m_alt_matrix.n_cols - m_env_matrix.n_cols );
+        double LR_env = -2 *( env_logl - alt_logl );
+        double p_env = 1.0 - chi_square_cdf( LR_env, num_cols - m_env_cols.n_elem );
 
-            double LR_add = -2 *( add_info.logl - alt_info.logl );
-            double p_add = 1.0 - chi_square_cdf( LR_add, m_alt_matrix.n_cols - m_add_matrix.n_cols );
+        double LR_add = -2 *( add_logl - alt_logl );
+        double p_add = 1.0 - chi_square_cdf( LR_add, num_cols - m_add_cols.n_elem );
 
-            output << p_null << "\t" << p_snp << "\t" << p_env << "\t" << p_add << "\t";
-        }
-        catch(bad_domain_value &e)
-        {
-            output << "NA\tNA\tNA\tNA\t";
-        }
+        output[ 0 ] = p_null;
+        output[ 1 ] = p_snp;
+        output[ 2 ] = p_env;
+        output[ 3 ] = p_add;
+
+        return p_add;
     }
-    else
+    catch(bad_domain_value &e)
     {
-        output << "NA\tNA\tNA\tNA\t";
+        return -9;
     }
 }
@@ -7,17 +7,31 @@
 #include <armadillo>
 
 #include <glm/glm.hpp>
-#include <besiq/method/env_method.hpp>
+#include <besiq/method/single_method.hpp>
 #include <besiq/stats/log_scale.hpp>
 
+/**
+ * A model is not fitted if the part of a column that is not explained
+ * by the previous columns has a sum of squares below this fraction of
+ * its total sum of squares, i.e. the design is nearly rank deficient.
+ */
+const double LM_ENV_COLLINEAR_TOLERANCE = 1e-10;
+
 /**
  * This class is responsible for initializing and repeatedly
  * executing the lm regression on a single variant and an
  * environmental factor. The variant is treated as a factor
  * variable.
+ *
+ * All models are linear, so they are fitted from the cross products
+ * of the design matrix of the full model. The cross products of the
+ * intercept, environment and covariates do not depend on the variant
+ * and are computed once, for each variant only the cross products of
+ * the samples with each genotype are computed, which gives the small
+ * normal equations of all 5 models.
  */
 class lm_env_stepwise
-: public method_env_type
+: public single_method_type
 {
 public:
     /**
@@ -31,35 +45,63 @@ public:
     lm_env_stepwise(method_data_ptr data, const arma::mat &E);
     
     /**
-     * @see method_env_type::init.
+     * @see single_method_type::init.
      */
-    virtual void init(std::ostream &output);
+    virtual std::vector<std::string> init();
 
     /**
-     * @see method_env_type::run.
+     * Computes the p-values of the full model against each of the
+     * 4 hypotheses, and returns the p-value of the interaction, i.e.
+     * the full model against the additive model.
+     *
+     * @see single_method_type::run.
      */
-    virtual void run(const snp_row &row, std::ostream &output);
+    virtual double run(const snp_row &row, float *output);
 
 private:
     /**
-     * Design matrix corresponding to the 4 hypotheses.
+     * Columns of the 4 hypotheses in the design matrix of the
+     * full model, which contains the intercept, environment,
+     * covariates, followed by the first genotype indicator and
+     * its interactions, and the second genotype indicator and
+     * its interactions.
      *
      * null: No snp or environment
      * snp: Only snp effect
      * env: Only env effect
      * add: Additive snp and env
-     * alt: Full snp and env model
      */
-    arma::mat m_null_matrix;
-    arma::mat m_snp_matrix;
-    arma::mat m_env_matrix;
-    arma::mat m_add_matrix;
-    arma::mat m_alt_matrix;
+    arma::uvec m_null_cols;
+    arma::uvec m_snp_cols;
+    arma::uvec m_env_cols;
+    arma::uvec m_add_cols;
 
     /**
-     * Contains all design matrices.
+     * Intercept, environment and covariates, zero for missing samples.
      */
-    std::vector<arma::mat *> m_model;
+    arma::mat m_base;
+
+    /**
+     * Phenotype, zero for missing samples.
+     */
+    arma::vec m_y;
+
+    /**
+     * Cross products of the base matrix and the phenotype over all
+     * non-missing samples.
+     */
+    arma::mat m_base_xx;
+    arma::vec m_base_xy;
+    double m_base_yy;
+    double m_base_n;
+
+    /**
+     * Log-likelihoods of the null and env models for variants that
+     * have no missing genotypes, and whether they could be fitted.
+     */
+    double m_null_logl;
+    double m_env_logl;
+    bool m_base_success;
 
     /**
      * Only contains non-redundant levels, i.e. the
@@ -69,15 +111,6 @@ private:
      * the variant interaction features. 
      */
     arma::mat m_E;
-
-    /**
-     * Initializes all design matrices with the genotypes.
-     *
-     * @param row Variant.
-     * @param missing The missing samples.
-     * @param valid Determines whether there were enough samples in each cell.
-     */
-    void init_matrix_with_snp(const snp_row &row, arma::uvec &missing, bool *valid);    
 };
 
 #endif /* End of __LM_ENV_STEPWISE_H__ */
@@ -0,0 +1,592 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <stdint.h>
+#include <unistd.h>
+
+#include <besiq/io/bundle.hpp>
+
+/**
+ * Magic number of a bundle.
+ */
+static const uint32_t BUNDLE_MAGIC = 0x4c444e42;
+
+/**
+ * Version of the bundle layout.
+ */
+static const uint32_t BUNDLE_VERSION = 1;
+
+/**
+ * Flag that indicates that the genotypes are coded by the minor allele.
+ */
+static const uint32_t BUNDLE_MAFFLIP = 0x1;
+
+/**
+ * Index of the phenotype and covariate column sections.
+ */
+static const size_t PHENOTYPE_SECTION = 0;
+static const size_t COVARIATE_SECTION = 1;
+
+/**
+ * The header of a bundle, all offsets are in bytes from the start
+ * of the file and aligned to 8 bytes. Strings are stored as offsets
+ * into a table of null terminated strings.
+ */
+struct bundle_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t flags;
+    uint32_t row_words;
+    uint64_t num_samples;
+    uint64_t num_variants;
+    uint64_t num_columns[ 2 ];
+    uint64_t genotype_offset;
+    uint64_t variant_offset;
+    uint64_t locus_offset;
+    uint64_t sample_offset;
+    uint64_t column_offset[ 2 ];
+    uint64_t string_offset;
+    uint64_t string_size;
+};
+
+/**
+ * Summary of the genotypes of a variant.
+ */
+struct bundle_variant
+{
+    float maf;
+    uint32_t counts[ 4 ];
+};
+
+/**
+ * A variant as stored in a bundle.
+ */
+struct bundle_locus
+{
+    uint64_t name;
+    uint64_t allele1;
+    uint64_t allele2;
+    int64_t bp_position;
+    float position;
+    uint32_t chromosome;
+};
+
+/**
+ * A sample as stored in a bundle.
+ */
+struct bundle_sample
+{
+    uint64_t fid;
+    uint64_t iid;
+    uint64_t father_iid;
+    uint64_t mother_iid;
+    int32_t sex;
+    int32_t affection;
+    double phenotype;
+};
+
+/**
+ * Returns the size of a column section, the name of each column
+ * followed by the values and the missing mask of each column.
+ *
+ * @param num_columns The number of columns.
+ * @param num_samples The number of samples.
+ *
+ * @return The size of the section in bytes.
+ */
+static uint64_t
+column_section_size(uint64_t num_columns, uint64_t num_samples)
+{
+    return num_columns * ( sizeof( uint64_t ) + num_samples * ( sizeof( double ) + 1 ) );
+}
+
+/**
+ * Builds the string table of a bundle.
+ */
+class string_table
+{
+public:
+    /**
+     * Adds a string to the table.
+     *
+     * @param str The string, may be NULL.
+     *
+     * @return The offset of the string in the table.
+     */
+    uint64_t add(const char *str)
+    {
+        uint64_t offset = m_strings.size( );
+        if( str != NULL )
+        {
+            m_strings.append( str );
+        }
+        m_strings.push_back( '\0' );
+
+        return offset;
+    }
+
+    /**
+     * Returns the contents of the table.
+     *
+     * @return the contents of the table.
+     */
+    const std::string &get_strings() const
+    {
+        return m_strings;
+    }
+
+private:
+    /**
+     * The null terminated strings.
+     */
+    std::string m_strings;
+};
+
+/**
+ * Pads the stream with zeros to a multiple of 8 bytes.
+ *
+ * @param stream The stream.
+ *
+ * @return The aligned position of the stream.
+ */
+static uint64_t
+align_stream(std::ofstream &stream)
+{
+    uint64_t pos = stream.tellp( );
+    while( pos % 8 != 0 )
+    {
+        stream.put( 0 );
+        pos++;
+    }
+
+    return pos;
+}
+
+/**
+ * Writes a column section.
+ *
+ * @param stream The stream.
+ * @param columns The columns.
+ * @param strings The names are added here.
+ */
+static void
+write_columns(std::ofstream &stream, const bundle_columns &columns, string_table &strings)
+{
+    for(size_t i = 0; i < columns.names.size( ); i++)
+    {
+        uint64_t name = strings.add( columns.names[ i ].c_str( ) );
+        stream.write( (const char *) &name, sizeof( uint64_t ) );
+    }
+
+    stream.write( (const char *) columns.values.memptr( ), sizeof( double ) * columns.values.n_elem );
+    for(size_t i = 0; i < columns.values.n_elem; i++)
+    {
+        stream.put( arma::is_finite( columns.values[ i ] ) ? 0 : 1 );
+    }
+}
+
+/**
+ * Writes all sections and the header of a bundle to a stream.
+ *
+ * @param stream The output stream.
+ * @param genotype_file The plink file, all remaining rows are read.
+ * @param mafflip Whether the plink file codes genotypes by the minor allele.
+ * @param phenotypes The phenotypes, may be empty.
+ * @param covariates The covariates, may be empty.
+ *
+ * @return True if the bundle was written, false otherwise.
+ */
+static bool
+write_sections(std::ofstream &stream, plink_file_ptr genotype_file, bool mafflip, const bundle_columns &phenotypes, const bundle_columns &covariates)
+{
+    const std::vector<pio_sample_t> &samples = genotype_file->get_samples( );
+    const std::vector<pio_locus_t> &loci = genotype_file->get_loci( );
+
+    bundle_header header;
+    memset( &header, 0, sizeof( bundle_header ) );
+    header.magic = BUNDLE_MAGIC;
+    header.version = BUNDLE_VERSION;
+    header.flags = mafflip ? BUNDLE_MAFFLIP : 0;
+    header.row_words = snp_row::num_words( samples.size( ) );
+    header.num_samples = samples.size( );
+    header.num_columns[ PHENOTYPE_SECTION ] = phenotypes.names.size( );
+    header.num_columns[ COVARIATE_SECTION ] = covariates.names.size( );
+    stream.write( (const char *) &header, sizeof( bundle_header ) );
+
+    /* Genotypes in the packed layout of snp_row */
+    header.genotype_offset = align_stream( stream );
+    std::vector<bundle_variant> variants;
+    snp_row row;
+    while( genotype_file->next_row( row ) )
+    {
+        bundle_variant variant;
+        memset( &variant, 0, sizeof( bundle_variant ) );
+        for(size_t i = 0; i < row.size( ); i++)
+        {
+            variant.counts[ row[ i ] ]++;
+        }
+        uint32_t total = variant.counts[ 0 ] + variant.counts[ 1 ] + variant.counts[ 2 ];
+        variant.maf = total > 0 ? ( variant.counts[ 1 ] + 2.0f * variant.counts[ 2 ] ) / ( 2.0f * total ) : 0.0f;
+        variants.push_back( variant );
+
+        stream.write( (const char *) row.data( ), sizeof( unsigned int ) * header.row_words );
+    }
+    header.num_variants = variants.size( );
+    if( variants.size( ) != loci.size( ) )
+    {
+        return false;
+    }
+
+    header.variant_offset = align_stream( stream );
+    if( !variants.empty( ) )
+    {
+        stream.write( (const char *) &variants[ 0 ], sizeof( bundle_variant ) * variants.size( ) );
+    }
+
+    string_table strings;
+    header.locus_offset = align_stream( stream );
+    for(size_t i = 0; i < loci.size( ); i++)
+    {
+        bundle_locus locus;
+        memset( &locus, 0, sizeof( bundle_locus ) );
+        locus.name = strings.add( loci[ i ].name );
+        locus.allele1 = strings.add( loci[ i ].allele1 );
+        locus.allele2 = strings.add( loci[ i ].allele2 );
+        locus.bp_position = loci[ i ].bp_position;
+        locus.position = loci[ i ].position;
+        locus.chromosome = loci[ i ].chromosome;
+        stream.write( (const char *) &locus, sizeof( bundle_locus ) );
+    }
+
+    header.sample_offset = align_stream( stream );
+    for(size_t i = 0; i < samples.size( ); i++)
+    {
+        bundle_sample sample;
+        memset( &sample, 0, sizeof( bundle_sample ) );
+        sample.fid = strings.add( samples[ i ].fid );
+        sample.iid = strings.add( samples[ i ].iid );
+        sample.father_iid = strings.add( samples[ i ].father_iid );
+        sample.mother_iid = strings.add( samples[ i ].mother_iid );
+        sample.sex = samples[ i ].sex;
+        sample.affection = samples[ i ].affection;
+        sample.phenotype = samples[ i ].phenotype;
+        stream.write( (const char *) &sample, sizeof( bundle_sample ) );
+    }
+
+    header.column_offset[ PHENOTYPE_SECTION ] = align_stream( stream );
+    write_columns( stream, phenotypes, strings );
+    header.column_offset[ COVARIATE_SECTION ] = align_stream( stream );
+    write_columns( stream, covariates, strings );
+
+    header.string_offset = align_stream( stream );
+    header.string_size = strings.get_strings( ).size( );
+    stream.write( strings.get_strings( ).data( ), header.string_size );
+
+    stream.seekp( 0 );
+    stream.write( (const char *) &header, sizeof( bundle_header ) );
+    stream.close( );
+
+    return !stream.fail( );
+}
+
+bool
+write_bundle(const std::string &path, plink_file_ptr genotype_file, bool mafflip, const bundle_columns &phenotypes, const bundle_columns &covariates)
+{
+    /* Write to a temporary file so that a failed write never leaves a partial bundle at path */
+    std::string tmp_path = path + ".tmp";
+    std::ofstream stream( tmp_path.c_str( ), std::ios::binary );
+    if( !stream.is_open( ) )
+    {
+        return false;
+    }
+
+    if( !write_sections( stream, genotype_file, mafflip, phenotypes, covariates ) || rename( tmp_path.c_str( ), path.c_str( ) ) != 0 )
+    {
+        unlink( tmp_path.c_str( ) );
+        return false;
+    }
+
+    return true;
+}
+
+bool
+is_bundle(const std::string &path)
+{
+    std::ifstream stream( path.c_str( ), std::ios::binary );
+    uint32_t magic = 0;
+    stream.read( (char *) &magic, sizeof( uint32_t ) );
+
+    return stream.good( ) && magic == BUNDLE_MAGIC;
+}
+
+/**
+ * Returns the header of a mapped bundle.
+ *
+ * @param file The mapped file.
+ *
+ * @return The header.
+ */
+static const bundle_header &
+get_header(const mapped_file_ptr &file)
+{
+    return *(const bundle_header *) file->data( );
+}
+
+/**
+ * Checks that a section lies within the mapped file.
+ *
+ * @param file The mapped file.
+ * @param offset The start of the section.
+ * @param size The size of the section.
+ *
+ * @return True if the section is within the file.
+ */
+static bool
+valid_section(const mapped_file_ptr &file, uint64_t offset, uint64_t size)
+{
+    return offset % 8 == 0 && offset <= file->size( ) && size <= file->size( ) - offset;
+}
+
+/**
+ * Returns a string from the string table of a mapped bundle.
+ *
+ * @param file The mapped file.
+ * @param offset The offset of the string, offsets outside of the
+ *               table return the empty string at its end.
+ *
+ * @return The null terminated string.
+ */
+static char *
+get_string(const mapped_file_ptr &file, uint64_t offset)
+{
+    const bundle_header &header = get_header( file );
+    offset = std::min( offset, header.string_size - 1 );
+
+    return (char *) file->data( ) + header.string_offset + offset;
+}
+
+dataset_bundle::dataset_bundle(const std::string &path)
+    : m_file( new mapped_file( path ) )
+{
+    if( m_file->size( ) < sizeof( bundle_header ) )
+    {
+        throw std::runtime_error( "dataset_bundle: " + path + " is not a bundle." );
+    }
+
+    const bundle_header &header = get_header( m_file );
+    if( header.magic != BUNDLE_MAGIC || header.version != BUNDLE_VERSION )
+    {
+        throw std::runtime_error( "dataset_bundle: " + path + " is not a bundle of a supported version." );
+    }
+
+    bool valid = header.row_words == snp_row::num_words( header.num_samples ) &&
+                 valid_section( m_file, header.genotype_offset, header.num_variants * header.row_words * sizeof( unsigned int ) ) &&
+                 valid_section( m_file, header.variant_offset, header.num_variants * sizeof( bundle_variant ) ) &&
+                 valid_section( m_file, header.locus_offset, header.num_variants * sizeof( bundle_locus ) ) &&
+                 valid_section( m_file, header.sample_offset, header.num_samples * sizeof( bundle_sample ) ) &&
+                 valid_section( m_file, header.column_offset[ 0 ], column_section_size( header.num_columns[ 0 ], header.num_samples ) ) &&
+                 valid_section( m_file, header.column_offset[ 1 ], column_section_size( header.num_columns[ 1 ], header.num_samples ) ) &&
+                 valid_section( m_file, header.string_offset, header.string_size ) &&
+                 header.string_size > 0 && m_file->data( )[ header.string_offset + header.string_size - 1 ] == '\0';
+    if( !valid )
+    {
+        throw std::runtime_error( "dataset_bundle: " + path + " is truncated or corrupt." );
+    }
+
+    const bundle_locus *loci = (const bundle_locus *) ( m_file->data( ) + header.locus_offset );
+    m_loci.resize( header.num_variants );
+    for(size_t i = 0; i < header.num_variants; i++)
+    {
+        pio_locus_t &locus = m_loci[ i ];
+        memset( &locus, 0, sizeof( pio_locus_t ) );
+        locus.pio_id = i;
+        locus.chromosome = loci[ i ].chromosome;
+        locus.name = get_string( m_file, loci[ i ].name );
+        locus.position = loci[ i ].position;
+        locus.bp_position = loci[ i ].bp_position;
+        locus.allele1 = get_string( m_file, loci[ i ].allele1 );
+        locus.allele2 = get_string( m_file, loci[ i ].allele2 );
+    }
+
+    const bundle_sample *samples = (const bundle_sample *) ( m_file->data( ) + header.sample_offset );
+    m_samples.resize( header.num_samples );
+    for(size_t i = 0; i < header.num_samples; i++)
+    {
+        pio_sample_t &sample = m_samples[ i ];
+        memset( &sample, 0, sizeof( pio_sample_t ) );
+        sample.pio_id = i;
+        sample.fid = get_string( m_file, samples[ i ].fid );
+        sample.iid = get_string( m_file, samples[ i ].iid );
+        sample.father_iid = get_string( m_file, samples[ i ].father_iid );
+        sample.mother_iid = get_string( m_file, samples[ i ].mother_iid );
+        sample.sex = (sex_t) samples[ i ].sex;
+        sample.affection = (affection_t) samples[ i ].affection;
+        sample.phenotype = samples[ i ].phenotype;
+    }
+
+    for(size_t section = 0; section < 2; section++)
+    {
+        const uint64_t *names = (const uint64_t *) ( m_file->data( ) + header.column_offset[ section ] );
+        for(size_t i = 0; i < header.num_columns[ section ]; i++)
+        {
+            m_column_names[ section ].push_back( get_string( m_file, names[ i ] ) );
+        }
+    }
+}
+
+const std::vector<pio_sample_t> &
+dataset_bundle::get_samples() const
+{
+    return m_samples;
+}
+
+std::vector<std::string>
+dataset_bundle::get_sample_iids() const
+{
+    std::vector<std::string> iids;
+    for(size_t i = 0; i < m_samples.size( ); i++)
+    {
+        iids.push_back( m_samples[ i ].iid );
+    }
+
+    return iids;
+}
+
+const std::vector<pio_locus_t> &
+dataset_bundle::get_loci() const
+{
+    return m_loci;
+}
+
+std::vector<std::string>
+dataset_bundle::get_locus_names() const
+{
+    std::vector<std::string> names;
+    for(size_t i = 0; i < m_loci.size( ); i++)
+    {
+        names.push_back( m_loci[ i ].name );
+    }
+
+    return names;
+}
+
+float
+dataset_bundle::get_maf(size_t index) const
+{
+    const bundle_variant *variants = (const bundle_variant *) ( m_file->data( ) + get_header( m_file ).variant_offset );
+    return variants[ index ].maf;
+}
+
+unsigned int
+dataset_bundle::get_count(size_t index, unsigned char genotype) const
+{
+    const bundle_variant *variants = (const bundle_variant *) ( m_file->data( ) + get_header( m_file ).variant_offset );
+    return variants[ index ].counts[ genotype & 0x3 ];
+}
+
+bool
+dataset_bundle::is_mafflipped() const
+{
+    return ( get_header( m_file ).flags & BUNDLE_MAFFLIP ) != 0;
+}
+
+genotype_matrix_ptr
+dataset_bundle::get_genotypes() const
+{
+    const bundle_header &header = get_header( m_file );
+    const unsigned int *words = (const unsigned int *) ( m_file->data( ) + header.genotype_offset );
+
+    shared_ptr< std::vector<snp_row> > rows( new std::vector<snp_row>( header.num_variants ) );
+    for(size_t i = 0; i < header.num_variants; i++)
+    {
+        ( *rows )[ i ].wrap( words + i * header.row_words, header.num_samples );
+    }
+
+    return genotype_matrix_ptr( new genotype_matrix( rows, get_locus_names( ), m_file ) );
+}
+
+size_t
+dataset_bundle::num_phenotypes() const
+{
+    return m_column_names[ PHENOTYPE_SECTION ].size( );
+}
+
+size_t
+dataset_bundle::num_covariates() const
+{
+    return m_column_names[ COVARIATE_SECTION ].size( );
+}
+
+arma::mat
+dataset_bundle::get_columns(size_t section, const std::vector<std::string> &names, arma::uvec &missing) const
+{
+    const bundle_header &header = get_header( m_file );
+    size_t num_samples = header.num_samples;
+    size_t num_columns = header.num_columns[ section ];
+    const char *base = m_file->data( ) + header.column_offset[ section ];
+    const double *values = (const double *) ( base + num_columns * sizeof( uint64_t ) );
+    const unsigned char *masks = (const unsigned char *) ( values + num_columns * num_samples );
+
+    arma::mat X( num_samples, names.size( ) );
+    for(size_t i = 0; i < names.size( ); i++)
+    {
+        const std::vector<std::string> &column_names = m_column_names[ section ];
+        std::vector<std::string>::const_iterator it = std::find( column_names.begin( ), column_names.end( ), names[ i ] );
+        if( it == column_names.end( ) )
+        {
+            throw std::runtime_error( "dataset_bundle: Could not find the column '" + names[ i ] + "'." );
+        }
+
+        size_t column = it - column_names.begin( );
+        std::copy( values + column * num_samples, values + ( column + 1 ) * num_samples, X.colptr( i ) );
+        for(size_t j = 0; j < num_samples; j++)
+        {
+            if( masks[ column * num_samples + j ] != 0 )
+            {
+                missing[ j ] = 1;
+            }
+        }
+    }
+
+    return X;
+}
+
+arma::vec
+dataset_bundle::get_phenotype(const std::string &name, arma::uvec &missing) const
+{
+    std::vector<std::string> names( 1, name );
+    if( name == "" )
+    {
+        if( num_phenotypes( ) != 1 )
+        {
+            throw std::runtime_error( "dataset_bundle: The bundle contains more than one phenotype, select one by name." );
+        }
+        names[ 0 ] = m_column_names[ PHENOTYPE_SECTION ][ 0 ];
+    }
+
+    return get_columns( PHENOTYPE_SECTION, names, missing ).col( 0 );
+}
+
+arma::mat
+dataset_bundle::get_covariates(const std::vector<std::string> *columns, arma::uvec &missing, std::vector<std::string> *out_header) const
+{
+    std::vector<std::string> names = m_column_names[ COVARIATE_SECTION ];
+    if( columns != NULL && !columns->empty( ) )
+    {
+        names = *columns;
+    }
+
+    if( out_header != NULL )
+    {
+        out_header->clear( );
+        out_header->push_back( "FID" );
+        out_header->push_back( "IID" );
+        out_header->insert( out_header->end( ), names.begin( ), names.end( ) );
+    }
+
+    return get_columns( COVARIATE_SECTION, names, missing );
+}
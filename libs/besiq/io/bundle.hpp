@@ -0,0 +1,215 @@
+#ifndef __BUNDLE_H__
+#define __BUNDLE_H__
+
+#include <string>
+#include <vector>
+
+#include <armadillo>
+
+#include <plink/mapped_file.hpp>
+#include <plink/plink_file.hpp>
+#include <shared_ptr/shared_ptr.hpp>
+
+/**
+ * A named set of columns with one value per sample, e.g. the
+ * phenotypes or covariates of a bundle. Missing values are NaN.
+ */
+struct bundle_columns
+{
+    /**
+     * The name of each column.
+     */
+    std::vector<std::string> names;
+
+    /**
+     * The values, one row per sample.
+     */
+    arma::mat values;
+};
+
+/**
+ * The genotypes, variants, samples, phenotypes and covariates of a
+ * data set preprocessed into a single binary file by besiq prepare.
+ * The file is memory mapped read-only, so opening it only reads the
+ * small tables, and the genotype rows refer directly to the mapped
+ * pages which are shared by every process that opens the bundle.
+ */
+class dataset_bundle
+{
+public:
+    /**
+     * Opens a bundle.
+     *
+     * @param path The path to the bundle.
+     *
+     * @throws std::runtime_error if the file is not a valid bundle.
+     */
+    dataset_bundle(const std::string &path);
+
+    /**
+     * Returns the samples in the order of the genotypes.
+     *
+     * @return the samples.
+     */
+    const std::vector<pio_sample_t> &get_samples() const;
+
+    /**
+     * Returns the iids of the samples in the order of the genotypes.
+     *
+     * @return the iids of the samples.
+     */
+    std::vector<std::string> get_sample_iids() const;
+
+    /**
+     * Returns the variants in the order of the genotypes.
+     *
+     * @return the variants.
+     */
+    const std::vector<pio_locus_t> &get_loci() const;
+
+    /**
+     * Returns the names of the variants.
+     *
+     * @return the names of the variants.
+     */
+    std::vector<std::string> get_locus_names() const;
+
+    /**
+     * Returns the frequency of the allele counted by the genotype
+     * coding of a variant, which is the minor allele if the genotypes
+     * were flipped.
+     *
+     * @param index Index of the variant.
+     *
+     * @return The allele frequency.
+     */
+    float get_maf(size_t index) const;
+
+    /**
+     * Returns the number of samples with the given genotype of a variant.
+     *
+     * @param index Index of the variant.
+     * @param genotype The genotype 0, 1, 2 or 3 for missing.
+     *
+     * @return The number of samples.
+     */
+    unsigned int get_count(size_t index, unsigned char genotype) const;
+
+    /**
+     * Returns true if the genotypes are coded so that 2 is
+     * homozygous for the minor allele.
+     *
+     * @return true if the genotypes are coded by the minor allele.
+     */
+    bool is_mafflipped() const;
+
+    /**
+     * Returns a genotype matrix whose rows refer to the mapped genotypes.
+     *
+     * @return a genotype matrix.
+     */
+    genotype_matrix_ptr get_genotypes() const;
+
+    /**
+     * Returns the number of phenotypes in the bundle.
+     *
+     * @return the number of phenotypes.
+     */
+    size_t num_phenotypes() const;
+
+    /**
+     * Returns the number of covariates in the bundle.
+     *
+     * @return the number of covariates.
+     */
+    size_t num_covariates() const;
+
+    /**
+     * Returns a phenotype.
+     *
+     * @param name The name of the phenotype, may be "" if the bundle
+     *             contains a single phenotype.
+     * @param missing Samples with a missing phenotype will be set to 1,
+     *                others will remain untouched.
+     *
+     * @throws std::runtime_error if the phenotype does not exist.
+     *
+     * @return The phenotype of each sample.
+     */
+    arma::vec get_phenotype(const std::string &name, arma::uvec &missing) const;
+
+    /**
+     * Returns a set of covariates.
+     *
+     * @param columns The names of the covariates, all if NULL or empty.
+     * @param missing Samples with a missing covariate will be set to 1,
+     *                others will remain untouched.
+     * @param out_header The header FID, IID followed by the covariate names
+     *                   will be stored here.
+     *
+     * @throws std::runtime_error if a covariate does not exist.
+     *
+     * @return A matrix with one column per covariate.
+     */
+    arma::mat get_covariates(const std::vector<std::string> *columns, arma::uvec &missing, std::vector<std::string> *out_header = NULL) const;
+
+private:
+    /**
+     * Returns the selected columns of a column section.
+     *
+     * @param section Index of the column section.
+     * @param names The names of the columns that are selected.
+     * @param missing Samples with a missing value will be set to 1.
+     *
+     * @return The selected columns.
+     */
+    arma::mat get_columns(size_t section, const std::vector<std::string> &names, arma::uvec &missing) const;
+
+    /**
+     * The mapped file.
+     */
+    mapped_file_ptr m_file;
+
+    /**
+     * The samples, the strings point into the mapped file.
+     */
+    std::vector<pio_sample_t> m_samples;
+
+    /**
+     * The variants, the strings point into the mapped file.
+     */
+    std::vector<pio_locus_t> m_loci;
+
+    /**
+     * The column names of the phenotypes and covariates.
+     */
+    std::vector<std::string> m_column_names[ 2 ];
+};
+
+typedef shared_ptr<dataset_bundle> dataset_bundle_ptr;
+
+/**
+ * Returns true if the given path is a bundle, as opposed to e.g.
+ * a plink prefix.
+ *
+ * @param path The path.
+ *
+ * @return true if the path is a bundle.
+ */
+bool is_bundle(const std::string &path);
+
+/**
+ * Writes a bundle from a plink file, phenotypes and covariates. The
+ * bundle is written to <path>.tmp and renamed once it is complete.
+ *
+ * @param path The path of the bundle.
+ * @param genotype_file The plink file, all remaining rows are read.
+ * @param mafflip Whether the plink file codes genotypes by the minor allele.
+ * @param phenotypes The phenotypes, may be empty.
+ * @param covariates The covariates, may be empty.
+ *
+ * @return True if the bundle was written, false otherwise.
+ */
+bool write_bundle(const std::string &path, plink_file_ptr genotype_file, bool mafflip, const bundle_columns &phenotypes, const bundle_columns &covariates);
+
+#endif /* End of __BUNDLE_H__ */
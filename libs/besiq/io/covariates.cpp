@@ -1,20 +1,119 @@
 #include <algorithm>
-#include <iterator>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <map>
 #include <sstream>
 #include <stdexcept>
 #include <vector>
 
-#include <assert.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <armadillo>
 
 #include <besiq/io/covariates.hpp>
+#include <gzstream/gzutil.hpp>
 #include <plink/plink_file.hpp>
 
 using namespace arma;
 
+/**
+ * Magic number of a binary covariate cache.
+ */
+static const uint32_t CACHE_MAGIC = 0x48434342;
+
+/**
+ * The number of bytes read from the stream at a time.
+ */
+static const size_t READ_CHUNK_SIZE = 1 << 20;
+
+/**
+ * Reads the remaining contents of a stream into a buffer, that is
+ * terminated by a null character so that the numeric fields can be
+ * parsed in place.
+ *
+ * @param stream The stream.
+ * @param buffer The contents will be stored here.
+ */
+static void
+read_contents(std::istream &stream, std::vector<char> &buffer)
+{
+    buffer.clear( );
+    size_t size = 0;
+    while( stream )
+    {
+        buffer.resize( size + READ_CHUNK_SIZE );
+        stream.read( &buffer[ size ], READ_CHUNK_SIZE );
+        size += stream.gcount( );
+    }
+
+    buffer.resize( size + 1 );
+    buffer[ size ] = '\0';
+}
+
+/**
+ * Moves to the next line of a buffer.
+ *
+ * @param pos The current position, will be moved past the line.
+ * @param end The end of the buffer.
+ * @param line_end The end of the line will be stored here.
+ *
+ * @return True if there was a line, false at the end of the buffer.
+ */
+static bool
+next_line(const char *&pos, const char *end, const char *&line_end)
+{
+    if( pos >= end )
+    {
+        return false;
+    }
+
+    line_end = (const char *) memchr( pos, '\n', end - pos );
+    if( line_end == NULL )
+    {
+        line_end = end;
+    }
+
+    return true;
+}
+
+/**
+ * Finds the next whitespace separated token in a line.
+ *
+ * @param pos The current position, will be moved past the token.
+ * @param line_end The end of the line.
+ * @param token The start of the token will be stored here.
+ * @param length The length of the token will be stored here.
+ *
+ * @return True if there was a token, false at the end of the line.
+ */
+static bool
+next_token(const char *&pos, const char *line_end, const char *&token, size_t &length)
+{
+    while( pos < line_end && isspace( (unsigned char) *pos ) )
+    {
+        pos++;
+    }
+    if( pos >= line_end )
+    {
+        return false;
+    }
+
+    token = pos;
+    while( pos < line_end && !isspace( (unsigned char) *pos ) )
+    {
+        pos++;
+    }
+    length = pos - token;
+
+    return true;
+}
+
 /**
  * Tokenizes a header, making sure that it starts with FID and IID.
  *
@@ -27,13 +126,17 @@ using namespace arma;
 std::vector<std::string>
 get_fields(const std::string &header)
 {
-    std::istringstream header_stream( header );
     std::vector<std::string> fields;
-    std::copy( std::istream_iterator<std::string>( header_stream ),
-               std::istream_iterator<std::string>( ),
-               std::back_inserter< std::vector<std::string> >( fields ) );
+    const char *pos = header.c_str( );
+    const char *end = pos + header.size( );
+    const char *token;
+    size_t length;
+    while( next_token( pos, end, token, length ) )
+    {
+        fields.push_back( std::string( token, length ) );
+    }
 
-    if( fields.size( ) <= 0 || fields[ 0 ] != "FID" || fields[ 1 ] != "IID" )
+    if( fields.size( ) < 2 || fields[ 0 ] != "FID" || fields[ 1 ] != "IID" )
     {
         throw std::runtime_error( "get_fields: The first two fields must be named FID and IID." );
     }
@@ -44,8 +147,10 @@ get_fields(const std::string &header)
 /**
  * Parses a single field expecting it to be a double.
  *
- * @param field_str The field string.
- * @param row_num The line number.
+ * @param field The start of the field, must be followed by a
+ *              character that is not part of a number.
+ * @param length The length of the field.
+ * @param row_num The index of the line after the header.
  * @param column The column number.
  *
  * @throws std::runtime_error.
@@ -53,21 +158,18 @@ get_fields(const std::string &header)
  * @return A parsed double.
  */
 double
-parse_field(const std::string &field_str, unsigned int row_num, unsigned int column)
+parse_field(const char *field, size_t length, unsigned int row_num, unsigned int column)
 {
-    std::istringstream field_stream( field_str );
-    float field;
-    char c;
-    if( ! (field_stream >> field) || field_stream.get( c ) )
+    char *field_end = NULL;
+    double value = strtod( field, &field_end );
+    if( length == 0 || field_end != field + length )
     {
         std::ostringstream error_message;
         error_message << "Could not parse file, error on line: " << row_num + 2 << " column " << column;
         throw std::runtime_error( error_message.str( ) );
     }
-    else
-    {
-        return field;
-    }
+
+    return value;
 }
 
 /**
@@ -90,72 +192,142 @@ create_iid_map(const std::vector<std::string> &order)
     return iid_index;
 }
 
+/**
+ * Finds the header column of each selected column.
+ *
+ * @param header The header of the file.
+ * @param columns The names of the selected columns, all columns
+ *                after FID and IID are selected if NULL or empty.
+ *
+ * @throws std::runtime_error.
+ *
+ * @return The header column of each selected column.
+ */
+static std::vector<size_t>
+select_columns(const std::vector<std::string> &header, const std::vector<std::string> *columns)
+{
+    std::vector<size_t> selected;
+    if( columns == NULL || columns->empty( ) )
+    {
+        for(size_t i = 2; i < header.size( ); i++)
+        {
+            selected.push_back( i );
+        }
+
+        return selected;
+    }
+
+    for(size_t i = 0; i < columns->size( ); i++)
+    {
+        std::vector<std::string>::const_iterator it = std::find( header.begin( ) + 2, header.end( ), ( *columns )[ i ] );
+        if( it == header.end( ) )
+        {
+            throw std::runtime_error( "select_columns: Could not find the column '" + ( *columns )[ i ] + "'." );
+        }
+
+        selected.push_back( it - header.begin( ) );
+    }
+
+    return selected;
+}
+
 mat
-parse_covariate_matrix(std::istream &stream, arma::uvec &missing, const std::vector<std::string> &order, std::vector<std::string> *out_header, const char *missing_string)
+parse_covariate_matrix(std::istream &stream, arma::uvec &missing, const std::vector<std::string> &order, std::vector<std::string> *out_header, const char *missing_string, const std::vector<std::string> *columns)
 {
-    std::string header;
-    std::getline( stream, header );
-    std::vector<std::string> header_fields = get_fields( header );
+    std::vector<char> buffer;
+    read_contents( stream, buffer );
+    const char *pos = &buffer[ 0 ];
+    const char *end = pos + buffer.size( ) - 1;
+    const char *line_end;
+
+    if( !next_line( pos, end, line_end ) )
+    {
+        throw std::runtime_error( "get_fields: The first two fields must be named FID and IID." );
+    }
+    std::vector<std::string> header_fields = get_fields( std::string( pos, line_end ) );
+    pos = line_end + 1;
+
+    std::vector<size_t> selected = select_columns( header_fields, columns );
     if( out_header != NULL )
     {
-        *out_header = header_fields;
+        out_header->assign( header_fields.begin( ), header_fields.begin( ) + 2 );
+        for(size_t i = 0; i < selected.size( ); i++)
+        {
+            out_header->push_back( header_fields[ selected[ i ] ] );
+        }
     }
-    
+
+    /* Destination column of each header column, or -1 if it is skipped */
+    std::vector<int> target( header_fields.size( ), -1 );
+    size_t last_column = 1;
+    for(size_t i = 0; i < selected.size( ); i++)
+    {
+        target[ selected[ i ] ] = i;
+        last_column = std::max( last_column, selected[ i ] );
+    }
+
     std::map<std::string, size_t> iid_index = create_iid_map( order );
-    mat X = arma::zeros<arma::mat>( order.size( ), header_fields.size( ) - 2 );
+    std::vector<char> found( order.size( ), 0 );
+    mat X( order.size( ), selected.size( ) );
     X.fill( arma::datum::nan );
 
-    std::string line;
-    int row_num = 0;
-    rowvec row( header_fields.size( ) - 2 );
-    while( std::getline( stream, line ) )
+    /* Counts every line after the header, so that errors refer to the line in the file */
+    size_t missing_length = strlen( missing_string );
+    int row_num = -1;
+    std::string iid;
+    while( next_line( pos, end, line_end ) )
     {
-        std::istringstream line_stream( line );
-        std::string fid;
-        std::string iid;
+        row_num++;
+        const char *token;
+        size_t length;
+        if( !next_token( pos, line_end, token, length ) || !next_token( pos, line_end, token, length ) )
+        {
+            pos = line_end + 1;
+            continue;
+        }
 
-        line_stream >> fid;
-        line_stream >> iid;
-        if( iid_index.count( iid ) <= 0 )
+        iid.assign( token, length );
+        std::map<std::string, size_t>::iterator it = iid_index.find( iid );
+        if( it == iid_index.end( ) || found[ it->second ] )
         {
+            pos = line_end + 1;
             continue;
         }
+        size_t row = it->second;
+        found[ row ] = 1;
 
-        for(int i = 2; i < header_fields.size( ); i++)
+        for(size_t i = 2; i <= last_column; i++)
         {
-            std::string field_str;
-            if( ! (line_stream >> field_str) )
+            if( !next_token( pos, line_end, token, length ) )
             {
                 std::ostringstream error_message;
                 error_message << "Missing column on line " << row_num + 2;
                 throw std::runtime_error( error_message.str( ) );
             }
+            if( target[ i ] == -1 )
+            {
+                continue;
+            }
 
-            if( field_str != missing_string )
+            if( length != missing_length || strncmp( token, missing_string, length ) != 0 )
             {
-                row[ i - 2 ] = parse_field( field_str, row_num, i );
+                X( row, target[ i ] ) = parse_field( token, length, row_num, i );
             }
             else
             {
-                missing[ iid_index[ iid ] ] = 1;
-                row[ i - 2 ] = arma::datum::nan;
+                missing[ row ] = 1;
             }
         }
 
-        X.row( iid_index[ iid ] ) = row;
-        iid_index.erase( iid );
-        
-        row_num++;
+        pos = line_end + 1;
     }
 
     /* Any missing iids marked as missing */
-    if( iid_index.size( ) > 0 )
+    for(size_t i = 0; i < found.size( ); i++)
     {
-        std::map<std::string, size_t>::iterator it;
-        for(it = iid_index.begin( ); it != iid_index.end( ); ++it)
+        if( !found[ i ] )
         {
-            missing[ it->second ] = 1;
-            X.row( it->second ).fill( arma::datum::nan );
+            missing[ i ] = 1;
         }
     }
 
@@ -165,28 +337,19 @@ parse_covariate_matrix(std::istream &stream, arma::uvec &missing, const std::vec
 arma::vec
 parse_phenotypes(std::istream &stream, arma::uvec &missing, const std::vector<std::string> &order, std::string pheno_name, const char *missing_string)
 {
-    std::vector<std::string> header;
-    mat phenotype_matrix = parse_covariate_matrix( stream, missing, order, &header, missing_string );
-    if( pheno_name == "" )
+    std::vector<std::string> columns;
+    if( pheno_name != "" )
     {
-        assert( phenotype_matrix.n_cols == 1 );
-        return phenotype_matrix.col( 0 );
+        columns.push_back( pheno_name );
     }
-    else
+
+    mat phenotype_matrix = parse_covariate_matrix( stream, missing, order, NULL, missing_string, &columns );
+    if( phenotype_matrix.n_cols != 1 )
     {
-        std::vector<std::string>::iterator it = std::find( header.begin( ), header.end( ), pheno_name );
-        if( it != header.end( ) )
-        {
-            int pos = it - header.begin( );
-            assert( phenotype_matrix.n_cols >= pos - 2 );
-            return phenotype_matrix.col( pos - 2 );
-        }
-        else
-        {
-            throw std::runtime_error( "parse_phenotypes: Could not find that phenotype name." );
-        }
+        throw std::runtime_error( "parse_phenotypes: The file contains more than one phenotype, select one by name." );
     }
 
+    return phenotype_matrix.col( 0 );
 }
 
 arma::mat
@@ -205,11 +368,12 @@ parse_environment(std::istream &stream, arma::uvec &missing, const std::vector<s
     mat X = arma::zeros<arma::mat>( order.size( ), levels );
 
     std::string line;
-    int row_num = 0;
+    int row_num = -1;
     rowvec row( levels );
     int current_level = 0;
     while( std::getline( stream, line ) )
     {
+        row_num++;
         std::istringstream line_stream( line );
         std::string fid;
         std::string iid;
@@ -232,7 +396,7 @@ parse_environment(std::istream &stream, arma::uvec &missing, const std::vector<s
 
         if( levels == 1 )
         {
-            row[ 0 ] = parse_field( env, row_num, 2 );
+            row[ 0 ] = parse_field( env.c_str( ), env.size( ), row_num, 2 );
         }
         else
         {
@@ -252,8 +416,6 @@ parse_environment(std::istream &stream, arma::uvec &missing, const std::vector<s
 
         X.row( iid_index[ iid ] ) = row;
         iid_index.erase( iid );
-        
-        row_num++;
     }
 
     /* Any missing iids marked as missing */
@@ -285,3 +447,246 @@ create_phenotype_vector(const std::vector<pio_sample_t> &samples, uvec &missing)
     return phenotype;
 }
 
+
+/**
+ * Updates a 64-bit FNV-1a hash with a string and a separator.
+ *
+ * @param hash The current hash.
+ * @param str The string.
+ *
+ * @return The updated hash.
+ */
+static uint64_t
+hash_string(uint64_t hash, const std::string &str)
+{
+    for(size_t i = 0; i <= str.size( ); i++)
+    {
+        hash ^= (unsigned char) str.c_str( )[ i ];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/**
+ * Returns the path of the cache of a parsed file, the name contains a
+ * hash of everything that determines the parsed values except the file
+ * contents, which are checked by modification time and size instead.
+ *
+ * @param path The path of the parsed file.
+ * @param order The order of the individuals.
+ * @param columns The selected columns.
+ * @param missing_string The string that indicates a missing value.
+ * @param key The hash will be stored here.
+ *
+ * @return The path of the cache file.
+ */
+static std::string
+cache_path(const std::string &path, const std::vector<std::string> &order, const std::vector<std::string> *columns, const char *missing_string, uint64_t *key)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    hash = hash_string( hash, missing_string );
+    for(size_t i = 0; columns != NULL && i < columns->size( ); i++)
+    {
+        hash = hash_string( hash, ( *columns )[ i ] );
+    }
+    hash = hash_string( hash, "" );
+    for(size_t i = 0; i < order.size( ); i++)
+    {
+        hash = hash_string( hash, order[ i ] );
+    }
+    *key = hash;
+
+    char hex[ 17 ];
+    snprintf( hex, sizeof( hex ), "%016llx", (unsigned long long) hash );
+    return path + "." + hex + ".bcache";
+}
+
+/**
+ * Reads a parsed covariate matrix from a cache file.
+ *
+ * @param cache The path of the cache.
+ * @param key The expected hash of the parse parameters.
+ * @param info The status of the parsed file.
+ * @param X The covariates will be stored here.
+ * @param missing The missing individuals will be stored here.
+ * @param header The header will be stored here.
+ *
+ * @return True if the cache existed and was valid, false otherwise.
+ */
+static bool
+read_cache(const std::string &cache, uint64_t key, const struct stat &info, arma::mat &X, arma::uvec &missing, std::vector<std::string> &header)
+{
+    std::ifstream stream( cache.c_str( ), std::ios::binary );
+    uint32_t magic = 0;
+    uint64_t stored_key = 0;
+    int64_t mtime = 0;
+    uint64_t size = 0;
+    uint64_t num_rows = 0;
+    uint64_t num_cols = 0;
+    stream.read( (char *) &magic, sizeof( uint32_t ) );
+    stream.read( (char *) &stored_key, sizeof( uint64_t ) );
+    stream.read( (char *) &mtime, sizeof( int64_t ) );
+    stream.read( (char *) &size, sizeof( uint64_t ) );
+    stream.read( (char *) &num_rows, sizeof( uint64_t ) );
+    stream.read( (char *) &num_cols, sizeof( uint64_t ) );
+    if( !stream.good( ) || magic != CACHE_MAGIC || stored_key != key ||
+        mtime != (int64_t) info.st_mtime || size != (uint64_t) info.st_size ||
+        num_rows != missing.n_elem )
+    {
+        return false;
+    }
+
+    header.resize( num_cols + 2 );
+    for(size_t i = 0; i < header.size( ); i++)
+    {
+        uint32_t length = 0;
+        stream.read( (char *) &length, sizeof( uint32_t ) );
+        if( !stream.good( ) )
+        {
+            return false;
+        }
+        header[ i ].resize( length );
+        if( length > 0 )
+        {
+            stream.read( &header[ i ][ 0 ], length );
+        }
+    }
+
+    X.set_size( num_rows, num_cols );
+    stream.read( (char *) X.memptr( ), sizeof( double ) * X.n_elem );
+    std::vector<char> missing_flags( num_rows );
+    if( num_rows > 0 )
+    {
+        stream.read( &missing_flags[ 0 ], num_rows );
+    }
+    if( stream.fail( ) )
+    {
+        return false;
+    }
+
+    for(size_t i = 0; i < num_rows; i++)
+    {
+        missing[ i ] = missing_flags[ i ];
+    }
+
+    return true;
+}
+
+/**
+ * Writes a parsed covariate matrix to a cache file. The cache is
+ * written to a temporary file that is renamed, so that concurrent
+ * jobs never see a partial cache. Failures are ignored, the file
+ * will simply be parsed again next time.
+ *
+ * @param cache The path of the cache.
+ * @param key The hash of the parse parameters.
+ * @param info The status of the parsed file.
+ * @param X The covariates.
+ * @param missing The missing individuals.
+ * @param header The header.
+ */
+static void
+write_cache(const std::string &cache, uint64_t key, const struct stat &info, const arma::mat &X, const arma::uvec &missing, const std::vector<std::string> &header)
+{
+    std::ostringstream tmp_path;
+    tmp_path << cache << "." << getpid( ) << ".tmp";
+    std::ofstream stream( tmp_path.str( ).c_str( ), std::ios::binary );
+    if( !stream.is_open( ) )
+    {
+        return;
+    }
+
+    int64_t mtime = info.st_mtime;
+    uint64_t size = info.st_size;
+    uint64_t num_rows = X.n_rows;
+    uint64_t num_cols = X.n_cols;
+    stream.write( (const char *) &CACHE_MAGIC, sizeof( uint32_t ) );
+    stream.write( (const char *) &key, sizeof( uint64_t ) );
+    stream.write( (const char *) &mtime, sizeof( int64_t ) );
+    stream.write( (const char *) &size, sizeof( uint64_t ) );
+    stream.write( (const char *) &num_rows, sizeof( uint64_t ) );
+    stream.write( (const char *) &num_cols, sizeof( uint64_t ) );
+    for(size_t i = 0; i < header.size( ); i++)
+    {
+        uint32_t length = header[ i ].size( );
+        stream.write( (const char *) &length, sizeof( uint32_t ) );
+        stream.write( header[ i ].c_str( ), length );
+    }
+
+    stream.write( (const char *) X.memptr( ), sizeof( double ) * X.n_elem );
+    for(size_t i = 0; i < missing.n_elem; i++)
+    {
+        stream.put( missing[ i ] != 0 ? 1 : 0 );
+    }
+    stream.close( );
+
+    if( stream.fail( ) || rename( tmp_path.str( ).c_str( ), cache.c_str( ) ) != 0 )
+    {
+        unlink( tmp_path.str( ).c_str( ) );
+    }
+}
+
+arma::mat
+read_covariate_file(const std::string &path, arma::uvec &missing, const std::vector<std::string> &order, const std::vector<std::string> *columns, std::vector<std::string> *out_header, bool use_cache, const char *missing_string)
+{
+    struct stat info;
+    use_cache = use_cache && stat( path.c_str( ), &info ) == 0;
+
+    uint64_t key = 0;
+    std::string cache;
+    arma::mat X;
+    arma::uvec file_missing = arma::zeros<arma::uvec>( order.size( ) );
+    std::vector<std::string> header;
+    if( use_cache )
+    {
+        cache = cache_path( path, order, columns, missing_string, &key );
+    }
+
+    if( !use_cache || !read_cache( cache, key, info, X, file_missing, header ) )
+    {
+        shared_ptr<std::istream> stream = open_possible_gz( path );
+        if( stream->fail( ) )
+        {
+            throw std::runtime_error( "read_covariate_file: Could not open '" + path + "'." );
+        }
+
+        X = parse_covariate_matrix( *stream, file_missing, order, &header, missing_string, columns );
+        if( use_cache )
+        {
+            write_cache( cache, key, info, X, file_missing, header );
+        }
+    }
+
+    for(size_t i = 0; i < file_missing.n_elem; i++)
+    {
+        if( file_missing[ i ] != 0 )
+        {
+            missing[ i ] = 1;
+        }
+    }
+    if( out_header != NULL )
+    {
+        *out_header = header;
+    }
+
+    return X;
+}
+
+arma::vec
+read_phenotype_file(const std::string &path, arma::uvec &missing, const std::vector<std::string> &order, const std::string &pheno_name, bool use_cache, const char *missing_string)
+{
+    std::vector<std::string> columns;
+    if( pheno_name != "" )
+    {
+        columns.push_back( pheno_name );
+    }
+
+    arma::mat phenotype_matrix = read_covariate_file( path, missing, order, &columns, NULL, use_cache, missing_string );
+    if( phenotype_matrix.n_cols != 1 )
+    {
+        throw std::runtime_error( "read_phenotype_file: The file contains more than one phenotype, select one by name." );
+    }
+
+    return phenotype_matrix.col( 0 );
+}
@@ -2,6 +2,8 @@
 #define __COVARIATE_H__
 
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include <armadillo>
 
@@ -19,11 +21,14 @@ struct pio_sample_t;
  *              be parsed from the covariate file.
  * @param out_header The header names will be stored here.
  * @param missing_string The string that indicates a missing value.
+ * @param columns The names of the columns to parse, all columns are
+ *                parsed if NULL or empty. Only the selected columns
+ *                determine which individuals are missing.
  *
  * @return A matrix that contains the parsed covariates.
  */
 arma::mat
-parse_covariate_matrix(std::istream &stream, arma::uvec &missing, const std::vector<std::string> &order, std::vector<std::string> *out_header = NULL, const char *missing_string = "NA");
+parse_covariate_matrix(std::istream &stream, arma::uvec &missing, const std::vector<std::string> &order, std::vector<std::string> *out_header = NULL, const char *missing_string = "NA", const std::vector<std::string> *columns = NULL);
 
 /**
  * Parsers phenotypes from a csv stream and returns them as a 
@@ -71,4 +76,49 @@ parse_environment(std::istream &stream, arma::uvec &missing, const std::vector<s
  */
 arma::vec create_phenotype_vector(const std::vector<pio_sample_t> &samples, arma::uvec &missing);
 
+/**
+ * Parses a possibly gzipped covariate file, see parse_covariate_matrix.
+ *
+ * If the cache is used, the parsed values are stored in a binary file
+ * next to the covariate file that is read instead of parsing the file
+ * again. The cache is keyed by the modification time and size of the
+ * file, the order of the individuals and the selected columns.
+ *
+ * @param path The path of the covariate file.
+ * @param missing The individuals with missing values will be set to 1,
+ *                others will remain untouched.
+ * @param order This vector defines the order of the individuals that will
+ *              be parsed from the covariate file.
+ * @param columns The names of the columns to parse, all if NULL or empty.
+ * @param out_header The header names will be stored here.
+ * @param use_cache If true, the binary cache is read and written.
+ * @param missing_string The string that indicates a missing value.
+ *
+ * @throws std::runtime_error.
+ *
+ * @return A matrix that contains the parsed covariates.
+ */
+arma::mat
+read_covariate_file(const std::string &path, arma::uvec &missing, const std::vector<std::string> &order, const std::vector<std::string> *columns = NULL, std::vector<std::string> *out_header = NULL, bool use_cache = false, const char *missing_string = "NA");
+
+/**
+ * Parses a possibly gzipped phenotype file, see read_covariate_file
+ * and parse_phenotypes.
+ *
+ * @param path The path of the phenotype file.
+ * @param missing The individuals with missing values will be set to 1,
+ *                others will remain untouched.
+ * @param order This vector defines the order of the individuals that will
+ *              be parsed from the phenotype file.
+ * @param pheno_name If different than "" only the column with this name is parsed.
+ * @param use_cache If true, the binary cache is read and written.
+ * @param missing_string The string that indicates a missing value.
+ *
+ * @throws std::runtime_error.
+ *
+ * @return A vector containing the parsed phenotypes.
+ */
+arma::vec
+read_phenotype_file(const std::string &path, arma::uvec &missing, const std::vector<std::string> &order, const std::string &pheno_name = "", bool use_cache = false, const char *missing_string = "NA");
+
 #endif /* End of __COVARIATE_H__ */
@@ -94,21 +94,32 @@ bresultfile::open()
 
 bool
 bresultfile::read(std::pair<std::string, std::string> *pair, float *values)
+{
+    uint32_t snps[ 2 ];
+    if( !read( snps, values ) )
+    {
+        return false;
+    }
+    
+    pair->first = m_snp_names[ snps[ 0 ] ];
+    pair->second = m_snp_names[ snps[ 1 ] ];
+
+    return true;
+}
+
+bool
+bresultfile::read(uint32_t *snps, float *values)
 {
     if( m_fp == NULL || m_mode != "r" )
     {
         return false;
     }
 
-    uint32_t snps[ 2 ];
     size_t bytes_read = fread( snps, sizeof( uint32_t ), 2, m_fp );
     if( bytes_read != 2 )
     {
         return false;
     }
-    
-    pair->first = m_snp_names[ snps[ 0 ] ];
-    pair->second = m_snp_names[ snps[ 1 ] ];
 
     bytes_read = fread( values, sizeof( float ), m_header.num_float_cols, m_fp );
     if( bytes_read != m_header.num_float_cols )
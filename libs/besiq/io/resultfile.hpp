@@ -165,6 +165,17 @@ class bresultfile : public resultfile
          */
         bool read(std::pair<std::string, std::string> *pair, float *values);
 
+        /**
+         * Reads the next pair as indices into get_snp_names, which
+         * avoids constructing the names.
+         *
+         * @param snps The indices of the two variants will be stored here.
+         * @param values The values of the pair will be stored here.
+         *
+         * @return True if a pair could be read, false otherwise.
+         */
+        bool read(uint32_t *snps, float *values);
+
         /**
          * @see resultfile::write.
          */
@@ -1,97 +1,307 @@
 #include <besiq/logp_grid.hpp>
 
+#include <algorithm>
 #include <cmath>
 
-bool locus_cmp(const pio_locus_t &a, const pio_locus_t &b)
+#include <stdint.h>
+
+/**
+ * Magic number of a binary grid file.
+ */
+static const uint32_t GRID_MAGIC = 0x44524750;
+
+/**
+ * Number of bytes of a cell in a binary grid file.
+ */
+static const uint64_t CELL_SIZE = 3 * sizeof( double ) + sizeof( uint64_t );
+
+/**
+ * Orders the indices of loci by chromosome and position.
+ */
+struct locus_index_cmp
 {
-    if( a.chromosome == b.chromosome )
+    locus_index_cmp(const std::vector<pio_locus_t> &loci)
+        : m_loci( loci )
     {
-        return a.bp_position < b.bp_position;
     }
-    else
+
+    bool operator()(size_t a, size_t b) const
     {
-        return a.chromosome < b.chromosome;
+        if( m_loci[ a ].chromosome == m_loci[ b ].chromosome )
+        {
+            return m_loci[ a ].bp_position < m_loci[ b ].bp_position;
+        }
+        else
+        {
+            return m_loci[ a ].chromosome < m_loci[ b ].chromosome;
+        }
     }
-}
 
-logp_grid::logp_grid(std::vector<pio_locus_t> loci, size_t max_grid_size, size_t bp_window)
-{
-    std::sort( loci.begin( ), loci.end( ), locus_cmp );
+    const std::vector<pio_locus_t> &m_loci;
+};
 
+/**
+ * Assigns each locus to a grid point of at most bp_window base pairs.
+ *
+ * @param loci The loci.
+ * @param order Indices of the loci sorted by position.
+ * @param bp_window Size in bp of each grid point.
+ * @param point The grid point of each locus will be stored here.
+ *
+ * @return The number of grid points.
+ */
+static size_t
+assign_grid_points(const std::vector<pio_locus_t> &loci, const std::vector<size_t> &order, size_t bp_window, std::vector<unsigned int> &point)
+{
+    point.assign( loci.size( ), 0 );
 
-    unsigned int prev_chrom = 0;
     long long grid_start_pos = -1;
     int grid_point = -1;
-    for(int i = 0; i < loci.size( ); i++)
+    for(size_t k = 0; k < order.size( ); k++)
     {
-        if( loci[ i ].chromosome != prev_chrom )
+        const pio_locus_t &locus = loci[ order[ k ] ];
+        if( k == 0 || locus.chromosome != loci[ order[ k - 1 ] ].chromosome )
         {
-            grid_start_pos = loci[ i ].bp_position;
+            grid_start_pos = locus.bp_position;
             grid_point++;
         }
 
-        if( loci[ i ].bp_position - grid_start_pos > bp_window )
+        if( locus.bp_position - grid_start_pos > bp_window )
         {
-            grid_start_pos = loci[ i ].bp_position;
+            grid_start_pos = locus.bp_position;
             grid_point++;
         }
 
-        m_variant_map[ std::string( loci[ i ].name ) ] = grid_point;
-        prev_chrom = loci[ i ].chromosome;
+        point[ order[ k ] ] = grid_point;
+    }
+
+    return grid_point + 1;
+}
+
+logp_grid::logp_grid()
+    : m_num_points( 0 ),
+      m_bp_window( 0 )
+{
+}
+
+logp_grid::logp_grid(const std::vector<pio_locus_t> &loci, size_t max_grid_size, size_t bp_window)
+{
+    std::vector<size_t> order( loci.size( ) );
+    for(size_t i = 0; i < loci.size( ); i++)
+    {
+        order[ i ] = i;
+        m_variant_index[ std::string( loci[ i ].name ) ] = i;
     }
+    std::sort( order.begin( ), order.end( ), locus_index_cmp( loci ) );
 
-    if( grid_point + 1 > max_grid_size )
+    m_num_points = assign_grid_points( loci, order, bp_window, m_point );
+    while( m_num_points > max_grid_size )
     {
-        std::cerr << "Too many grid points: " << grid_point + 1 << std::endl;
-        exit( 1 );
+        bp_window *= 2;
+        m_num_points = assign_grid_points( loci, order, bp_window, m_point );
     }
+    m_bp_window = bp_window;
 
-    for(int i = 0; i < grid_point + 1; i++)
+    m_cells.resize( m_num_points * ( m_num_points + 1 ) / 2 );
+}
+
+size_t
+logp_grid::cell_index(size_t x, size_t y) const
+{
+    if( x > y )
     {
-        m_grid.push_back( std::vector<grid_data>( grid_point + 1 ) );
+        std::swap( x, y );
     }
+
+    return x * m_num_points - x * ( x - 1 ) / 2 + ( y - x );
+}
+
+bool
+logp_grid::add_pvalue(size_t index1, size_t index2, double p)
+{
+    if( index1 >= m_point.size( ) || index2 >= m_point.size( ) )
+    {
+        return false;
+    }
+
+    grid_data &data = m_cells[ cell_index( m_point[ index1 ], m_point[ index2 ] ) ];
+
+    double mlogp = (p != 1.0) ? -std::log( p ) : 0.0;
+
+    data.max_value = std::max( data.max_value, mlogp );
+    data.sum += mlogp;
+    data.sum_sq += mlogp * mlogp;
+    data.n += 1;
+
+    return true;
 }
 
 bool
 logp_grid::add_pvalue(const std::string &snp1, const std::string &snp2, double p)
 {
-    std::map<std::string, int>::iterator s1 = m_variant_map.find( snp1 );
-    std::map<std::string, int>::iterator s2 = m_variant_map.find( snp2 );
+    size_t index1;
+    size_t index2;
+    if( !get_index( snp1, index1 ) || !get_index( snp2, index2 ) )
+    {
+        return false;
+    }
+
+    return add_pvalue( index1, index2, p );
+}
+
+size_t
+logp_grid::get_bp_window() const
+{
+    return m_bp_window;
+}
 
-    if( s1 == m_variant_map.end( ) || s2 == m_variant_map.end( ) )
+bool
+logp_grid::get_index(const std::string &name, size_t &index) const
+{
+    std::map<std::string, size_t>::const_iterator it = m_variant_index.find( name );
+    if( it == m_variant_index.end( ) )
     {
         return false;
     }
 
-    grid_data &data1 = m_grid[ s1->second ][ s2->second ];
-    grid_data &data2 = m_grid[ s2->second ][ s1->second ];
+    index = it->second;
+    return true;
+}
 
-    double mlogp = (p != 1.0) ? -std::log( p ) : 0.0;
+bool
+logp_grid::merge(const logp_grid &other)
+{
+    if( m_num_points != other.m_num_points || m_point != other.m_point )
+    {
+        return false;
+    }
 
-    data1.max_value = std::max( data1.max_value, mlogp );
-    data1.sum += mlogp;
-    data1.sum_sq += mlogp * mlogp;
-    data1.n += 1;
-    
-    data2.max_value = data1.max_value;
-    data2.sum = data1.sum;
-    data2.sum_sq = data1.sum_sq;
-    data2.n = data1.n;
+    for(size_t i = 0; i < m_cells.size( ); i++)
+    {
+        grid_data &data = m_cells[ i ];
+        const grid_data &other_data = other.m_cells[ i ];
+
+        data.max_value = std::max( data.max_value, other_data.max_value );
+        data.sum += other_data.sum;
+        data.sum_sq += other_data.sum_sq;
+        data.n += other_data.n;
+    }
 
     return true;
 }
 
 void
-logp_grid::write_grid(std::ostream &stream)
+logp_grid::clear()
+{
+    std::fill( m_cells.begin( ), m_cells.end( ), grid_data( ) );
+}
+
+void
+logp_grid::write_grid(std::ostream &stream) const
 {
     stream << "x\ty\tmax\tsum\tsum_sq\tn\n";
-    for(int i = 0; i < m_grid.size( ); i++)
+    for(size_t i = 0; i < m_num_points; i++)
+    {
+        for(size_t j = 0; j < m_num_points; j++)
+        {
+            const grid_data &data = m_cells[ cell_index( i, j ) ];
+            stream << i << "\t" << j << "\t" << data.max_value << "\t" << data.sum << "\t" << data.sum_sq << "\t" << data.n << "\n";
+        }
+    }
+}
+
+bool
+logp_grid::write_binary(std::ostream &stream) const
+{
+    uint64_t num_variants = m_point.size( );
+    uint64_t num_points = m_num_points;
+    stream.write( (const char *) &GRID_MAGIC, sizeof( uint32_t ) );
+    stream.write( (const char *) &num_variants, sizeof( uint64_t ) );
+    stream.write( (const char *) &num_points, sizeof( uint64_t ) );
+    for(size_t i = 0; i < m_point.size( ); i++)
     {
-        std::vector<grid_data> &row = m_grid[ i ];
+        uint32_t point = m_point[ i ];
+        stream.write( (const char *) &point, sizeof( uint32_t ) );
+    }
 
-        for(int j = 0; j < row.size( ); j++)
+    for(size_t i = 0; i < m_cells.size( ); i++)
+    {
+        uint64_t n = m_cells[ i ].n;
+        stream.write( (const char *) &m_cells[ i ].max_value, sizeof( double ) );
+        stream.write( (const char *) &m_cells[ i ].sum, sizeof( double ) );
+        stream.write( (const char *) &m_cells[ i ].sum_sq, sizeof( double ) );
+        stream.write( (const char *) &n, sizeof( uint64_t ) );
+    }
+
+    return stream.good( );
+}
+
+bool
+logp_grid::read_binary(std::istream &stream)
+{
+    uint32_t magic = 0;
+    uint64_t num_variants = 0;
+    uint64_t num_points = 0;
+    stream.read( (char *) &magic, sizeof( uint32_t ) );
+    stream.read( (char *) &num_variants, sizeof( uint64_t ) );
+    stream.read( (char *) &num_points, sizeof( uint64_t ) );
+    if( !stream.good( ) || magic != GRID_MAGIC )
+    {
+        return false;
+    }
+
+    /* Check the sizes against the rest of the stream before allocating anything */
+    std::streampos start = stream.tellg( );
+    stream.seekg( 0, std::ios::end );
+    std::streampos end = stream.tellg( );
+    stream.seekg( start );
+    if( start < 0 || end < start || !stream.good( ) )
+    {
+        return false;
+    }
+    uint64_t remaining = end - start;
+    if( num_variants > remaining / sizeof( uint32_t ) || num_points > remaining / CELL_SIZE )
+    {
+        return false;
+    }
+    uint64_t num_cells = num_points * ( num_points + 1 ) / 2;
+    if( num_cells > ( remaining - num_variants * sizeof( uint32_t ) ) / CELL_SIZE )
+    {
+        return false;
+    }
+
+    std::vector<unsigned int> point( num_variants );
+    for(size_t i = 0; i < num_variants; i++)
+    {
+        uint32_t p = 0;
+        stream.read( (char *) &p, sizeof( uint32_t ) );
+        if( p >= num_points )
         {
-            stream << i << "\t" << j << "\t" << row[ j ].max_value << "\t" << row[ j ].sum << "\t" << row[ j ].sum_sq << "\t" << row[ j ].n << "\n";
+            return false;
         }
+        point[ i ] = p;
+    }
+
+    std::vector<grid_data> cells( num_cells );
+    for(size_t i = 0; i < cells.size( ); i++)
+    {
+        uint64_t n = 0;
+        stream.read( (char *) &cells[ i ].max_value, sizeof( double ) );
+        stream.read( (char *) &cells[ i ].sum, sizeof( double ) );
+        stream.read( (char *) &cells[ i ].sum_sq, sizeof( double ) );
+        stream.read( (char *) &n, sizeof( uint64_t ) );
+        cells[ i ].n = n;
     }
+    if( stream.fail( ) )
+    {
+        return false;
+    }
+
+    m_variant_index.clear( );
+    m_point.swap( point );
+    m_cells.swap( cells );
+    m_num_points = num_points;
+    m_bp_window = 0;
+
+    return true;
 }
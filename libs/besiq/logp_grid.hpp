@@ -2,6 +2,7 @@
 #define __LOGP_GRID_H__
 
 #include <iostream>
+#include <map>
 #include <vector>
 #include <string>
 
@@ -44,21 +45,44 @@ struct grid_data
 
 /**
  * Manages summary statistics of p-values in a grid, to enable
- * high level plots of pair-wise interactions.
+ * high level plots of pair-wise interactions. The variants are
+ * referred to by their index in the list of loci, and since the
+ * grid is symmetric only the upper triangle is stored. Grids with
+ * the same layout can be merged, so that partial grids computed
+ * by different threads or jobs can be combined.
  */
 class logp_grid
 {
 public:
+    /**
+     * Constructor for an empty grid, see read_binary.
+     */
+    logp_grid();
+
     /**
      * Constructor.
      *
      * @param loci A list of loci. It is important that the chromosome
-     *             and position of these loci are correct. A copy is made
-     *             to sort the variants first.
-     * @param max_grid_size Maximum grid size.
+     *             and position of these loci are correct.
+     * @param max_grid_size Maximum grid size, the window is doubled until
+     *                      the number of grid points is below this size,
+     *                      see get_bp_window.
      * @param bp_window Size in bp of each grid point.
      */
-    logp_grid(std::vector<pio_locus_t> loci, size_t max_grid_size = 7000, size_t bp_window = 500000);
+    logp_grid(const std::vector<pio_locus_t> &loci, size_t max_grid_size = 7000, size_t bp_window = 500000);
+
+    /**
+     * Adds a p-value of a variant pair to the grid.
+     *
+     * @param index1 Index of the first variant in the list of loci
+     *               supplied to the constructor.
+     * @param index2 Index of the second variant in the list of loci
+     *               supplied to the constructor.
+     * @param p The p-value
+     *
+     * @return True if successful, False otherwise.
+     */
+    bool add_pvalue(size_t index1, size_t index2, double p);
 
     /**
      * Adds a p-value of a variant pair to the grid.
@@ -73,6 +97,39 @@ public:
      */
     bool add_pvalue(const std::string &snp1, const std::string &snp2, double p);
 
+    /**
+     * Returns the size in bp of each grid point after the window has
+     * been doubled to fit the maximum grid size, or 0 for a grid that
+     * was read with read_binary.
+     *
+     * @return The effective window size in bp.
+     */
+    size_t get_bp_window() const;
+
+    /**
+     * Returns the index of a variant in the list of loci.
+     *
+     * @param name Name of the variant.
+     * @param index The index will be stored here.
+     *
+     * @return True if the variant exists, false otherwise.
+     */
+    bool get_index(const std::string &name, size_t &index) const;
+
+    /**
+     * Adds the statistics of another grid to this grid.
+     *
+     * @param other A grid with the same layout.
+     *
+     * @return False if the grids have different layouts.
+     */
+    bool merge(const logp_grid &other);
+
+    /**
+     * Removes all statistics, but keeps the layout.
+     */
+    void clear();
+
     /**
      * Writes the grid to a file on the csv format
      *
@@ -80,18 +137,63 @@ public:
      *
      * @param stream The stream to write the data to.
      */
-    void write_grid(std::ostream &stream);
+    void write_grid(std::ostream &stream) const;
+
+    /**
+     * Writes the layout and statistics of the grid in a binary format.
+     *
+     * @param stream The stream to write the data to.
+     *
+     * @return True if the grid could be written, false otherwise.
+     */
+    bool write_binary(std::ostream &stream) const;
+
+    /**
+     * Reads a grid that was written with write_binary. The sizes in
+     * the header are checked against the length of the stream, and the
+     * grid is left unchanged if the file is truncated or corrupt.
+     *
+     * @param stream A seekable stream to read the data from.
+     *
+     * @return True if the grid could be read, false otherwise.
+     */
+    bool read_binary(std::istream &stream);
 
 private:
     /**
-     * Maps a variant name to its grid point.
+     * Returns the index of a cell in the upper triangle.
+     *
+     * @param x The first grid point.
+     * @param y The second grid point.
+     *
+     * @return The index of the cell in m_cells.
+     */
+    size_t cell_index(size_t x, size_t y) const;
+
+    /**
+     * Grid point of each variant.
+     */
+    std::vector<unsigned int> m_point;
+
+    /**
+     * Maps a variant name to its index.
+     */
+    std::map<std::string, size_t> m_variant_index;
+
+    /**
+     * Number of grid points along each axis.
+     */
+    size_t m_num_points;
+
+    /**
+     * Size in bp of each grid point.
      */
-    std::map<std::string, int> m_variant_map;
+    size_t m_bp_window;
 
     /**
-     * A grid of summary stats.
+     * Summary stats of the upper triangle of the grid, row by row.
      */
-    std::vector< std::vector<grid_data> > m_grid;
+    std::vector<grid_data> m_cells;
 };
 
 #endif /* End of __LOGP_GRID_H__ */
@@ -55,6 +55,11 @@ bayes_fast_method::init()
         }
     }
 
+    for(int i = 0; i < m_models.size( ); i++)
+    {
+        m_models[ i ]->init_table( m_weight.n_elem );
+    }
+
     std::vector<std::string> header;
     header.push_back( "Posterior" );
     return header;
@@ -22,8 +22,11 @@ public:
      * @param data Additional data required by all methods, such as
      *             covariates.
      * @param num_mc_iterations The number of monte carlo iterations.
+     * @param alpha The beta prior parameters.
+     * @param integrator The integration method of the sindependent model.
+     * @param tolerance The relative error at which the laplace integrator stops.
      */
-    besiq_fine_method(method_data_ptr data, int num_mc_iterations, arma::vec alpha = arma::ones<arma::vec>( 2 ));
+    besiq_fine_method(method_data_ptr data, int num_mc_iterations, arma::vec alpha = arma::ones<arma::vec>( 2 ), integrator_t integrator = INTEGRATOR_MC, double tolerance = 0.01);
 };
 
 #endif /* End of __BAYESIC_FINE_METHOD_H__ */
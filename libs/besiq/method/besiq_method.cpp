@@ -75,6 +75,15 @@ besiq_method::init()
         }
     }
 
+    /* Counts are integers when there are no covariate weights */
+    if( get_data( )->covariate_matrix.n_elem == 0 )
+    {
+        for(int i = 0; i < m_models.size( ); i++)
+        {
+            m_models[ i ]->init_table( m_weight.n_elem );
+        }
+    }
+
     std::vector<std::string> header;
     header.push_back( "Posterior" );
     return header;
@@ -95,3 +104,51 @@ double besiq_method::run(const snp_row &row1, const snp_row &row2, float *output
 
     return posterior.value( );
 }
+
+double besiq_method::run(size_t row1_id, size_t row2_id, float *output)
+{
+    const snp_row &row1 = get_variant_cache( )->get_row( row1_id );
+    const snp_row &row2 = get_variant_cache( )->get_row( row2_id );
+
+    log_double denominator = 0.0;
+    std::vector<log_double> prior_likelihood( m_models.size( ), 0.0 );
+    for(int i = 0; i < m_models.size( ); i++)
+    {
+        ld_assoc *single_model = dynamic_cast<ld_assoc *>( m_models[ i ] );
+        if( single_model != NULL )
+        {
+            arma::mat counts;
+            if( single_model->is_first( ) )
+            {
+                counts = get_variant_cache( )->pair_marginal( row1_id, row2_id, true );
+            }
+            else
+            {
+                counts = get_variant_cache( )->pair_marginal( row2_id, row1_id, true );
+            }
+            prior_likelihood[ i ] = m_models[ i ]->prior( ) * single_model->prob( counts );
+        }
+        else
+        {
+            prior_likelihood[ i ] = m_models[ i ]->prior( ) * m_models[ i ]->prob( row1, row2, get_data( )->phenotype, m_weight );
+        }
+        denominator += prior_likelihood[ i ];
+    }
+    log_double posterior = prior_likelihood[ 0 ] / denominator;
+
+    output[ 0 ] = posterior.value( );
+
+    return posterior.value( );
+}
+
+bool
+besiq_method::use_variant_cache()
+{
+    return true;
+}
+
+variant_cache_ptr
+besiq_method::make_variant_cache(genotype_matrix_ptr genotypes)
+{
+    return create_variant_cache( genotypes, get_data( )->phenotype, m_weight );
+}
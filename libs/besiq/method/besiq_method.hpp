@@ -46,6 +46,25 @@ public:
      */
     virtual double run(const snp_row &row1, const snp_row &row2, float *output);
 
+    /**
+     * Uses cached counts for the single snp models.
+     *
+     * @see method_type::run.
+     */
+    virtual double run(size_t row1_id, size_t row2_id, float *output);
+
+    /**
+     * @see method_type::use_variant_cache.
+     */
+    virtual bool use_variant_cache();
+
+    /**
+     * Caches the counts of each variant with the covariate weights.
+     *
+     * @see method_type::make_variant_cache.
+     */
+    virtual variant_cache_ptr make_variant_cache(genotype_matrix_ptr genotypes);
+
 private:
     /**
      * The different models that is part of the besiq method,
@@ -1,3 +1,5 @@
+#include <cfloat>
+
 #include <dcdflib/libdcdf.hpp>
 #include <glm/models/binomial.hpp>
 #include <glm/models/normal.hpp>
@@ -5,29 +7,61 @@
 #include <glm/models/links/power_odds.hpp>
 
 #include <besiq/method/boxcox_method.hpp>
+#include <besiq/stats/cell_glm.hpp>
+
+boxcox_profile::boxcox_profile()
+    : m_max_logl( -DBL_MAX ),
+      m_prev_logl( -DBL_MAX ),
+      m_num_decreasing( 0 )
+{
+}
+
+bool
+boxcox_profile::add(double logl)
+{
+    bool is_max = logl > m_max_logl;
+    if( is_max )
+    {
+        m_max_logl = logl;
+    }
 
-boxcox_method::boxcox_method(method_data_ptr data, model_matrix &model_matrix, bool is_lm, float lambda_start, float lambda_end, float lambda_step, bool use_power_odds)
+    if( logl < m_prev_logl )
+    {
+        m_num_decreasing++;
+    }
+    else
+    {
+        m_num_decreasing = 0;
+    }
+    m_prev_logl = logl;
+
+    return is_max;
+}
+
+bool
+boxcox_profile::is_done() const
+{
+    return m_num_decreasing >= BOXCOX_EARLY_STOP;
+}
+
+double
+boxcox_profile::get_max() const
+{
+    return m_max_logl;
+}
+
+boxcox_method::boxcox_method(method_data_ptr data, model_matrix &model_matrix, bool is_lm, float lambda_start, float lambda_end, float lambda_step, bool use_power_odds, bool grid_search)
 : method_type::method_type( data ),
-  m_model_matrix( model_matrix )
+  m_model_matrix( model_matrix ),
+  m_is_lm( is_lm ),
+  m_use_power_odds( use_power_odds ),
+  m_grid_search( grid_search ),
+  m_lambda_step( lambda_step )
 {
     for(float lambda = lambda_start; lambda <= lambda_end; lambda += lambda_step)
     {
         m_lambda.push_back( lambda );
-        if( is_lm )
-        {
-            if( !use_power_odds )
-            {
-                m_model.push_back( new normal( new power_link( lambda ) ) );
-            }
-            else
-            {
-                m_model.push_back( new normal( new power_odds_link( lambda ) ) );
-            }
-        }
-        else
-        {
-            m_model.push_back( new binomial( new power_odds_link( lambda ) ) );
-        }
+        m_model.push_back( make_model( lambda ) );
     }
 
     if( is_lm && use_power_odds )
@@ -43,6 +77,8 @@ boxcox_method::boxcox_method(method_data_ptr data, model_matrix &model_matrix, b
     {
         m_fixed_pheno = get_data( )->phenotype;
     }
+
+    m_use_cells = m_model.size( ) > 0 && model_matrix.get_cell_matrices( m_cell_null, m_cell_alt );
 }
 
 boxcox_method::~boxcox_method()
@@ -64,21 +100,72 @@ boxcox_method::init()
     return header;
 }
 
-double boxcox_method::run(const snp_row &row1, const snp_row &row2, float *output)
+glm_model *
+boxcox_method::make_model(float lambda)
+{
+    if( m_is_lm )
+    {
+        if( !m_use_power_odds )
+        {
+            return new normal( new power_link( lambda ) );
+        }
+        else
+        {
+            return new normal( new power_odds_link( lambda ) );
+        }
+    }
+    else
+    {
+        return new binomial( new power_odds_link( lambda ) );
+    }
+}
+
+bool
+boxcox_method::fit(const glm_model &model, bool is_alt, arma::vec &beta, glm_info &info)
+{
+    arma::vec start = beta;
+    if( m_use_cells )
+    {
+        const arma::mat &X = is_alt ? m_cell_alt : m_cell_null;
+        beta = cell_glm_fit( X, m_count, model, info, start );
+    }
+    else
+    {
+        const arma::mat &X = is_alt ? m_model_matrix.get_alt( ) : m_model_matrix.get_null( );
+        beta = glm_fit( X, m_fixed_pheno, m_missing, model, info, start );
+    }
+
+    /* A poor starting point can make the fit fail, so retry from scratch */
+    if( !info.success && start.n_elem > 0 )
+    {
+        beta.reset( );
+        return fit( model, is_alt, beta, info );
+    }
+
+    return info.success;
+}
+
+double
+boxcox_method::null_logl(float lambda, arma::vec &beta)
 {
-    arma::uvec missing = get_data( )->missing;
-    m_model_matrix.update_matrix( row1, row2, missing );
-    set_num_ok_samples( missing.n_elem - sum( missing ) );
+    glm_model *model = make_model( lambda );
+    glm_info info;
+    bool success = fit( *model, false, beta, info );
+    delete model;
+
+    return success ? info.logl : -DBL_MAX;
+}
 
-    double max_logl = -DBL_MAX;
+bool
+boxcox_method::grid_search(float &best_lambda, double &max_logl)
+{
     int best_index = -1;
-    
+    max_logl = -DBL_MAX;
     for(int i = 0; i < m_model.size( ); i++)
     {
         glm_info null_info;
-        glm_fit( m_model_matrix.get_null( ), m_fixed_pheno, missing, *m_model[ i ], null_info );
-
-        if( !null_info.success )
+        arma::vec beta;
+        if( !fit( *m_model[ i ], false, beta, null_info ) )
         {
             continue;
         }
@@ -89,15 +176,133 @@ double boxcox_method::run(const snp_row &row1, const snp_row &row2, float *outpu
             best_index = i;
         }
     }
-    
+
     if( best_index == -1 )
+    {
+        return false;
+    }
+
+    best_lambda = m_lambda[ best_index ];
+    return true;
+}
+
+bool
+boxcox_method::path_search(float &best_lambda, double &max_logl)
+{
+    /*
+     * Coarse pass over the grid, each lambda starts from the estimate
+     * of the previous one. Stop when the profile has decreased for a
+     * few consecutive lambdas after the maximum.
+     */
+    int best_index = -1;
+    boxcox_profile profile;
+    arma::vec beta;
+    arma::vec best_beta;
+    for(int i = 0; i < m_model.size( ); i++)
+    {
+        glm_info null_info;
+        if( !fit( *m_model[ i ], false, beta, null_info ) )
+        {
+            beta.reset( );
+            continue;
+        }
+
+        if( profile.add( null_info.logl ) )
+        {
+            best_index = i;
+            best_beta = beta;
+        }
+        else if( profile.is_done( ) )
+        {
+            break;
+        }
+    }
+
+    if( best_index == -1 )
+    {
+        return false;
+    }
+    max_logl = profile.get_max( );
+
+    /*
+     * Golden-section search around the best lambda on the grid.
+     */
+    const double ratio = 0.6180339887498949;
+    double a = m_lambda[ std::max( best_index - 1, 0 ) ];
+    double b = m_lambda[ std::min( best_index + 1, (int) m_lambda.size( ) - 1 ) ];
+    double c = b - ratio * ( b - a );
+    double d = a + ratio * ( b - a );
+    arma::vec beta_c = best_beta;
+    arma::vec beta_d = best_beta;
+    double logl_c = null_logl( c, beta_c );
+    double logl_d = null_logl( d, beta_d );
+
+    best_lambda = m_lambda[ best_index ];
+    while( b - a > BOXCOX_TOLERANCE * m_lambda_step )
+    {
+        if( logl_c > logl_d )
+        {
+            b = d;
+            d = c;
+            logl_d = logl_c;
+            beta_d = beta_c;
+            c = b - ratio * ( b - a );
+            logl_c = null_logl( c, beta_c );
+        }
+        else
+        {
+            a = c;
+            c = d;
+            logl_c = logl_d;
+            beta_c = beta_d;
+            d = a + ratio * ( b - a );
+            logl_d = null_logl( d, beta_d );
+        }
+    }
+
+    if( logl_c > max_logl )
+    {
+        max_logl = logl_c;
+        best_lambda = c;
+    }
+    if( logl_d > max_logl )
+    {
+        max_logl = logl_d;
+        best_lambda = d;
+    }
+
+    return true;
+}
+
+double boxcox_method::run(const snp_row &row1, const snp_row &row2, float *output)
+{
+    m_missing = get_data( )->missing;
+    if( m_use_cells )
+    {
+        size_t num_ok = 0;
+        m_count = cell_count( row1, row2, m_fixed_pheno, m_missing, m_model[ 0 ]->is_binary( ), num_ok );
+        set_num_ok_samples( num_ok );
+    }
+    else
+    {
+        m_model_matrix.update_matrix( row1, row2, m_missing );
+        set_num_ok_samples( m_missing.n_elem - sum( m_missing ) );
+    }
+
+    float best_lambda;
+    double max_logl;
+    bool found = m_grid_search ? grid_search( best_lambda, max_logl ) : path_search( best_lambda, max_logl );
+    if( !found )
     {
         return -9;
     }
 
     /* Fit alternative model and test against best null */
+    glm_model *model = make_model( best_lambda );
     glm_info alt_info;
-    glm_fit( m_model_matrix.get_alt( ), m_fixed_pheno, missing, *m_model[ best_index ], alt_info );
+    arma::vec beta;
+    fit( *model, true, beta, alt_info );
+    delete model;
 
     if( alt_info.success )
     {
@@ -106,8 +311,8 @@ double boxcox_method::run(const snp_row &row1, const snp_row &row2, float *outpu
             double LR = -2 * ( max_logl - alt_info.logl );
             double p = 1.0 - chi_square_cdf( LR, m_model_matrix.num_df( ) );
 
-            output[ 0 ] = m_lambda[ best_index ];
-            if( std::abs( m_lambda[ best_index ] ) < 1e-5 )
+            output[ 0 ] = best_lambda;
+            if( std::abs( best_lambda ) < 1e-5 )
             {
                 output[ 0 ] = 0.0;
             }
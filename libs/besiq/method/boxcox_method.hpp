@@ -11,8 +11,73 @@
 #include <besiq/stats/log_scale.hpp>
 #include <besiq/model_matrix.hpp>
 
+/**
+ * Number of consecutive lambdas with decreasing likelihood after
+ * the maximum, before the coarse search stops.
+ */
+const int BOXCOX_EARLY_STOP = 2;
+
+/**
+ * The golden-section search stops when the interval is smaller
+ * than this fraction of the lambda step.
+ */
+const double BOXCOX_TOLERANCE = 0.05;
+
+/**
+ * Follows the profile likelihood during the coarse pass over the
+ * lambda grid, and decides when the pass can stop. The pass stops
+ * when the likelihood has decreased for BOXCOX_EARLY_STOP consecutive
+ * lambdas, so a profile that dips and then rises again is followed
+ * to its later maximum.
+ */
+class boxcox_profile
+{
+public:
+    /**
+     * Constructor.
+     */
+    boxcox_profile();
+
+    /**
+     * Adds the likelihood of the next lambda on the grid.
+     *
+     * @param logl The log likelihood.
+     *
+     * @return True if this is the highest likelihood so far.
+     */
+    bool add(double logl);
+
+    /**
+     * Returns true if the likelihood has decreased for enough
+     * consecutive lambdas to stop the pass.
+     */
+    bool is_done() const;
+
+    /**
+     * Returns the highest likelihood so far.
+     */
+    double get_max() const;
+
+private:
+    /**
+     * The highest and the last likelihood.
+     */
+    double m_max_logl;
+    double m_prev_logl;
+
+    /**
+     * Number of consecutive decreases.
+     */
+    int m_num_decreasing;
+};
+
 /**
  * This class for running the scale invariant method.
+ *
+ * The lambda that maximizes the likelihood of the null model is found
+ * either by fitting every lambda on the grid, or by a coarse pass over
+ * the grid where each fit starts from the previous estimate, followed
+ * by a golden-section search around the best lambda.
  */
 class boxcox_method
 : public method_type
@@ -30,8 +95,10 @@ public:
      * @param lambda_end End value of lambda.
      * @param lambda_start Step value of lambda.
      * @param use_power_odds Use the power odds link family for normal data.
+     * @param grid_search If true every lambda on the grid is fitted, and the
+     *                    best one is reported, otherwise the grid is refined.
      */
-    boxcox_method(method_data_ptr data, model_matrix &model_matrix, bool is_lm, float lambda_start, float lambda_end, float lambda_step, bool use_power_odds = false);
+    boxcox_method(method_data_ptr data, model_matrix &model_matrix, bool is_lm, float lambda_start, float lambda_end, float lambda_step, bool use_power_odds = false, bool grid_search = false);
     
     /**
      * Destructor.
@@ -49,6 +116,59 @@ public:
     virtual double run(const snp_row &row1, const snp_row &row2, float *output);
 
 private:
+    /**
+     * Creates the model for the given lambda.
+     *
+     * @param lambda The lambda of the link function.
+     *
+     * @return A new model, the caller is responsible for deleting it.
+     */
+    glm_model *make_model(float lambda);
+
+    /**
+     * Fits the null or alternative model to the current pair.
+     *
+     * @param model The model to fit.
+     * @param is_alt If true the alternative model is fitted, otherwise the null.
+     * @param beta Starting point for the fit, or empty. Will contain the estimate.
+     * @param info Output statistics of the fit.
+     *
+     * @return True if the fit succeeded, false otherwise.
+     */
+    bool fit(const glm_model &model, bool is_alt, arma::vec &beta, glm_info &info);
+
+    /**
+     * Fits the null model for a lambda that is not necessarily on the grid.
+     *
+     * @param lambda The lambda of the link function.
+     * @param beta Starting point for the fit, will contain the estimate.
+     *
+     * @return The log likelihood, or -DBL_MAX if the fit failed.
+     */
+    double null_logl(float lambda, arma::vec &beta);
+
+    /**
+     * Fits every lambda on the grid.
+     *
+     * @param best_lambda The lambda with the highest likelihood.
+     * @param max_logl The highest likelihood.
+     *
+     * @return True if any lambda could be fitted, false otherwise.
+     */
+    bool grid_search(float &best_lambda, double &max_logl);
+
+    /**
+     * Warm started coarse search over the grid followed by
+     * a golden-section search.
+     *
+     * @param best_lambda The lambda with the highest likelihood.
+     * @param max_logl The highest likelihood.
+     *
+     * @return True if any lambda could be fitted, false otherwise.
+     */
+    bool path_search(float &best_lambda, double &max_logl);
+
+
     /**
      * The included models.
      */
@@ -59,6 +179,18 @@ private:
      */
     model_matrix &m_model_matrix;
 
+    /**
+     * If true the models are fitted on the genotype cells, which is
+     * possible when there are no covariates.
+     */
+    bool m_use_cells;
+
+    /**
+     * The null and alternative matrix for the genotype cells.
+     */
+    arma::mat m_cell_null;
+    arma::mat m_cell_alt;
+
     /**
      * List of lambda for each link.
      */
@@ -68,6 +200,28 @@ private:
      * A possibly transformed phenotype.
      */
     arma::vec m_fixed_pheno;
+
+    /**
+     * Type of models, see constructor.
+     */
+    bool m_is_lm;
+    bool m_use_power_odds;
+
+    /**
+     * If true all lambdas on the grid are fitted.
+     */
+    bool m_grid_search;
+
+    /**
+     * Distance between lambdas on the grid.
+     */
+    float m_lambda_step;
+
+    /**
+     * Missing samples and cell counts for the current pair.
+     */
+    arma::uvec m_missing;
+    arma::mat m_count;
 };
 
 #endif /* End of __BOXCOX_METHOD_H__ */
@@ -1,4 +1,5 @@
 #include <besiq/method/glm_method.hpp>
+#include <besiq/stats/cell_glm.hpp>
 
 #include <dcdflib/libdcdf.hpp>
 
@@ -7,6 +8,7 @@ glm_method::glm_method(method_data_ptr data, const glm_model &model, model_matri
   m_model( model ),
   m_model_matrix( model_matrix )
 {
+    m_use_cells = cell_glm_supported( model ) && model_matrix.get_cell_matrices( m_cell_null, m_cell_alt );
 }
 
 std::vector<std::string>
@@ -21,10 +23,61 @@ glm_method::init()
 
 double glm_method::run(const snp_row &row1, const snp_row &row2, float *output)
 { 
+    if( m_use_cells )
+    {
+        size_t num_ok = 0;
+        arma::mat count = cell_count( row1, row2, get_data( )->phenotype, get_data( )->missing, m_model.is_binary( ), num_ok );
+        set_num_ok_samples( num_ok );
+
+        glm_info null_info;
+        cell_glm_fit( m_cell_null, count, m_model, null_info );
+
+        glm_info alt_info;
+        cell_glm_fit( m_cell_alt, count, m_model, alt_info );
+
+        return likelihood_ratio( null_info, alt_info, output );
+    }
+
     arma::uvec missing = get_data( )->missing;
 
     m_model_matrix.update_matrix( row1, row2, missing );
 
+    return fit_models( missing, output );
+}
+
+double
+glm_method::run(size_t row1_id, size_t row2_id, float *output)
+{
+    if( m_use_cells )
+    {
+        return method_type::run( row1_id, row2_id, output );
+    }
+
+    variant_cache_ptr cache = get_variant_cache( );
+    arma::uvec missing = get_data( )->missing;
+
+    m_model_matrix.update_matrix( &cache->get( row1_id ).genotypes[ 0 ], &cache->get( row2_id ).genotypes[ 0 ], missing );
+
+    return fit_models( missing, output );
+}
+
+bool
+glm_method::use_variant_cache()
+{
+    return !m_use_cells;
+}
+
+variant_cache_ptr
+glm_method::make_variant_cache(genotype_matrix_ptr genotypes)
+{
+    arma::vec weight = 1.0 - arma::conv_to<arma::vec>::from( get_data( )->missing != 0 );
+
+    return create_variant_cache( genotypes, get_data( )->phenotype, weight, true );
+}
+
+double
+glm_method::fit_models(const arma::uvec &missing, float *output)
+{
     glm_info null_info;
     arma::vec b1 = glm_fit( m_model_matrix.get_null( ), get_data( )->phenotype, missing, m_model, null_info );
 
@@ -33,6 +86,12 @@ double glm_method::run(const snp_row &row1, const snp_row &row2, float *output)
 
     set_num_ok_samples( missing.n_elem - sum( missing ) );
 
+    return likelihood_ratio( null_info, alt_info, output );
+}
+
+double
+glm_method::likelihood_ratio(const glm_info &null_info, const glm_info &alt_info, float *output)
+{
     if( null_info.success && alt_info.success )
     {
         double LR = -2 * ( null_info.logl - alt_info.logl );
@@ -36,7 +36,52 @@ public:
      */
     virtual double run(const snp_row &row1, const snp_row &row2, float *output);
 
+    /**
+     * Updates the model matrix from the cached genotypes, which
+     * avoids decoding the snps for each pair.
+     *
+     * @see method_type::run.
+     */
+    virtual double run(size_t row1_id, size_t row2_id, float *output);
+
+    /**
+     * The cache is only used when the model matrix is, since the
+     * genotype cells are counted directly from the snps.
+     *
+     * @see method_type::use_variant_cache.
+     */
+    virtual bool use_variant_cache();
+
+    /**
+     * Stores the genotypes of each variant for the model matrix.
+     *
+     * @see method_type::make_variant_cache.
+     */
+    virtual variant_cache_ptr make_variant_cache(genotype_matrix_ptr genotypes);
+
 private:
+    /**
+     * Fits the null and alternative model on the current model matrix.
+     *
+     * @param missing Missing samples of the pair are indicated by non-zero values.
+     * @param output The output, see method_type::run.
+     *
+     * @return The p-value, or -9 if it could not be computed.
+     */
+    double fit_models(const arma::uvec &missing, float *output);
+
+    /**
+     * Writes the likelihood ratio test of the two fits to the output.
+     *
+     * @param null_info The fit of the null model.
+     * @param alt_info The fit of the alternative model.
+     * @param output The output, see method_type::run.
+     *
+     * @return The p-value, or -9 if it could not be computed.
+     */
+    double likelihood_ratio(const glm_info &null_info, const glm_info &alt_info, float *output);
+
+
     /**
      * The glm model used, in this case a binomial model with logit link.
      */
@@ -46,6 +91,18 @@ private:
      * The model matrix that is used.
      */
     model_matrix &m_model_matrix;
+
+    /**
+     * If true the models are fitted on the genotype cells, which is
+     * possible when there are no covariates.
+     */
+    bool m_use_cells;
+
+    /**
+     * The null and alternative matrix for the genotype cells.
+     */
+    arma::mat m_cell_null;
+    arma::mat m_cell_alt;
 };
 
 #endif /* End of __GLM_METHOD_H__ */
@@ -23,6 +23,31 @@ loglinear_method::init()
     return header;
 }
 
+double
+loglinear_method::compute_p_value(const std::vector<log_double> &likelihood, size_t num_samples, float *output)
+{
+    std::vector<double> bic( m_models.size( ), 0.0 );
+    for(int i = 0; i < m_models.size( ); i++)
+    {
+        bic[ i ] = -2.0 * likelihood[ i ].log_value( ) + m_models[ i ]->df( ) * log( num_samples );
+    }
+
+    unsigned int best_model = std::distance( bic.begin( ), std::min_element( bic.begin( ) + 1, bic.end( ) ) );
+    double LR = -2.0*(likelihood[ best_model ].log_value( ) - likelihood[ 0 ].log_value( ));
+
+    try
+    {
+        double p_value = 1.0 - chi_square_cdf( LR, m_models[ 0 ]->df( ) - m_models[ best_model ]->df( ) );
+        output[ 0 ] = p_value;
+        return p_value;
+    }
+    catch(bad_domain_value &e)
+    {
+    }
+
+    return -9;
+}
+
 double
 loglinear_method::run(const snp_row &row1, const snp_row &row2, float *output)
 {
@@ -35,25 +60,60 @@ loglinear_method::run(const snp_row &row1, const snp_row &row2, float *output)
     }
 
     std::vector<log_double> likelihood( m_models.size( ), 0.0 );
-    std::vector<double> bic( m_models.size( ), 0.0 );
     for(int i = 0; i < m_models.size( ); i++)
     {
         likelihood[ i ] = m_models[ i ]->prob( count );
-        bic[ i ] = -2.0 * likelihood[ i ].log_value( ) + m_models[ i ]->df( ) * log( num_samples );
     }
 
-    unsigned int best_model = std::distance( bic.begin( ), std::min_element( bic.begin( ) + 1, bic.end( ) ) );
-    double LR = -2.0*(likelihood[ best_model ].log_value( ) - likelihood[ 0 ].log_value( ));
+    return compute_p_value( likelihood, num_samples, output );
+}
 
-    try
+double
+loglinear_method::run(size_t row1_id, size_t row2_id, float *output)
+{
+    variant_cache_ptr cache = get_variant_cache( );
+    arma::mat count = joint_count( cache->get_row( row1_id ), cache->get_row( row2_id ), get_data( )->phenotype, m_weight );
+    size_t num_samples = arma::accu( count );
+    set_num_ok_samples( num_samples );
+    if( arma::min( arma::min( count ) ) < METHOD_SMALLEST_CELL_SIZE_BINOMIAL )
     {
-        double p_value = 1.0 - chi_square_cdf( LR, m_models[ 0 ]->df( ) - m_models[ best_model ]->df( ) );
-        output[ 0 ] = p_value;
-        return p_value;
+        return -9;
     }
-    catch(bad_domain_value &e)
+
+    std::vector<log_double> likelihood( m_models.size( ), 0.0 );
+    for(int i = 0; i < m_models.size( ); i++)
     {
+        binomial_single *single_model = dynamic_cast<binomial_single *>( m_models[ i ] );
+        if( single_model != NULL )
+        {
+            arma::mat counts;
+            if( single_model->is_first( ) )
+            {
+                counts = cache->pair_marginal( row1_id, row2_id, true );
+            }
+            else
+            {
+                counts = cache->pair_marginal( row2_id, row1_id, true );
+            }
+            likelihood[ i ] = single_model->prob_marginal( counts );
+        }
+        else
+        {
+            likelihood[ i ] = m_models[ i ]->prob( count );
+        }
     }
 
-    return -9;
+    return compute_p_value( likelihood, num_samples, output );
+}
+
+bool
+loglinear_method::use_variant_cache()
+{
+    return true;
+}
+
+variant_cache_ptr
+loglinear_method::make_variant_cache(genotype_matrix_ptr genotypes)
+{
+    return create_variant_cache( genotypes, get_data( )->phenotype, m_weight );
 }
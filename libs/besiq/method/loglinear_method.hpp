@@ -36,7 +36,40 @@ public:
      */
     virtual double run(const snp_row &row1, const snp_row &row2, float *output);
 
+    /**
+     * Computes the likelihood of the single snp models from the
+     * cached marginals.
+     *
+     * @see method_type::run.
+     */
+    virtual double run(size_t row1_id, size_t row2_id, float *output);
+
+    /**
+     * @see method_type::use_variant_cache.
+     */
+    virtual bool use_variant_cache();
+
+    /**
+     * Caches the counts of each variant with the same weights
+     * as the joint counts.
+     *
+     * @see method_type::make_variant_cache.
+     */
+    virtual variant_cache_ptr make_variant_cache(genotype_matrix_ptr genotypes);
+
 private: 
+    /**
+     * Selects the reduced model with the smallest BIC and tests
+     * it against the full model.
+     *
+     * @param likelihood The likelihood of each model.
+     * @param num_samples The number of samples in the joint counts.
+     * @param output The p-value, see method_type::run.
+     *
+     * @return The p-value, or -9 if it could not be computed.
+     */
+    double compute_p_value(const std::vector<log_double> &likelihood, size_t num_samples, float *output);
+
     /**
      * A weight > 0 associated with each sample, that allows for
      * covariate adjustment.
@@ -5,6 +5,22 @@
 #include <besiq/io/pairfile.hpp>
 #include <besiq/io/resultfile.hpp>
 
+variant_cache_ptr
+method_type::make_variant_cache(genotype_matrix_ptr genotypes)
+{
+    const arma::uvec &missing = m_data->missing;
+    arma::vec weight = arma::ones<arma::vec>( missing.n_elem );
+    for(int i = 0; i < missing.n_elem; i++)
+    {
+        if( missing[ i ] != 0 )
+        {
+            weight[ i ] = 0.0;
+        }
+    }
+
+    return create_variant_cache( genotypes, m_data->phenotype, weight );
+}
+
 void run_method(method_type &method, genotype_matrix_ptr genotypes, pairfile &pairs, resultfile &result)
 {
     std::vector<std::string> method_header = method.init( );
@@ -13,27 +29,41 @@ void run_method(method_type &method, genotype_matrix_ptr genotypes, pairfile &pa
 
     float *output = new float[ method_header.size( ) ];
     double threshold = method.get_data( )->threshold;
+
+    if( method.use_variant_cache( ) && !method.get_variant_cache( ) )
+    {
+        method.set_variant_cache( method.make_variant_cache( genotypes ) );
+    }
+    bool use_cache = method.get_variant_cache( );
     
     std::pair<std::string, std::string> pair;
     while( pairs.read( pair ) )
     {
-        snp_row const *row1 = genotypes->get_row( pair.first );
-        snp_row const *row2 = genotypes->get_row( pair.second );
-
-        if( row1 == NULL || row2 == NULL )
+        size_t index1, index2;
+        if( !genotypes->get_index( pair.first, index1 ) || !genotypes->get_index( pair.second, index2 ) )
         {
             continue;
         }
+        const snp_row &row1 = genotypes->get_row( index1 );
+        const snp_row &row2 = genotypes->get_row( index2 );
 
         std::fill( output, output + method_header.size( ), result_get_missing( ) );
 
-        double statistic = method.run( *row1, *row2, output );
+        double statistic;
+        if( use_cache )
+        {
+            statistic = method.run( index1, index2, output );
+        }
+        else
+        {
+            statistic = method.run( row1, row2, output );
+        }
         if( threshold != -9 && (statistic == -9 || statistic > threshold) )
         {
             continue;
         }
 
-        output[ method_header.size( ) - 1 ] = method.num_ok_samples( *row1, *row2 );
+        output[ method_header.size( ) - 1 ] = method.num_ok_samples( row1, row2 );
 
         result.write( pair, output );
     }
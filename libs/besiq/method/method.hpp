@@ -6,7 +6,9 @@
 
 #include <armadillo>
 
+#include <plink/dosage_row.hpp>
 #include <plink/snp_row.hpp>
+#include <besiq/variant_cache.hpp>
 #include <shared_ptr/shared_ptr.hpp>
 
 class pairfile;
@@ -94,9 +96,10 @@ public:
     }
 
     /**
-     * Returns the additional data.
+     * Returns the additional data, as a reference so that run
+     * does not copy the pointer when called from several threads.
      */
-    method_data_ptr get_data()
+    const method_data_ptr &get_data() const
     {
         return m_data;
     }
@@ -120,6 +123,20 @@ public:
         return m_num_ok_samples;
     }
 
+    /**
+     * Return the number of samples that could be used in
+     * the last call to run on genotype probabilities.
+     *
+     * @param row1 The first variant.
+     * @param row2 The second variant.
+     *
+     * @return The number of samples that could be used.
+     */
+    virtual size_t num_ok_samples(const dosage_row &row1, const dosage_row &row2)
+    {
+        return m_num_ok_samples;
+    }
+
     /**
      * Return the column names that will be written by this method.
      */
@@ -137,6 +154,80 @@ public:
      */
     virtual double run(const snp_row &row1, const snp_row &row2, float *output) = 0;
 
+    /**
+     * Runs the method on the genotype probabilities of two imputed
+     * variants. Methods that can use the probabilities directly should
+     * override this, by default the most probable genotypes are passed
+     * to run.
+     *
+     * @param row1 The first variant.
+     * @param row2 The second variant.
+     * @param output The results for this method, see run.
+     *
+     * @return The value of the test statistic, should return -9 if not computed or missing.
+     */
+    virtual double run(const dosage_row &row1, const dosage_row &row2, float *output)
+    {
+        return run( row1.hard_call( 0.0f ), row2.hard_call( 0.0f ), output );
+    }
+
+    /**
+     * Runs the method on the variants with the given indices in the
+     * variant cache. Methods that can make use of the cached per-variant
+     * quantities should override this, by default the genotypes are
+     * looked up and passed to run.
+     *
+     * @param row1_id Index of the first variant in the variant cache.
+     * @param row2_id Index of the second variant in the variant cache.
+     * @param output The results for this method, see run.
+     *
+     * @return The value of the test statistic, should return -9 if not computed or missing.
+     */
+    virtual double run(size_t row1_id, size_t row2_id, float *output)
+    {
+        return run( m_cache->get_row( row1_id ), m_cache->get_row( row2_id ), output );
+    }
+
+    /**
+     * Returns true if the method benefits from a variant cache, in
+     * which case run_method will create one before running.
+     */
+    virtual bool use_variant_cache()
+    {
+        return false;
+    }
+
+    /**
+     * Creates a variant cache for the given genotypes, this is called
+     * by run_method after init. By default the marginals are weighted
+     * by 1 for non-missing samples and 0 for missing samples, and no
+     * design columns are stored.
+     *
+     * @param genotypes The genotype matrix.
+     *
+     * @return A variant cache for the genotypes.
+     */
+    virtual variant_cache_ptr make_variant_cache(genotype_matrix_ptr genotypes);
+
+    /**
+     * Sets the variant cache, its indices must correspond to the
+     * genotype matrix the method is run on.
+     *
+     * @param cache The variant cache.
+     */
+    void set_variant_cache(variant_cache_ptr cache)
+    {
+        m_cache = cache;
+    }
+
+    /**
+     * Returns the variant cache, or an empty pointer if there is none.
+     */
+    variant_cache_ptr get_variant_cache()
+    {
+        return m_cache;
+    }
+
 private:
     /**
      * Additional data required by the method.
@@ -147,6 +238,11 @@ private:
      * The number of samples
      */
     size_t m_num_ok_samples;
+
+    /**
+     * Per-variant quantities shared across pairs.
+     */
+    variant_cache_ptr m_cache;
 };
 
 /**
@@ -3,6 +3,7 @@
 #include <glm/models/normal.hpp>
 
 #include <besiq/method/scaleinv_method.hpp>
+#include <besiq/stats/cell_glm.hpp>
 
 scaleinv_method::scaleinv_method(method_data_ptr data, model_matrix &model_matrix, bool is_lm)
 : method_type::method_type( data ),
@@ -20,6 +21,8 @@ scaleinv_method::scaleinv_method(method_data_ptr data, model_matrix &model_matri
     {
         m_model.push_back( new normal( "identity" ) );
     }
+
+    m_use_cells = model_matrix.get_cell_matrices( m_cell_null, m_cell_alt );
 }
 
 scaleinv_method::~scaleinv_method()
@@ -44,16 +47,58 @@ scaleinv_method::init()
 double scaleinv_method::run(const snp_row &row1, const snp_row &row2, float *output)
 {
     arma::uvec missing = get_data( )->missing;
-    m_model_matrix.update_matrix( row1, row2, missing );
-    set_num_ok_samples( missing.n_elem - sum( missing ) );
-    
+    arma::mat count;
+    if( m_use_cells )
+    {
+        size_t num_ok = 0;
+        count = cell_count( row1, row2, get_data( )->phenotype, missing, m_model[ 0 ]->is_binary( ), num_ok );
+        set_num_ok_samples( num_ok );
+    }
+    else
+    {
+        m_model_matrix.update_matrix( row1, row2, missing );
+        set_num_ok_samples( missing.n_elem - sum( missing ) );
+    }
+
+    return fit_models( count, missing, output );
+}
+
+double scaleinv_method::run(const dosage_row &row1, const dosage_row &row2, float *output)
+{
+    arma::uvec missing = get_data( )->missing;
+    arma::mat count;
+    if( m_use_cells )
+    {
+        size_t num_ok = 0;
+        count = cell_count( row1, row2, get_data( )->phenotype, missing, m_model[ 0 ]->is_binary( ), num_ok );
+        set_num_ok_samples( num_ok );
+    }
+    else
+    {
+        m_model_matrix.update_matrix( row1, row2, missing );
+        set_num_ok_samples( missing.n_elem - sum( missing ) );
+    }
+
+    return fit_models( count, missing, output );
+}
+
+double
+scaleinv_method::fit_models(const arma::mat &count, const arma::uvec &missing, float *output)
+{
     for(int i = 0; i < m_model.size( ); i++)
     {
         glm_info alt_info;
-        glm_fit( m_model_matrix.get_alt( ), get_data( )->phenotype, missing, *m_model[ i ], alt_info );
-
         glm_info null_info;
-        glm_fit( m_model_matrix.get_null( ), get_data( )->phenotype, missing, *m_model[ i ], null_info );
+        if( m_use_cells )
+        {
+            cell_glm_fit( m_cell_alt, count, *m_model[ i ], alt_info );
+            cell_glm_fit( m_cell_null, count, *m_model[ i ], null_info );
+        }
+        else
+        {
+            glm_fit( m_model_matrix.get_alt( ), get_data( )->phenotype, missing, *m_model[ i ], alt_info );
+            glm_fit( m_model_matrix.get_null( ), get_data( )->phenotype, missing, *m_model[ i ], null_info );
+        }
 
         if( !null_info.success || !alt_info.success )
         {
@@ -41,7 +41,33 @@ public:
      */
     virtual double run(const snp_row &row1, const snp_row &row2, float *output);
 
+    /**
+     * Without covariates the models are fitted on the expected cell
+     * counts, where each sample is spread over the 9 cells by its
+     * joint genotype probabilities, see cell_count. With covariates
+     * the design matrix holds the expected value of each column
+     * instead, see model_matrix::update_matrix. The two estimators
+     * give the same fit when every genotype is certain, but differ
+     * for uncertain genotypes.
+     *
+     * @see method_type::run.
+     */
+    virtual double run(const dosage_row &row1, const dosage_row &row2, float *output);
+
 private:
+    /**
+     * Fits the models on the cell counts or the current model
+     * matrix and writes the p-value of the first model that could
+     * be fitted.
+     *
+     * @param count The cell counts, only used if m_use_cells is true.
+     * @param missing Missing samples are indicated by non-zero values.
+     * @param output The results for this method.
+     *
+     * @return The p-value, or -9 if no model could be fitted.
+     */
+    double fit_models(const arma::mat &count, const arma::uvec &missing, float *output);
+
     /**
      * The included models.
      */
@@ -51,6 +77,18 @@ private:
      * The model matrix.
      */
     model_matrix &m_model_matrix;
+
+    /**
+     * If true the models are fitted on the genotype cells, which is
+     * possible when there are no covariates.
+     */
+    bool m_use_cells;
+
+    /**
+     * The null and alternative matrix for the genotype cells.
+     */
+    arma::mat m_cell_null;
+    arma::mat m_cell_alt;
 };
 
 #endif /* End of __SCALEINV_METHOD_H__ */
@@ -0,0 +1,55 @@
+#include <algorithm>
+
+#include <plink/plink_file.hpp>
+
+#include <besiq/method/single_method.hpp>
+#include <besiq/io/resultfile.hpp>
+
+/**
+ * Number of variants that are run before their results are written.
+ */
+const size_t SINGLE_BLOCK_SIZE = 4096;
+
+void
+run_single_method(single_method_type &method, genotype_matrix_ptr genotypes, resultfile &result,
+                  size_t split, size_t num_splits, int num_threads)
+{
+    std::vector<std::string> method_header = method.init( );
+    method_header.push_back( "N" );
+    result.set_header( method_header );
+
+    size_t num_cols = method_header.size( );
+    double threshold = method.get_data( )->threshold;
+    const std::vector<std::string> &names = genotypes->get_snp_names( );
+
+    size_t first_variant = ( split - 1 ) * genotypes->size( ) / num_splits;
+    size_t last_variant = split * genotypes->size( ) / num_splits;
+
+    std::vector<float> values( SINGLE_BLOCK_SIZE * num_cols );
+    std::vector<char> keep( SINGLE_BLOCK_SIZE );
+    for(size_t first = first_variant; first < last_variant; first += SINGLE_BLOCK_SIZE)
+    {
+        size_t last = std::min( first + SINGLE_BLOCK_SIZE, last_variant );
+
+        #pragma omp parallel for num_threads( num_threads ) schedule( dynamic, 16 )
+        for(int i = first; i < (int) last; i++)
+        {
+            const snp_row &row = genotypes->get_row( i );
+            float *output = &values[ ( i - first ) * num_cols ];
+            std::fill( output, output + num_cols, result_get_missing( ) );
+
+            double statistic = method.run( row, output );
+            keep[ i - first ] = threshold == -9 || ( statistic != -9 && statistic <= threshold );
+            output[ num_cols - 1 ] = method.num_ok_samples( row );
+        }
+
+        for(size_t i = first; i < last; i++)
+        {
+            if( keep[ i - first ] )
+            {
+                std::pair<std::string, std::string> pair( names[ i ], names[ i ] );
+                result.write( pair, &values[ ( i - first ) * num_cols ] );
+            }
+        }
+    }
+}
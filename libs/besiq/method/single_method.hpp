@@ -0,0 +1,109 @@
+#ifndef __SINGLE_METHOD_H__
+#define __SINGLE_METHOD_H__
+
+#include <vector>
+#include <string>
+
+#include <armadillo>
+
+#include <plink/snp_row.hpp>
+#include <shared_ptr/shared_ptr.hpp>
+#include <besiq/method/method.hpp>
+
+class resultfile;
+class genotype_matrix;
+typedef shared_ptr<genotype_matrix> genotype_matrix_ptr;
+
+/**
+ * A method that tests a single variant at a time, for example
+ * against an environmental factor. The results are written as
+ * the pair of the variant with itself.
+ */
+class single_method_type
+{
+public:
+    /**
+     * Constructor.
+     */
+    single_method_type(method_data_ptr data)
+        : m_data( data )
+    {
+    }
+
+    virtual ~single_method_type()
+    {
+    }
+
+    /**
+     * Returns the additional data, as a reference so that run
+     * does not copy the pointer when called from several threads.
+     */
+    const method_data_ptr &get_data() const
+    {
+        return m_data;
+    }
+    
+    /**
+     * Returns the number of samples that can be used for
+     * the given variant.
+     *
+     * @param row The variant.
+     *
+     * @return The number of samples that could be used.
+     */
+    virtual size_t num_ok_samples(const snp_row &row)
+    {
+        unsigned int n = 0;
+        for(int i = 0; i < row.size( ); i++)
+        {
+            if( row[ i ] != 3 && m_data->missing[ i ] == 0 )
+            {
+                n++;
+            }
+        }
+
+        return n;
+    }
+
+    /**
+     * Return the column names that will be written by this method.
+     */
+    virtual std::vector<std::string> init() = 0;
+
+    /**
+     * Runs the method on a single variant, this may be called from
+     * several threads at the same time.
+     *
+     * @param row The variant.
+     * @param output The results for this method, the size will be the same
+     *               as the length of the header, -9 is interpreted as missing.
+     *               You can assume that all values are initialized to -9.
+     *
+     * @return The p-value used for thresholding, should return -9 if not
+     *         computed or missing.
+     */
+    virtual double run(const snp_row &row, float *output) = 0;
+
+private:
+    /**
+     * Additional data required by the method.
+     */
+    method_data_ptr m_data;
+};
+
+/**
+ * Runs the given method on each variant in a part of the genotype
+ * file. The variants are processed in blocks by several threads and
+ * the results are written in the order of the genotype file.
+ *
+ * @param method A method to run.
+ * @param genotypes Genotypes for all SNPs.
+ * @param result The result file.
+ * @param split Run on part split of 1-num_splits parts of the variants.
+ * @param num_splits The number of parts to split the variants in.
+ * @param num_threads The number of threads.
+ */
+void run_single_method(single_method_type &method, genotype_matrix_ptr genotypes, resultfile &result,
+                       size_t split = 1, size_t num_splits = 1, int num_threads = 1);
+
+#endif /* End of __SINGLE_METHOD_H__ */
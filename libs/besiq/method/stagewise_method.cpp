@@ -38,12 +38,9 @@ stagewise_method::init()
     return header;
 }
 
-double
-stagewise_method::run(const snp_row &row1, const snp_row &row2, float *output)
+bool
+stagewise_method::compute_count(const snp_row &row1, const snp_row &row2, arma::mat &count)
 {
-    std::vector<log_double> likelihood( m_models.size( ), 0.0 );
-
-    arma::mat count;
     float min_samples = 0.0;
     unsigned int sample_threshold = METHOD_SMALLEST_CELL_SIZE_BINOMIAL;
     if( m_model == "binomial" )
@@ -59,29 +56,91 @@ stagewise_method::run(const snp_row &row1, const snp_row &row2, float *output)
         min_samples = arma::min( count.col( 1 ) );
         sample_threshold = METHOD_SMALLEST_CELL_SIZE_NORMAL;
     }
-    
-    if( min_samples < sample_threshold )
+
+    return min_samples >= sample_threshold;
+}
+
+double
+stagewise_method::compute_p_values(const std::vector<log_double> &likelihood, float *output)
+{
+    for(int i = 1; i < m_models.size( ); i++)
+    {
+        double LR = -2.0*(likelihood[ i ].log_value( ) - likelihood[ 0 ].log_value( ));
+
+        try
+        {
+            output[ i - 1 ] = 1.0 - chi_square_cdf( LR, m_models[ 0 ]->df( ) - m_models[ i ]->df( ) );
+        }
+        catch(bad_domain_value &e)
+        {
+        }
+    }
+
+    return output[ 0 ];
+}
+
+double
+stagewise_method::run(const snp_row &row1, const snp_row &row2, float *output)
+{
+    arma::mat count;
+    if( !compute_count( row1, row2, count ) )
     {
         return -9;
     }
-    
+
+    std::vector<log_double> likelihood( m_models.size( ), 0.0 );
     for(int i = 0; i < m_models.size( ); i++)
     {
         likelihood[ i ] = m_models[ i ]->prob( count );
     }
 
-    for(int i = 1; i < m_models.size( ); i++)
+    return compute_p_values( likelihood, output );
+}
+
+double
+stagewise_method::run(size_t row1_id, size_t row2_id, float *output)
+{
+    variant_cache_ptr cache = get_variant_cache( );
+    arma::mat count;
+    if( !compute_count( cache->get_row( row1_id ), cache->get_row( row2_id ), count ) )
     {
-        double LR = -2.0*(likelihood[ i ].log_value( ) - likelihood[ 0 ].log_value( ));
+        return -9;
+    }
 
-        try
+    std::vector<log_double> likelihood( m_models.size( ), 0.0 );
+    for(int i = 0; i < m_models.size( ); i++)
+    {
+        normal_single *normal_model = dynamic_cast<normal_single *>( m_models[ i ] );
+        binomial_single *binomial_model = dynamic_cast<binomial_single *>( m_models[ i ] );
+        if( normal_model != NULL )
         {
-            output[ i - 1 ] = 1.0 - chi_square_cdf( LR, m_models[ 0 ]->df( ) - m_models[ i ]->df( ) );
+            bool is_first = normal_model->is_first( );
+            arma::mat marginal = cache->pair_marginal( is_first ? row1_id : row2_id, is_first ? row2_id : row1_id, false );
+            likelihood[ i ] = normal_model->prob_marginal( marginal );
         }
-        catch(bad_domain_value &e)
+        else if( binomial_model != NULL )
+        {
+            bool is_first = binomial_model->is_first( );
+            arma::mat marginal = cache->pair_marginal( is_first ? row1_id : row2_id, is_first ? row2_id : row1_id, true );
+            likelihood[ i ] = binomial_model->prob_marginal( marginal );
+        }
+        else
         {
+            likelihood[ i ] = m_models[ i ]->prob( count );
         }
     }
 
-    return output[ 0 ];
+    return compute_p_values( likelihood, output );
+}
+
+bool
+stagewise_method::use_variant_cache()
+{
+    return true;
+}
+
+variant_cache_ptr
+stagewise_method::make_variant_cache(genotype_matrix_ptr genotypes)
+{
+    return create_variant_cache( genotypes, get_data( )->phenotype, m_weight );
 }
@@ -60,7 +60,49 @@ public:
      */
     virtual double run(const snp_row &row1, const snp_row &row2, float *output);
 
+    /**
+     * Computes the likelihood of the single snp models from the
+     * cached marginals.
+     *
+     * @see method_type::run.
+     */
+    virtual double run(size_t row1_id, size_t row2_id, float *output);
+
+    /**
+     * @see method_type::use_variant_cache.
+     */
+    virtual bool use_variant_cache();
+
+    /**
+     * Caches the marginals of each variant with the same weights
+     * as the joint counts.
+     *
+     * @see method_type::make_variant_cache.
+     */
+    virtual variant_cache_ptr make_variant_cache(genotype_matrix_ptr genotypes);
+
 private:
+    /**
+     * Computes the joint counts of the two snps.
+     *
+     * @param row1 The first snp.
+     * @param row2 The second snp.
+     * @param count The joint counts, see joint_count and joint_count_cont.
+     *
+     * @return True if all cells are large enough for the test, false otherwise.
+     */
+    bool compute_count(const snp_row &row1, const snp_row &row2, arma::mat &count);
+
+    /**
+     * Computes the p-values of the reduced models against the full model.
+     *
+     * @param likelihood The likelihood of each model.
+     * @param output The p-values, see method_type::run.
+     *
+     * @return The p-value of the null model.
+     */
+    double compute_p_values(const std::vector<log_double> &likelihood, float *output);
+
     /**
      * Type of model.
      */
@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <cmath>
+
+#include <dcdflib/libdcdf.hpp>
+
+#include <besiq/method/var_method.hpp>
+
+/**
+ * Orders sample indices by their phenotype.
+ */
+struct phenotype_cmp
+{
+    phenotype_cmp(const arma::vec &pheno)
+        : m_pheno( pheno )
+    {
+    }
+
+    bool operator()(unsigned int a, unsigned int b) const
+    {
+        return m_pheno[ a ] < m_pheno[ b ];
+    }
+
+    const arma::vec &m_pheno;
+};
+
+var_method::var_method(method_data_ptr data)
+: single_method_type::single_method_type( data )
+{
+    const arma::vec &pheno = data->phenotype;
+    for(unsigned int i = 0; i < pheno.n_elem; i++)
+    {
+        if( data->missing[ i ] == 0 )
+        {
+            m_samples.push_back( i );
+        }
+    }
+
+    m_order = m_samples;
+    std::sort( m_order.begin( ), m_order.end( ), phenotype_cmp( pheno ) );
+}
+
+bool
+var_method::compute_medians(const snp_row &row, double *medians, double *counts) const
+{
+    for(int i = 0; i < 3; i++)
+    {
+        medians[ i ] = 0.0;
+        counts[ i ] = 0.0;
+    }
+
+    for(size_t i = 0; i < m_samples.size( ); i++)
+    {
+        unsigned char g = row[ m_samples[ i ] ];
+        if( g != 3 )
+        {
+            counts[ g ] += 1.0;
+        }
+    }
+
+    if( counts[ 0 ] <= 20 || counts[ 1 ] <= 20 || counts[ 2 ] <= 20 )
+    {
+        return false;
+    }
+
+    /* The median of a genotype is its sample of rank n / 2 in the sorted phenotypes */
+    size_t target[ 3 ];
+    size_t seen[ 3 ] = { 0, 0, 0 };
+    for(int i = 0; i < 3; i++)
+    {
+        target[ i ] = (size_t) counts[ i ] / 2;
+    }
+
+    const arma::vec &pheno = get_data( )->phenotype;
+    int num_found = 0;
+    for(size_t i = 0; i < m_order.size( ) && num_found < 3; i++)
+    {
+        unsigned char g = row[ m_order[ i ] ];
+        if( g == 3 )
+        {
+            continue;
+        }
+
+        if( seen[ g ]++ == target[ g ] )
+        {
+            medians[ g ] = pheno[ m_order[ i ] ];
+            num_found++;
+        }
+    }
+
+    return true;
+}
+
+bool
+var_method::compute_brown_forsythe(const snp_row &row, double *W, double *p) const
+{
+    double k = 3;
+    double medians[ 3 ];
+    double counts[ 3 ];
+    if( !compute_medians( row, medians, counts ) )
+    {
+        return false;
+    }
+
+    /* Mean absolute deviation of each genotype */
+    const arma::vec &pheno = get_data( )->phenotype;
+    double z_i[ 3 ] = { 0.0, 0.0, 0.0 };
+    for(size_t i = 0; i < m_samples.size( ); i++)
+    {
+        unsigned char g = row[ m_samples[ i ] ];
+        if( g != 3 )
+        {
+            z_i[ g ] += std::abs( pheno[ m_samples[ i ] ] - medians[ g ] );
+        }
+    }
+
+    double N = counts[ 0 ] + counts[ 1 ] + counts[ 2 ];
+    double z = ( z_i[ 0 ] + z_i[ 1 ] + z_i[ 2 ] ) / N;
+    double numerator = 0.0;
+    for(int i = 0; i < 3; i++)
+    {
+        z_i[ i ] /= counts[ i ];
+        numerator += counts[ i ] * ( z_i[ i ] - z ) * ( z_i[ i ] - z );
+    }
+
+    /* Sum around the group means in a second pass, since sum_sq - n * mean^2 cancels badly */
+    double W_sq = 0.0;
+    for(size_t i = 0; i < m_samples.size( ); i++)
+    {
+        unsigned char g = row[ m_samples[ i ] ];
+        if( g != 3 )
+        {
+            double d = std::abs( pheno[ m_samples[ i ] ] - medians[ g ] ) - z_i[ g ];
+            W_sq += d * d;
+        }
+    }
+
+    *W = ( ( N - k ) * numerator ) / ( ( k - 1 ) * W_sq );
+    *p = 1 - f_cdf( *W, k - 1, N - k );
+
+    return true;
+}
+
+std::vector<std::string>
+var_method::init()
+{
+    std::vector<std::string> header;
+    header.push_back( "W" );
+    header.push_back( "P" );
+
+    return header;
+}
+
+double
+var_method::run(const snp_row &row, float *output)
+{
+    double W;
+    double p;
+    if( !compute_brown_forsythe( row, &W, &p ) )
+    {
+        return -9;
+    }
+
+    output[ 0 ] = W;
+    output[ 1 ] = p;
+
+    return p;
+}
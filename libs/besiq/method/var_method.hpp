@@ -0,0 +1,78 @@
+#ifndef __VAR_METHOD_H__
+#define __VAR_METHOD_H__
+
+#include <string>
+#include <vector>
+
+#include <armadillo>
+
+#include <besiq/method/single_method.hpp>
+
+/**
+ * Tests for variance heterogeneity of the phenotype between the
+ * genotypes of a single variant with the Brown-Forsythe test. The
+ * samples are sorted by phenotype once, so the median of each genotype
+ * is found with a single walk over the sorted samples instead of
+ * sorting the phenotypes of each variant.
+ */
+class var_method
+: public single_method_type
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param data Additional data required by all methods.
+     */
+    var_method(method_data_ptr data);
+
+    /**
+     * @see single_method_type::init.
+     */
+    virtual std::vector<std::string> init();
+
+    /**
+     * Computes the Brown-Forsythe statistic W and its p-value.
+     *
+     * @see single_method_type::run.
+     */
+    virtual double run(const snp_row &row, float *output);
+
+private:
+    /**
+     * Computes the median phenotype and the number of samples of
+     * each genotype.
+     *
+     * @param row The variant.
+     * @param medians The median of each genotype will be stored here.
+     * @param counts The number of samples of each genotype will be stored here.
+     *
+     * @return True if each genotype has enough samples, false otherwise,
+     *         in which case the medians are not computed.
+     */
+    bool compute_medians(const snp_row &row, double *medians, double *counts) const;
+
+    /**
+     * Computes the Brown-Forsythe test for equal variances between the
+     * genotypes.
+     *
+     * @param row The variant.
+     * @param W The test statistic will be stored here.
+     * @param p The p-value will be stored here.
+     *
+     * @return True if each genotype had enough samples, false otherwise.
+     */
+    bool compute_brown_forsythe(const snp_row &row, double *W, double *p) const;
+
+    /**
+     * The non-missing samples.
+     */
+    std::vector<unsigned int> m_samples;
+
+    /**
+     * The non-missing samples sorted by phenotype.
+     */
+    std::vector<unsigned int> m_order;
+};
+
+#endif /* End of __VAR_METHOD_H__ */
@@ -27,6 +27,9 @@ general_matrix::general_matrix(const arma::mat &cov, size_t n, size_t num_null,
 
     m_num_null = num_null;
     m_num_alt = num_alt;
+    m_has_row1 = false;
+    m_snp1 = NULL;
+    m_has_cov = cov.n_cols > 0;
 }
 
 general_matrix::~general_matrix()
@@ -63,245 +66,433 @@ general_matrix::num_null()
     return m_num_null;
 }
 
-additive_matrix::additive_matrix(const arma::mat &cov, size_t n)
-    : general_matrix( cov, n, 3, 4 )
+void
+general_matrix::set_encoding(const arma::mat &snp1_code, const arma::uvec &snp1_cols,
+                             const arma::mat &snp2_code, const arma::uvec &snp2_cols,
+                             const arma::mat &inter_code, const arma::uvec &inter_cols)
+{
+    m_snp1_code = snp1_code;
+    m_snp1_cols = snp1_cols;
+    m_snp2_code = snp2_code;
+    m_snp2_cols = snp2_cols;
+    m_inter_code = inter_code;
+    m_inter_cols = inter_cols;
+    m_has_row1 = false;
+    m_snp1 = NULL;
+
+    m_cell_null = arma::zeros<arma::mat>( 9, m_num_null );
+    m_cell_alt = arma::zeros<arma::mat>( 9, m_num_alt );
+    for(int g1 = 0; g1 < 3; g1++)
+    {
+        for(int g2 = 0; g2 < 3; g2++)
+        {
+            int cell = 3 * g1 + g2;
+            for(int k = 0; k < snp1_cols.n_elem; k++)
+            {
+                m_cell_null( cell, snp1_cols[ k ] ) = m_cell_alt( cell, snp1_cols[ k ] ) = snp1_code( g1, k );
+            }
+            for(int k = 0; k < snp2_cols.n_elem; k++)
+            {
+                m_cell_null( cell, snp2_cols[ k ] ) = m_cell_alt( cell, snp2_cols[ k ] ) = snp2_code( g2, k );
+            }
+            for(int k = 0; k < inter_cols.n_elem; k++)
+            {
+                m_cell_alt( cell, inter_cols[ k ] ) = inter_code( cell, k );
+            }
+        }
+    }
+    m_cell_null.col( m_num_null - 1 ).ones( );
+    m_cell_alt.col( m_num_alt - 1 ).ones( );
+}
+
+bool
+general_matrix::get_cell_matrices(arma::mat &null, arma::mat &alt)
 {
+    if( m_has_cov )
+    {
+        return false;
+    }
+
+    null = m_cell_null;
+    alt = m_cell_alt;
+
+    return true;
+}
+
+/**
+ * Unpacks the genotypes of a snp into a plain array.
+ *
+ * @param row The snp.
+ * @param genotypes The unpacked genotypes.
+ */
+static void
+decode_row(const snp_row &row, std::vector<unsigned char> &genotypes)
+{
+    genotypes.resize( row.size( ) );
+    for(int i = 0; i < row.size( ); i++)
+    {
+        genotypes[ i ] = row[ i ];
+    }
 }
 
 void
-additive_matrix::update_matrix(const snp_row &row1, const snp_row &row2, arma::uvec &missing)
+general_matrix::write_snp1(size_t i, bool clear)
 {
-    for(int i = 0; i < row1.size( ); i++)
+    unsigned char g1 = m_snp1[ i ];
+    for(int k = 0; k < m_snp1_cols.n_elem; k++)
     {
-        if( row1[ i ] != 3 && row2[ i ] != 3 && missing[ i ] == 0 )
-        {
-            m_alt( i, 0 ) = row1[ i ];
-            m_alt( i, 1 ) = row2[ i ];
-            m_alt( i, 2 ) = row1[ i ] * row2[ i ];
-            
-            m_null( i, 0 ) = row1[ i ];
-            m_null( i, 1 ) = row2[ i ];
-        }
-        else
-        {
-            m_alt( i, 0 ) = 0.0;
-            m_alt( i, 1 ) = 0.0;
-            m_alt( i, 2 ) = 0.0;
-            
-            m_null( i, 0 ) = 0.0;
-            m_null( i, 1 ) = 0.0;
-            
-            missing[ i ] = 1;
-        }
+        double value = ( clear || g1 == 3 ) ? 0.0 : m_snp1_code( g1, k );
+        m_alt( i, m_snp1_cols[ k ] ) = value;
+        m_null( i, m_snp1_cols[ k ] ) = value;
     }
 }
 
-tukey_matrix::tukey_matrix(const arma::mat &cov, size_t n)
-    : general_matrix( cov, n, 5, 6 )
+void
+general_matrix::update_matrix(const snp_row &row1, const snp_row &row2, arma::uvec &missing)
+{
+    bool new_row1 = !m_has_row1 || m_snp1 != &m_geno1[ 0 ] || !( row1 == m_row1 );
+    if( new_row1 )
+    {
+        m_row1 = row1;
+        m_has_row1 = true;
+        decode_row( row1, m_geno1 );
+    }
+    decode_row( row2, m_geno2 );
+
+    update_columns( &m_geno1[ 0 ], new_row1, &m_geno2[ 0 ], missing );
+}
+
+void
+general_matrix::update_matrix(const unsigned char *geno1, const unsigned char *geno2, arma::uvec &missing)
 {
+    update_columns( geno1, geno1 != m_snp1, geno2, missing );
 }
 
 void
-tukey_matrix::update_matrix(const snp_row &row1, const snp_row &row2, arma::uvec &missing)
+general_matrix::update_columns(const unsigned char *geno1, bool new_row1, const unsigned char *geno2, arma::uvec &missing)
 {
-    for(int i = 0; i < row1.size( ); i++)
+    size_t n = missing.n_elem;
+    m_snp1 = geno1;
+
+    /*
+     * First snp, only rewritten when it changes, otherwise
+     * the samples cleared by the previous pair are restored.
+     */
+    if( new_row1 )
     {
-        if( row1[ i ] != 3 && row2[ i ] != 3 && missing[ i ] == 0 )
+        m_cleared.clear( );
+
+        for(int k = 0; k < m_snp1_cols.n_elem; k++)
         {
-            double s11 = row1[ i ] == 1 ? 1.0 : 0.0;
-            double s12 = row1[ i ] == 2 ? 1.0 : 0.0;
-            double s21 = row2[ i ] == 1 ? 1.0 : 0.0;
-            double s22 = row2[ i ] == 2 ? 1.0 : 0.0;
-
-            m_alt( i, 0 ) = s11;
-            m_alt( i, 1 ) = s12;
-            m_alt( i, 2 ) = s21;
-            m_alt( i, 3 ) = s22;
-            // Note: at most one of these terms are 1, so this is either 0 or 1.
-            m_alt( i, 4 ) = s11*s21 + s11*s22 + s12*s21 + s12*s22;
-            
-            m_null( i, 0 ) = s11;
-            m_null( i, 1 ) = s12;
-            m_null( i, 2 ) = s21;
-            m_null( i, 3 ) = s22;
+            double *alt_col = m_alt.colptr( m_snp1_cols[ k ] );
+            double *null_col = m_null.colptr( m_snp1_cols[ k ] );
+            for(int i = 0; i < n; i++)
+            {
+                unsigned char g1 = geno1[ i ];
+                double value = g1 != 3 ? m_snp1_code( g1, k ) : 0.0;
+                alt_col[ i ] = value;
+                null_col[ i ] = value;
+            }
         }
-        else
+    }
+    else
+    {
+        for(int j = 0; j < m_cleared.size( ); j++)
         {
-            m_alt( i, 0 ) = 0.0;
-            m_alt( i, 1 ) = 0.0;
-            m_alt( i, 2 ) = 0.0;
-            m_alt( i, 3 ) = 0.0;
-            m_alt( i, 4 ) = 0.0;
-            
-            m_null( i, 0 ) = 0.0;
-            m_null( i, 1 ) = 0.0;
-            m_null( i, 2 ) = 0.0;
-            m_null( i, 3 ) = 0.0;
+            write_snp1( m_cleared[ j ], false );
+        }
+        m_cleared.clear( );
+    }
 
+    /*
+     * Missingness of the pair.
+     */
+    for(int i = 0; i < n; i++)
+    {
+        if( geno1[ i ] == 3 || geno2[ i ] == 3 || missing[ i ] != 0 )
+        {
             missing[ i ] = 1;
+            if( geno1[ i ] != 3 )
+            {
+                m_cleared.push_back( i );
+            }
+        }
+    }
+
+    for(int j = 0; j < m_cleared.size( ); j++)
+    {
+        write_snp1( m_cleared[ j ], true );
+    }
+
+    /*
+     * Second snp.
+     */
+    for(int k = 0; k < m_snp2_cols.n_elem; k++)
+    {
+        double *alt_col = m_alt.colptr( m_snp2_cols[ k ] );
+        double *null_col = m_null.colptr( m_snp2_cols[ k ] );
+        for(int i = 0; i < n; i++)
+        {
+            double value = missing[ i ] == 0 ? m_snp2_code( geno2[ i ], k ) : 0.0;
+            alt_col[ i ] = value;
+            null_col[ i ] = value;
+        }
+    }
+
+    /*
+     * Interaction.
+     */
+    for(int k = 0; k < m_inter_cols.n_elem; k++)
+    {
+        double *alt_col = m_alt.colptr( m_inter_cols[ k ] );
+        for(int i = 0; i < n; i++)
+        {
+            alt_col[ i ] = missing[ i ] == 0 ? m_inter_code( 3 * geno1[ i ] + geno2[ i ], k ) : 0.0;
         }
     }
 }
 
-factor_matrix::factor_matrix(const arma::mat &cov, size_t n)
-    : general_matrix( cov, n, 5, 9 )
+/**
+ * Unpacks the quantised genotype probabilities of a snp into three
+ * arrays of length n, one for each genotype. Missing samples have
+ * all probabilities set to zero.
+ *
+ * @param row The snp.
+ * @param missing Missing samples are indicated by non-zero values.
+ * @param prob The 3*n probabilities.
+ */
+static void
+unpack_probabilities(const dosage_row &row, const arma::uvec &missing, std::vector<double> &prob)
+{
+    size_t n = row.size( );
+    prob.resize( 3 * n );
+    const unsigned short *het = row.het_data( );
+    const unsigned short *hom = row.hom_data( );
+    for(size_t i = 0; i < n; i++)
+    {
+        double scale = missing[ i ] == 0 ? 1.0 / dosage_row::SCALE : 0.0;
+        double q1 = missing[ i ] == 0 ? het[ i ] : 0.0;
+        double q2 = missing[ i ] == 0 ? hom[ i ] : 0.0;
+        prob[ i ] = scale * ( dosage_row::SCALE - q1 - q2 );
+        prob[ n + i ] = scale * q1;
+        prob[ 2 * n + i ] = scale * q2;
+    }
+}
+
+/**
+ * Writes the expected value of the given encoding of a snp, the
+ * loop over the samples is branch free so it can be vectorised.
+ *
+ * @param prob The 3*n genotype probabilities, see unpack_probabilities.
+ * @param code Values of the column for each genotype.
+ * @param col The column that will be written.
+ * @param n The number of samples.
+ */
+static void
+write_expected(const std::vector<double> &prob, const double *code, double *col, size_t n)
 {
+    const double *p0 = &prob[ 0 ];
+    const double *p1 = &prob[ n ];
+    const double *p2 = &prob[ 2 * n ];
+    for(size_t i = 0; i < n; i++)
+    {
+        col[ i ] = code[ 0 ] * p0[ i ] + code[ 1 ] * p1[ i ] + code[ 2 ] * p2[ i ];
+    }
 }
 
 void
-factor_matrix::update_matrix(const snp_row &row1, const snp_row &row2, arma::uvec &missing)
+general_matrix::update_matrix(const dosage_row &row1, const dosage_row &row2, arma::uvec &missing)
 {
-    for(int i = 0; i < row1.size( ); i++)
+    size_t n = row1.size( );
+
+    /* The hard called first snp must be rewritten by the next update */
+    m_has_row1 = false;
+    m_snp1 = NULL;
+    m_cleared.clear( );
+
+    for(int i = 0; i < n; i++)
     {
-        if( row1[ i ] != 3 && row2[ i ] != 3 && missing[ i ] == 0 )
+        if( row1.is_missing( i ) || row2.is_missing( i ) )
         {
-            double s11 = row1[ i ] == 1 ? 1.0 : 0.0;
-            double s12 = row1[ i ] == 2 ? 1.0 : 0.0;
-            double s21 = row2[ i ] == 1 ? 1.0 : 0.0;
-            double s22 = row2[ i ] == 2 ? 1.0 : 0.0;
-
-            m_alt( i, 0 ) = s11;
-            m_alt( i, 1 ) = s12;
-            m_alt( i, 2 ) = s21;
-            m_alt( i, 3 ) = s22;
-            m_alt( i, 4 ) = s11*s21;
-            m_alt( i, 5 ) = s11*s22;
-            m_alt( i, 6 ) = s12*s21;
-            m_alt( i, 7 ) = s12*s22;
-
-            m_null( i, 0 ) = s11;
-            m_null( i, 1 ) = s12;
-            m_null( i, 2 ) = s21;
-            m_null( i, 3 ) = s22;
+            missing[ i ] = 1;
         }
-        else
+    }
+    unpack_probabilities( row1, missing, m_prob1 );
+    unpack_probabilities( row2, missing, m_prob2 );
+
+    /*
+     * Single snps.
+     */
+    for(int k = 0; k < m_snp1_cols.n_elem; k++)
+    {
+        write_expected( m_prob1, m_snp1_code.colptr( k ), m_alt.colptr( m_snp1_cols[ k ] ), n );
+        write_expected( m_prob1, m_snp1_code.colptr( k ), m_null.colptr( m_snp1_cols[ k ] ), n );
+    }
+    for(int k = 0; k < m_snp2_cols.n_elem; k++)
+    {
+        write_expected( m_prob2, m_snp2_code.colptr( k ), m_alt.colptr( m_snp2_cols[ k ] ), n );
+        write_expected( m_prob2, m_snp2_code.colptr( k ), m_null.colptr( m_snp2_cols[ k ] ), n );
+    }
+
+    /*
+     * Interaction, the genotypes of the two snps are assumed to
+     * be independent given the probabilities, so the expectation
+     * is p1' * M * p2 where M is the 3x3 code of the column.
+     */
+    std::vector<double> inner( 3 * n );
+    for(int k = 0; k < m_inter_cols.n_elem; k++)
+    {
+        for(int g1 = 0; g1 < 3; g1++)
         {
-            m_alt( i, 0 ) = 0.0;
-            m_alt( i, 1 ) = 0.0;
-            m_alt( i, 2 ) = 0.0;
-            m_alt( i, 3 ) = 0.0;
-            m_alt( i, 4 ) = 0.0;
-            m_alt( i, 5 ) = 0.0;
-            m_alt( i, 6 ) = 0.0;
-            m_alt( i, 7 ) = 0.0;
-            
-            m_null( i, 0 ) = 0.0;
-            m_null( i, 1 ) = 0.0;
-            m_null( i, 2 ) = 0.0;
-            m_null( i, 3 ) = 0.0;
-            missing[ i ] = 1;
+            const double code[] = { m_inter_code( 3 * g1, k ), m_inter_code( 3 * g1 + 1, k ), m_inter_code( 3 * g1 + 2, k ) };
+            write_expected( m_prob2, code, &inner[ g1 * n ], n );
+        }
+
+        double *alt_col = m_alt.colptr( m_inter_cols[ k ] );
+        const double *p0 = &m_prob1[ 0 ];
+        const double *p1 = &m_prob1[ n ];
+        const double *p2 = &m_prob1[ 2 * n ];
+        for(size_t i = 0; i < n; i++)
+        {
+            alt_col[ i ] = p0[ i ] * inner[ i ] + p1[ i ] * inner[ n + i ] + p2[ i ] * inner[ 2 * n + i ];
         }
     }
-    
 }
 
-noia_matrix::noia_matrix(const arma::mat &cov, size_t n)
-    : general_matrix( cov, n, 5, 9 )
+/**
+ * Creates a list of column indices.
+ */
+static arma::uvec
+columns(unsigned int c1)
 {
+    arma::uvec cols( 1 );
+    cols[ 0 ] = c1;
+    return cols;
 }
 
-void
-noia_matrix::update_matrix(const snp_row &row1, const snp_row &row2, arma::uvec &missing)
+static arma::uvec
+columns(unsigned int c1, unsigned int c2)
 {
-    for(int i = 0; i < row1.size( ); i++)
+    arma::uvec cols( 2 );
+    cols[ 0 ] = c1;
+    cols[ 1 ] = c2;
+    return cols;
+}
+
+static arma::uvec
+columns(unsigned int c1, unsigned int c2, unsigned int c3, unsigned int c4)
+{
+    arma::uvec cols( 4 );
+    cols[ 0 ] = c1;
+    cols[ 1 ] = c2;
+    cols[ 2 ] = c3;
+    cols[ 3 ] = c4;
+    return cols;
+}
+
+/**
+ * Computes all pairwise products of the columns of two snp
+ * encodings, ordered so that the columns of the second snp
+ * vary fastest.
+ *
+ * @param code1 A 3xk encoding of the first snp.
+ * @param code2 A 3xm encoding of the second snp.
+ *
+ * @return A 9x(k*m) encoding of the interaction, where row 3*g1 + g2
+ *         corresponds to the genotypes g1 and g2.
+ */
+static arma::mat
+pairwise_products(const arma::mat &code1, const arma::mat &code2)
+{
+    arma::mat products( 9, code1.n_cols * code2.n_cols );
+    for(int g1 = 0; g1 < 3; g1++)
     {
-        if( row1[ i ] != 3 && row2[ i ] != 3 && missing[ i ] == 0 )
+        for(int g2 = 0; g2 < 3; g2++)
         {
-            double a1 = row1[ i ] - 1;
-            double a2 = row2[ i ] - 1;
-            double d1 = row1[ i ] == 1 ? 1.0 : 0.0;
-            double d2 = row2[ i ] == 1 ? 1.0 : 0.0;
-            double aa = a1 * a2;
-            double ad = a1 * d2;
-            double da = d1 * a2;
-            double dd = d1 * d2;
-
-            m_alt( i, 0 ) = a1;
-            m_alt( i, 1 ) = a2;
-            m_alt( i, 2 ) = d1;
-            m_alt( i, 3 ) = d2;
-            m_alt( i, 4 ) = a1 * a2;
-            m_alt( i, 5 ) = a1 * d2;
-            m_alt( i, 6 ) = d1 * a2;
-            m_alt( i, 7 ) = d1 * d2;
-
-            m_null( i, 0 ) = a1;
-            m_null( i, 1 ) = a2;
-            m_null( i, 2 ) = d1;
-            m_null( i, 3 ) = d2;
-        }
-        else
-        {
-            m_alt( i, 0 ) = 0.0;
-            m_alt( i, 1 ) = 0.0;
-            m_alt( i, 2 ) = 0.0;
-            m_alt( i, 3 ) = 0.0;
-            m_alt( i, 4 ) = 0.0;
-            m_alt( i, 5 ) = 0.0;
-            m_alt( i, 6 ) = 0.0;
-            m_alt( i, 7 ) = 0.0;
-            
-            m_null( i, 0 ) = 0.0;
-            m_null( i, 1 ) = 0.0;
-            m_null( i, 2 ) = 0.0;
-            m_null( i, 3 ) = 0.0;
-            missing[ i ] = 1;
+            for(int a = 0; a < code1.n_cols; a++)
+            {
+                for(int b = 0; b < code2.n_cols; b++)
+                {
+                    products( 3 * g1 + g2, a * code2.n_cols + b ) = code1( g1, a ) * code2( g2, b );
+                }
+            }
         }
     }
-    
+
+    return products;
+}
+
+/* Genotype encodings, stored column by column for genotypes 0, 1 and 2. */
+static const double ADDITIVE_CODE[] = { 0.0, 1.0, 2.0 };
+static const double INDICATOR_CODE[] = { 0.0, 1.0, 0.0,
+                                         0.0, 0.0, 1.0 };
+static const double NOIA_CODE[] = { -1.0, 0.0, 1.0,
+                                     0.0, 1.0, 0.0 };
+
+additive_matrix::additive_matrix(const arma::mat &cov, size_t n)
+    : general_matrix( cov, n, 3, 4 )
+{
+    arma::mat code( ADDITIVE_CODE, 3, 1 );
+    set_encoding( code, columns( 0 ), code, columns( 1 ), pairwise_products( code, code ), columns( 2 ) );
+}
+
+tukey_matrix::tukey_matrix(const arma::mat &cov, size_t n)
+    : general_matrix( cov, n, 5, 6 )
+{
+    // Note: at most one of the products are 1, so the sum is either 0 or 1.
+    arma::mat code( INDICATOR_CODE, 3, 2 );
+    arma::mat inter = arma::sum( pairwise_products( code, code ), 1 );
+    set_encoding( code, columns( 0, 1 ), code, columns( 2, 3 ), inter, columns( 4 ) );
+}
+
+factor_matrix::factor_matrix(const arma::mat &cov, size_t n)
+    : general_matrix( cov, n, 5, 9 )
+{
+    arma::mat code( INDICATOR_CODE, 3, 2 );
+    set_encoding( code, columns( 0, 1 ), code, columns( 2, 3 ), pairwise_products( code, code ), columns( 4, 5, 6, 7 ) );
+}
+
+noia_matrix::noia_matrix(const arma::mat &cov, size_t n)
+    : general_matrix( cov, n, 5, 9 )
+{
+    /* Columns are a1, a2, d1, d2 followed by aa, ad, da, dd */
+    arma::mat code( NOIA_CODE, 3, 2 );
+    set_encoding( code, columns( 0, 2 ), code, columns( 1, 3 ), pairwise_products( code, code ), columns( 4, 5, 6, 7 ) );
 }
 
 separate_matrix::separate_matrix(const arma::mat &cov, size_t n, separate_mode_t mode)
     : general_matrix( cov, n, 3, 4 )
 {
+    int snp1_threshold = 1;
+    int snp2_threshold = 1;
     if( mode == DOM_DOM )
     {
-        m_snp1_threshold = m_snp2_threshold = 1;
+        snp1_threshold = snp2_threshold = 1;
     }
     else if( mode == REC_DOM )
     {
-        m_snp1_threshold = 2;
-        m_snp2_threshold = 1;
+        snp1_threshold = 2;
+        snp2_threshold = 1;
     }
     else if( mode == DOM_REC )
     {
-        m_snp1_threshold = 1;
-        m_snp2_threshold = 2;
+        snp1_threshold = 1;
+        snp2_threshold = 2;
     }
     else if( mode == REC_REC )
     {
-        m_snp1_threshold = m_snp2_threshold = 2;
+        snp1_threshold = snp2_threshold = 2;
     }
-}
 
-void
-separate_matrix::update_matrix(const snp_row &row1, const snp_row &row2, arma::uvec &missing)
-{
-    for(int i = 0; i < row1.size( ); i++)
+    arma::mat code1( 3, 1 );
+    arma::mat code2( 3, 1 );
+    for(int g = 0; g < 3; g++)
     {
-        if( row1[ i ] != 3 && row2[ i ] != 3 && missing[ i ] == 0 )
-        {
-            double snp1 = ( row1[ i ] >= m_snp1_threshold ) ? 1.0 : 0.0;
-            double snp2 = ( row2[ i ] >= m_snp2_threshold ) ? 1.0 : 0.0;
-
-            m_alt( i, 0 ) = snp1;
-            m_alt( i, 1 ) = snp2;
-            m_alt( i, 2 ) = snp1 * snp2;
-
-            m_null( i, 0 ) = snp1;
-            m_null( i, 1 ) = snp2;
-        }
-        else
-        {
-            m_alt( i, 0 ) = 0.0;
-            m_alt( i, 1 ) = 0.0;
-            m_alt( i, 2 ) = 0.0;
-            
-            m_null( i, 0 ) = 0.0;
-            m_null( i, 1 ) = 0.0;
-            missing[ i ] = 1;
-        }
+        code1( g, 0 ) = ( g >= snp1_threshold ) ? 1.0 : 0.0;
+        code2( g, 0 ) = ( g >= snp2_threshold ) ? 1.0 : 0.0;
     }
+
+    set_encoding( code1, columns( 0 ), code2, columns( 1 ), pairwise_products( code1, code2 ), columns( 2 ) );
 }
 
 model_matrix *
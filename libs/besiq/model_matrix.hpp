@@ -1,8 +1,11 @@
 #ifndef __MODEL_MATRIX_H__
 #define __MODEL_MATRIX_H__
 
+#include <vector>
+
 #include <armadillo>
 
+#include <plink/dosage_row.hpp>
 #include <plink/snp_row.hpp>
 
 class model_matrix
@@ -14,6 +17,24 @@ class model_matrix
          */
         virtual void update_matrix(const snp_row &row1, const snp_row &row2, arma::uvec &missing) = 0;
 
+        /**
+         * Updates the model matrix with the expected encoding of the
+         * genotype probabilities of the following variants. This is
+         * the expected design rather than the expected cell counts of
+         * cell_count, the two only agree when the genotypes are certain.
+         */
+        virtual void update_matrix(const dosage_row &row1, const dosage_row &row2, arma::uvec &missing) = 0;
+
+        /**
+         * Updates the model matrix with the following decoded genotypes,
+         * one byte per sample with 3 for missing, as stored by the variant
+         * cache. The genotypes of the first variant must stay unchanged
+         * at the same address while it is used, so that consecutive
+         * pairs with the same first variant can be recognized by
+         * the pointer alone.
+         */
+        virtual void update_matrix(const unsigned char *geno1, const unsigned char *geno2, arma::uvec &missing) = 0;
+
         /**
          * Returns the model matrix.
          */
@@ -22,8 +43,38 @@ class model_matrix
         virtual size_t num_df() = 0;
         virtual size_t num_alt() = 0;
         virtual size_t num_null() = 0;
+
+        /**
+         * Returns the model matrices for the 9 genotype cells, where
+         * row 3*g1 + g2 corresponds to the genotypes g1 and g2. This is
+         * only possible when there are no covariates, because then all
+         * samples in a cell share the same row.
+         *
+         * @param null The null matrix for the cells.
+         * @param alt The alternative matrix for the cells.
+         *
+         * @return True if the cell matrices are available, false otherwise.
+         */
+        virtual bool get_cell_matrices(arma::mat &null, arma::mat &alt)
+        {
+            return false;
+        }
 };
 
+/**
+ * A model matrix where each snp is encoded by a fixed number of
+ * columns that only depend on its genotype, and the interaction
+ * columns only depend on the pair of genotypes.
+ *
+ * The intercept and covariates are written once in the constructor.
+ * The columns of the first snp are only rewritten when it changes,
+ * which is the common case for pair files sorted by the first snp,
+ * so for consecutive pairs only the columns of the second snp and
+ * the interaction are written.
+ *
+ * For imputed variants the columns contain the expected value of the
+ * encoding over the genotype probabilities of each sample.
+ */
 class general_matrix : public model_matrix
 {
 public:
@@ -34,44 +85,132 @@ public:
     virtual size_t num_df();
     virtual size_t num_alt();
     virtual size_t num_null();
-    virtual void update_matrix(const snp_row &row1, const snp_row &row2, arma::uvec &missing) = 0;
+    virtual void update_matrix(const snp_row &row1, const snp_row &row2, arma::uvec &missing);
+    virtual void update_matrix(const dosage_row &row1, const dosage_row &row2, arma::uvec &missing);
+    virtual void update_matrix(const unsigned char *geno1, const unsigned char *geno2, arma::uvec &missing);
+    virtual bool get_cell_matrices(arma::mat &null, arma::mat &alt);
 
 protected:
+    /**
+     * Sets how the genotypes are encoded, must be called by
+     * the constructor of the subclasses.
+     *
+     * @param snp1_code A 3xk matrix, where row g contains the values of
+     *                  the k columns of the first snp for genotype g.
+     * @param snp1_cols Indices of the columns of the first snp, these are
+     *                  the same in the null and alternative matrix.
+     * @param snp2_code A 3xk matrix for the second snp, see snp1_code.
+     * @param snp2_cols Indices of the columns of the second snp.
+     * @param inter_code A 9xm matrix, where row 3*g1 + g2 contains the values
+     *                   of the m interaction columns.
+     * @param inter_cols Indices of the interaction columns in the alternative matrix.
+     */
+    void set_encoding(const arma::mat &snp1_code, const arma::uvec &snp1_cols,
+                      const arma::mat &snp2_code, const arma::uvec &snp2_cols,
+                      const arma::mat &inter_code, const arma::uvec &inter_cols);
+
     arma::mat m_alt;
     arma::mat m_null;
     size_t m_num_alt;
     size_t m_num_null;
+
+private:
+    /**
+     * True if the matrices contain covariates.
+     */
+    bool m_has_cov;
+
+    /**
+     * Model matrices for the 9 genotype cells.
+     */
+    arma::mat m_cell_null;
+    arma::mat m_cell_alt;
+
+    /**
+     * Writes the columns of the first snp for a single sample.
+     *
+     * @param i The sample.
+     * @param clear If true the columns are set to 0.
+     */
+    void write_snp1(size_t i, bool clear);
+
+    /**
+     * Writes the columns of both snps and the interaction, and
+     * sets the missing samples of the pair.
+     *
+     * @param geno1 The genotypes of the first snp.
+     * @param new_row1 If false the first snp is the same as in the last
+     *                 update, so only the cleared samples are restored.
+     * @param geno2 The genotypes of the second snp.
+     * @param missing Missing samples are indicated by non-zero values.
+     */
+    void update_columns(const unsigned char *geno1, bool new_row1, const unsigned char *geno2, arma::uvec &missing);
+
+    arma::mat m_snp1_code;
+    arma::uvec m_snp1_cols;
+    arma::mat m_snp2_code;
+    arma::uvec m_snp2_cols;
+    arma::mat m_inter_code;
+    arma::uvec m_inter_cols;
+
+    /**
+     * The first snp of the last update, and whether there has been one.
+     */
+    snp_row m_row1;
+    bool m_has_row1;
+
+    /**
+     * Decoded genotypes of the first and second snp.
+     */
+    std::vector<unsigned char> m_geno1;
+    std::vector<unsigned char> m_geno2;
+
+    /**
+     * Genotypes of the first snp in the last update, either m_geno1
+     * or the genotypes passed to update_matrix, NULL if the columns
+     * of the first snp must be rewritten.
+     */
+    const unsigned char *m_snp1;
+
+    /**
+     * Samples where the columns of the first snp was cleared because
+     * they were missing for the second snp, or in the missing vector.
+     */
+    std::vector<size_t> m_cleared;
+
+    /**
+     * Genotype probabilities of the first and second snp, stored
+     * genotype by genotype, zero for missing samples.
+     */
+    std::vector<double> m_prob1;
+    std::vector<double> m_prob2;
 };
 
 class additive_matrix : public general_matrix
 {
 public:
     additive_matrix(const arma::mat &cov, size_t n);
-    void update_matrix(const snp_row &row1, const snp_row &row2, arma::uvec &missing);
 };
 
 class tukey_matrix : public general_matrix
 {
 public:
     tukey_matrix(const arma::mat &cov, size_t n);
-    void update_matrix(const snp_row &row1, const snp_row &row2, arma::uvec &missing);
 };
 
 class factor_matrix : public general_matrix
 {
 public:
     factor_matrix(const arma::mat &cov, size_t n);
-    void update_matrix(const snp_row &row1, const snp_row &row2, arma::uvec &missing);
 };
 
 class noia_matrix : public general_matrix
 {
 public:
     noia_matrix(const arma::mat &cov, size_t n);
-    void update_matrix(const snp_row &row1, const snp_row &row2, arma::uvec &missing);
 };
 
-typedef enum 
+typedef enum
 {
     DOM_DOM = 0,
     REC_DOM = 1,
@@ -83,10 +222,6 @@ class separate_matrix : public general_matrix
 {
 public:
     separate_matrix(const arma::mat &cov, size_t n, separate_mode_t mode);
-    void update_matrix(const snp_row &row1, const snp_row &row2, arma::uvec &missing);
-private:
-    int m_snp1_threshold;
-    int m_snp2_threshold;
 };
 
 model_matrix *make_model_matrix(const std::string &type, const arma::mat &cov, size_t n);
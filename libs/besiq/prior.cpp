@@ -4,6 +4,7 @@
 
 #include <besiq/stats/snp_count.hpp>
 #include <besiq/stats/beta.hpp>
+#include <besiq/stats/dirichlet.hpp>
 
 /**
  * Permutes the given phenotype and returns a new
@@ -13,16 +14,17 @@
  * @param weight Weight for each individual, will be changed
  *               after this call to ensure that individuals with
  *               weight 0 always are ignored.
+ * @param rng The random generator.
  *
  * @return Permuted phenotypes.
  */
 arma::vec
-permute_phenotype(const arma::vec &phenotype, arma::vec &weight)
+permute_phenotype(const arma::vec &phenotype, arma::vec &weight, counter_rng &rng)
 {
     arma::vec permuted_phenotype = phenotype;
     for(int i = phenotype.n_elem - 1; i > 0; --i)
     {
-        int j = random( ) % ( i + 1 );
+        int j = rng.next( ) % ( i + 1 );
 
         std::swap( permuted_phenotype[ i ], permuted_phenotype[ j ] );
         std::swap( weight[ i ], weight[ j ] );
@@ -38,14 +40,15 @@ permute_phenotype(const arma::vec &phenotype, arma::vec &weight)
  * @param snp2 Second snp.
  * @param phenotype Phenotype.
  * @param weight Weight for each sample.
+ * @param rng The random generator.
  *
  * @return The estimated risk in a random cell.
  */
 double
-sample_risk(const snp_row &snp1, const snp_row &snp2, const arma::vec &phenotype, arma::vec &weight)
+sample_risk(const snp_row &snp1, const snp_row &snp2, const arma::vec &phenotype, arma::vec &weight, counter_rng &rng)
 {
-    int cell = random( ) % 9;
-    arma::vec permuted_phenotype = permute_phenotype( phenotype, weight );
+    int cell = rng.next( ) % 9;
+    arma::vec permuted_phenotype = permute_phenotype( phenotype, weight, rng );
     arma::mat counts = joint_count( snp1, snp2, permuted_phenotype, weight );
 
     return ( counts( cell, 1 ) + 1 ) / ( counts( cell, 0 ) + counts( cell, 1 ) + 2 );
@@ -67,20 +70,21 @@ estimate_prior_parameters(genotype_matrix_ptr genotypes, const arma::vec &phenot
         }
     }
     
+    counter_rng rng( 0 );
     arma::vec samples = arma::zeros<arma::vec>( num_samples );
     for(int i = 0; i < num_samples; i++)
     {
-        int snp1 = random( ) % genotypes->size( );
+        int snp1 = rng.next( ) % genotypes->size( );
         int snp2 = snp1;
         while( snp1 == snp2 )
         {
-            snp2 = random( ) % genotypes->size( );
+            snp2 = rng.next( ) % genotypes->size( );
         }
 
         const snp_row &snp1_row = genotypes->get_row( snp1 );
         const snp_row &snp2_row = genotypes->get_row( snp2 );
 
-        samples[ i ] = sample_risk( snp1_row, snp2_row, phenotype, weight );
+        samples[ i ] = sample_risk( snp1_row, snp2_row, phenotype, weight, rng );
     }
 
     return mom_beta( samples );
@@ -1,3 +1,7 @@
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
 #include <besiq/stats/besiq_models.hpp>
 
 using namespace arma;
@@ -13,16 +17,13 @@ saturated::prob(const snp_row &row1, const snp_row &row2, const arma::vec &pheno
 {
     mat counts = joint_count( row1, row2, phenotype, weight );
 
-    vec alpha = get_alpha( );
-    
-    log_double likelihood = 1.0;
+    double loglikelihood = 0.0;
     for(int i = 0; i < counts.n_rows; i++)
     {
-        vec row_count = counts.row( i ).t( );
-        likelihood *= log_double::from_log( ldirmult( row_count, alpha ) );
+        loglikelihood += get_table( ).ldirmult( counts, i );
     }
 
-    return likelihood;
+    return log_double::from_log( loglikelihood );
 }
 
 null::null(log_double prior, const arma::vec &alpha)
@@ -35,9 +36,8 @@ log_double
 null::prob(const snp_row &row1, const snp_row &row2, const arma::vec &phenotype, const arma::vec &weight)
 {
     vec counts = pheno_count( row1, row2, phenotype, weight );
-    vec alpha = get_alpha( );
 
-    return log_double::from_log( ldirmult( counts, alpha ) );
+    return log_double::from_log( get_table( ).ldirmult( counts ) );
 }
 
 ld_assoc::ld_assoc(log_double prior, const arma::vec &alpha, bool is_first)
@@ -54,23 +54,264 @@ ld_assoc::prob(const snp_row &row1, const snp_row &row2, const arma::vec &phenot
     const snp_row &snp2 = m_is_first ? row2 : row1;
 
     mat counts = single_count( snp1, snp2, phenotype, weight );
-    
-    vec alpha = get_alpha( );
 
-    log_double likelihood = 1.0;
+    return prob( counts );
+}
+
+log_double
+ld_assoc::prob(const arma::mat &counts)
+{
+    double loglikelihood = 0.0;
     for(int i = 0; i < counts.n_rows; i++)
     {
-        vec row_count = counts.row( i ).t( );
-        likelihood *= log_double::from_log( ldirmult( row_count, alpha ) );
+        loglikelihood += get_table( ).ldirmult( counts, i );
+    }
+
+    return log_double::from_log( loglikelihood );
+}
+
+bool
+ld_assoc::is_first() const
+{
+    return m_is_first;
+}
+
+/**
+ * Variance inflation of the normal approximation used as proposal
+ * in the laplace integrator.
+ */
+const double LAPLACE_SCALE = 2.0;
+
+/**
+ * Fraction of the laplace proposals that are drawn from the prior,
+ * this bounds the importance weights.
+ */
+const double LAPLACE_DEFENSIVE = 0.1;
+
+/**
+ * Number of samples between each check of the stopping rule.
+ */
+const int LAPLACE_BATCH = 1000;
+
+/**
+ * Number of prior samples that are drawn at once in the
+ * monte carlo integrator.
+ */
+const int MC_BATCH = 4096;
+
+/**
+ * Computes the relative standard error of an importance sampling
+ * estimate from the sum of the weights and the squared weights.
+ *
+ * @param sum_w The sum of the weights.
+ * @param sum_w2 The sum of the squared weights.
+ * @param n The number of samples.
+ *
+ * @return The relative standard error of the mean weight.
+ */
+double
+relative_error(const log_double &sum_w, const log_double &sum_w2, int n)
+{
+    if( n < 2 || sum_w.is_zero( ) )
+    {
+        return DBL_MAX;
+    }
+
+    double rel_var = exp( sum_w2.log_value( ) + log( (double) n ) - 2 * sum_w.log_value( ) ) - 1.0;
+    return sqrt( std::max( rel_var, 0.0 ) / n );
+}
+
+/**
+ * Computes the log density of the beta prior of the penetrance
+ * parameters on the logit scale, i.e. including the jacobian.
+ *
+ * @param alpha The beta prior parameters.
+ * @param active Indices of the parameters to include, 0-2 for p and 3-5 for q.
+ * @param theta The logit of the six parameters.
+ *
+ * @return The log prior density.
+ */
+double
+logit_beta_prior(const arma::vec &alpha, const arma::uvec &active, const arma::vec &theta)
+{
+    double lbeta = lgamma( alpha[ 0 ] ) + lgamma( alpha[ 1 ] ) - lgamma( alpha[ 0 ] + alpha[ 1 ] );
+    double logp = 0.0;
+    for(int l = 0; l < active.n_elem; l++)
+    {
+        double x = theta[ active[ l ] ];
+        double log_p = x > 0 ? -log1p( exp( -x ) ) : x - log1p( exp( x ) );
+        logp += alpha[ 0 ] * log_p + alpha[ 1 ] * ( log_p - x ) - lbeta;
+    }
+
+    return logp;
+}
+
+/**
+ * Computes the log of the sindependent integrand, the likelihood times
+ * the prior, where the six penetrance parameters are on the logit scale.
+ *
+ * @param counts The joint counts, see joint_count.
+ * @param alpha The beta prior parameters.
+ * @param active Indices of the parameters to include, 0-2 for p and 3-5 for q.
+ * @param theta The logit of the six parameters.
+ * @param grad If not null, the 6x1 gradient will be written here.
+ * @param hessian If not null, the 6x6 hessian will be written here.
+ *
+ * @return The log integrand.
+ */
+double
+sindependent_logl(const arma::mat &counts, const arma::vec &alpha, const arma::uvec &active, const arma::vec &theta, arma::vec *grad, arma::mat *hessian)
+{
+    double p[ 6 ];
+    double log_p[ 6 ];
+    double log_q[ 6 ];
+    for(int k = 0; k < 6; k++)
+    {
+        double x = theta[ k ];
+        p[ k ] = 1.0 / ( 1.0 + exp( -x ) );
+        log_p[ k ] = x > 0 ? -log1p( exp( -x ) ) : x - log1p( exp( x ) );
+        log_q[ k ] = log_p[ k ] - x;
+    }
+
+    vec g = zeros<vec>( 6 );
+    mat H = zeros<mat>( 6, 6 );
+    double logl = logit_beta_prior( alpha, active, theta );
+    for(int l = 0; l < active.n_elem; l++)
+    {
+        unsigned int k = active[ l ];
+        g[ k ] += alpha[ 0 ] * ( 1 - p[ k ] ) - alpha[ 1 ] * p[ k ];
+        H( k, k ) -= ( alpha[ 0 ] + alpha[ 1 ] ) * p[ k ] * ( 1 - p[ k ] );
+    }
+
+    for(int i = 0; i < 3; i++)
+    {
+        for(int j = 0; j < 3; j++)
+        {
+            double n_ij0 = counts( 3 * i + j, 0 );
+            double n_ij1 = counts( 3 * i + j, 1 );
+            if( n_ij0 == 0.0 && n_ij1 == 0.0 )
+            {
+                continue;
+            }
+
+            /* The probability of being a control s = (1 - p) * (1 - q) */
+            unsigned int a = i;
+            unsigned int b = 3 + j;
+            double log_s = log_q[ a ] + log_q[ b ];
+            double s = exp( log_s );
+            double r = -expm1( log_s );
+
+            logl += n_ij0 * log_s;
+            g[ a ] -= n_ij0 * p[ a ];
+            g[ b ] -= n_ij0 * p[ b ];
+            H( a, a ) -= n_ij0 * p[ a ] * ( 1 - p[ a ] );
+            H( b, b ) -= n_ij0 * p[ b ] * ( 1 - p[ b ] );
+
+            if( n_ij1 > 0.0 )
+            {
+                logl += n_ij1 * log( r );
+                g[ a ] += n_ij1 * s * p[ a ] / r;
+                g[ b ] += n_ij1 * s * p[ b ] / r;
+                H( a, a ) += n_ij1 * s * p[ a ] * ( ( 1 - p[ a ] ) * r - p[ a ] ) / ( r * r );
+                H( b, b ) += n_ij1 * s * p[ b ] * ( ( 1 - p[ b ] ) * r - p[ b ] ) / ( r * r );
+                H( a, b ) -= n_ij1 * p[ a ] * p[ b ] * s / ( r * r );
+                H( b, a ) -= n_ij1 * p[ a ] * p[ b ] * s / ( r * r );
+            }
+        }
+    }
+
+    if( grad != NULL )
+    {
+        *grad = g;
+    }
+    if( hessian != NULL )
+    {
+        *hessian = H;
+    }
+
+    return logl;
+}
+
+/**
+ * Finds the mode of the sindependent integrand on the logit scale
+ * with a damped newton method.
+ *
+ * @param counts The joint counts, see joint_count.
+ * @param alpha The beta prior parameters.
+ * @param active Indices of the parameters to optimize.
+ * @param mode The mode will be written here.
+ * @param neg_hessian The negative hessian of the active parameters at the mode.
+ *
+ * @return True if a mode with a positive definite negative hessian was found.
+ */
+bool
+sindependent_mode(const arma::mat &counts, const arma::vec &alpha, const arma::uvec &active, arma::vec &mode, arma::mat &neg_hessian)
+{
+    mode = zeros<vec>( 6 );
+    vec grad;
+    mat hessian;
+    double logl = sindependent_logl( counts, alpha, active, mode, &grad, &hessian );
+    for(int iter = 0; iter < 100; iter++)
+    {
+        vec g = grad.elem( active );
+        mat A = -hessian.submat( active, active );
+        if( !A.is_finite( ) )
+        {
+            return false;
+        }
+
+        /* Damp the step until the negative hessian is positive definite */
+        mat R;
+        double damping = 0.0;
+        while( !chol( R, A + damping * eye<mat>( A.n_rows, A.n_cols ) ) )
+        {
+            damping = std::max( 10 * damping, 1e-4 );
+            if( damping > 1e8 )
+            {
+                return false;
+            }
+        }
+        vec step = solve( trimatu( R ), solve( trimatl( R.t( ) ), g ) );
+
+        /* Backtrack until the integrand increases */
+        double t = 1.0;
+        vec next = mode;
+        double next_logl = -DBL_MAX;
+        while( t > 1e-8 )
+        {
+            next.elem( active ) = mode.elem( active ) + t * step;
+            next_logl = sindependent_logl( counts, alpha, active, next, NULL, NULL );
+            if( next_logl >= logl )
+            {
+                break;
+            }
+            t /= 2.0;
+        }
+        if( t <= 1e-8 )
+        {
+            break;
+        }
+
+        mode = next;
+        logl = sindependent_logl( counts, alpha, active, mode, &grad, &hessian );
+        if( max( abs( t * step ) ) < 1e-8 )
+        {
+            break;
+        }
     }
 
-    return likelihood;
+    neg_hessian = -hessian.submat( active, active );
+    mat R;
+    return neg_hessian.is_finite( ) && chol( R, neg_hessian );
 }
 
-sindependent::sindependent(log_double prior, const arma::vec &alpha, int num_mc_iterations)
+sindependent::sindependent(log_double prior, const arma::vec &alpha, int num_mc_iterations, integrator_t integrator, double tolerance)
 : model::model( prior, alpha ),
   m_rdir( 0 ),
-  m_num_mc_iterations( num_mc_iterations )
+  m_num_mc_iterations( num_mc_iterations ),
+  m_integrator( integrator ),
+  m_tolerance( tolerance ),
+  m_last_error( 0.0 )
 {
 }
 
@@ -79,36 +320,189 @@ sindependent::prob(const snp_row &row1, const snp_row &row2, const arma::vec &ph
 {
     mat counts = joint_count( row1, row2, phenotype, weight );
 
+    if( m_integrator == INTEGRATOR_LAPLACE )
+    {
+        return prob_laplace( counts );
+    }
+    else
+    {
+        return prob_mc( counts );
+    }
+}
+
+double
+sindependent::last_error() const
+{
+    return m_last_error;
+}
+
+log_double
+sindependent::prob_mc(const arma::mat &counts)
+{
     vec alpha = model::get_alpha( );
+
+    /* The controls only contribute log(1 - p) + log(1 - q), so they can be summed per parameter */
+    vec control_count = zeros<vec>( 6 );
+    for(int i = 0; i < 3; i++)
+    {
+        for(int j = 0; j < 3; j++)
+        {
+            control_count[ i ] += counts( 3 * i + j, 0 );
+            control_count[ 3 + j ] += counts( 3 * i + j, 0 );
+        }
+    }
+
+    mat params( MC_BATCH, 6 );
+    vec log_factors( MC_BATCH );
     log_double likelihood = 0.0;
-    for(int k = 0; k < m_num_mc_iterations; k++)
+    log_double sum_squares = 0.0;
+    int n = 0;
+    while( n < m_num_mc_iterations )
     {
-        double p[ 3 ];
-        double q[ 3 ];
-        for(int i = 0; i < 3; i++)
+        int batch = std::min( MC_BATCH, m_num_mc_iterations - n );
+        for(int k = 0; k < 6; k++)
         {
-            p[ i ] = m_rdir.sample( alpha )[ 0 ];
-            q[ i ] = m_rdir.sample( alpha )[ 0 ];
+            m_rdir.sample_beta( alpha[ 0 ], alpha[ 1 ], batch, params.colptr( k ) );
+        }
+
+        double *lf = log_factors.memptr( );
+        std::fill( lf, lf + batch, 0.0 );
+        for(int k = 0; k < 6; k++)
+        {
+            double n_k0 = control_count[ k ];
+            if( n_k0 == 0.0 )
+            {
+                continue;
+            }
+
+            const double *p = params.colptr( k );
+            for(int b = 0; b < batch; b++)
+            {
+                lf[ b ] += n_k0 * log1p( -p[ b ] );
+            }
         }
 
-        log_double factors = 1.0;
         for(int i = 0; i < 3; i++)
         {
             for(int j = 0; j < 3; j++)
             {
-                double n_ij0 = counts( 3 * i + j, 0 );
                 double n_ij1 = counts( 3 * i + j, 1 );
+                if( n_ij1 == 0.0 )
+                {
+                    continue;
+                }
+
+                const double *p = params.colptr( i );
+                const double *q = params.colptr( 3 + j );
+                for(int b = 0; b < batch; b++)
+                {
+                    lf[ b ] += n_ij1 * log( p[ b ] + q[ b ] - p[ b ] * q[ b ] );
+                }
+            }
+        }
+
+        likelihood += logsumexp( lf, batch );
+        for(int b = 0; b < batch; b++)
+        {
+            lf[ b ] *= 2;
+        }
+        sum_squares += logsumexp( lf, batch );
 
-                double risk = p[ i ] * q[ j ] + ( 1.0 - p[ i ] ) * q[ j ] + p[ i ] * ( 1.0 - q[ j ] );
+        n += batch;
+    }
+
+    m_last_error = relative_error( likelihood, sum_squares, m_num_mc_iterations );
 
-                log_double fac1 = log_double::from_log( n_ij1 * log( risk ) );
-                log_double fac2 = log_double::from_log( n_ij0 * log( 1.0 - risk ) );
-                factors *= fac1 * fac2;
+    return likelihood / ( (double) m_num_mc_iterations );
+}
+
+log_double
+sindependent::prob_laplace(const arma::mat &counts)
+{
+    vec alpha = model::get_alpha( );
+
+    /* Parameters without any observations integrate to one */
+    std::vector<unsigned int> active_list;
+    for(int i = 0; i < 3; i++)
+    {
+        if( accu( counts.rows( 3 * i, 3 * i + 2 ) ) > 0.0 )
+        {
+            active_list.push_back( i );
+        }
+    }
+    for(int j = 0; j < 3; j++)
+    {
+        if( accu( counts.row( j ) + counts.row( 3 + j ) + counts.row( 6 + j ) ) > 0.0 )
+        {
+            active_list.push_back( 3 + j );
+        }
+    }
+    if( active_list.size( ) == 0 )
+    {
+        m_last_error = 0.0;
+        return 1.0;
+    }
+    uvec active = conv_to<uvec>::from( active_list );
+    size_t k = active.n_elem;
+
+    vec mode;
+    mat neg_hessian;
+    mat R;
+    if( !sindependent_mode( counts, alpha, active, mode, neg_hessian ) || !chol( R, inv( neg_hessian ) * LAPLACE_SCALE ) )
+    {
+        return prob_mc( counts );
+    }
+
+    /* Proposal is a mixture of the normal approximation and the prior */
+    mat L = R.t( );
+    mat L_inv = inv( trimatl( L ) );
+    double log_norm = -0.5 * k * log( 2 * datum::pi ) - accu( log( L.diag( ) ) );
+    vec mode_active = mode.elem( active );
+
+    vec theta = mode;
+    vec z( k );
+    log_double sum_w = 0.0;
+    log_double sum_w2 = 0.0;
+    int n = 0;
+    while( n < m_num_mc_iterations )
+    {
+        if( m_rdir.uniform( ) < LAPLACE_DEFENSIVE )
+        {
+            for(int l = 0; l < k; l++)
+            {
+                double p = m_rdir.sample( alpha )[ 0 ];
+                while( p <= 0.0 || p >= 1.0 )
+                {
+                    p = m_rdir.sample( alpha )[ 0 ];
+                }
+                theta[ active[ l ] ] = log( p ) - log1p( -p );
             }
         }
+        else
+        {
+            for(int l = 0; l < k; l++)
+            {
+                z[ l ] = m_rdir.normal( );
+            }
+            theta.elem( active ) = mode_active + L * z;
+        }
+
+        vec d = L_inv * ( theta.elem( active ) - mode_active );
+        log_double proposal = log_double::from_log( log_norm - 0.5 * dot( d, d ) ) * ( 1.0 - LAPLACE_DEFENSIVE ) +
+                              log_double::from_log( logit_beta_prior( alpha, active, theta ) ) * LAPLACE_DEFENSIVE;
 
-        likelihood += factors / ( (double) m_num_mc_iterations );
+        double log_w = sindependent_logl( counts, alpha, active, theta, NULL, NULL ) - proposal.log_value( );
+        sum_w += log_double::from_log( log_w );
+        sum_w2 += log_double::from_log( 2 * log_w );
+        n++;
+
+        if( n % LAPLACE_BATCH == 0 && relative_error( sum_w, sum_w2, n ) < m_tolerance )
+        {
+            break;
+        }
     }
 
-    return likelihood;
+    m_last_error = relative_error( sum_w, sum_w2, n );
+
+    return sum_w / ( (double) n );
 }
@@ -23,7 +23,8 @@ public:
      */
     model(log_double prior, const arma::vec &alpha)
     : m_prior( prior ),
-      m_alpha( alpha )
+      m_alpha( alpha ),
+      m_table( alpha, 0 )
     {
     }
 
@@ -52,6 +53,27 @@ public:
         return m_alpha;
     }
 
+    /**
+     * Precomputes the log gamma values needed by ldirmult for
+     * integer counts up to the given maximum.
+     *
+     * @param max_count The largest count, usually the number of samples.
+     */
+    void init_table(size_t max_count)
+    {
+        m_table = ldirmult_table( m_alpha, max_count );
+    }
+
+    /**
+     * Returns the ldirmult table for the prior parameters.
+     *
+     * @return The ldirmult table.
+     */
+    const ldirmult_table &get_table() const
+    {
+        return m_table;
+    }
+
     /**
      * Computes the likelihood of the phenotype under this
      * model.
@@ -75,6 +97,11 @@ private:
      * The beta prior parameters.
      */
     arma::vec m_alpha;
+
+    /**
+     * Precomputed ldirmult values for m_alpha.
+     */
+    ldirmult_table m_table;
 };
 
 /**
@@ -179,6 +206,21 @@ public:
      */
     virtual log_double prob(const snp_row &row1, const snp_row &row2, const arma::vec &phenotype, const arma::vec &weight);
 
+    /**
+     * Computes the likelihood from already aggregated counts, this
+     * allows the counts of the associated snp to be cached.
+     *
+     * @param counts Counts for each genotype of the associated snp, see single_count.
+     *
+     * @return The likelihood of the counts.
+     */
+    log_double prob(const arma::mat &counts);
+
+    /**
+     * Returns true if the first snp is the associated one.
+     */
+    bool is_first() const;
+
 private:
     /**
      * Indicates which snp is associated with the phenotype, if true
@@ -187,6 +229,25 @@ private:
     bool m_is_first;
 };
 
+/**
+ * The method used to integrate over the penetrance parameters
+ * in the sindependent model.
+ */
+typedef enum
+{
+    /**
+     * Plain monte carlo integration by sampling from the prior.
+     */
+    INTEGRATOR_MC = 0,
+
+    /**
+     * Importance sampling from a normal approximation at the
+     * posterior mode on the logit scale, that stops when the
+     * relative error is below a tolerance.
+     */
+    INTEGRATOR_LAPLACE = 1
+} integrator_t;
+
 /**
  * This class represents a model where two snps are independently
  * associated to the phenotype.
@@ -203,22 +264,71 @@ public:
      * Constructor.
      *
      * @param prior The prior probability for the model.
-     * @param num_mc_iterations The number of monte carlo iterations.
+     * @param num_mc_iterations The number of monte carlo iterations, for the
+     *                          laplace integrator this is the maximum number.
+     * @param integrator The integration method.
+     * @param tolerance The relative standard error at which the laplace
+     *                  integrator stops.
      */
-    sindependent(log_double prior, const arma::vec &alpha, int num_mc_iterations);
+    sindependent(log_double prior, const arma::vec &alpha, int num_mc_iterations, integrator_t integrator = INTEGRATOR_MC, double tolerance = 0.01);
 
     /**
      * @see model::prob.
      */
     virtual log_double prob(const snp_row &row1, const snp_row &row2, const arma::vec &phenotype, const arma::vec &weight);
 
+    /**
+     * Returns the estimated relative standard error of the
+     * last likelihood computed by prob.
+     *
+     * @return The relative standard error.
+     */
+    double last_error() const;
+
 private:
+    /**
+     * Computes the likelihood by sampling the parameters from the prior.
+     *
+     * @param counts The joint counts, see joint_count.
+     *
+     * @return The likelihood of the counts.
+     */
+    log_double prob_mc(const arma::mat &counts);
+
+    /**
+     * Computes the likelihood by importance sampling around the
+     * posterior mode.
+     *
+     * @param counts The joint counts, see joint_count.
+     *
+     * @return The likelihood of the counts.
+     */
+    log_double prob_laplace(const arma::mat &counts);
+
+    /**
+     * Random generator for the prior and importance samples.
+     */
     dir_generator m_rdir;
 
     /**
      * Number of monte carlo iterations.
      */
     int m_num_mc_iterations;
+
+    /**
+     * The integration method.
+     */
+    integrator_t m_integrator;
+
+    /**
+     * Relative standard error at which the laplace integrator stops.
+     */
+    double m_tolerance;
+
+    /**
+     * Relative standard error of the last likelihood.
+     */
+    double m_last_error;
 };
 
 #endif /* End of __BESIQ_MODELS_H__ */
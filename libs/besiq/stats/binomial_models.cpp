@@ -56,8 +56,20 @@ binomial_single::prob(const arma::mat &count)
             snp_pheno( i, 1 ) = count( 3*0 + i, 1 ) + count( 3*1 + i, 1 ) + count( 3*2 + i, 1 );
         }
     }
-    
+
+    return prob_marginal( snp_pheno );
+}
+
+log_double
+binomial_single::prob_marginal(const arma::mat &snp_pheno)
+{
     arma::vec p_snp = snp_pheno.col( 1 ) / ( snp_pheno.col( 0 ) + snp_pheno.col( 1 ) );
     
     return log_double::from_log( accu( snp_pheno.col( 1 ) % arma::log( p_snp ) + snp_pheno.col( 0 ) % arma::log( 1 - p_snp ) ) );
 }
+
+bool
+binomial_single::is_first() const
+{
+    return m_is_first;
+}
@@ -0,0 +1,230 @@
+#include <cmath>
+
+#include <glm/irls.hpp>
+#include <besiq/stats/cell_glm.hpp>
+#include <besiq/stats/snp_count.hpp>
+
+using namespace arma;
+
+arma::mat
+cell_count(const snp_row &row1, const snp_row &row2, const arma::vec &phenotype, const arma::uvec &missing, bool is_binary, size_t &num_ok)
+{
+    arma::mat counts = zeros<mat>( 9, is_binary ? 2 : 3 );
+    num_ok = 0;
+    for(int i = 0; i < row1.size( ); i++)
+    {
+        unsigned char snp1 = row1[ i ];
+        unsigned char snp2 = row2[ i ];
+        if( snp1 == 3 || snp2 == 3 || missing[ i ] != 0 )
+        {
+            continue;
+        }
+
+        double pheno = phenotype[ i ];
+        if( is_binary )
+        {
+            counts( 3 * snp1 + snp2, (unsigned int) pheno ) += 1.0;
+        }
+        else
+        {
+            counts( 3 * snp1 + snp2, 0 ) += pheno;
+            counts( 3 * snp1 + snp2, 1 ) += 1.0;
+            counts( 3 * snp1 + snp2, 2 ) += pheno * pheno;
+        }
+        num_ok++;
+    }
+
+    return counts;
+}
+
+arma::mat
+cell_count(const dosage_row &row1, const dosage_row &row2, const arma::vec &phenotype, const arma::uvec &missing, bool is_binary, size_t &num_ok)
+{
+    vec weight = zeros<vec>( row1.size( ) );
+    vec pheno = zeros<vec>( row1.size( ) );
+    num_ok = 0;
+    for(int i = 0; i < row1.size( ); i++)
+    {
+        if( !row1.is_missing( i ) && !row2.is_missing( i ) && missing[ i ] == 0 )
+        {
+            weight[ i ] = 1.0;
+            pheno[ i ] = phenotype[ i ];
+            num_ok++;
+        }
+    }
+
+    if( is_binary )
+    {
+        return joint_count( row1, row2, pheno, weight );
+    }
+    else
+    {
+        return joint_count_cont( row1, row2, pheno, weight );
+    }
+}
+
+bool
+cell_glm_supported(const glm_model &model)
+{
+    return model.get_name( ) == "binomial" || model.get_name( ) == "normal";
+}
+
+/**
+ * Solves the linear regression on the cell means weighted by the
+ * number of samples in each cell, the residual sum of squares also
+ * includes the variation within each cell.
+ *
+ * @param X The 9xk design matrix.
+ * @param count The 9x3 cell sums, see cell_count.
+ * @param output Output statistics of the estimated betas.
+ *
+ * @return Estimated beta coefficients.
+ */
+arma::vec
+cell_lm(const arma::mat &X, const arma::mat &count, glm_info &output)
+{
+    vec sum_y = count.col( 0 );
+    vec n = count.col( 1 );
+    vec sum_y2 = count.col( 2 );
+
+    mat cov = X.t( ) * diagmat( n ) * X;
+    mat cov_inv;
+    if( !inv( cov_inv, cov ) )
+    {
+        output.success = false;
+        return vec( );
+    }
+
+    vec beta = cov_inv * ( X.t( ) * sum_y );
+    vec mu = X * beta;
+
+    double rss = accu( sum_y2 - 2 * mu % sum_y + n % mu % mu );
+    double total = accu( n );
+    double k = X.n_cols;
+    double sigma_square = rss / ( total - k );
+
+    output.se_beta = sqrt( sigma_square * diagvec( cov_inv ) );
+    output.mu = mu;
+    output.logl = -total/2*log( 2*datum::pi ) - total/2*log( sigma_square ) - rss / ( 2*sigma_square );
+    output.num_iters = 0;
+    output.success = true;
+    output.converged = true;
+
+    return beta;
+}
+
+/**
+ * Fits a normal model with a non-identity link on the cell means
+ * weighted by the number of samples in each cell. The estimates are
+ * the same as for the individual samples, since the residual sum of
+ * squares only differs by the variation within each cell, which is
+ * added back when computing the final likelihood.
+ *
+ * @param X The 9xk design matrix.
+ * @param count The 9x3 cell sums, see cell_count.
+ * @param model The normal model.
+ * @param output Output statistics of the estimated betas.
+ * @param start Starting point for beta.
+ *
+ * @return Estimated beta coefficients.
+ */
+arma::vec
+cell_normal(const arma::mat &X, const arma::mat &count, const glm_model &model, glm_info &output, const arma::vec &start)
+{
+    uvec nonempty = find( count.col( 1 ) > 0 );
+    vec n = count.col( 1 );
+    n = n.elem( nonempty );
+    vec sum_y = count.col( 0 );
+    sum_y = sum_y.elem( nonempty );
+    vec sum_y2 = count.col( 2 );
+    sum_y2 = sum_y2.elem( nonempty );
+    vec mean_y = sum_y / n;
+
+    vec beta = weighted_irls( X.rows( nonempty ), mean_y, n, model, output, start );
+    if( !output.success )
+    {
+        return beta;
+    }
+
+    double within = accu( sum_y2 - sum_y % mean_y );
+    double between = accu( n % ( mean_y - output.mu ) % ( mean_y - output.mu ) );
+    double rss = within + between;
+    double total = accu( n );
+    float sigma_square = rss / ( total - beta.n_elem );
+
+    output.logl = -total/2*log( 2*datum::pi ) - total/2*log( sigma_square ) - rss / ( 2*sigma_square );
+
+    return beta;
+}
+
+/**
+ * Computes the maximum likelihood estimate of a saturated binomial
+ * model directly from the cell proportions. Only valid if the design
+ * matrix is square and invertible and no cell has a proportion of
+ * 0 or 1.
+ *
+ * @param X The 9x9 design matrix.
+ * @param count The 9x2 cell counts, see cell_count.
+ * @param model The binomial model.
+ * @param output Output statistics of the estimated betas.
+ *
+ * @return Estimated beta coefficients.
+ */
+arma::vec
+cell_saturated_binomial(const arma::mat &X, const arma::mat &count, const glm_model &model, glm_info &output)
+{
+    vec n = count.col( 0 ) + count.col( 1 );
+    vec mu = count.col( 1 ) / n;
+
+    const glm_link &link = model.get_link( );
+    vec mu_eta = link.mu_eta( mu );
+    vec w = n % compute_w( model.var( mu ), mu_eta );
+
+    vec beta;
+    mat C;
+    mat I = X.t( ) * diagmat( w ) * X;
+    if( !solve( beta, X, link.eta( mu ) ) || !I.is_finite( ) || !inv( C, I ) )
+    {
+        output.success = false;
+        return beta;
+    }
+
+    output.se_beta = sqrt( diagvec( C ) );
+    output.mu = mu;
+    output.logl = accu( count.col( 1 ) % log( mu ) + count.col( 0 ) % log( 1 - mu ) );
+    output.num_iters = 0;
+    output.success = true;
+    output.converged = true;
+
+    return beta;
+}
+
+arma::vec
+cell_glm_fit(const arma::mat &X, const arma::mat &count, const glm_model &model, glm_info &output, const arma::vec &start)
+{
+    if( model.get_name( ) == "normal" )
+    {
+        if( model.get_link( ).get_name( ) == "identity" )
+        {
+            return cell_lm( X, count, output );
+        }
+        else
+        {
+            return cell_normal( X, count, model, output, start );
+        }
+    }
+
+    bool interior = all( count.col( 0 ) > 0 ) && all( count.col( 1 ) > 0 );
+    if( interior && X.n_rows == X.n_cols && rank( X ) == X.n_cols )
+    {
+        return cell_saturated_binomial( X, count, model, output );
+    }
+
+    /* One observation for each cell and outcome, weighted by the count */
+    uvec nonzero = find( vectorise( count.cols( 0, 1 ) ) > 0 );
+    mat X_cells = join_cols( X, X );
+    vec y_cells = join_cols( zeros<vec>( X.n_rows ), ones<vec>( X.n_rows ) );
+    vec weight = vectorise( count.cols( 0, 1 ) );
+
+    return weighted_irls( X_cells.rows( nonzero ), y_cells.elem( nonzero ), weight.elem( nonzero ), model, output, start );
+}
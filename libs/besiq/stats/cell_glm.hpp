@@ -0,0 +1,80 @@
+#ifndef __CELL_GLM_H__
+#define __CELL_GLM_H__
+
+#include <armadillo>
+
+#include <glm/glm_info.hpp>
+#include <glm/models/glm_model.hpp>
+#include <plink/dosage_row.hpp>
+#include <plink/snp_row.hpp>
+
+/**
+ * Aggregates the phenotype for each of the 9 genotype cells, samples
+ * that are missing or have a missing genotype are ignored.
+ *
+ * @param row1 The first snp.
+ * @param row2 The second snp.
+ * @param phenotype The phenotype.
+ * @param missing Missing samples are indicated by non-zero values.
+ * @param is_binary If true the phenotype is 0.0 or 1.0.
+ * @param num_ok The number of samples that were counted will be written here.
+ *
+ * @return For a binary phenotype a 9x2 matrix with the number of controls and
+ *         cases, see joint_count. Otherwise a 9x3 matrix with the sum of phenotypes,
+ *         number of individuals and sum of squared phenotypes, see joint_count_cont.
+ */
+arma::mat cell_count(const snp_row &row1, const snp_row &row2, const arma::vec &phenotype, const arma::uvec &missing, bool is_binary, size_t &num_ok);
+
+/**
+ * Aggregates the phenotype for each of the 9 genotype cells from the
+ * genotype probabilities, so each sample is spread over the cells by
+ * its expected joint genotype, see cell_count. A model fitted on these
+ * counts is not the same as a model fitted on the expected design of
+ * model_matrix::update_matrix, but the two agree when every genotype
+ * probability is 0 or 1.
+ *
+ * @param row1 The first snp.
+ * @param row2 The second snp.
+ * @param phenotype The phenotype.
+ * @param missing Missing samples are indicated by non-zero values.
+ * @param is_binary If true the phenotype is 0.0 or 1.0.
+ * @param num_ok The number of samples that were counted will be written here.
+ *
+ * @return The expected cell counts, see cell_count.
+ */
+arma::mat cell_count(const dosage_row &row1, const dosage_row &row2, const arma::vec &phenotype, const arma::uvec &missing, bool is_binary, size_t &num_ok);
+
+/**
+ * Returns true if the given model can be fitted by cell_glm_fit.
+ *
+ * @param model A glm model.
+ *
+ * @return True if the model can be fitted on cell counts.
+ */
+bool cell_glm_supported(const glm_model &model);
+
+/**
+ * Fits a generalized linear model where the samples have been grouped
+ * into the 9 genotype cells. This gives the same estimates as fitting
+ * the model on all samples, when each cell corresponds to a single row
+ * in the design matrix.
+ *
+ * Linear regression and saturated binomial models are solved in closed
+ * form, other binomial models are fitted with irls on the 18 combinations
+ * of cell and outcome weighted by their counts. Other normal models are
+ * fitted with irls on the cell means weighted by the cell sizes.
+ *
+ * @param X The 9xk design matrix, where row 3*g1 + g2 corresponds to the
+ *          genotypes g1 and g2.
+ * @param count The counts for each cell, see cell_count.
+ * @param model The GLM model to estimate, see cell_glm_supported.
+ * @param output Output statistics of the estimated betas, mu contains one
+ *               value for each observation used in the fit.
+ * @param start Starting point for beta when irls is used, if empty a
+ *              starting point is computed from the counts.
+ *
+ * @return Estimated beta coefficients.
+ */
+arma::vec cell_glm_fit(const arma::mat &X, const arma::mat &count, const glm_model &model, glm_info &output, const arma::vec &start = arma::vec( ));
+
+#endif /* End of __CELL_GLM_H__ */
@@ -1,7 +1,6 @@
 #include <assert.h>
 
 #include <besiq/stats/dirichlet.hpp>
-#include <dcdflib/libdcdf.hpp>
 
 double
 dirmult(const arma::vec &x, const arma::vec &alpha)
@@ -42,8 +41,155 @@ lbinomial(double n, double k)
     return lgamma( n + 1.0 ) - lgamma( n - k + 1.0 ) - lgamma( k + 1.0 );
 }
 
-dir_generator::dir_generator(unsigned long seed)
-    :   m_generator( seed )
+ldirmult_table::ldirmult_table(const arma::vec &alpha, size_t max_count)
+    : m_alpha( alpha ),
+      m_table( max_count + 1, alpha.n_elem ),
+      m_sum_table( max_count + 1 )
+{
+    double alpha_sum = arma::sum( alpha );
+    for(size_t k = 0; k <= max_count; k++)
+    {
+        for(int i = 0; i < alpha.n_elem; i++)
+        {
+            m_table( k, i ) = lgamma( k + alpha[ i ] ) - lgamma( alpha[ i ] );
+        }
+        m_sum_table[ k ] = lgamma( alpha_sum ) - lgamma( k + alpha_sum );
+    }
+}
+
+double
+ldirmult_table::ldirmult(const arma::vec &x) const
+{
+    return lookup( x.memptr( ), 1 );
+}
+
+double
+ldirmult_table::ldirmult(const arma::mat &counts, size_t row) const
+{
+    return lookup( counts.memptr( ) + row, counts.n_rows );
+}
+
+double
+ldirmult_table::lookup(const double *x, size_t stride) const
+{
+    size_t max_count = m_sum_table.n_elem;
+    size_t x_sum = 0;
+    double x_alpha = 0.0;
+    bool in_table = true;
+    for(int i = 0; i < m_alpha.n_elem; i++)
+    {
+        /* Check the range before converting, negative or NaN counts can not be cast to size_t */
+        double xi = x[ i * stride ];
+        if( !( xi >= 0.0 && xi < max_count ) )
+        {
+            in_table = false;
+            break;
+        }
+
+        size_t k = (size_t) xi;
+        if( (double) k != xi )
+        {
+            in_table = false;
+            break;
+        }
+
+        x_alpha += m_table( k, i );
+        x_sum += k;
+    }
+
+    if( !in_table || x_sum >= max_count )
+    {
+        arma::vec x_copy( m_alpha.n_elem );
+        for(int i = 0; i < m_alpha.n_elem; i++)
+        {
+            x_copy[ i ] = x[ i * stride ];
+        }
+        return ::ldirmult( x_copy, m_alpha );
+    }
+
+    return m_sum_table[ x_sum ] + x_alpha;
+}
+
+/**
+ * Mixes the bits of a 64-bit value, the finalizer of splitmix64.
+ *
+ * @param x The value to mix.
+ *
+ * @return The mixed value.
+ */
+static inline uint64_t
+mix64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+counter_rng::counter_rng(uint64_t seed, uint64_t stream)
+    : m_key( mix64( seed + 0x9e3779b97f4a7c15ULL * ( stream + 1 ) ) ),
+      m_counter( 0 )
+{
+
+}
+
+uint64_t
+counter_rng::next()
+{
+    return mix64( m_key + 0x9e3779b97f4a7c15ULL * ( ++m_counter ) );
+}
+
+double
+counter_rng::uniform()
+{
+    /* 53 random bits, shifted half a step away from 0 */
+    return ( ( next( ) >> 11 ) + 0.5 ) * ( 1.0 / 9007199254740992.0 );
+}
+
+double
+counter_rng::normal()
+{
+    /* Box-Muller transform */
+    double u1 = uniform( );
+    double u2 = uniform( );
+    return sqrt( -2.0 * log( u1 ) ) * cos( 2.0 * arma::datum::pi * u2 );
+}
+
+double
+counter_rng::gamma(double shape)
+{
+    if( shape < 1.0 )
+    {
+        /* Gamma(a) = Gamma(a + 1) * U^(1/a) */
+        double u = uniform( );
+        return gamma( shape + 1.0 ) * pow( u, 1.0 / shape );
+    }
+
+    double d = shape - 1.0 / 3.0;
+    double c = 1.0 / sqrt( 9.0 * d );
+    while( true )
+    {
+        double x = normal( );
+        double v = 1.0 + c * x;
+        if( v <= 0.0 )
+        {
+            continue;
+        }
+
+        v = v * v * v;
+        double u = uniform( );
+        double x2 = x * x;
+        if( u < 1.0 - 0.0331 * x2 * x2 || log( u ) < 0.5 * x2 + d * ( 1.0 - v + log( v ) ) )
+        {
+            return d * v;
+        }
+    }
+}
+
+dir_generator::dir_generator(unsigned long seed, unsigned long stream)
+    :   m_generator( seed, stream )
 {
 
 }
@@ -54,9 +200,51 @@ dir_generator::sample(const arma::vec &alpha)
     arma::vec x = arma::zeros<arma::vec>( alpha.n_elem );
     for(int i = 0; i < alpha.n_elem; i++)
     {
-        double runif = m_generator( ) / ( m_generator.max( ) - m_generator.min( ) + 1.0 );
-        x[ i ] = gamma_cdf_inv( runif, alpha[ i ], 1.0 );
+        x[ i ] = m_generator.gamma( alpha[ i ] );
     }
 
     return x / sum( x );
 }
+
+void
+dir_generator::sample(const arma::vec &alpha, arma::mat &samples)
+{
+    samples.set_size( alpha.n_elem, samples.n_cols );
+    for(int j = 0; j < samples.n_cols; j++)
+    {
+        double *x = samples.colptr( j );
+        double total = 0.0;
+        for(int i = 0; i < alpha.n_elem; i++)
+        {
+            x[ i ] = m_generator.gamma( alpha[ i ] );
+            total += x[ i ];
+        }
+        for(int i = 0; i < alpha.n_elem; i++)
+        {
+            x[ i ] /= total;
+        }
+    }
+}
+
+void
+dir_generator::sample_beta(double a, double b, size_t n, double *samples)
+{
+    for(size_t i = 0; i < n; i++)
+    {
+        double x = m_generator.gamma( a );
+        double y = m_generator.gamma( b );
+        samples[ i ] = x / ( x + y );
+    }
+}
+
+double
+dir_generator::uniform()
+{
+    return m_generator.uniform( );
+}
+
+double
+dir_generator::normal()
+{
+    return m_generator.normal( );
+}
@@ -7,14 +7,7 @@
 #include <numeric>
 #include <vector>
 
-#include <besiq/config.h>
-#ifndef HAVE_TR1_RANDOM
-#include <random>
-typedef std::mt19937 prg_type;
-#else
-#include <tr1/random>
-typedef std::tr1::mt19937 prg_type;
-#endif
+#include <stdint.h>
 
 /**
  * Computes the dirichlet multinomial probability of a vector
@@ -48,6 +41,118 @@ double ldirmult(const arma::vec &x, const arma::vec &alpha);
  */
 double lbinomial(double n, double k);
 
+/**
+ * Precomputed log gamma values for ldirmult with a fixed alpha. For
+ * unweighted data the counts are integers bounded by the number of
+ * samples, so the dirichlet multinomial only needs table lookups.
+ * Counts that are not integers or outside the table are computed
+ * with ldirmult directly.
+ */
+class ldirmult_table
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param alpha The prior parameters of the dirichlet density.
+     * @param max_count The largest count, usually the number of samples.
+     */
+    ldirmult_table(const arma::vec &alpha, size_t max_count);
+
+    /**
+     * Computes the dirichlet multinomial log probability of x.
+     *
+     * @param x The observations.
+     *
+     * @return The log posterior probability of x, see ldirmult.
+     */
+    double ldirmult(const arma::vec &x) const;
+
+    /**
+     * Computes the dirichlet multinomial log probability of a row
+     * of a count matrix.
+     *
+     * @param counts A matrix with one column per alpha.
+     * @param row The row that contains the observations.
+     *
+     * @return The log posterior probability of the row, see ldirmult.
+     */
+    double ldirmult(const arma::mat &counts, size_t row) const;
+
+private:
+    /**
+     * Computes the log probability of the elements x[ i * stride ].
+     */
+    double lookup(const double *x, size_t stride) const;
+
+    /**
+     * The prior parameters.
+     */
+    arma::vec m_alpha;
+
+    /**
+     * Column i contains lgamma( k + alpha_i ) - lgamma( alpha_i ) in row k.
+     */
+    arma::mat m_table;
+
+    /**
+     * Contains lgamma( sum alpha ) - lgamma( k + sum alpha ) in element k.
+     */
+    arma::vec m_sum_table;
+};
+
+/**
+ * A counter based random generator, the i:th number of a stream
+ * is a hash of the seed, the stream and i. Different streams
+ * are independent, so each thread can be given its own stream
+ * and still produce the same numbers regardless of scheduling.
+ */
+class counter_rng
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param seed The seed of the generator.
+     * @param stream The stream, e.g. the thread number.
+     */
+    counter_rng(uint64_t seed, uint64_t stream = 0);
+
+    /**
+     * Returns the next 64 random bits.
+     */
+    uint64_t next();
+
+    /**
+     * Returns a sample from the uniform distribution on (0, 1).
+     */
+    double uniform();
+
+    /**
+     * Returns a sample from the standard normal distribution.
+     */
+    double normal();
+
+    /**
+     * Returns a sample from the gamma distribution with the given
+     * shape and scale 1, using the method of Marsaglia and Tsang.
+     *
+     * @param shape The shape parameter.
+     */
+    double gamma(double shape);
+
+private:
+    /**
+     * The key derived from the seed and stream.
+     */
+    uint64_t m_key;
+
+    /**
+     * The number of generated 64-bit blocks.
+     */
+    uint64_t m_counter;
+};
+
 /**
  * This class is responsible for generating samples from a
  * dirichlet distribution. It does so by using the fact that
@@ -63,8 +168,9 @@ public:
      * Initializes the random generator with the given seed.
      *
      * @param seed The seed given to the random generator.
+     * @param stream The random stream, use one per thread.
      */
-    dir_generator(unsigned long seed);
+    dir_generator(unsigned long seed, unsigned long stream = 0);
 
     /**
      * Generates a random sample from the dirichlet distribution
@@ -76,11 +182,41 @@ public:
      */
     arma::vec sample(const arma::vec &alpha);
 
+    /**
+     * Generates a batch of samples from the dirichlet distribution.
+     *
+     * @param alpha The parameters of the dirichlet density.
+     * @param samples Each column will be filled with a sample, the
+     *                number of columns determines the batch size.
+     */
+    void sample(const arma::vec &alpha, arma::mat &samples);
+
+    /**
+     * Generates a batch of samples from the beta distribution, which
+     * is the first component of a two-dimensional dirichlet.
+     *
+     * @param a The first shape parameter.
+     * @param b The second shape parameter.
+     * @param n The number of samples.
+     * @param samples The samples will be written here.
+     */
+    void sample_beta(double a, double b, size_t n, double *samples);
+
+    /**
+     * Returns a sample from the uniform distribution on (0, 1).
+     */
+    double uniform();
+
+    /**
+     * Returns a sample from the standard normal distribution.
+     */
+    double normal();
+
 private:
     /**
-     * Mersenne twister random generator.
+     * Counter based random generator.
      */
-    prg_type m_generator;
+    counter_rng m_generator;
 };
 
 #endif /* End of __DIRICHLET_H__ */
@@ -1,13 +1,19 @@
 #ifndef __LOG_SCALE_H__
 #define __LOG_SCALE_H__
 
+#include <algorithm>
 #include <cmath>
 #include <cfloat>
+#include <limits>
 #include <stdexcept>
 
 /**
  * This class represents a value on the log scale that supports
  * the common arithmetic operators.
+ *
+ * Zero is represented by a log value of -inf, so addition and
+ * multiplication need no special cases and never throw. Only
+ * subtraction of a larger value and division by zero throw.
  */
 template <class T>
 class log_scale
@@ -19,17 +25,8 @@ public:
      * @param value The value to log.
      */
     log_scale(T value)
+    : m_log_value( log( value ) )
     {
-        if( value != 0.0 )
-        {
-            m_log_value = log( value );
-            m_is_zero = false;
-        }
-        else
-        {
-            m_log_value = -DBL_MAX;
-            m_is_zero = true;
-        }
     }
 
     /**
@@ -56,53 +53,32 @@ public:
      */
     const log_scale<T> &operator=(const log_scale<T> &other)
     {
-        if( this != &other )
-        {
-            m_log_value = other.m_log_value;
-            m_is_zero = other.m_is_zero;
-        }
+        m_log_value = other.m_log_value;
         return *this;
     }
 
     /* Arithmetic operators +, -, * and /. */
     const log_scale<T> &operator+=(const log_scale<T> &other)
     {
-        if( !m_is_zero && !other.m_is_zero )
-        {
-            if( m_log_value > other.m_log_value )
-            {
-                T diff = other.m_log_value - m_log_value;
-                m_log_value += log1p( exp( diff ) );
-            }
-            else
-            {
-                T diff = m_log_value - other.m_log_value;
-                m_log_value = other.m_log_value + log1p( exp( diff ) );
-            }
-        }
-        else if( m_is_zero )
-        {
-            m_log_value = other.m_log_value;
-            m_is_zero = other.m_is_zero;
-        }
+        T hi = std::max( m_log_value, other.m_log_value );
+        T lo = std::min( m_log_value, other.m_log_value );
+
+        /* If both are zero, lo - hi would be nan */
+        m_log_value = ( hi == neg_inf( ) ) ? hi : hi + log1p( exp( lo - hi ) );
 
         return *this;
     }
 
     const log_scale<T> &operator-=(const log_scale<T> &other)
     {
-        if( !m_is_zero && !other.m_is_zero )
+        if( other.m_log_value > m_log_value )
         {
-            T diff = m_log_value - other.m_log_value;
-            if( diff < 0.0 )
-            {
-                throw std::domain_error( "log_scale: Cannot represent negative values on log scale." );
-            }
-            m_log_value = other.m_log_value + log( exp( diff ) - 1.0 );
+            throw std::domain_error( "log_scale: Cannot represent negative values on log scale." );
         }
-        else if( m_is_zero && !other.m_is_zero )
+
+        if( m_log_value != neg_inf( ) )
         {
-            throw std::domain_error( "log_scale: Cannot represent negative values on log scale." );
+            m_log_value += log( -expm1( other.m_log_value - m_log_value ) );
         }
 
         return *this;
@@ -110,36 +86,18 @@ public:
 
     const log_scale<T> &operator*=(const log_scale<T> &other)
     {
-        if( !m_is_zero && !other.m_is_zero )
-        {
-            m_log_value += other.m_log_value;
-        }
-        else
-        {
-            m_log_value = -DBL_MAX;
-            m_is_zero = true;
-        }
-
+        m_log_value += other.m_log_value;
         return *this;
     }
 
     const log_scale<T> &operator/=(const log_scale<T> &other)
     {
-        /* Note: Order matters */
-        if( !m_is_zero && !other.m_is_zero )
-        {
-            m_log_value -= other.m_log_value;
-        }
-        else if( other.m_is_zero )
+        if( other.m_log_value == neg_inf( ) )
         {
             throw std::domain_error( "log_scale: Division with zero." );
         }
-        else
-        {
-            m_log_value = -DBL_MAX;
-            m_is_zero = true;
-        }
 
+        m_log_value -= other.m_log_value;
         return *this;
     }
 
@@ -150,45 +108,73 @@ public:
      */
     T value() const
     {
-        if( !m_is_zero )
-        {
-            return exp( m_log_value );
-        }
-        else
-        {
-            return 0.0;
-        }
+        return exp( m_log_value );
     }
 
     /**
-     * Returns the logged value.
+     * Returns the logged value, zero is returned as -DBL_MAX.
      * 
      * @return the logged value.
      */
     T log_value() const
     {
-        if( !m_is_zero )
-        {
-            return m_log_value;
-        }
-        else
-        {
-            return -DBL_MAX;
-        }
+        return std::max( m_log_value, (T) -DBL_MAX );
+    }
+
+    /**
+     * Returns true if the value is zero.
+     */
+    bool is_zero() const
+    {
+        return m_log_value == neg_inf( );
     }
 
 private:
     /**
-     * The underlying logged value.
+     * Returns the log of zero.
      */
-    T m_log_value;
+    static T neg_inf()
+    {
+        return -std::numeric_limits<T>::infinity( );
+    }
 
     /**
-     * Determines whether this should be zero.
+     * The underlying logged value, -inf for zero.
      */
-    bool m_is_zero;
+    T m_log_value;
 };
 
+/**
+ * Computes the sum of many values given on the log scale, this is
+ * faster and more accurate than adding them one at a time.
+ *
+ * @param log_values The logged values.
+ * @param n The number of values.
+ *
+ * @return The sum of the values.
+ */
+template <class T>
+log_scale<T> logsumexp(const T *log_values, size_t n)
+{
+    T max_value = -std::numeric_limits<T>::infinity( );
+    for(size_t i = 0; i < n; i++)
+    {
+        max_value = std::max( max_value, log_values[ i ] );
+    }
+    if( max_value == -std::numeric_limits<T>::infinity( ) )
+    {
+        return log_scale<T>::from_log( max_value );
+    }
+
+    T sum = 0.0;
+    for(size_t i = 0; i < n; i++)
+    {
+        sum += exp( log_values[ i ] - max_value );
+    }
+
+    return log_scale<T>::from_log( max_value + log( sum ) );
+}
+
 /* Binaray arithmetic operators for +, -, * and /. */
 template <class T>
 log_scale<T> operator+(const log_scale<T> &lhs, const log_scale<T> &rhs)
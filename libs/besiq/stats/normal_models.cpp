@@ -64,7 +64,13 @@ normal_single::prob(const arma::mat &count)
             snp_pheno( i, 2 ) = count( 3*0 + i, 2 ) + count( 3*1 + i, 2 ) + count( 3*2 + i, 2 );
         }
     }
-    
+
+    return prob_marginal( snp_pheno );
+}
+
+log_double
+normal_single::prob_marginal(const arma::mat &snp_pheno)
+{
     arma::vec mu_single = snp_pheno.col( 0 ) / snp_pheno.col( 1 );
     arma::vec residual = snp_pheno.col( 1 ) % mu_single % mu_single - 2 * mu_single % snp_pheno.col( 0 ) + snp_pheno.col( 2 );
     double k = 3;
@@ -73,3 +79,9 @@ normal_single::prob(const arma::mat &count)
 
     return log_double::from_log( -(n/2)*log(2*datum::pi) - (n/2)*log( sigma_square ) - 1/(2*sigma_square) * sum( residual ) );
 }
+
+bool
+normal_single::is_first() const
+{
+    return m_is_first;
+}
@@ -64,6 +64,21 @@ public:
      */
     virtual log_double prob(const arma::mat &count);
 
+    /**
+     * Computes the likelihood from the marginals of the associated
+     * snp, this allows the marginals to be cached.
+     *
+     * @param snp_pheno The 3x3 sums of each genotype, see joint_count_cont.
+     *
+     * @return The likelihood of the marginals.
+     */
+    log_double prob_marginal(const arma::mat &snp_pheno);
+
+    /**
+     * Returns true if the first snp is the associated one.
+     */
+    bool is_first() const;
+
 private:
     /**
      * Indicates which snp is associated with the phenotype, if true
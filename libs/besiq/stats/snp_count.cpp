@@ -1,3 +1,5 @@
+#include <vector>
+
 #include <besiq/stats/snp_count.hpp>
 
 using namespace arma;
@@ -36,6 +38,97 @@ joint_count_cont(const snp_row &row1, const snp_row &row2, const arma::vec &phen
     return counts;
 }
 
+/**
+ * Unpacks the quantised probabilities of a snp into three arrays of
+ * length n, one for each genotype, scaled by the given weight. Samples
+ * that are missing in either snp get a zero weight.
+ *
+ * @param row The snp to unpack.
+ * @param other The other snp of the pair.
+ * @param weight The weight of each sample.
+ * @param prob The 3*n scaled probabilities.
+ */
+static void
+unpack_probabilities(const dosage_row &row, const dosage_row &other, const double *weight, std::vector<double> &prob)
+{
+    size_t n = row.size( );
+    const unsigned short *het = row.het_data( );
+    const unsigned short *hom = row.hom_data( );
+    const unsigned short *other_het = other.het_data( );
+    double *p0 = &prob[ 0 ];
+    double *p1 = &prob[ n ];
+    double *p2 = &prob[ 2 * n ];
+    for(size_t i = 0; i < n; i++)
+    {
+        bool ok = het[ i ] != dosage_row::MISSING && other_het[ i ] != dosage_row::MISSING;
+        double w = ok ? weight[ i ] / dosage_row::SCALE : 0.0;
+        double q1 = ok ? het[ i ] : 0.0;
+        double q2 = ok ? hom[ i ] : 0.0;
+        p0[ i ] = w * ( dosage_row::SCALE - q1 - q2 );
+        p1[ i ] = w * q1;
+        p2[ i ] = w * q2;
+    }
+}
+
+/**
+ * Computes the sum over all samples of the outer product of the genotype
+ * probabilities of two snps, weighted by the given weight. The loops only
+ * run over plain arrays without branches so that they can be vectorised.
+ *
+ * @param row1 The first snp.
+ * @param row2 The second snp.
+ * @param weight The weight of each sample.
+ * @param cells The 9 weighted expected counts, where cell 3*g1 + g2
+ *              corresponds to the genotypes g1 and g2.
+ */
+static void
+expected_cells(const dosage_row &row1, const dosage_row &row2, const arma::vec &weight, double *cells)
+{
+    size_t n = row1.size( );
+    std::vector<double> ones( n, 1.0 );
+    std::vector<double> prob1( 3 * n );
+    std::vector<double> prob2( 3 * n );
+    unpack_probabilities( row1, row2, weight.memptr( ), prob1 );
+    unpack_probabilities( row2, row1, &ones[ 0 ], prob2 );
+
+    for(int g1 = 0; g1 < 3; g1++)
+    {
+        const double *p1 = &prob1[ g1 * n ];
+        for(int g2 = 0; g2 < 3; g2++)
+        {
+            const double *p2 = &prob2[ g2 * n ];
+            double sum = 0.0;
+            for(size_t i = 0; i < n; i++)
+            {
+                sum += p1[ i ] * p2[ i ];
+            }
+            cells[ 3 * g1 + g2 ] = sum;
+        }
+    }
+}
+
+arma::mat
+joint_count(const dosage_row &row1, const dosage_row &row2, const arma::vec &phenotype, const arma::vec &weight)
+{
+    arma::mat counts = zeros<mat>( 9, 2 );
+    arma::vec is_case = arma::conv_to<arma::vec>::from( phenotype == 1.0 );
+    expected_cells( row1, row2, weight % ( 1.0 - is_case ), counts.colptr( 0 ) );
+    expected_cells( row1, row2, weight % is_case, counts.colptr( 1 ) );
+
+    return counts;
+}
+
+arma::mat
+joint_count_cont(const dosage_row &row1, const dosage_row &row2, const arma::vec &phenotype, const arma::vec &weight)
+{
+    arma::mat counts = zeros<mat>( 9, 3 );
+    expected_cells( row1, row2, weight % phenotype, counts.colptr( 0 ) );
+    expected_cells( row1, row2, weight, counts.colptr( 1 ) );
+    expected_cells( row1, row2, weight % phenotype % phenotype, counts.colptr( 2 ) );
+
+    return counts;
+}
+
 arma::vec
 joint_count(const snp_row &row1, const snp_row &row2)
 {
@@ -123,6 +216,32 @@ compute_real_maf(const snp_row &row)
     }
 }
 
+float
+compute_real_maf(const dosage_row &row)
+{
+    unsigned int n = 0;
+    double dose = 0.0;
+
+    for(int i = 0; i < row.size( ); i++)
+    {
+        if( !row.is_missing( i ) )
+        {
+            dose += row.dosage( i );
+            n += 1;
+        }
+    }
+
+    if( n != 0 )
+    {
+        float maf = dose / ( 2 * n );
+        return std::min( maf, 1 - maf );
+    }
+    else
+    {
+        return 0.0;
+    }
+}
+
 double
 min_na(double a, double b, double na)
 {
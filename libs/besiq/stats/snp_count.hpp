@@ -3,6 +3,7 @@
 
 #include <armadillo>
 
+#include <plink/dosage_row.hpp>
 #include <plink/snp_row.hpp>
 
 /**
@@ -37,6 +38,34 @@ arma::mat joint_count(const snp_row &row1, const snp_row &row2, const arma::vec
  */
 arma::mat joint_count_cont(const snp_row &row1, const snp_row &row2, const arma::vec &phenotype, const arma::vec &weight);
 
+/**
+ * Computes the expected number of cases and controls with each genotype
+ * from the genotype probabilities, each individual contributes the outer
+ * product of its probabilities at the two snps. Individuals that are
+ * missing in either snp are ignored.
+ *
+ * @param row1 The first snp.
+ * @param row2 The second snp.
+ * @param phenotype The phenotype 0.0 or 1.0.
+ * @param weight The weight of each individual.
+ *
+ * @return Expected counts for each genotype, see joint_count.
+ */
+arma::mat joint_count(const dosage_row &row1, const dosage_row &row2, const arma::vec &phenotype, const arma::vec &weight);
+
+/**
+ * Aggregates the phenotype for each genotype weighted by the expected
+ * genotype of each individual, see joint_count and joint_count_cont.
+ *
+ * @param row1 The first snp.
+ * @param row2 The second snp.
+ * @param phenotype The phenotype.
+ * @param weight The weight of each individual.
+ *
+ * @return Aggregated phenotypes for each genotype, see joint_count_cont.
+ */
+arma::mat joint_count_cont(const dosage_row &row1, const dosage_row &row2, const arma::vec &phenotype, const arma::vec &weight);
+
 /**
  * Counts the number of individuals with each genotype.
  *
@@ -102,6 +131,16 @@ arma::vec compute_maf(const snp_row &row);
  */
 float compute_real_maf(const snp_row &row);
 
+/**
+ * Estimates the minor allele frequency from the expected number
+ * of copies of each allele, see dosage_row::dosage.
+ *
+ * @param row The genotype probabilities of a snp.
+ *
+ * @return The frequency of the minor allele.
+ */
+float compute_real_maf(const dosage_row &row);
+
 /**
  * Find the minimum but respect that the values
  * can be na, in that case return the non-na value.
@@ -0,0 +1,308 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include <glm/irls.hpp>
+#include <glm/models/links/glm_link.hpp>
+#include <dcdflib/libdcdf.hpp>
+#include <besiq/stats/streaming_glm.hpp>
+
+using namespace arma;
+
+/**
+ * Largest number of variants that are decoded at a time.
+ */
+static const size_t MAX_BLOCK_SIZE = 1024;
+
+streaming_design::streaming_design(genotype_matrix_ptr genotypes, const std::vector<size_t> &variants, const arma::mat &dense, size_t block_size, int num_threads)
+    : m_genotypes( genotypes ),
+      m_variants( variants ),
+      m_dense( dense ),
+      m_block_size( std::max( block_size, (size_t) 1 ) ),
+      m_num_threads( num_threads )
+{
+    m_num_blocks = ( m_variants.size( ) + m_block_size - 1 ) / m_block_size;
+}
+
+size_t
+streaming_design::num_rows() const
+{
+    return m_dense.n_rows;
+}
+
+size_t
+streaming_design::num_cols() const
+{
+    return m_variants.size( ) + m_dense.n_cols;
+}
+
+void
+streaming_design::decode_block(size_t block, arma::mat &G) const
+{
+    size_t first = block * m_block_size;
+    size_t last = std::min( first + m_block_size, m_variants.size( ) );
+    G.set_size( num_rows( ), last - first );
+
+    for(size_t k = first; k < last; k++)
+    {
+        const snp_row &row = m_genotypes->get_row( m_variants[ k ] );
+        double *col = G.colptr( k - first );
+        for(size_t j = 0; j < row.size( ); j++)
+        {
+            unsigned char g = row[ j ];
+            col[ j ] = ( g != 3 ) ? g : 0.0;
+        }
+    }
+}
+
+void
+streaming_design::multiply(const arma::vec &b, arma::vec &eta) const
+{
+    size_t num_variants = m_variants.size( );
+    eta = zeros<vec>( num_rows( ) );
+    if( m_dense.n_cols > 0 )
+    {
+        eta = m_dense * b.subvec( num_variants, num_cols( ) - 1 );
+    }
+
+    #pragma omp parallel num_threads( m_num_threads )
+    {
+        vec local_eta = zeros<vec>( num_rows( ) );
+        mat G;
+
+        #pragma omp for schedule( dynamic, 1 )
+        for(int block = 0; block < m_num_blocks; block++)
+        {
+            decode_block( block, G );
+            size_t first = block * m_block_size;
+            local_eta += G * b.subvec( first, first + G.n_cols - 1 );
+        }
+
+        #pragma omp critical
+        eta += local_eta;
+    }
+}
+
+void
+streaming_design::cross_products(const arma::vec &w, const arma::vec &z, arma::mat &XtWX, arma::vec &XtWz) const
+{
+    size_t num_variants = m_variants.size( );
+    size_t p = num_cols( );
+
+    vec wz = zeros<vec>( w.n_elem );
+    for(size_t i = 0; i < w.n_elem; i++)
+    {
+        if( w[ i ] != 0.0 )
+        {
+            wz[ i ] = w[ i ] * z[ i ];
+        }
+    }
+
+    XtWX.zeros( p, p );
+    XtWz.zeros( p );
+
+    mat WD = diagmat( w ) * m_dense;
+    if( m_dense.n_cols > 0 )
+    {
+        XtWX.submat( num_variants, num_variants, p - 1, p - 1 ) = m_dense.t( ) * WD;
+        XtWz.subvec( num_variants, p - 1 ) = m_dense.t( ) * wz;
+    }
+
+    /* Each thread owns the upper triangular blocks in the rows of its block */
+    #pragma omp parallel num_threads( m_num_threads )
+    {
+        mat G1;
+        mat WG1;
+        mat G2;
+
+        #pragma omp for schedule( dynamic, 1 )
+        for(int block1 = 0; block1 < m_num_blocks; block1++)
+        {
+            decode_block( block1, G1 );
+            WG1 = diagmat( w ) * G1;
+            size_t first1 = block1 * m_block_size;
+            size_t last1 = first1 + G1.n_cols - 1;
+
+            XtWX.submat( first1, first1, last1, last1 ) = WG1.t( ) * G1;
+            if( m_dense.n_cols > 0 )
+            {
+                XtWX.submat( first1, num_variants, last1, p - 1 ) = WG1.t( ) * m_dense;
+            }
+            XtWz.subvec( first1, last1 ) = G1.t( ) * wz;
+
+            for(size_t block2 = block1 + 1; block2 < m_num_blocks; block2++)
+            {
+                decode_block( block2, G2 );
+                size_t first2 = block2 * m_block_size;
+                XtWX.submat( first1, first2, last1, first2 + G2.n_cols - 1 ) = WG1.t( ) * G2;
+            }
+        }
+    }
+
+    XtWX = symmatu( XtWX );
+}
+
+size_t
+streaming_block_size(size_t num_samples, size_t num_variants, size_t num_dense, size_t memory_mb, int num_threads)
+{
+    double budget = memory_mb * 1024.0 * 1024.0;
+    double p = num_variants + num_dense;
+
+    /* The normal equations, their Cholesky factor, and the dense columns */
+    double fixed = 2.0 * p * p * sizeof( double ) + 2.0 * num_samples * num_dense * sizeof( double );
+    if( fixed >= budget )
+    {
+        return 0;
+    }
+
+    /* Three decoded blocks for each thread */
+    double per_variant = 3.0 * num_samples * sizeof( double ) * std::max( num_threads, 1 );
+    double block_size = std::floor( ( budget - fixed ) / per_variant );
+    if( block_size < 1.0 )
+    {
+        return 0;
+    }
+
+    /* Keep at least one block per thread */
+    size_t thread_share = ( num_variants + num_threads - 1 ) / std::max( num_threads, 1 );
+    return std::max( std::min( std::min( (size_t) block_size, MAX_BLOCK_SIZE ), thread_share ), (size_t) 1 );
+}
+
+/**
+ * Solves the normal equations X'WX b = X'Wz with a Cholesky
+ * decomposition.
+ *
+ * @param X The design matrix.
+ * @param w The weight of each observation.
+ * @param z The right hand side.
+ * @param XtWX The matrix X'WX will be stored here.
+ * @param b The solution will be stored here.
+ *
+ * @return True if the normal equations are positive definite,
+ *         false otherwise.
+ */
+static bool
+solve_normal_equations(const streaming_design &X, const arma::vec &w, const arma::vec &z, arma::mat &XtWX, arma::vec &b)
+{
+    vec XtWz;
+    X.cross_products( w, z, XtWX, XtWz );
+
+    mat R;
+    if( !XtWX.is_finite( ) || !chol( R, XtWX ) )
+    {
+        return false;
+    }
+
+    vec y = solve( trimatl( R.t( ) ), XtWz );
+    b = solve( trimatu( R ), y );
+
+    return true;
+}
+
+arma::vec
+streaming_irls(const streaming_design &X, const arma::vec &y, const arma::uvec &missing, const glm_model &model, glm_info &output)
+{
+    const glm_link &link = model.get_link( );
+    vec weight = ones<vec>( missing.n_elem );
+    set_missing_to_zero( missing, weight );
+
+    mat XtWX;
+    vec b;
+    output.num_iters = 0;
+    output.converged = false;
+    output.success = false;
+    if( !solve_normal_equations( X, weight, link.eta( ( y + 0.5 ) / 3.0 ), XtWX, b ) )
+    {
+        return b;
+    }
+
+    vec w( X.num_rows( ) );
+    vec z( X.num_rows( ) );
+    vec eta;
+    X.multiply( b, eta );
+    vec mu = link.mu( eta );
+    vec mu_eta = link.mu_eta( mu );
+
+    int num_iter = 0;
+    double old_logl = -DBL_MAX;
+    double logl = model.weighted_likelihood( mu, y, weight );
+    bool invalid_mu = false;
+    bool inverse_fail = false;
+    vec b_old = b;
+    bool first_attempt = true;
+    while( num_iter < IRLS_MAX_ITERS && ! ( fabs( logl - old_logl ) / ( 0.1 + fabs( logl ) ) < IRLS_TOLERANCE ) )
+    {
+        w = compute_w( model.var( mu ), mu_eta );
+        z = compute_z( eta, mu, mu_eta, y );
+        for(size_t i = 0; i < w.n_elem; i++)
+        {
+            w[ i ] = ( weight[ i ] != 0.0 ) ? w[ i ] * weight[ i ] : 0.0;
+        }
+
+        if( !solve_normal_equations( X, w, z, XtWX, b ) )
+        {
+            inverse_fail = true;
+            break;
+        }
+
+        X.multiply( b, eta );
+        mu = link.mu( eta );
+        if( !model.valid_mu( mu ) && first_attempt )
+        {
+            /* Try a smaller step */
+            b = 0.5 * b_old + 0.5 * b;
+            first_attempt = false;
+            X.multiply( b, eta );
+            mu = link.mu( eta );
+        }
+        mu_eta = link.mu_eta( mu );
+
+        if( !model.valid_mu( mu ) )
+        {
+            invalid_mu = true;
+            break;
+        }
+
+        old_logl = logl;
+        b_old = b;
+        logl = model.weighted_likelihood( mu, y, weight );
+
+        num_iter++;
+    }
+
+    output.num_iters = num_iter;
+    if( num_iter >= IRLS_MAX_ITERS || invalid_mu || inverse_fail )
+    {
+        return b;
+    }
+
+    mat C;
+    if( !XtWX.is_finite( ) || !inv( C, XtWX ) )
+    {
+        return b;
+    }
+
+    float dispersion = model.weighted_dispersion( mu, y, weight, b.n_elem );
+    output.se_beta = sqrt( model.weighted_dispersion( mu, y, weight, dispersion ) * diagvec( C ) );
+    output.converged = true;
+    output.success = true;
+    output.mu = mu;
+    output.logl = model.weighted_likelihood( mu, y, weight, dispersion );
+
+    vec wald_z = b / output.se_beta;
+    vec chi2_value = wald_z % wald_z;
+    output.p_value = -1.0 * ones<vec>( chi2_value.n_elem );
+    for(int i = 0; i < chi2_value.n_elem; i++)
+    {
+        try
+        {
+            output.p_value[ i ] = 1.0 - chi_square_cdf( chi2_value[ i ], 1 );
+        }
+        catch(bad_domain_value &e)
+        {
+            continue;
+        }
+    }
+
+    return b;
+}
@@ -0,0 +1,140 @@
+#ifndef __STREAMING_GLM_H__
+#define __STREAMING_GLM_H__
+
+#include <vector>
+
+#include <armadillo>
+
+#include <glm/glm_info.hpp>
+#include <glm/models/glm_model.hpp>
+#include <plink/plink_file.hpp>
+
+/**
+ * A design matrix [G D] where G are the additive codings of a set of
+ * variants and D is a small dense matrix, typically the covariates and
+ * the intercept. The genotypes are never stored as doubles, instead
+ * blocks of columns are decoded from the packed rows when they are
+ * needed, so only a few blocks are in memory at a time.
+ */
+class streaming_design
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param genotypes The genotypes.
+     * @param variants Index in genotypes of the variant of each column in G,
+     *                 missing genotypes are coded as 0.
+     * @param dense The dense columns D.
+     * @param block_size The number of variants decoded at a time.
+     * @param num_threads The number of threads that process the blocks.
+     */
+    streaming_design(genotype_matrix_ptr genotypes, const std::vector<size_t> &variants, const arma::mat &dense, size_t block_size, int num_threads = 1);
+
+    /**
+     * Returns the number of rows.
+     *
+     * @return the number of rows.
+     */
+    size_t num_rows() const;
+
+    /**
+     * Returns the number of columns.
+     *
+     * @return the number of columns.
+     */
+    size_t num_cols() const;
+
+    /**
+     * Computes eta = X * b.
+     *
+     * @param b The coefficients.
+     * @param eta The product will be stored here.
+     */
+    void multiply(const arma::vec &b, arma::vec &eta) const;
+
+    /**
+     * Computes the weighted cross products X' * W * X and X' * W * z,
+     * observations with weight 0 are ignored.
+     *
+     * @param w The weight of each observation.
+     * @param z The right hand side.
+     * @param XtWX The matrix X' * W * X will be stored here.
+     * @param XtWz The vector X' * W * z will be stored here.
+     */
+    void cross_products(const arma::vec &w, const arma::vec &z, arma::mat &XtWX, arma::vec &XtWz) const;
+
+private:
+    /**
+     * Decodes the variants of a block into the columns of G.
+     *
+     * @param block Index of the block.
+     * @param G The decoded genotypes will be stored here.
+     */
+    void decode_block(size_t block, arma::mat &G) const;
+
+    /**
+     * The genotypes.
+     */
+    genotype_matrix_ptr m_genotypes;
+
+    /**
+     * Index of the variant in each genotype column.
+     */
+    std::vector<size_t> m_variants;
+
+    /**
+     * The dense columns.
+     */
+    arma::mat m_dense;
+
+    /**
+     * The number of variants decoded at a time.
+     */
+    size_t m_block_size;
+
+    /**
+     * The number of blocks of variants.
+     */
+    size_t m_num_blocks;
+
+    /**
+     * The number of threads.
+     */
+    int m_num_threads;
+};
+
+/**
+ * Chooses the number of variants that are decoded at a time, so that
+ * the normal equations and the decoded blocks of each thread fit within
+ * the given memory budget.
+ *
+ * @param num_samples The number of samples.
+ * @param num_variants The number of variant columns.
+ * @param num_dense The number of dense columns.
+ * @param memory_mb The memory budget in megabytes.
+ * @param num_threads The number of threads.
+ *
+ * @return The block size, or 0 if the normal equations alone
+ *         do not fit within the budget.
+ */
+size_t streaming_block_size(size_t num_samples, size_t num_variants, size_t num_dense, size_t memory_mb, int num_threads = 1);
+
+/**
+ * Fits a generalized linear model with the iteratively reweighted
+ * least squares algorithm, see irls. In each iteration the normal
+ * equations are accumulated from the streamed design matrix and
+ * solved with a Cholesky decomposition, so the design matrix is
+ * never formed.
+ *
+ * @param X The design matrix.
+ * @param y The observations.
+ * @param missing Missing observations are indicated by 1.
+ * @param model The GLM model to estimate.
+ * @param output Output statistics of the estimated betas.
+ *
+ * @return Estimated beta coefficients.
+ */
+arma::vec streaming_irls(const streaming_design &X, const arma::vec &y, const arma::uvec &missing, const glm_model &model, glm_info &output);
+
+#endif /* End of __STREAMING_GLM_H__ */
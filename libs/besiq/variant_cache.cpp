@@ -0,0 +1,148 @@
+#include <cstring>
+
+#include <plink/plink_file.hpp>
+#include <besiq/variant_cache.hpp>
+#include <besiq/stats/snp_count.hpp>
+
+using namespace arma;
+
+variant_cache::variant_cache(const arma::vec &phenotype, const arma::vec &weight, bool encode_columns)
+    : m_phenotype( phenotype ),
+      m_weight( weight ),
+      m_encode_columns( encode_columns )
+{
+}
+
+variant_cache::~variant_cache()
+{
+    for(size_t i = 0; i < m_info.size( ); i++)
+    {
+        delete m_info[ i ];
+    }
+}
+
+void
+variant_cache::add(const snp_row &row)
+{
+    m_rows.push_back( &row );
+    m_info.push_back( NULL );
+}
+
+const variant_info &
+variant_cache::get(size_t index)
+{
+    if( m_info[ index ] != NULL )
+    {
+        return *m_info[ index ];
+    }
+
+    variant_info *info = new variant_info( );
+    const snp_row &row = *m_rows[ index ];
+    info->maf = compute_real_maf( row );
+    memset( info->counts, 0, sizeof( info->counts ) );
+    memset( info->sums, 0, sizeof( info->sums ) );
+    if( m_encode_columns )
+    {
+        info->genotypes.resize( row.size( ) );
+    }
+
+    for(int i = 0; i < row.size( ); i++)
+    {
+        unsigned char snp = row[ i ];
+        if( m_encode_columns )
+        {
+            info->genotypes[ i ] = snp;
+        }
+        if( snp == 3 )
+        {
+            info->missing_samples.push_back( i );
+            continue;
+        }
+        if( m_weight[ i ] == 0.0 )
+        {
+            continue;
+        }
+
+        double w = m_weight[ i ];
+        double pheno = m_phenotype[ i ];
+        if( pheno == 0.0 || pheno == 1.0 )
+        {
+            info->counts[ snp ][ (unsigned int) pheno ] += w;
+        }
+        info->sums[ snp ][ 0 ] += w * pheno;
+        info->sums[ snp ][ 1 ] += w;
+        info->sums[ snp ][ 2 ] += w * pheno * pheno;
+    }
+    m_info[ index ] = info;
+
+    return *info;
+}
+
+const snp_row &
+variant_cache::get_row(size_t index) const
+{
+    return *m_rows[ index ];
+}
+
+arma::mat
+variant_cache::pair_marginal(size_t snp1_id, size_t snp2_id, bool is_binary)
+{
+    const variant_info &info = get( snp1_id );
+    const snp_row &snp1 = *m_rows[ snp1_id ];
+    arma::mat marginal( 3, is_binary ? 2 : 3 );
+    for(int g = 0; g < 3; g++)
+    {
+        for(int k = 0; k < marginal.n_cols; k++)
+        {
+            marginal( g, k ) = is_binary ? info.counts[ g ][ k ] : info.sums[ g ][ k ];
+        }
+    }
+
+    /* Remove the samples that are missing in the other snp */
+    const std::vector<unsigned int> &missing_samples = get( snp2_id ).missing_samples;
+    for(size_t i = 0; i < missing_samples.size( ); i++)
+    {
+        unsigned int sample = missing_samples[ i ];
+        unsigned char snp = snp1[ sample ];
+        double w = m_weight[ sample ];
+        if( snp == 3 || w == 0.0 )
+        {
+            continue;
+        }
+
+        double pheno = m_phenotype[ sample ];
+        if( is_binary )
+        {
+            if( pheno == 0.0 || pheno == 1.0 )
+            {
+                marginal( snp, (unsigned int) pheno ) -= w;
+            }
+        }
+        else
+        {
+            marginal( snp, 0 ) -= w * pheno;
+            marginal( snp, 1 ) -= w;
+            marginal( snp, 2 ) -= w * pheno * pheno;
+        }
+    }
+
+    return marginal;
+}
+
+size_t
+variant_cache::size() const
+{
+    return m_info.size( );
+}
+
+variant_cache_ptr
+create_variant_cache(genotype_matrix_ptr genotypes, const arma::vec &phenotype, const arma::vec &weight, bool encode_columns)
+{
+    variant_cache_ptr cache( new variant_cache( phenotype, weight, encode_columns ) );
+    for(size_t i = 0; i < genotypes->size( ); i++)
+    {
+        cache->add( genotypes->get_row( i ) );
+    }
+
+    return cache;
+}
@@ -0,0 +1,183 @@
+#ifndef __VARIANT_CACHE_H__
+#define __VARIANT_CACHE_H__
+
+#include <vector>
+
+#include <armadillo>
+
+#include <plink/snp_row.hpp>
+#include <shared_ptr/shared_ptr.hpp>
+
+class genotype_matrix;
+typedef shared_ptr<genotype_matrix> genotype_matrix_ptr;
+
+/**
+ * Quantities that only depend on a single variant, and therefore
+ * can be computed once and shared by all pairs the variant is part of.
+ *
+ * The marginals are plain arrays so that an entry only costs its
+ * fixed size plus the missing samples, and the design columns when
+ * they are requested.
+ */
+struct variant_info
+{
+    /**
+     * The minor allele frequency, see compute_real_maf.
+     */
+    float maf;
+
+    /**
+     * Weighted number of controls and cases with each genotype,
+     * as in single_count. Only samples with a phenotype of 0 or 1
+     * are counted.
+     */
+    double counts[ 3 ][ 2 ];
+
+    /**
+     * Weighted sum of phenotypes, sum of weights and weighted sum of
+     * squared phenotypes for each genotype, the columns of
+     * joint_count_cont.
+     */
+    double sums[ 3 ][ 3 ];
+
+    /**
+     * The missing mask of the variant, stored as the sorted indices
+     * of the samples with a missing genotype since there are usually
+     * few of them.
+     */
+    std::vector<unsigned int> missing_samples;
+
+    /**
+     * The genotype of each sample, one byte per sample with 3 for
+     * missing, from which the design columns of a model_matrix are
+     * encoded. Only filled in when the cache was created with
+     * encode_columns set.
+     */
+    std::vector<unsigned char> genotypes;
+};
+
+/**
+ * Holds a variant_info for each variant in a genotype matrix, the
+ * index of a variant is the same as in the matrix.
+ *
+ * The quantities of a variant are computed the first time it is
+ * looked up, so only the variants that are part of a tested pair
+ * are visited, and a variant that is never looked up only costs
+ * two pointers.
+ *
+ * The rows are not copied, so they must outlive the cache.
+ */
+class variant_cache
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param phenotype The phenotype.
+     * @param weight The weight of each sample in the marginals,
+     *               missing samples should have weight 0.
+     * @param encode_columns If true the genotypes are decoded and stored
+     *                       for each variant, this requires 1 byte per
+     *                       sample and variant.
+     */
+    variant_cache(const arma::vec &phenotype, const arma::vec &weight, bool encode_columns = false);
+
+    /**
+     * Destructor.
+     */
+    ~variant_cache();
+
+    /**
+     * Adds a variant, it will be assigned the next index.
+     *
+     * @param row The genotypes of the variant.
+     */
+    void add(const snp_row &row);
+
+    /**
+     * Returns the cached quantities for the given variant, they
+     * are computed if this is the first time the variant is used.
+     *
+     * @param index Index of the variant.
+     *
+     * @return The cached quantities.
+     */
+    const variant_info &get(size_t index);
+
+    /**
+     * Returns the genotypes for the given variant.
+     *
+     * @param index Index of the variant.
+     *
+     * @return The genotypes for the given variant.
+     */
+    const snp_row &get_row(size_t index) const;
+
+    /**
+     * Returns the marginals of the first variant over the samples
+     * where the second variant is non-missing, by removing the
+     * samples that are missing in the second variant from the
+     * cached marginals.
+     *
+     * @param snp1_id Index of the variant that is counted.
+     * @param snp2_id Index of the other variant.
+     * @param is_binary If true the 3x2 counts of controls and cases are
+     *                  returned, see single_count, otherwise the 3x3 sums,
+     *                  see variant_info::sums.
+     *
+     * @return The marginals of the first variant.
+     */
+    arma::mat pair_marginal(size_t snp1_id, size_t snp2_id, bool is_binary);
+
+    /**
+     * Returns the number of variants in the cache.
+     */
+    size_t size() const;
+
+private:
+    /**
+     * The cache owns the entries, so it can not be copied.
+     */
+    variant_cache(const variant_cache &other);
+    variant_cache &operator=(const variant_cache &other);
+
+    /**
+     * The phenotype and the weight of each sample.
+     */
+    arma::vec m_phenotype;
+    arma::vec m_weight;
+
+    /**
+     * Determines whether the genotypes are stored.
+     */
+    bool m_encode_columns;
+
+    /**
+     * The genotypes of each variant, these are owned by
+     * someone else.
+     */
+    std::vector<const snp_row *> m_rows;
+
+    /**
+     * Cached quantities for each variant, NULL until the
+     * variant is looked up.
+     */
+    std::vector<variant_info *> m_info;
+};
+
+typedef shared_ptr<variant_cache> variant_cache_ptr;
+
+/**
+ * Creates a cache for all variants in the given matrix. Nothing
+ * is computed until a variant is looked up.
+ *
+ * @param genotypes The genotype matrix.
+ * @param phenotype The phenotype.
+ * @param weight The weight of each sample, see variant_cache.
+ * @param encode_columns If true the genotypes are stored as well.
+ *
+ * @return A cache where each index corresponds to the same index in genotypes.
+ */
+variant_cache_ptr create_variant_cache(genotype_matrix_ptr genotypes, const arma::vec &phenotype, const arma::vec &weight, bool encode_columns = false);
+
+#endif /* End of __VARIANT_CACHE_H__ */
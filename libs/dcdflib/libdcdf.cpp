@@ -6,6 +6,11 @@ extern "C"
     #include <dcdflib/cdflib.h>
 }
 
+/*
+ * The dcdflib routines keep intermediate values in static variables,
+ * so calls from different threads are serialized.
+ */
+
 double
 chi_square_cdf(double x, unsigned int df)
 {
@@ -17,6 +22,7 @@ chi_square_cdf(double x, unsigned int df)
     int status;
     double bound;
 
+    #pragma omp critical( dcdflib )
     cdfchi( &which, &p, &q, &x_chi, &df_chi, &status, &bound );
 
     if( status == 0 )
@@ -42,6 +48,7 @@ norm_cdf(double x, double mu, double sd)
     int status;
     double bound;
 
+    #pragma omp critical( dcdflib )
     cdfnor( &which, &p, &q, &x_norm, &mu_norm, &sd_norm, &status, &bound );
 
     if( status == 0 )
@@ -67,6 +74,7 @@ f_cdf(double x, double d1, double d2)
     int status;
     double bound;
 
+    #pragma omp critical( dcdflib )
     cdff( &which, &p, &q, &x_f, &d1_f, &d2_f, &status, &bound );
 
     if( status == 0 )
@@ -91,6 +99,7 @@ gamma_cdf_inv(double p, double a, double b)
     double bound;
     int status;
 
+    #pragma omp critical( dcdflib )
     cdfgam( &which, &p_gam, &q, &x, &shape, &scale, &status, &bound );
 
     if( status == 0 )
@@ -15,9 +15,11 @@
  * @param missing Identifies missing sampels by 1 and non-missing by 0.
  * @param model The GLM model to estimate.
  * @param output Output statistics of the estimated betas.
+ * @param start Starting point for beta in iterative algorithms, if
+ *              empty a starting point is computed from y.
  *
  * @return Estimated beta coefficients.
  */
-arma::vec glm_fit(const arma::mat &X, const arma::vec &y, const arma::uvec &missing, const glm_model &model, glm_info &output);
+arma::vec glm_fit(const arma::mat &X, const arma::vec &y, const arma::uvec &missing, const glm_model &model, glm_info &output, const arma::vec &start = arma::vec( ));
 
 #endif /* End of __GLM_H__ */
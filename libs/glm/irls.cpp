@@ -67,18 +67,50 @@ compute_w(const vec &var, const vec& mu_eta)
 }
 
 vec
-init_beta(const mat &X, const vec&y, const uvec &missing, const glm_model &model)
+init_beta(const mat &X, const vec&y, const vec &weight, const glm_model &model)
 {
     vec eta = model.get_link( ).eta( (y + 0.5) / 3.0 );
 
-    return weighted_least_squares( X, eta, ones<vec>( missing.n_elem ) - missing );
+    return weighted_least_squares( X, eta, weight );
+}
+
+/**
+ * Multiplies the IRLS weights with the prior weights, observations
+ * with prior weight 0 are set to 0 regardless of their IRLS weight.
+ *
+ * @param weight The prior weights.
+ * @param w The IRLS weights.
+ */
+void
+apply_prior_weight(const vec &weight, vec &w)
+{
+    for(int i = 0; i < w.n_elem; i++)
+    {
+        if( weight[ i ] == 0.0 )
+        {
+            w[ i ] = 0.0;
+        }
+        else
+        {
+            w[ i ] *= weight[ i ];
+        }
+    }
+}
+
+vec
+irls(const mat &X, const vec &y, const uvec &missing, const glm_model &model, glm_info &output, const vec &start)
+{
+    vec weight = ones<vec>( missing.n_elem );
+    set_missing_to_zero( missing, weight );
+
+    return weighted_irls( X, y, weight, model, output, start );
 }
 
 vec
-irls(const mat &X, const vec &y, const uvec &missing, const glm_model &model, glm_info &output)
+weighted_irls(const mat &X, const vec &y, const vec &weight, const glm_model &model, glm_info &output, const vec &start)
 {
     const glm_link &link = model.get_link( );
-    vec b = init_beta( X, y, missing, model );
+    vec b = start.n_elem == X.n_cols ? start : init_beta( X, y, weight, model );
     vec w( X.n_rows );
     vec z( X.n_rows );
     vec eta = X * b;
@@ -88,7 +120,7 @@ irls(const mat &X, const vec &y, const uvec &missing, const glm_model &model, gl
 
     int num_iter = 0;
     double old_logl = -DBL_MAX;
-    double logl = model.likelihood( mu, y, missing );
+    double logl = model.weighted_likelihood( mu, y, weight );
     bool invalid_mu = false;
     bool inverse_fail = false;
     vec b_old = b;
@@ -97,7 +129,7 @@ irls(const mat &X, const vec &y, const uvec &missing, const glm_model &model, gl
     {
         w = compute_w( model.var( mu ), mu_eta );
         z = compute_z( eta, mu, mu_eta, y );
-        set_missing_to_zero( missing, w );
+        apply_prior_weight( weight, w );
         b = weighted_least_squares( X, z, w );
         if( b.n_elem <= 0 )
         {
@@ -128,7 +160,7 @@ compute_eta:
 
         old_logl = logl;
         b_old = b;
-        logl = model.likelihood( mu, y, missing );
+        logl = model.weighted_likelihood( mu, y, weight );
 
         num_iter++;
     }
@@ -139,13 +171,13 @@ compute_eta:
         mat C;
         if( I.is_finite( ) && inv( C, I ) )
         {
-            float dispersion = model.dispersion( mu, y, missing, b.n_elem );
-            output.se_beta = sqrt( model.dispersion( mu, y, missing, dispersion ) * diagvec( C ) );
+            float dispersion = model.weighted_dispersion( mu, y, weight, b.n_elem );
+            output.se_beta = sqrt( model.weighted_dispersion( mu, y, weight, dispersion ) * diagvec( C ) );
             output.num_iters = num_iter;
             output.converged = true;
             output.success = true;
             output.mu = mu;
-            output.logl = model.likelihood( mu, y, missing, dispersion );
+            output.logl = model.weighted_likelihood( mu, y, weight, dispersion );
             
             vec wald_z = b / output.se_beta;
             vec chi2_value = wald_z % wald_z;
@@ -105,9 +105,29 @@ arma::vec irls(const arma::mat &X, const arma::vec &y, const glm_model &model, g
  * @param missing Identifies missing sampels by 1 and non-missing by 0.
  * @param model The GLM model to estimate.
  * @param output Output statistics of the estimated betas.
+ * @param start Starting point for beta, if empty a starting point is computed from y.
  *
  * @return Estimated beta coefficients.
  */
-arma::vec irls(const arma::mat &X, const arma::vec &y, const arma::uvec &missing, const glm_model &model, glm_info &output);
+arma::vec irls(const arma::mat &X, const arma::vec &y, const arma::uvec &missing, const glm_model &model, glm_info &output, const arma::vec &start = arma::vec( ));
+
+/**
+ * This function performs the iteratively reweighted
+ * least squares algorithm where each observation has a prior
+ * weight. This allows observations that share the same row
+ * in the design matrix to be grouped.
+ *
+ * @param X The design matrix (caller is responsible for
+ *          adding an intercept).
+ * @param y The observations.
+ * @param weight The prior weight of each observation, 0 for missing.
+ * @param model The GLM model to estimate.
+ * @param output Output statistics of the estimated betas.
+ * @param start Starting point for beta, e.g. the estimate of a closely
+ *              related model. If empty a starting point is computed from y.
+ *
+ * @return Estimated beta coefficients.
+ */
+arma::vec weighted_irls(const arma::mat &X, const arma::vec &y, const arma::vec &weight, const glm_model &model, glm_info &output, const arma::vec &start = arma::vec( ));
 
 #endif /* End of __IRLS_H__ */
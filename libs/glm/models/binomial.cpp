@@ -59,6 +59,27 @@ binomial::likelihood(const arma::vec &mu, const arma::vec &y, const arma::uvec &
     return loglikelihood;
 }
 
+double
+binomial::weighted_dispersion(const arma::vec &mu, const arma::vec &y, const arma::vec &weight, float k) const
+{
+    return 1.0;
+}
+
+double
+binomial::weighted_likelihood(const arma::vec &mu, const arma::vec &y, const arma::vec &weight, float dispersion) const
+{
+    double loglikelihood = 0.0;
+    for(int i = 0; i < y.n_elem; i++)
+    {
+        if( weight[ i ] != 0.0 )
+        {
+            loglikelihood += weight[ i ] * ( y[ i ] * log( mu[ i ] ) + ( 1 - y[ i ] ) * log( 1 - mu[ i ] ) );
+        }
+    }
+
+    return loglikelihood;
+}
+
 bool
 binomial::is_binary() const
 {
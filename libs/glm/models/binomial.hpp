@@ -49,6 +49,16 @@ public:
      */
     virtual double likelihood(const arma::vec &mu, const arma::vec &y, const arma::uvec &missing, float dispersion = 1.0) const;
 
+    /**
+     * @see glm_model.weighted_dispersion.
+     */
+    virtual double weighted_dispersion(const arma::vec &mu, const arma::vec &y, const arma::vec &weight, float k) const;
+
+    /**
+     * @see glm_model.weighted_likelihood.
+     */
+    virtual double weighted_likelihood(const arma::vec &mu, const arma::vec &y, const arma::vec &weight, float dispersion = 1.0) const;
+
     /**
      * @see glm_model.is_binary.
      */
@@ -109,6 +109,32 @@ public:
      */
     virtual double likelihood(const arma::vec &mu, const arma::vec &y, const arma::uvec &missing, float dispersion = 1.0) const = 0;
 
+    /**
+     * Estimate the dispersion of the model, where each observation
+     * has a prior weight, e.g. the number of samples it represents.
+     *
+     * @param mu The mean value parameter.
+     * @param y The observations.
+     * @param weight The prior weight of each observation, 0 for missing.
+     * @param k The number of estimated betas.
+     *
+     * @return The estimated dispersion.
+     */
+    virtual double weighted_dispersion(const arma::vec &mu, const arma::vec &y, const arma::vec &weight, float k) const = 0;
+
+    /**
+     * Compute the log likelihood for the parameters, where each
+     * observation has a prior weight.
+     *
+     * @param mu The mean value parameter.
+     * @param y The observations.
+     * @param weight The prior weight of each observation, 0 for missing.
+     * @param dispersion Estimated dispersion (only used for final likelihood).
+     *
+     * @return The log likelihood.
+     */
+    virtual double weighted_likelihood(const arma::vec &mu, const arma::vec &y, const arma::vec &weight, float dispersion = 1.0) const = 0;
+
     /**
      * Returns true if the phenotype is binary.
      *
@@ -43,6 +43,40 @@ normal::likelihood(const arma::vec &mu, const arma::vec &y, const arma::uvec &mi
     return arma::as_scalar( ( -0.5*log( 2 * datum::pi ) -0.5*log( sigma2 ) - (1.0/(2*sigma2))*arma::trans( ( ( y - mu ) % ( y - mu ) ) ) ) * ( 1 - missing ) );
 }
 
+double 
+normal::weighted_dispersion(const arma::vec &mu, const arma::vec &y, const arma::vec &weight, float k) const
+{
+    double rss = 0.0;
+    double n = 0.0;
+    for(int i = 0; i < y.n_elem; i++)
+    {
+        if( weight[ i ] != 0.0 )
+        {
+            rss += weight[ i ] * ( y[ i ] - mu[ i ] ) * ( y[ i ] - mu[ i ] );
+            n += weight[ i ];
+        }
+    }
+
+    return rss / ( n - k );
+}
+
+double
+normal::weighted_likelihood(const arma::vec &mu, const arma::vec &y, const arma::vec &weight, float dispersion) const
+{
+    float sigma2 = dispersion;
+    double loglikelihood = 0.0;
+    for(int i = 0; i < y.n_elem; i++)
+    {
+        if( weight[ i ] != 0.0 )
+        {
+            double r = y[ i ] - mu[ i ];
+            loglikelihood += weight[ i ] * ( -0.5*log( 2 * datum::pi ) - 0.5*log( sigma2 ) - (1.0/(2*sigma2)) * r * r );
+        }
+    }
+
+    return loglikelihood;
+}
+
 bool
 normal::is_binary() const
 {
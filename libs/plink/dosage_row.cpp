@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <limits>
+
+#include <plink/dosage_row.hpp>
+
+/**
+ * Quantises a probability to 16 bits.
+ */
+static inline unsigned short
+quantise(float p)
+{
+    return (unsigned short) ( std::min( std::max( p, 0.0f ), 1.0f ) * dosage_row::SCALE + 0.5f );
+}
+
+const unsigned short dosage_row::MISSING;
+const unsigned short dosage_row::SCALE;
+
+dosage_row::dosage_row()
+{
+
+}
+
+void
+dosage_row::resize(size_t new_size)
+{
+    m_het.assign( new_size, MISSING );
+    m_hom.assign( new_size, 0 );
+}
+
+size_t
+dosage_row::size() const
+{
+    return m_het.size( );
+}
+
+void
+dosage_row::assign(size_t index, float p_het, float p_hom)
+{
+    m_het[ index ] = quantise( p_het );
+    m_hom[ index ] = std::min( quantise( p_hom ), (unsigned short) ( SCALE - m_het[ index ] ) );
+}
+
+void
+dosage_row::assign_quantised(size_t index, unsigned short het, unsigned short hom)
+{
+    m_het[ index ] = het;
+    m_hom[ index ] = hom;
+}
+
+bool
+dosage_row::is_missing(size_t index) const
+{
+    return m_het[ index ] == MISSING;
+}
+
+void
+dosage_row::probabilities(size_t index, double *p) const
+{
+    p[ 1 ] = m_het[ index ] / (double) SCALE;
+    p[ 2 ] = m_hom[ index ] / (double) SCALE;
+    p[ 0 ] = 1.0 - p[ 1 ] - p[ 2 ];
+}
+
+float
+dosage_row::dosage(size_t index) const
+{
+    if( is_missing( index ) )
+    {
+        return std::numeric_limits<float>::quiet_NaN( );
+    }
+
+    return ( m_het[ index ] + 2.0f * m_hom[ index ] ) / SCALE;
+}
+
+snp_row
+dosage_row::hard_call(float call_rate) const
+{
+    snp_row row;
+    row.resize( size( ) );
+    for(size_t i = 0; i < size( ); i++)
+    {
+        if( is_missing( i ) )
+        {
+            row.assign( i, 3 );
+            continue;
+        }
+
+        double p[ 3 ];
+        probabilities( i, p );
+        unsigned char best = std::max_element( p, p + 3 ) - p;
+        row.assign( i, p[ best ] > call_rate ? best : 3 );
+    }
+
+    return row;
+}
+
+const unsigned short *
+dosage_row::het_data() const
+{
+    return &m_het[ 0 ];
+}
+
+const unsigned short *
+dosage_row::hom_data() const
+{
+    return &m_hom[ 0 ];
+}
@@ -0,0 +1,123 @@
+#ifndef __DOSAGE_ROW_H__
+#define __DOSAGE_ROW_H__
+
+#include <string>
+#include <vector>
+
+#include <plink/snp_row.hpp>
+
+/**
+ * Genotype probabilities of a single imputed variant. For each sample
+ * the probabilities of one and two copies of the second allele are
+ * quantised to 16 bits, the probability of zero copies is implied.
+ * The quantised values are stored in two plain arrays, so that loops
+ * over the samples can be vectorised.
+ */
+class dosage_row
+{
+public:
+    /**
+     * Quantised value that marks a missing sample.
+     */
+    static const unsigned short MISSING = 0xffff;
+
+    /**
+     * Quantised value that corresponds to a probability of 1.
+     */
+    static const unsigned short SCALE = 0xfffe;
+
+    /**
+     * Constructor.
+     */
+    dosage_row();
+
+    /**
+     * Resizes the row, all samples are set to missing.
+     *
+     * @param new_size The new size of the row.
+     */
+    void resize(size_t new_size);
+
+    /**
+     * Returns the length of the row.
+     *
+     * @return The length of the row.
+     */
+    size_t size() const;
+
+    /**
+     * Sets the genotype probabilities of a sample.
+     *
+     * @param index Index of the sample.
+     * @param p_het Probability of one copy of the second allele.
+     * @param p_hom Probability of two copies of the second allele.
+     */
+    void assign(size_t index, float p_het, float p_hom);
+
+    /**
+     * Sets the quantised genotype probabilities of a sample.
+     *
+     * @param index Index of the sample.
+     * @param het Quantised probability of one copy, or MISSING.
+     * @param hom Quantised probability of two copies.
+     */
+    void assign_quantised(size_t index, unsigned short het, unsigned short hom);
+
+    /**
+     * Returns true if the probabilities of the sample are missing.
+     *
+     * @param index Index of the sample.
+     */
+    bool is_missing(size_t index) const;
+
+    /**
+     * Writes the probability of 0, 1 and 2 copies of the
+     * second allele.
+     *
+     * @param index Index of the sample.
+     * @param p Array of length 3 where the probabilities will be written.
+     */
+    void probabilities(size_t index, double *p) const;
+
+    /**
+     * Returns the expected number of copies of the second allele.
+     *
+     * @param index Index of the sample.
+     *
+     * @return The dosage, or NaN if the sample is missing.
+     */
+    float dosage(size_t index) const;
+
+    /**
+     * Returns the most probable genotype of each sample if its
+     * probability is above the call rate, otherwise missing.
+     *
+     * @param call_rate Threshold for calling a genotype.
+     *
+     * @return The hard called genotypes.
+     */
+    snp_row hard_call(float call_rate) const;
+
+    /**
+     * Returns the quantised probabilities of one copy.
+     */
+    const unsigned short *het_data() const;
+
+    /**
+     * Returns the quantised probabilities of two copies.
+     */
+    const unsigned short *hom_data() const;
+
+private:
+    /**
+     * Quantised probabilities of one copy, MISSING for missing samples.
+     */
+    std::vector<unsigned short> m_het;
+
+    /**
+     * Quantised probabilities of two copies.
+     */
+    std::vector<unsigned short> m_hom;
+};
+
+#endif /* End of __DOSAGE_ROW_H__ */
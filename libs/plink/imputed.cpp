@@ -1,65 +1,391 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <fstream>
+#include <limits>
 #include <sstream>
 
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <gzstream/gzutil.hpp>
 #include <plink/snp_row.hpp>
 #include <plink/imputed.hpp>
 
-imputed_matrix_ptr
-parse_genotypes(const std::string &path, float call_rate, const std::vector<std::string> &samples)
+/**
+ * Powers of ten used when parsing floats.
+ */
+static const double POW10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+                                1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18 };
+
+/**
+ * Skips whitespace and one token.
+ *
+ * @param p Position in a null terminated line.
+ *
+ * @return The position after the token.
+ */
+static inline const char *
+skip_token(const char *p)
 {
-    std::ifstream stream( path.c_str( ) );
-    std::string line;
-    
-    int num_rows = 0;
-    imputed_matrix_ptr matrix( new std::vector<snp_row>( ) );
-    while( std::getline( stream, line ) )
+    while( *p == ' ' || *p == '\t' )
     {
-        std::string tmp;
-        std::string name;
-        unsigned long long pos;
-        std::string a1;
-        std::string a2;
-        float p_AA;
-        float p_Aa;
-        float p_aa;
+        p++;
+    }
+    while( *p != '\0' && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r' )
+    {
+        p++;
+    }
+    return p;
+}
 
-        std::istringstream line_stream( line );
+/**
+ * Parses a float in decimal or scientific notation, this is much
+ * faster than streams since impute2 files only contain plain numbers.
+ *
+ * @param p Position in a null terminated line, will be moved past the number.
+ * @param value The parsed value.
+ *
+ * @return True if a number could be parsed, false otherwise.
+ */
+static inline bool
+parse_float(const char *&p, float &value)
+{
+    while( *p == ' ' || *p == '\t' )
+    {
+        p++;
+    }
 
-        line_stream >> tmp;
-        line_stream >> name;
-        line_stream >> pos;
-        line_stream >> a1;
-        line_stream >> a2;
+    bool negative = false;
+    if( *p == '-' || *p == '+' )
+    {
+        negative = *p == '-';
+        p++;
+    }
 
-        snp_row row;
-        row.resize( samples.size( ) );
-        int i = 0;
-        while( (line_stream >> p_AA) && (line_stream >> p_Aa) && (line_stream >> p_aa) && i < samples.size( ) )
+    const char *start = p;
+    double mantissa = 0.0;
+    while( *p >= '0' && *p <= '9' )
+    {
+        mantissa = mantissa * 10.0 + ( *p - '0' );
+        p++;
+    }
+    int exponent = 0;
+    if( *p == '.' )
+    {
+        p++;
+        while( *p >= '0' && *p <= '9' )
         {
-            if( p_AA > p_Aa && p_AA > p_aa && p_AA > call_rate )
+            if( exponent > -18 )
             {
-                row.assign( i,  0 );
+                mantissa = mantissa * 10.0 + ( *p - '0' );
+                exponent--;
             }
-            else if( p_Aa > p_AA && p_Aa > p_aa && p_Aa > call_rate )
+            p++;
+        }
+    }
+    if( p == start || ( p == start + 1 && *start == '.' ) )
+    {
+        return false;
+    }
+
+    if( *p == 'e' || *p == 'E' )
+    {
+        p++;
+        bool negative_exponent = false;
+        if( *p == '-' || *p == '+' )
+        {
+            negative_exponent = *p == '-';
+            p++;
+        }
+        int e = 0;
+        while( *p >= '0' && *p <= '9' )
+        {
+            e = e * 10 + ( *p - '0' );
+            p++;
+        }
+        exponent += negative_exponent ? -e : e;
+    }
+
+    double result = mantissa;
+    if( exponent < 0 )
+    {
+        result = exponent >= -18 ? result / POW10[ -exponent ] : result * pow( 10.0, exponent );
+    }
+    else if( exponent > 0 )
+    {
+        result = exponent <= 18 ? result * POW10[ exponent ] : result * pow( 10.0, exponent );
+    }
+
+    value = negative ? -result : result;
+    return true;
+}
+
+/**
+ * Returns the most probable genotype if its probability is
+ * above the call rate, otherwise missing.
+ *
+ * @param p_AA Probability of zero copies of the second allele.
+ * @param p_Aa Probability of one copy of the second allele.
+ * @param p_aa Probability of two copies of the second allele.
+ * @param call_rate Threshold for calling a genotype.
+ *
+ * @return The called genotype, or 3 if missing.
+ */
+static inline unsigned char
+call_genotype(float p_AA, float p_Aa, float p_aa, float call_rate)
+{
+    if( p_AA > p_Aa && p_AA > p_aa && p_AA > call_rate )
+    {
+        return 0;
+    }
+    else if( p_Aa > p_AA && p_Aa > p_aa && p_Aa > call_rate )
+    {
+        return 1;
+    }
+    else if( p_aa > p_AA && p_aa > p_Aa && p_aa > call_rate )
+    {
+        return 2;
+    }
+    else
+    {
+        return 3;
+    }
+}
+
+/**
+ * Parses a single line of an impute2 .gen file.
+ *
+ * @param line The null terminated line.
+ * @param call_rate Threshold for calling a genotype.
+ * @param num_samples The number of samples.
+ * @param row The hard called genotypes will be stored here, may be NULL.
+ * @param dosage The genotype probabilities will be stored here, may be NULL.
+ */
+static void
+parse_gen_line(const char *line, float call_rate, size_t num_samples, snp_row *row, dosage_row *dosage)
+{
+    if( row != NULL )
+    {
+        row->resize( num_samples );
+    }
+    if( dosage != NULL )
+    {
+        dosage->resize( num_samples );
+    }
+
+    /* Chromosome or snp id, name, position and the two alleles */
+    const char *p = line;
+    for(int i = 0; i < 5; i++)
+    {
+        p = skip_token( p );
+    }
+
+    size_t i = 0;
+    float p_AA;
+    float p_Aa;
+    float p_aa;
+    while( i < num_samples && parse_float( p, p_AA ) && parse_float( p, p_Aa ) && parse_float( p, p_aa ) )
+    {
+        if( row != NULL )
+        {
+            row->assign( i, call_genotype( p_AA, p_Aa, p_aa, call_rate ) );
+        }
+
+        float total = p_AA + p_Aa + p_aa;
+        if( dosage != NULL && total > 0.0f )
+        {
+            dosage->assign( i, p_Aa / total, p_aa / total );
+        }
+        i++;
+    }
+
+    if( row != NULL )
+    {
+        for( ; i < num_samples; i++)
+        {
+            row->assign( i, 3 );
+        }
+    }
+}
+
+/**
+ * Parses lines of an impute2 .gen file in parallel.
+ *
+ * @param lines The lines to parse.
+ * @param call_rate Threshold for calling a genotype.
+ * @param num_samples The number of samples.
+ * @param genotypes The hard called genotypes will be stored here, may be NULL.
+ * @param dosages The genotype probabilities will be stored here, may be NULL.
+ * @param num_threads The number of threads to parse the lines with.
+ */
+static void
+parse_gen_lines(const std::vector<std::string> &lines, float call_rate, size_t num_samples,
+                std::vector<snp_row> *genotypes, std::vector<dosage_row> *dosages, int num_threads)
+{
+    if( genotypes != NULL )
+    {
+        genotypes->resize( lines.size( ) );
+    }
+    if( dosages != NULL )
+    {
+        dosages->resize( lines.size( ) );
+    }
+
+    #pragma omp parallel for num_threads( num_threads ) schedule( dynamic, 16 )
+    for(int i = 0; i < (int) lines.size( ); i++)
+    {
+        snp_row *row = genotypes != NULL ? &(*genotypes)[ i ] : NULL;
+        dosage_row *dosage = dosages != NULL ? &(*dosages)[ i ] : NULL;
+        parse_gen_line( lines[ i ].c_str( ), call_rate, num_samples, row, dosage );
+    }
+}
+
+std::string
+imputed_gen_path(const std::string &prefix)
+{
+    struct stat file_stat;
+    if( stat( prefix.c_str( ), &file_stat ) != 0 && stat( ( prefix + ".gz" ).c_str( ), &file_stat ) == 0 )
+    {
+        return prefix + ".gz";
+    }
+
+    return prefix;
+}
+
+/**
+ * Scans an uncompressed .gen file for the start of each line.
+ *
+ * @param path Path to the genotype file.
+ *
+ * @return The line offsets followed by the file size.
+ */
+static std::vector<unsigned long long>
+build_gen_index(const std::string &path)
+{
+    std::ifstream stream( path.c_str( ), std::ios::binary );
+    std::vector<unsigned long long> offsets;
+
+    std::vector<char> buffer( 1 << 20 );
+    unsigned long long pos = 0;
+    bool line_start = true;
+    while( stream.read( &buffer[ 0 ], buffer.size( ) ) || stream.gcount( ) > 0 )
+    {
+        size_t num_read = stream.gcount( );
+        for(size_t i = 0; i < num_read; i++)
+        {
+            if( line_start )
             {
-                row.assign( i,  1 );
+                offsets.push_back( pos + i );
+                line_start = false;
             }
-            else if( p_aa > p_AA && p_aa > p_Aa && p_aa > call_rate )
+            if( buffer[ i ] == '\n' )
             {
-                row.assign( i,  2 );
+                line_start = true;
             }
-            else
+        }
+        pos += num_read;
+    }
+    offsets.push_back( pos );
+
+    return offsets;
+}
+
+std::vector<unsigned long long>
+read_gen_index(const std::string &path)
+{
+    struct stat file_stat;
+    if( stat( path.c_str( ), &file_stat ) != 0 )
+    {
+        return std::vector<unsigned long long>( 1, 0 );
+    }
+    unsigned long long file_size = file_stat.st_size;
+    unsigned long long file_mtime = file_stat.st_mtime;
+
+    /* The sidecar starts with the size and modification time of the indexed file and the number of offsets */
+    std::string index_path = path + ".idx";
+    std::ifstream index_stream( index_path.c_str( ), std::ios::binary );
+    unsigned long long header[ 3 ] = { 0, 0, 0 };
+    if( index_stream.read( (char *) header, sizeof( header ) ) &&
+        header[ 0 ] == file_size && header[ 1 ] == file_mtime && header[ 2 ] > 0 && header[ 2 ] <= file_size + 1 )
+    {
+        std::vector<unsigned long long> offsets( header[ 2 ] );
+        if( index_stream.read( (char *) &offsets[ 0 ], offsets.size( ) * sizeof( unsigned long long ) ) &&
+            offsets.back( ) == file_size )
+        {
+            return offsets;
+        }
+    }
+    index_stream.close( );
+
+    std::vector<unsigned long long> offsets = build_gen_index( path );
+
+    /* Write to a temporary file that is renamed, so that concurrent jobs never read a partial index */
+    std::ostringstream tmp_path;
+    tmp_path << index_path << "." << getpid( ) << ".tmp";
+    std::ofstream output( tmp_path.str( ).c_str( ), std::ios::binary );
+    if( !output.is_open( ) )
+    {
+        /* Not being able to write the index is not an error */
+        return offsets;
+    }
+
+    header[ 0 ] = file_size;
+    header[ 1 ] = file_mtime;
+    header[ 2 ] = offsets.size( );
+    output.write( (const char *) header, sizeof( header ) );
+    output.write( (const char *) &offsets[ 0 ], offsets.size( ) * sizeof( unsigned long long ) );
+    output.close( );
+    if( output.fail( ) || rename( tmp_path.str( ).c_str( ), index_path.c_str( ) ) != 0 )
+    {
+        unlink( tmp_path.str( ).c_str( ) );
+    }
+
+    return offsets;
+}
+
+void
+parse_genotypes(const std::string &path, float call_rate, size_t num_samples, size_t first, size_t last,
+                std::vector<snp_row> *genotypes, std::vector<dosage_row> *dosages, int num_threads)
+{
+    std::vector<std::string> lines;
+    if( ends_with( path, ".gz" ) )
+    {
+        /* Compressed files can not be seeked, skip lines without parsing them */
+        shared_ptr<std::istream> stream = open_possible_gz( path );
+        std::string line;
+        for(size_t i = 0; i < last && std::getline( *stream, line ); i++)
+        {
+            if( i >= first )
             {
-                row.assign( i,  3 );
+                lines.push_back( line );
             }
-            i++;
         }
+    }
+    else
+    {
+        std::vector<unsigned long long> offsets = read_gen_index( path );
+        size_t num_lines = offsets.size( ) - 1;
+        last = std::min( last, num_lines );
+        if( first < last )
+        {
+            std::ifstream stream( path.c_str( ), std::ios::binary );
+            std::string chunk( offsets[ last ] - offsets[ first ], '\0' );
+            stream.seekg( offsets[ first ] );
+            stream.read( &chunk[ 0 ], chunk.size( ) );
 
-        matrix->push_back( row );
+            for(size_t i = first; i < last; i++)
+            {
+                size_t start = offsets[ i ] - offsets[ first ];
+                size_t end = offsets[ i + 1 ] - offsets[ first ];
+                lines.push_back( chunk.substr( start, end - start ) );
+            }
+        }
     }
 
-    return matrix;
+    parse_gen_lines( lines, call_rate, num_samples, genotypes, dosages, num_threads );
 }
 
 std::vector<std::string>
@@ -117,14 +443,401 @@ parse_info(const std::string &path)
     return info_list;
 }
 
+/**
+ * Identifies a binary imputed cache, the last character is the version.
+ */
+static const char CACHE_MAGIC[ 8 ] = { 'B', 'E', 'S', 'I', 'Q', 'I', 'C', '3' };
+
+std::string
+imputed_cache_path(const std::string &prefix)
+{
+    return prefix + ".bcache";
+}
+
+/**
+ * Returns the size of the record of a single variant in the cache,
+ * 2 bits per hard call followed by the 16-bit quantised probabilities
+ * of one and two copies for each sample, see dosage_row.
+ *
+ * @param num_samples The number of samples.
+ *
+ * @return The size of a record in bytes.
+ */
+static size_t
+cache_record_size(size_t num_samples)
+{
+    return ( num_samples + 3 ) / 4 + 4 * num_samples;
+}
+
+/**
+ * Returns the modification time and size of each file that the cache
+ * is built from, the .gen file followed by the info and sample files.
+ * Both are 0 for a file that does not exist.
+ *
+ * @param prefix The path prefix.
+ * @param status The modification time and size of each file will be stored here.
+ */
+static void
+source_status(const std::string &prefix, unsigned long long *status)
+{
+    std::string paths[ 3 ] = { imputed_gen_path( prefix ), prefix + "_info", prefix + "_samples" };
+    for(int i = 0; i < 3; i++)
+    {
+        struct stat file_stat;
+        if( stat( paths[ i ].c_str( ), &file_stat ) != 0 )
+        {
+            memset( &file_stat, 0, sizeof( struct stat ) );
+        }
+        status[ 2 * i ] = file_stat.st_mtime;
+        status[ 2 * i + 1 ] = file_stat.st_size;
+    }
+}
+
+/**
+ * Writes a length prefixed string.
+ */
+static void
+write_string(std::ostream &stream, const std::string &str)
+{
+    unsigned int length = str.size( );
+    stream.write( (const char *) &length, sizeof( length ) );
+    stream.write( str.c_str( ), length );
+}
+
+/**
+ * Reads a length prefixed string.
+ */
+static bool
+read_string(std::istream &stream, std::string &str)
+{
+    unsigned int length = 0;
+    if( !stream.read( (char *) &length, sizeof( length ) ) )
+    {
+        return false;
+    }
+    str.resize( length );
+    return length == 0 || stream.read( &str[ 0 ], length );
+}
+
+/**
+ * Writes the samples, the variant info and the genotype records of
+ * an impute2 imputation to a cache stream.
+ *
+ * @param stream The cache stream.
+ * @param prefix The path prefix.
+ * @param call_rate Threshold for calling a genotype.
+ * @param num_threads The number of threads to parse the lines with.
+ *
+ * @return True if the cache could be written, false otherwise.
+ */
+static bool
+write_imputed_cache(std::ofstream &stream, const std::string &prefix, float call_rate, int num_threads)
+{
+    /* The status is taken before parsing, so a file that changes meanwhile invalidates the cache */
+    unsigned long long status[ 6 ];
+    source_status( prefix, status );
+    std::vector<imputed_info> info = parse_info( prefix + "_info" );
+    std::vector<std::string> samples = parse_sample( prefix + "_samples" );
+
+    unsigned long long num_samples = samples.size( );
+    unsigned long long num_variants = info.size( );
+    stream.write( CACHE_MAGIC, sizeof( CACHE_MAGIC ) );
+    stream.write( (const char *) &call_rate, sizeof( call_rate ) );
+    stream.write( (const char *) status, sizeof( status ) );
+    stream.write( (const char *) &num_samples, sizeof( num_samples ) );
+    stream.write( (const char *) &num_variants, sizeof( num_variants ) );
+    for(size_t i = 0; i < samples.size( ); i++)
+    {
+        write_string( stream, samples[ i ] );
+    }
+    for(size_t i = 0; i < info.size( ); i++)
+    {
+        write_string( stream, info[ i ].name );
+        stream.write( (const char *) &info[ i ].pos, sizeof( info[ i ].pos ) );
+        stream.write( (const char *) &info[ i ].maf, sizeof( info[ i ].maf ) );
+        stream.write( (const char *) &info[ i ].info, sizeof( info[ i ].info ) );
+    }
+
+    /* Convert the genotypes in blocks to bound the memory */
+    const size_t block_size = 1024;
+    shared_ptr<std::istream> gen_stream = open_possible_gz( imputed_gen_path( prefix ) );
+    std::vector<char> record( cache_record_size( num_samples ) );
+    for(size_t first = 0; first < num_variants && stream.good( ); first += block_size)
+    {
+        std::vector<std::string> lines;
+        std::string line;
+        size_t last = std::min( first + block_size, (size_t) num_variants );
+        while( lines.size( ) < last - first && std::getline( *gen_stream, line ) )
+        {
+            lines.push_back( line );
+        }
+        if( lines.size( ) != last - first )
+        {
+            return false;
+        }
+
+        std::vector<snp_row> genotypes;
+        std::vector<dosage_row> dosages;
+        parse_gen_lines( lines, call_rate, num_samples, &genotypes, &dosages, num_threads );
+
+        for(size_t v = 0; v < genotypes.size( ); v++)
+        {
+            std::fill( record.begin( ), record.end( ), 0 );
+            unsigned char *calls = (unsigned char *) &record[ 0 ];
+            char *het = &record[ ( num_samples + 3 ) / 4 ];
+            char *hom = het + 2 * num_samples;
+            for(size_t i = 0; i < num_samples; i++)
+            {
+                calls[ i / 4 ] |= genotypes[ v ][ i ] << ( 2 * ( i % 4 ) );
+            }
+            memcpy( het, dosages[ v ].het_data( ), 2 * num_samples );
+            memcpy( hom, dosages[ v ].hom_data( ), 2 * num_samples );
+            stream.write( &record[ 0 ], record.size( ) );
+        }
+    }
+
+    stream.close( );
+    return !stream.fail( );
+}
+
+bool
+build_imputed_cache(const std::string &prefix, float call_rate, int num_threads)
+{
+    /* Write to a temporary file that is renamed, so that concurrent jobs never read a partial cache */
+    std::string path = imputed_cache_path( prefix );
+    std::ostringstream tmp_path;
+    tmp_path << path << "." << getpid( ) << ".tmp";
+    std::ofstream stream( tmp_path.str( ).c_str( ), std::ios::binary );
+    if( !stream.is_open( ) )
+    {
+        return false;
+    }
+
+    if( !write_imputed_cache( stream, prefix, call_rate, num_threads ) || rename( tmp_path.str( ).c_str( ), path.c_str( ) ) != 0 )
+    {
+        stream.close( );
+        unlink( tmp_path.str( ).c_str( ) );
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Opens the binary cache of the given prefix, if it is valid for the
+ * given call rate, and reads the samples and variant info.
+ *
+ * @param prefix The path prefix.
+ * @param call_rate Threshold for calling a genotype.
+ * @param stream The stream that will be positioned at the first record.
+ * @param data The samples and info will be stored here.
+ *
+ * @return True if the cache could be used, false otherwise.
+ */
+static bool
+open_imputed_cache(const std::string &prefix, float call_rate, std::ifstream &stream, imputed_data &data)
+{
+    std::string path = imputed_cache_path( prefix );
+    stream.open( path.c_str( ), std::ios::binary );
+    char magic[ sizeof( CACHE_MAGIC ) ];
+    float cache_call_rate;
+    unsigned long long cache_status[ 6 ];
+    unsigned long long status[ 6 ];
+    unsigned long long num_samples;
+    unsigned long long num_variants;
+    if( !stream.read( magic, sizeof( magic ) ) || memcmp( magic, CACHE_MAGIC, sizeof( magic ) ) != 0 ||
+        !stream.read( (char *) &cache_call_rate, sizeof( cache_call_rate ) ) ||
+        !stream.read( (char *) cache_status, sizeof( cache_status ) ) ||
+        !stream.read( (char *) &num_samples, sizeof( num_samples ) ) ||
+        !stream.read( (char *) &num_variants, sizeof( num_variants ) ) )
+    {
+        return false;
+    }
+
+    /* Any change to the .gen, info or sample file since the cache was built invalidates it */
+    source_status( prefix, status );
+    if( memcmp( status, cache_status, sizeof( status ) ) != 0 )
+    {
+        return false;
+    }
+    if( cache_call_rate != call_rate )
+    {
+        std::cerr << "besiq: warning: Ignoring cache '" << path << "' that was built with call rate " << cache_call_rate << "." << std::endl;
+        return false;
+    }
+
+    data.samples.resize( num_samples );
+    for(size_t i = 0; i < num_samples; i++)
+    {
+        if( !read_string( stream, data.samples[ i ] ) )
+        {
+            return false;
+        }
+    }
+
+    data.info.resize( num_variants );
+    for(size_t i = 0; i < num_variants; i++)
+    {
+        imputed_info &info = data.info[ i ];
+        if( !read_string( stream, info.name ) ||
+            !stream.read( (char *) &info.pos, sizeof( info.pos ) ) ||
+            !stream.read( (char *) &info.maf, sizeof( info.maf ) ) ||
+            !stream.read( (char *) &info.info, sizeof( info.info ) ) )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Reads the records of the variants in [first, last) from a cache
+ * opened with open_imputed_cache.
+ *
+ * @param stream The stream positioned at the first record.
+ * @param num_samples The number of samples.
+ * @param first Index of the first variant to read.
+ * @param last Index past the last variant to read.
+ * @param genotypes The hard called genotypes will be stored here, may be NULL.
+ * @param dosages The genotype probabilities will be stored here, may be NULL.
+ *
+ * @return True if the records could be read, false otherwise.
+ */
+static bool
+read_cache_records(std::ifstream &stream, size_t num_samples, size_t first, size_t last,
+                   std::vector<snp_row> *genotypes, std::vector<dosage_row> *dosages)
+{
+    size_t record_size = cache_record_size( num_samples );
+    std::vector<char> records( ( last - first ) * record_size );
+    stream.seekg( first * record_size, std::ios::cur );
+    if( records.size( ) > 0 && !stream.read( &records[ 0 ], records.size( ) ) )
+    {
+        return false;
+    }
+
+    if( genotypes != NULL )
+    {
+        genotypes->resize( last - first );
+    }
+    if( dosages != NULL )
+    {
+        dosages->resize( last - first );
+    }
+
+    for(size_t v = 0; v < last - first; v++)
+    {
+        const unsigned char *calls = (const unsigned char *) &records[ v * record_size ];
+        const char *het = &records[ v * record_size + ( num_samples + 3 ) / 4 ];
+        const char *hom = het + 2 * num_samples;
+
+        if( genotypes != NULL )
+        {
+            snp_row &row = (*genotypes)[ v ];
+            row.resize( num_samples );
+            for(size_t i = 0; i < num_samples; i++)
+            {
+                row.assign( i, ( calls[ i / 4 ] >> ( 2 * ( i % 4 ) ) ) & 0x3 );
+            }
+        }
+
+        if( dosages != NULL )
+        {
+            dosage_row &dosage = (*dosages)[ v ];
+            dosage.resize( num_samples );
+            for(size_t i = 0; i < num_samples; i++)
+            {
+                unsigned short q_het;
+                unsigned short q_hom;
+                memcpy( &q_het, het + 2 * i, sizeof( q_het ) );
+                memcpy( &q_hom, hom + 2 * i, sizeof( q_hom ) );
+                dosage.assign_quantised( i, q_het, q_hom );
+            }
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Allocates the rows of the parsed variants, either the hard calls
+ * or the genotype probabilities.
+ *
+ * @param data The imputed data.
+ * @param use_dosage If true the genotype probabilities are parsed.
+ * @param genotypes Will point to the hard calls, or NULL.
+ * @param dosages Will point to the genotype probabilities, or NULL.
+ */
+static void
+init_rows(imputed_data &data, bool use_dosage, std::vector<snp_row> *&genotypes, std::vector<dosage_row> *&dosages)
+{
+    data.genotypes = imputed_matrix_ptr( new std::vector<snp_row>( ) );
+    data.dosages = dosage_matrix_ptr( new std::vector<dosage_row>( ) );
+    data.first = 0;
+
+    genotypes = use_dosage ? NULL : data.genotypes.get( );
+    dosages = use_dosage ? data.dosages.get( ) : NULL;
+}
+
 imputed_data
-parse_imputed_data(const std::string &prefix, float call_rate)
+parse_imputed_data(const std::string &prefix, float call_rate, bool use_dosage)
 {
     imputed_data data;
+    std::vector<snp_row> *genotypes;
+    std::vector<dosage_row> *dosages;
+    init_rows( data, use_dosage, genotypes, dosages );
+
+    std::ifstream cache;
+    if( open_imputed_cache( prefix, call_rate, cache, data ) &&
+        read_cache_records( cache, data.samples.size( ), 0, data.info.size( ), genotypes, dosages ) )
+    {
+        return data;
+    }
 
     data.info = parse_info( prefix + "_info" );
     data.samples = parse_sample( prefix + "_samples" );
-    data.genotypes = parse_genotypes( prefix, call_rate, data.samples );
-        
+    parse_genotypes( imputed_gen_path( prefix ), call_rate, data.samples.size( ), 0, std::numeric_limits<size_t>::max( ), genotypes, dosages );
+
     return data;
 }
+
+int
+parse_imputed_window(const std::string &prefix, float call_rate, const std::string &variant, int window_size, imputed_data &data, int num_threads, bool use_dosage)
+{
+    std::vector<snp_row> *genotypes;
+    std::vector<dosage_row> *dosages;
+    init_rows( data, use_dosage, genotypes, dosages );
+
+    std::ifstream cache;
+    bool use_cache = open_imputed_cache( prefix, call_rate, cache, data );
+    if( !use_cache )
+    {
+        data.info = parse_info( prefix + "_info" );
+        data.samples = parse_sample( prefix + "_samples" );
+    }
+
+    int index = -1;
+    for(int i = 0; i < data.info.size( ); i++)
+    {
+        if( data.info[ i ].name == variant )
+        {
+            index = i;
+            break;
+        }
+    }
+    if( index == -1 )
+    {
+        return -1;
+    }
+
+    data.first = std::max( index - window_size, 0 );
+    size_t last = std::min( index + window_size, (int) data.info.size( ) );
+    if( use_cache && read_cache_records( cache, data.samples.size( ), data.first, last, genotypes, dosages ) )
+    {
+        return index;
+    }
+
+    parse_genotypes( imputed_gen_path( prefix ), call_rate, data.samples.size( ), data.first, last, genotypes, dosages, num_threads );
+
+    return index;
+}
@@ -4,10 +4,12 @@
 #include <vector>
 #include <string>
 
+#include <plink/dosage_row.hpp>
 #include <plink/snp_row.hpp>
 #include <shared_ptr/shared_ptr.hpp>
 
-typedef shared_ptr<std::vector<snp_row>> imputed_matrix_ptr;
+typedef shared_ptr<std::vector<snp_row> > imputed_matrix_ptr;
+typedef shared_ptr<std::vector<dosage_row> > dosage_matrix_ptr;
 
 struct imputed_info
 {
@@ -35,30 +37,103 @@ struct imputed_info
 struct imputed_data
 {
     /**
-     * Genotypes.
+     * Hard called genotypes of the parsed variants, empty if
+     * the genotype probabilities were parsed instead.
      */
     imputed_matrix_ptr genotypes;
 
+    /**
+     * Genotype probabilities of the parsed variants, empty if
+     * the hard calls were parsed instead.
+     */
+    dosage_matrix_ptr dosages;
+
+    /**
+     * Index in info of the first parsed variant, the genotypes
+     * of variant i are found at genotypes[ i - first ], and
+     * likewise for the dosages.
+     */
+    size_t first;
+
     /**
      * Samples.
      */
     std::vector<std::string> samples;
 
     /**
-     * Variant info.
+     * Variant info for all variants in the file.
      */
     std::vector<imputed_info> info;
 };
 
 /**
- * Parses and hard calls the genotypes from an impute2 .gen file.
+ * Returns the path of the genotype file for the given prefix,
+ * either the prefix itself or the prefix with a .gz suffix.
+ *
+ * @param prefix The path prefix.
+ *
+ * @return The path of the genotype file.
+ */
+std::string imputed_gen_path(const std::string &prefix);
+
+/**
+ * Returns the byte offset of each line in an uncompressed impute2
+ * .gen file, with the size of the file as the last element. The
+ * offsets are stored in a sidecar file path + '.idx', which is
+ * reused as long as the size and modification time of the .gen
+ * file are unchanged.
+ *
+ * @param path Path to the genotype file.
+ *
+ * @return The line offsets.
+ */
+std::vector<unsigned long long> read_gen_index(const std::string &path);
+
+/**
+ * Parses the hard calls or the genotype probabilities from an
+ * impute2 .gen file, only the variants in the range [first, last)
+ * are parsed. The file may be gzipped, in which case the preceding
+ * lines are skipped without parsing, otherwise the lines are found
+ * with the sidecar index.
  *
  * @param path Path to the genotype file.
  * @param call_rate Threshold for calling a genotype.
+ * @param num_samples The number of samples.
+ * @param first Index of the first variant to parse.
+ * @param last Index past the last variant to parse.
+ * @param genotypes The hard called genotypes will be stored here, may be NULL.
+ * @param dosages The genotype probabilities will be stored here, may be NULL.
+ * @param num_threads The number of threads to parse the lines with.
+ */
+void parse_genotypes(const std::string &path, float call_rate, size_t num_samples, size_t first, size_t last,
+                     std::vector<snp_row> *genotypes, std::vector<dosage_row> *dosages, int num_threads = 1);
+
+/**
+ * Returns the path of the binary cache for the given prefix.
+ *
+ * @param prefix The path prefix, see parse_imputed_data.
+ *
+ * @return The path of the cache.
+ */
+std::string imputed_cache_path(const std::string &prefix);
+
+/**
+ * Converts an impute2 imputation into a binary cache that contains
+ * the samples, the variant info, and for each variant the hard calls
+ * and 16-bit quantised genotype probabilities. Each variant has a record of the same
+ * size, so any window can be read with a single seek. The cache is
+ * used by parse_imputed_data and parse_imputed_window when it exists,
+ * the .gen, info and sample files have the same modification times
+ * and sizes as when it was built, and it was built with the same call
+ * rate. The cache is written to a temporary file that is renamed.
  *
- * @return The genotype matrix.
+ * @param prefix The path prefix, see parse_imputed_data.
+ * @param call_rate Threshold for calling a genotype.
+ * @param num_threads The number of threads to parse the lines with.
+ *
+ * @return True if the cache could be written, false otherwise.
  */
-imputed_matrix_ptr parse_genotypes(const std::string &path, float call_rate, const std::vector<std::string> &samples);
+bool build_imputed_cache(const std::string &prefix, float call_rate, int num_threads = 1);
 
 /**
  * Parses the sample file from an impute2 .gen_samples file.
@@ -79,15 +154,36 @@ std::vector<std::string> parse_sample(const std::string &path);
 std::vector<imputed_info> parse_info(const std::string &path);
 
 /**
- * Prases all of the imputed data associated with an impute2 
+ * Prases all of the imputed data associated with an impute2
  * imputation.
  *
  * @param prefix The path prefix, it is assumed that prefix,
  *               prefix + '_sample' and prefix + '_info' exists.
  * @param call_rate Threshold for calling a genotype.
+ * @param use_dosage If true the genotype probabilities are parsed
+ *                   instead of the hard calls.
  *
  * @return Parsed data.
  */
-imputed_data parse_imputed_data(const std::string &prefix, float call_rate);
+imputed_data parse_imputed_data(const std::string &prefix, float call_rate, bool use_dosage = false);
+
+/**
+ * Parses the info and samples of an impute2 imputation, but only
+ * the genotypes of the variants within a window around the given
+ * variant.
+ *
+ * @param prefix The path prefix, see parse_imputed_data.
+ * @param call_rate Threshold for calling a genotype.
+ * @param variant Name of the variant in the center of the window.
+ * @param window_size Number of variants on each side of the variant.
+ * @param data The parsed data will be stored here.
+ * @param num_threads The number of threads to parse the lines with.
+ * @param use_dosage If true the genotype probabilities are parsed
+ *                   instead of the hard calls.
+ *
+ * @return The index of the variant in data.info, or -1 if it could
+ *         not be found.
+ */
+int parse_imputed_window(const std::string &prefix, float call_rate, const std::string &variant, int window_size, imputed_data &data, int num_threads = 1, bool use_dosage = false);
 
 #endif /* __IMPUTED_H__ */
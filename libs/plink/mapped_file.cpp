@@ -0,0 +1,82 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <plink/mapped_file.hpp>
+
+mapped_file::mapped_file(const std::string &path)
+    : m_data( NULL ),
+      m_size( 0 )
+{
+    int fd = open( path.c_str( ), O_RDONLY );
+    if( fd == -1 )
+    {
+        throw std::runtime_error( "mapped_file: Could not open " + path + ": " + strerror( errno ) );
+    }
+
+    struct stat info;
+    if( fstat( fd, &info ) != 0 )
+    {
+        std::string error = strerror( errno );
+        close( fd );
+        throw std::runtime_error( "mapped_file: Could not stat " + path + ": " + error );
+    }
+
+    if( !map( fd, info.st_size ) )
+    {
+        std::string error = strerror( errno );
+        close( fd );
+        throw std::runtime_error( "mapped_file: Could not map " + path + ": " + error );
+    }
+
+    /* The mapping stays valid after the descriptor is closed */
+    close( fd );
+}
+
+mapped_file::mapped_file()
+    : m_data( NULL ),
+      m_size( 0 )
+{
+}
+
+bool
+mapped_file::map(int fd, size_t size)
+{
+    if( size > 0 )
+    {
+        void *data = mmap( NULL, size, PROT_READ, MAP_SHARED, fd, 0 );
+        if( data == MAP_FAILED )
+        {
+            return false;
+        }
+        m_data = (const char *) data;
+    }
+    m_size = size;
+
+    return true;
+}
+
+mapped_file::~mapped_file()
+{
+    if( m_data != NULL )
+    {
+        munmap( (void *) m_data, m_size );
+    }
+}
+
+const char *
+mapped_file::data() const
+{
+    return m_data;
+}
+
+size_t
+mapped_file::size() const
+{
+    return m_size;
+}
@@ -0,0 +1,81 @@
+#ifndef __MAPPED_FILE_H__
+#define __MAPPED_FILE_H__
+
+#include <string>
+
+#include <shared_ptr/shared_ptr.hpp>
+
+/**
+ * A file that is mapped read-only into memory. The pages are shared
+ * with every other process that maps the same file, and are only
+ * read from disk when they are first accessed.
+ */
+class mapped_file
+{
+public:
+    /**
+     * Maps the given file.
+     *
+     * @param path The path to the file.
+     *
+     * @throws std::runtime_error if the file could not be mapped.
+     */
+    mapped_file(const std::string &path);
+
+    /**
+     * Unmaps the file.
+     */
+    virtual ~mapped_file();
+
+    /**
+     * Returns the contents of the file.
+     *
+     * @return the contents of the file.
+     */
+    const char *data() const;
+
+    /**
+     * Returns the size of the file in bytes.
+     *
+     * @return the size of the file in bytes.
+     */
+    size_t size() const;
+
+protected:
+    /**
+     * Constructor for subclasses that map the memory themselves,
+     * see map.
+     */
+    mapped_file();
+
+    /**
+     * Maps an opened file read-only.
+     *
+     * @param fd The file descriptor, it may be closed afterwards.
+     * @param size The number of bytes to map.
+     *
+     * @return True if the file could be mapped, false otherwise.
+     */
+    bool map(int fd, size_t size);
+
+private:
+    /**
+     * Disallow copies, the mapping is owned by this object.
+     */
+    mapped_file(const mapped_file &other);
+    mapped_file &operator=(const mapped_file &other);
+
+    /**
+     * Start of the mapping.
+     */
+    const char *m_data;
+
+    /**
+     * Size of the mapping.
+     */
+    size_t m_size;
+};
+
+typedef shared_ptr<mapped_file> mapped_file_ptr;
+
+#endif /* End of __MAPPED_FILE_H__ */
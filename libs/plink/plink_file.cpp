@@ -147,6 +147,17 @@ genotype_matrix::genotype_matrix(shared_ptr< std::vector<snp_row> > matrix, cons
     }
 }
 
+genotype_matrix::genotype_matrix(shared_ptr< std::vector<snp_row> > matrix, const std::vector<std::string> &snp_names, mapped_file_ptr storage)
+    : m_matrix( matrix ),
+    m_snp_names( snp_names ),
+    m_storage( storage )
+{
+    for(int i = 0; i < snp_names.size( ); i++)
+    {
+        m_snp_to_index[ snp_names[ i ] ] = i;
+    }
+}
+
 snp_row const *
 genotype_matrix::get_row(const std::string &name) const
 {
@@ -166,6 +177,21 @@ genotype_matrix::get_row(size_t index) const
     return (*m_matrix)[ index ];
 }
 
+bool
+genotype_matrix::get_index(const std::string &name, size_t &index) const
+{
+    std::map<std::string, size_t>::const_iterator it = m_snp_to_index.find( name );
+    if( it != m_snp_to_index.end( ) )
+    {
+        index = it->second;
+        return true;
+    }
+    else
+    {
+        return false;
+    }
+}
+
 const std::vector<std::string> &
 genotype_matrix::get_snp_names() const
 {
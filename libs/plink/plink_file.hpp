@@ -7,6 +7,7 @@
 #include <map>
 #include <shared_ptr/shared_ptr.hpp>
 
+#include <plink/mapped_file.hpp>
 #include <plink/snp_row.hpp>
 #include <plinkio/plinkio.h>
 
@@ -129,6 +130,18 @@ public:
      */
     genotype_matrix(shared_ptr< std::vector<snp_row> > matrix, const std::vector<std::string> &snp_names);
 
+    /**
+     * Constructor for rows that refer to genotypes in a mapped file,
+     * see snp_row::wrap.
+     *
+     * @param matrix The genotypes. This class now takes responsibility
+     *               of the matrix.
+     * @param snp_names The name of each variant.
+     * @param storage The file that the rows refer to, it is kept
+     *                mapped as long as the matrix exists.
+     */
+    genotype_matrix(shared_ptr< std::vector<snp_row> > matrix, const std::vector<std::string> &snp_names, mapped_file_ptr storage);
+
     /**
      * Returns the genotypes for the given name.
      *
@@ -148,6 +161,16 @@ public:
      */
     snp_row &get_row(size_t index) const;
 
+    /**
+     * Finds the index of the variant with the given name.
+     *
+     * @param name Name of the variant.
+     * @param index The index will be written here if found.
+     *
+     * @return True if the variant was found, false otherwise.
+     */
+    bool get_index(const std::string &name, size_t &index) const;
+
     /**
      * Returns a list of snp names.
      *
@@ -171,6 +194,11 @@ private:
      */
     std::vector<std::string> m_snp_names;
 
+    /**
+     * The file that the rows refer to, if any.
+     */
+    mapped_file_ptr m_storage;
+
     /**
      * An index mapping snp names to indices.
      */
@@ -0,0 +1,405 @@
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <stdint.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <plink/shared_genotypes.hpp>
+
+/**
+ * Magic number of a genotype segment.
+ */
+static const uint32_t SEGMENT_MAGIC = 0x4f4e4547;
+
+/**
+ * Size of the segment header, the rows start after it.
+ */
+static const size_t SEGMENT_HEADER_SIZE = 64;
+
+/**
+ * Prefix of the segment names.
+ */
+static const std::string SEGMENT_PREFIX = "/besiq-";
+
+/**
+ * The directory where the segments are listed.
+ */
+static const char *SHM_DIR = "/dev/shm";
+
+/**
+ * The number of times to retry if the segment is removed while it
+ * is being opened, or has not been allocated by its creator yet.
+ */
+static const int MAX_ATTEMPTS = 8;
+
+/**
+ * The time in microseconds to wait before the first retry, it is
+ * doubled for every attempt.
+ */
+static const useconds_t RETRY_DELAY = 1000;
+
+/**
+ * Segments that were never allocated are only removed as stale
+ * when they are older than this many seconds, a younger one may
+ * belong to a creator that has not locked it yet.
+ */
+static const time_t UNALLOCATED_AGE = 60;
+
+/**
+ * Header of a genotype segment.
+ */
+struct segment_header
+{
+    uint32_t magic;
+    uint32_t ready;
+    uint64_t num_samples;
+    uint64_t num_variants;
+    uint64_t row_words;
+};
+
+/**
+ * Returns the size of a segment.
+ *
+ * @param num_samples The number of samples.
+ * @param num_variants The number of variants.
+ *
+ * @return The size of the segment in bytes.
+ */
+static size_t
+segment_size(size_t num_samples, size_t num_variants)
+{
+    return SEGMENT_HEADER_SIZE + num_variants * snp_row::num_words( num_samples ) * sizeof( unsigned int );
+}
+
+/**
+ * Reads the header of a segment and checks that the segment has been
+ * allocated by its creator, i.e. the header has been written and the
+ * segment has the full size of the genotypes in the header. Only the
+ * ready flag may change after this.
+ *
+ * @param fd A descriptor of the segment.
+ * @param header The header will be stored here.
+ *
+ * @return True if the segment has been allocated, false if it is
+ *         empty or its creator died before writing the header.
+ */
+static bool
+is_allocated(int fd, segment_header &header)
+{
+    struct stat info;
+    if( pread( fd, &header, sizeof( segment_header ), 0 ) != (ssize_t) sizeof( segment_header ) ||
+        fstat( fd, &info ) != 0 || header.magic != SEGMENT_MAGIC )
+    {
+        return false;
+    }
+
+    return (size_t) info.st_size == segment_size( header.num_samples, header.num_variants );
+}
+
+/**
+ * Removes the name of a segment, but only if the name still refers
+ * to the opened segment and not to one created after it was removed.
+ *
+ * @param name The name of the segment.
+ * @param fd A descriptor of the segment.
+ *
+ * @return True if the name was removed, false otherwise.
+ */
+static bool
+unlink_segment(const std::string &name, int fd)
+{
+    struct stat ours;
+    struct stat current;
+    int current_fd = shm_open( name.c_str( ), O_RDONLY, 0 );
+    if( current_fd == -1 )
+    {
+        return false;
+    }
+
+    bool removed = fstat( fd, &ours ) == 0 && fstat( current_fd, &current ) == 0 &&
+                   ours.st_dev == current.st_dev && ours.st_ino == current.st_ino &&
+                   shm_unlink( name.c_str( ) ) == 0;
+    close( current_fd );
+
+    return removed;
+}
+
+shared_genotypes::shared_genotypes(const std::string &name, plink_file_ptr genotype_file)
+    : m_name( name ),
+      m_fd( -1 )
+{
+    for(int attempt = 0; attempt < MAX_ATTEMPTS; attempt++)
+    {
+        m_fd = shm_open( m_name.c_str( ), O_RDWR | O_CREAT | O_EXCL, 0600 );
+        if( m_fd != -1 )
+        {
+            /* Other processes wait on the shared lock until the genotypes are written */
+            flock( m_fd, LOCK_EX );
+            try
+            {
+                if( !create( genotype_file ) )
+                {
+                    std::string error = strerror( errno );
+                    unlink_segment( m_name, m_fd );
+                    close( m_fd );
+                    throw std::runtime_error( "shared_genotypes: Could not create " + m_name + ": " + error );
+                }
+            }
+            catch(plink_error &e)
+            {
+                unlink_segment( m_name, m_fd );
+                close( m_fd );
+                throw;
+            }
+            flock( m_fd, LOCK_SH );
+
+            return;
+        }
+        else if( errno != EEXIST )
+        {
+            throw std::runtime_error( "shared_genotypes: Could not create " + m_name + ": " + strerror( errno ) );
+        }
+
+        m_fd = shm_open( m_name.c_str( ), O_RDONLY, 0 );
+        if( m_fd == -1 )
+        {
+            if( errno == ENOENT )
+            {
+                continue;
+            }
+            throw std::runtime_error( "shared_genotypes: Could not open " + m_name + ": " + strerror( errno ) );
+        }
+
+        flock( m_fd, LOCK_SH );
+        if( is_ready( genotype_file ) )
+        {
+            struct stat info;
+            if( fstat( m_fd, &info ) == 0 && map( m_fd, info.st_size ) )
+            {
+                return;
+            }
+            std::string error = strerror( errno );
+            close( m_fd );
+            throw std::runtime_error( "shared_genotypes: Could not map " + m_name + ": " + error );
+        }
+
+        segment_header header;
+        if( !is_allocated( m_fd, header ) )
+        {
+            /* The creator has not taken its exclusive lock yet, wait for it instead of removing the segment */
+            close( m_fd );
+            usleep( RETRY_DELAY << attempt );
+            continue;
+        }
+        if( header.ready != 0 )
+        {
+            close( m_fd );
+            throw std::runtime_error( "shared_genotypes: The segment " + m_name + " does not match the plink file." );
+        }
+
+        /* The creator failed after allocating, remove the segment unless someone still uses it */
+        if( flock( m_fd, LOCK_EX | LOCK_NB ) == 0 )
+        {
+            unlink_segment( m_name, m_fd );
+        }
+        close( m_fd );
+    }
+
+    throw std::runtime_error( "shared_genotypes: Could not attach to " + m_name + "." );
+}
+
+bool
+shared_genotypes::create(plink_file_ptr genotype_file)
+{
+    size_t num_samples = genotype_file->get_samples( ).size( );
+    size_t num_variants = genotype_file->get_loci( ).size( );
+    size_t row_words = snp_row::num_words( num_samples );
+    size_t size = segment_size( num_samples, num_variants );
+
+    /* Reserve the memory up front, writing to an unbacked page of a full tmpfs raises SIGBUS */
+    int error = posix_fallocate( m_fd, 0, size );
+    if( error != 0 )
+    {
+        errno = error;
+        return false;
+    }
+
+    void *data = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0 );
+    if( data == MAP_FAILED )
+    {
+        return false;
+    }
+    if( !map( m_fd, size ) )
+    {
+        munmap( data, size );
+        return false;
+    }
+
+    segment_header *header = (segment_header *) data;
+    header->magic = SEGMENT_MAGIC;
+    header->ready = 0;
+    header->num_samples = num_samples;
+    header->num_variants = num_variants;
+    header->row_words = row_words;
+
+    unsigned int *words = (unsigned int *) ( (char *) data + SEGMENT_HEADER_SIZE );
+    snp_row row;
+    size_t num_rows = 0;
+    while( num_rows < num_variants && genotype_file->next_row( row ) )
+    {
+        memcpy( words + num_rows * row_words, row.data( ), row_words * sizeof( unsigned int ) );
+        num_rows++;
+    }
+
+    /* A truncated plink file leaves the segment unready, so it is never attached */
+    header->ready = num_rows == num_variants;
+    munmap( data, size );
+    if( num_rows != num_variants )
+    {
+        throw plink_error( "shared_genotypes: The plink file ended before all genotypes were read into " + m_name + "." );
+    }
+
+    return true;
+}
+
+bool
+shared_genotypes::is_ready(plink_file_ptr genotype_file) const
+{
+    segment_header header;
+    if( pread( m_fd, &header, sizeof( segment_header ), 0 ) != (ssize_t) sizeof( segment_header ) )
+    {
+        return false;
+    }
+
+    struct stat info;
+    size_t num_samples = genotype_file->get_samples( ).size( );
+    size_t num_variants = genotype_file->get_loci( ).size( );
+    return header.magic == SEGMENT_MAGIC && header.ready == 1 &&
+           header.num_samples == num_samples && header.num_variants == num_variants &&
+           fstat( m_fd, &info ) == 0 && (size_t) info.st_size == segment_size( num_samples, num_variants );
+}
+
+shared_genotypes::~shared_genotypes()
+{
+    /* Only the last user gets the exclusive lock, remove the name if it still refers to this segment */
+    if( flock( m_fd, LOCK_EX | LOCK_NB ) == 0 )
+    {
+        unlink_segment( m_name, m_fd );
+    }
+
+    close( m_fd );
+}
+
+size_t
+shared_genotypes::num_variants() const
+{
+    return ( (const segment_header *) data( ) )->num_variants;
+}
+
+const unsigned int *
+shared_genotypes::get_row(size_t index) const
+{
+    const segment_header *header = (const segment_header *) data( );
+    const unsigned int *words = (const unsigned int *) ( data( ) + SEGMENT_HEADER_SIZE );
+
+    return words + index * header->row_words;
+}
+
+std::string
+shared_genotypes_name(const std::string &plink_prefix, bool mafflip)
+{
+    std::string bed_path = plink_prefix + ".bed";
+    char resolved[ PATH_MAX ];
+    if( realpath( bed_path.c_str( ), resolved ) != NULL )
+    {
+        bed_path = resolved;
+    }
+
+    struct stat info;
+    memset( &info, 0, sizeof( struct stat ) );
+    stat( bed_path.c_str( ), &info );
+
+    std::ostringstream key;
+    key << bed_path << "\n" << (long long) info.st_size << "\n" << (long long) info.st_mtime << "\n" << mafflip;
+
+    /* 64-bit FNV-1a, segment names are limited in length */
+    std::string key_str = key.str( );
+    uint64_t hash = 14695981039346656037ULL;
+    for(size_t i = 0; i < key_str.size( ); i++)
+    {
+        hash ^= (unsigned char) key_str[ i ];
+        hash *= 1099511628211ULL;
+    }
+
+    char hex[ 17 ];
+    snprintf( hex, sizeof( hex ), "%016llx", (unsigned long long) hash );
+
+    return SEGMENT_PREFIX + hex;
+}
+
+size_t
+remove_stale_shared_genotypes()
+{
+    DIR *dir = opendir( SHM_DIR );
+    if( dir == NULL )
+    {
+        throw std::runtime_error( std::string( "shared_genotypes: Could not list " ) + SHM_DIR + ": " + strerror( errno ) );
+    }
+
+    size_t num_removed = 0;
+    struct dirent *entry;
+    while( ( entry = readdir( dir ) ) != NULL )
+    {
+        std::string name = std::string( "/" ) + entry->d_name;
+        if( name.compare( 0, SEGMENT_PREFIX.size( ), SEGMENT_PREFIX ) != 0 )
+        {
+            continue;
+        }
+
+        /* Every user holds a shared lock, so the exclusive lock is only granted when there are none */
+        int fd = shm_open( name.c_str( ), O_RDONLY, 0 );
+        if( fd == -1 )
+        {
+            continue;
+        }
+        segment_header header;
+        struct stat info;
+        bool stale = is_allocated( fd, header ) ||
+                     ( fstat( fd, &info ) == 0 && time( NULL ) - info.st_mtime > UNALLOCATED_AGE );
+        if( stale && flock( fd, LOCK_EX | LOCK_NB ) == 0 && unlink_segment( name, fd ) )
+        {
+            num_removed++;
+        }
+        close( fd );
+    }
+    closedir( dir );
+
+    return num_removed;
+}
+
+genotype_matrix_ptr
+create_shared_genotype_matrix(plink_file_ptr genotype_file, const std::string &plink_prefix, bool mafflip)
+{
+    shared_genotypes_ptr segment( new shared_genotypes( shared_genotypes_name( plink_prefix, mafflip ), genotype_file ) );
+
+    size_t num_samples = genotype_file->get_samples( ).size( );
+    shared_ptr< std::vector<snp_row> > rows( new std::vector<snp_row>( segment->num_variants( ) ) );
+    for(size_t i = 0; i < rows->size( ); i++)
+    {
+        ( *rows )[ i ].wrap( segment->get_row( i ), num_samples );
+    }
+
+    return genotype_matrix_ptr( new genotype_matrix( rows, genotype_file->get_locus_names( ), segment ) );
+}
@@ -0,0 +1,149 @@
+#ifndef __SHARED_GENOTYPES_H__
+#define __SHARED_GENOTYPES_H__
+
+#include <string>
+
+#include <plink/mapped_file.hpp>
+#include <plink/plink_file.hpp>
+
+/**
+ * The packed genotypes of a plink file in a named POSIX shared memory
+ * segment. The first process creates the segment and decodes the
+ * genotypes into it, every other process that opens the same plink
+ * file maps the segment read-only, so the genotypes are stored once
+ * per machine.
+ *
+ * Each process that uses the segment holds a shared lock on it, which
+ * acts as a reference count that the kernel releases even if the process
+ * is killed. The last process to detach removes the segment. A segment
+ * whose users all crashed is reused by the next job that opens it, and
+ * removed when that job finishes, or by remove_stale_shared_genotypes.
+ *
+ * A segment is only removed on open once its creator has allocated it
+ * and failed to write it. An empty segment may belong to a creator that
+ * has not taken its lock yet, so the opener waits and tries again.
+ */
+class shared_genotypes
+: public mapped_file
+{
+public:
+    /**
+     * Attaches to the named segment, or creates it from the remaining
+     * rows of the plink file if it does not exist. The rows are only
+     * read if the segment could be allocated.
+     *
+     * @param name The name of the segment.
+     * @param genotype_file The plink file.
+     *
+     * @throws plink_error if the plink file ended before all rows
+     *         were read, the segment is then removed.
+     * @throws std::runtime_error if the segment could not be
+     *         created or attached, e.g. because it stayed empty, in
+     *         which case no rows have been read.
+     */
+    shared_genotypes(const std::string &name, plink_file_ptr genotype_file);
+
+    /**
+     * Detaches from the segment, and removes it if no other
+     * process uses it.
+     */
+    virtual ~shared_genotypes();
+
+    /**
+     * Returns the number of variants.
+     *
+     * @return the number of variants.
+     */
+    size_t num_variants() const;
+
+    /**
+     * Returns the packed genotypes of a variant, see snp_row::wrap.
+     *
+     * @param index Index of the variant.
+     *
+     * @return the packed genotypes.
+     */
+    const unsigned int *get_row(size_t index) const;
+
+private:
+    /**
+     * Creates the segment and decodes the genotypes into it.
+     *
+     * @param genotype_file The plink file.
+     *
+     * @throws plink_error if the plink file ended before all rows were read.
+     *
+     * @return True if the segment was created, false if it could not
+     *         be allocated, in which case no rows have been read.
+     */
+    bool create(plink_file_ptr genotype_file);
+
+    /**
+     * Checks that the opened segment has been completely written
+     * and matches the plink file.
+     *
+     * @param genotype_file The plink file.
+     *
+     * @return True if the segment is ready to be mapped.
+     */
+    bool is_ready(plink_file_ptr genotype_file) const;
+
+    /**
+     * The name of the segment.
+     */
+    std::string m_name;
+
+    /**
+     * The descriptor of the segment, it holds the shared lock.
+     */
+    int m_fd;
+};
+
+typedef shared_ptr<shared_genotypes> shared_genotypes_ptr;
+
+/**
+ * Returns the segment name of the genotypes of a plink file, it is
+ * derived from the path, size and modification time of the .bed file
+ * and the allele coding.
+ *
+ * @param plink_prefix The path to the plink file.
+ * @param mafflip If true the alleles are coded according to the minor allele.
+ *
+ * @return The segment name.
+ */
+std::string shared_genotypes_name(const std::string &plink_prefix, bool mafflip);
+
+/**
+ * Creates a matrix of genotypes that are shared with other processes
+ * that open the same plink file, see shared_genotypes.
+ *
+ * @param genotype_file A plink file, opened with the same mafflip.
+ * @param plink_prefix The path to the plink file.
+ * @param mafflip If true the alleles are coded according to the minor allele.
+ *
+ * @throws plink_error if the plink file ended before all rows were
+ *         read, the rows are then consumed and the plink file can not
+ *         be read again.
+ * @throws std::runtime_error if shared memory could not be used, in
+ *         which case no rows have been read from the plink file.
+ *
+ * @return A matrix of genotypes.
+ */
+genotype_matrix_ptr create_shared_genotype_matrix(plink_file_ptr genotype_file, const std::string &plink_prefix, bool mafflip);
+
+/**
+ * Removes the segments that no process uses, e.g. those left behind
+ * by jobs that were killed. A segment is in use while some process
+ * holds a shared lock on it, so segments of running jobs are kept.
+ *
+ * This is only supported where the segments are listed in /dev/shm,
+ * e.g. on Linux. Segments that were never allocated are only removed
+ * after a minute, since their creator may not have locked them yet.
+ *
+ * @throws std::runtime_error if the segments could not be listed.
+ *
+ * @return The number of removed segments.
+ */
+size_t remove_stale_shared_genotypes();
+
+#endif /* End of __SHARED_GENOTYPES_H__ */
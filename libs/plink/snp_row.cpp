@@ -1,19 +1,85 @@
+#include <algorithm>
+
 #include <plink/snp_row.hpp>
 
+/**
+ * Returns a pointer to the first element of a vector, or NULL if empty.
+ *
+ * @param words A vector.
+ *
+ * @return A pointer to the first element of the vector.
+ */
+static const unsigned int *
+first_word(const std::vector<unsigned int> &words)
+{
+    return words.empty( ) ? NULL : &words[ 0 ];
+}
+
 snp_row::snp_row()
+    : m_size( 0 ),
+      m_data( NULL )
+{
+
+}
+
+snp_row::snp_row(const snp_row &other)
+    : m_size( other.m_size ),
+      m_genotypes( other.m_data, other.m_data + num_words( other.m_size ) ),
+      m_data( first_word( m_genotypes ) )
 {
+}
+
+snp_row &
+snp_row::operator=(const snp_row &other)
+{
+    if( this != &other )
+    {
+        /* Wrapped genotypes are copied as well, since their storage may not outlive the copy */
+        m_size = other.m_size;
+        m_genotypes.assign( other.m_data, other.m_data + num_words( other.m_size ) );
+        m_data = first_word( m_genotypes );
+    }
 
+    return *this;
 }
 
 void
-snp_row::resize(size_t new_size)
+snp_row::wrap(const unsigned int *words, size_t new_size)
+{
+    m_genotypes.clear( );
+    m_size = new_size;
+    m_data = words;
+}
+
+const unsigned int *
+snp_row::data() const
 {
-    unsigned int total_number_of_bits = new_size * 2;
+    return m_data;
+}
+
+size_t
+snp_row::num_words(size_t size)
+{
+    unsigned int total_number_of_bits = size * 2;
     unsigned int bits_per_element = 8 * sizeof( int );
-    unsigned int elements_required = (total_number_of_bits + bits_per_element - 1) / bits_per_element;
+
+    return (total_number_of_bits + bits_per_element - 1) / bits_per_element;
+}
+
+void
+snp_row::resize(size_t new_size)
+{
+    size_t elements_required = num_words( new_size );
+
+    /* Take a copy of external genotypes before they are modified */
+    if( m_data != first_word( m_genotypes ) )
+    {
+        m_genotypes.assign( m_data, m_data + std::min( num_words( m_size ), elements_required ) );
+    }
 
     m_size = new_size;
     m_genotypes.resize( elements_required );
+    m_data = first_word( m_genotypes );
 }
 
 size_t
@@ -28,13 +94,18 @@ snp_row::operator[](size_t index) const
     size_t element = ( index * 2 ) / ( 8 * sizeof( unsigned int ) );
     unsigned int element_index = ( index * 2 ) - element * ( 8 * sizeof( unsigned int ) );
     unsigned int element_mask = 0x3 << element_index;
-    
-    return ( m_genotypes[ element ] & element_mask ) >> element_index;
+
+    return ( m_data[ element ] & element_mask ) >> element_index;
 }
 
 void
 snp_row::assign(size_t index, unsigned char value)
 {
+    if( m_data != first_word( m_genotypes ) )
+    {
+        resize( m_size );
+    }
+
     size_t element = ( index * 2 ) / ( 8 * sizeof( unsigned int ) );
     unsigned int element_index = ( index * 2 ) - element * ( 8 * sizeof( int ) );
     unsigned int element_mask = ~( 0x3 << element_index );
@@ -42,3 +113,9 @@ snp_row::assign(size_t index, unsigned char value)
 
     m_genotypes[ element ] = ( m_genotypes[ element ] & element_mask ) | positioned_value;
 }
+
+bool
+snp_row::operator==(const snp_row &other) const
+{
+    return m_size == other.m_size && std::equal( m_data, m_data + num_words( m_size ), other.m_data );
+}
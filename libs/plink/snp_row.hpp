@@ -12,6 +12,52 @@ public:
      */
     snp_row();
 
+    /**
+     * Copy constructor, the copy always owns its genotypes, so
+     * the genotypes of a wrapped row are copied.
+     *
+     * @param other The row to copy.
+     */
+    snp_row(const snp_row &other);
+
+    /**
+     * Assignment operator, see the copy constructor.
+     *
+     * @param other The row to copy.
+     *
+     * @return This row.
+     */
+    snp_row &operator=(const snp_row &other);
+
+    /**
+     * Makes the row refer to packed genotypes that are owned by
+     * someone else, e.g. a memory mapped file. The genotypes must
+     * outlive the row, and are copied the first time the row is
+     * modified or copied.
+     *
+     * @param words The packed genotypes, in the layout of data( ).
+     * @param new_size The number of genotypes.
+     */
+    void wrap(const unsigned int *words, size_t new_size);
+
+    /**
+     * Returns the packed genotypes, 2 bits per genotype starting
+     * from the least significant bits of each word.
+     *
+     * @return The packed genotypes.
+     */
+    const unsigned int *data() const;
+
+    /**
+     * Returns the number of words needed to store the given
+     * number of genotypes.
+     *
+     * @param size The number of genotypes.
+     *
+     * @return The number of words.
+     */
+    static size_t num_words(size_t size);
+
     /**
      * Resizes the row to be able to hold the given size.
      *
@@ -43,6 +89,16 @@ public:
      */
     void assign(size_t index, unsigned char value);
 
+    /**
+     * Compares two rows, they are equal if they have the
+     * same size and the same genotypes.
+     *
+     * @param other The row to compare with.
+     *
+     * @return True if the rows are equal, false otherwise.
+     */
+    bool operator==(const snp_row &other) const;
+
 private:
     /**
      * Size of the row.
@@ -53,6 +109,12 @@ private:
      * Internal data structure, as a vector.
      */
     std::vector<unsigned int> m_genotypes;
+
+    /**
+     * The genotypes that are read, either m_genotypes or
+     * external genotypes.
+     */
+    const unsigned int *m_data;
 };
 
 #endif /* End of __SNP_ROW_H__ */
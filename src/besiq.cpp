@@ -34,6 +34,7 @@ struct command g_commands[] =
     { "lars", "Run the least angle regression in LASSO mode." },
     { "mglm", "Multivarite additive GLM model." },
     { "meta", "Run a meta-analysis of clean case/control data." },
+    { "prepare", "Preprocess a data set into a bundle used by the other commands." },
     { NULL, NULL }
 };
 
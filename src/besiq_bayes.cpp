@@ -26,6 +26,9 @@ main(int argc, char *argv[])
     group.add_option( "-s", "--num-single" ).type( "int" ).help( "The number of snps to consider when correcting (default: proportional to square of the number of interactions)." );
     group.add_option( "-t", "--single-prior" ).type( "float" ).help( "The probability that a single snp is associated (default: %default)." ).set_default( 0.0 );
     group.add_option( "-i", "--mc-iterations" ).type( "int" ).help( "The number of monte carlo iterations to use in the fine method (default: %default)." ).set_default( 4000000 );
+    char const* const integrators[] = { "mc", "laplace" };
+    group.add_option( "--integrator" ).choices( &integrators[ 0 ], &integrators[ 2 ] ).help( "The integration method of the fine method, 'mc' samples from the prior and 'laplace' uses importance sampling around the posterior mode and stops at the given tolerance (default: %default)." ).set_default( "mc" );
+    group.add_option( "--tolerance" ).type( "float" ).help( "The relative error at which the laplace integrator stops, the number of iterations is at most --mc-iterations (default: %default)." ).set_default( 0.01 );
     group.add_option( "-a", "--beta-prior-param1" ).type( "float" ).help( "First shape parameter of beta prior (default: %default)." ).set_default( 2.0 );
     group.add_option( "-b", "--beta-prior-param2" ).type( "float" ).help( "Second shape parameter of beta prior (default: %default)." ).set_default( 2.0 );
     group.add_option( "-e", "--estimate-prior-params" ).action( "store_true" ).help( "Estimate prior parameters from data by permuting phenotype (default: off)." );
@@ -62,7 +65,12 @@ main(int argc, char *argv[])
     }
     else
     {
-        m = new besiq_fine_method( parsed_data->data, (int) options.get( "mc_iterations" ), alpha );
+        integrator_t integrator = INTEGRATOR_MC;
+        if( options[ "integrator" ] == "laplace" )
+        {
+            integrator = INTEGRATOR_LAPLACE;
+        }
+        m = new besiq_fine_method( parsed_data->data, (int) options.get( "mc_iterations" ), alpha, integrator, (float) options.get( "tolerance" ) );
     }
     
     run_method( *m, parsed_data->genotypes, *parsed_data->pairs, *parsed_data->result_file );
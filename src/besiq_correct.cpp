@@ -162,8 +162,7 @@ main(int argc, char *argv[])
         std::vector<std::string> order = genotype_file->get_sample_iids( );
         if( options.is_set( "pheno" ) )
         {
-            std::ifstream phenotype_file( options[ "pheno" ].c_str( ) );
-            data->phenotype = parse_phenotypes( phenotype_file, data->missing, order, options[ "mpheno" ] );
+            data->phenotype = read_phenotype_file( options[ "pheno" ], data->missing, order, options[ "mpheno" ] );
         }
         else
         {
@@ -11,7 +11,8 @@
 #include <plink/plink_file.hpp>
 #include <besiq/env_method/lm_env_stepwise.hpp>
 #include <besiq/method/method.hpp>
-#include <besiq/method/env_method.hpp>
+#include <besiq/method/single_method.hpp>
+#include <besiq/io/resultfile.hpp>
 
 using namespace arma;
 using namespace optparse;
@@ -40,6 +41,11 @@ main(int argc, char *argv[])
     parser.add_option( "-e", "--levels" ).type( "int" ).help( "The number of levels of the environmental variable." ).set_default( 1 );
     parser.add_option( "-f", "--factor" ).choices( &factor_choices[ 0 ], &factor_choices[ 3 ] ).help( "Determines how to code the SNPs, in 'factor' no order of the alleles is assumed, in 'additive' the SNPs are coded as the number of minor alleles, in 'tukey' the coding is the same as factor except that a single parameter for the interaction is used." ).set_default( "factor" );
     parser.add_option( "-c", "--cov" ).action( "store" ).type( "string" ).metavar( "filename" ).help( "Performs the analysis by including the covariates in this file." );
+    parser.add_option( "-o", "--out" ).help( "The output file that will contain the results (binary)." );
+    parser.add_option( "--threshold" ).help( "Only output variants with an interaction p-value less than this." ).set_default( -9 );
+    parser.add_option( "--split" ).help( "Runs the analysis on a part of the variants, and this is part X of 1-<num_splits> parts (default = 1)." ).set_default( 1 );
+    parser.add_option( "--num-splits" ).help( "Sets the number of parts to split the variants in (default = 1)." ).set_default( 1 );
+    parser.add_option( "-t", "--threads" ).type( "int" ).help( "Number of threads used to test the variants (default = 1)." ).set_default( 1 );
     
     Values options = parser.parse_args( argc, argv );
     std::vector<std::string> args = parser.args( );
@@ -55,6 +61,16 @@ main(int argc, char *argv[])
         exit( 1 );
     }
 
+    size_t split = (size_t) options.get( "split" );
+    size_t num_splits = (size_t) options.get( "num_splits" );
+    if( split > num_splits || split == 0 || num_splits == 0 )
+    {
+        std::cerr << "besiq: error: Num splits and split must be > 0, and split <= num_splits." << std::endl;
+        exit( 1 );
+    }
+
+    std::ios_base::sync_with_stdio( false );
+
     /* Read all genotypes */
     plink_file_ptr genotype_file = open_plink_file( args[ 1 ] );
     genotype_matrix_ptr genotypes = create_genotype_matrix( genotype_file );
@@ -62,12 +78,12 @@ main(int argc, char *argv[])
  
     /* Read additional data  */
     method_data_ptr data( new method_data( ) );
+    data->threshold = (double) options.get( "threshold" );
     data->missing = zeros<uvec>( genotype_file->get_samples( ).size( ) );
     std::vector<std::string> order = genotype_file->get_sample_iids( );
     if( options.is_set( "pheno" ) )
     {
-        std::ifstream phenotype_file( options[ "pheno" ].c_str( ) );
-        data->phenotype = parse_phenotypes( phenotype_file, data->missing, order, options[ "mpheno" ] );
+        data->phenotype = read_phenotype_file( options[ "pheno" ], data->missing, order, options[ "mpheno" ] );
     }
     else
     {
@@ -77,8 +93,7 @@ main(int argc, char *argv[])
     /* Read covariates */
     if( options.is_set( "cov" ) )
     {
-        std::ifstream covariate_file( options[ "cov" ].c_str( ) );
-        data->covariate_matrix = parse_covariate_matrix( covariate_file, data->missing, order );
+        data->covariate_matrix = read_covariate_file( options[ "cov" ], data->missing, order );
     }
 
     /* Read environment factor */
@@ -89,6 +104,22 @@ main(int argc, char *argv[])
     std::ostream nullstream( 0 );
     arma::set_stream_err2( nullstream );
 
+    /* Open results. */
+    resultfile *result_file = NULL;
+    if( options.is_set( "out" ) )
+    {
+        result_file = new bresultfile( options[ "out" ], locus_names );
+    }
+    else
+    {
+        result_file = new tresultfile( "-", "w" );
+    }
+    if( result_file == NULL || !result_file->open( ) )
+    {
+        std::cerr << "besiq: error: Can not open result file." << std::endl;
+        exit( 1 );
+    }
+
     if( options[ "method" ] == "stepwise" )
     {
         if( E.n_cols > 1 )
@@ -98,8 +129,11 @@ main(int argc, char *argv[])
         }
 
         lm_env_stepwise stepwise_env( data, E );
-        run_env_method( stepwise_env, genotypes );
+        run_single_method( stepwise_env, genotypes, *result_file, split, num_splits, (int) options.get( "threads" ) );
     }
 
+    result_file->close( );
+    delete result_file;
+
     return 0;
 }
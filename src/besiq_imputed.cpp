@@ -1,5 +1,10 @@
+#include <algorithm>
 #include <iostream>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include <armadillo>
 
 #include <glm/models/binomial.hpp>
@@ -20,16 +25,39 @@ const std::string DESCRIPTION = "Computes p-values for imputed data";
 const std::string VERSION = "besiq 0.0.1";
 const std::string EPILOG = "";
 
-ssize_t find_variant_index(const std::vector<imputed_info> &info, const std::string &name)
+/**
+ * Returns the number of variants that were parsed in a window.
+ *
+ * @param data The parsed window.
+ * @param use_dosage Whether the genotype probabilities were parsed.
+ *
+ * @return The number of parsed variants.
+ */
+size_t
+num_parsed(const imputed_data &data, bool use_dosage)
 {
-    for(int i = 0; i < info.size( ); i++)
+    return use_dosage ? data.dosages->size( ) : data.genotypes->size( );
+}
+
+/**
+ * Computes the minor allele frequency of each parsed variant in a
+ * window, from the genotypes that will be tested.
+ *
+ * @param data The parsed window.
+ * @param use_dosage Whether the genotype probabilities were parsed.
+ *
+ * @return The minor allele frequency of each parsed variant.
+ */
+std::vector<float>
+window_maf(const imputed_data &data, bool use_dosage)
+{
+    std::vector<float> maf( num_parsed( data, use_dosage ) );
+    for(size_t i = 0; i < maf.size( ); i++)
     {
-        if( name == info[ i ].name )
-        {
-            return i;
-        }
+        maf[ i ] = use_dosage ? compute_real_maf( (*data.dosages)[ i ] ) : compute_real_maf( (*data.genotypes)[ i ] );
     }
-    return -1;
+
+    return maf;
 }
 
 int
@@ -51,8 +79,24 @@ main(int argc, char *argv[])
     parser.add_option( "-o", "--out" ).help( "The output file that will contain the results (binary)." );
     parser.add_option( "-m", "--model" ).choices( &model_choices[ 0 ], &model_choices[ 2 ] ).metavar( "model" ).help( "The model to use for the phenotype, 'binomial' or 'normal', default = 'binomial'." ).set_default( "binomial" );
     parser.add_option( "--call" ).help( "Call rate for hard calls (default = 0.8)." ).set_default( 0.8 );
+    parser.add_option( "--dosage" ).action( "store_true" ).help( "Test the genotype probabilities instead of the hard calls." );
+    parser.add_option( "--build-cache" ).action( "store_true" ).help( "Convert the given impute2 files into binary caches that are used instead of the text files in later runs, and exit." );
+    parser.add_option( "-t", "--threads" ).type( "int" ).help( "Number of threads used to parse the genotype files and test the pairs (default = 1)." ).set_default( 1 );
 
     Values options = parser.parse_args( argc, argv );
+    if( options.is_set( "build_cache" ) && parser.args( ).size( ) > 0 )
+    {
+        for(int i = 0; i < parser.args( ).size( ); i++)
+        {
+            const std::string &prefix = parser.args( )[ i ];
+            if( !build_imputed_cache( prefix, (float) options.get( "call" ), (int) options.get( "threads" ) ) )
+            {
+                std::cerr << "besiq-imputed: error: Could not build cache '" << imputed_cache_path( prefix ) << "'." << std::endl;
+                exit( 1 );
+            }
+        }
+        return 0;
+    }
     if( parser.args( ).size( ) != 3 )
     {
         parser.print_help( );
@@ -64,26 +108,27 @@ main(int argc, char *argv[])
     int window_size = (int) options.get( "window" );
     float info_threshold = (float) options.get( "info" );
     float maf_threshold = (float) options.get( "maf" );
+    int num_threads = (int) options.get( "threads" );
+    bool use_dosage = options.is_set( "dosage" );
 
+    /* Only the genotypes within the windows are parsed */
     method_data_ptr data( new method_data( ) );
-    imputed_data imputed1 = parse_imputed_data( parser.args( )[ 0 ], call_rate );
-    imputed_data imputed2 = parse_imputed_data( parser.args( )[ 1 ], call_rate );
+    imputed_data imputed1;
+    imputed_data imputed2;
+    int variant1 = parse_imputed_window( parser.args( )[ 0 ], call_rate, options[ "snp1" ], window_size, imputed1, num_threads, use_dosage );
+    int variant2 = parse_imputed_window( parser.args( )[ 1 ], call_rate, options[ "snp2" ], window_size, imputed2, num_threads, use_dosage );
     data->missing = arma::zeros<arma::uvec>( imputed1.samples.size( ) );
-    
-    int variant1 = find_variant_index( imputed1.info, options[ "snp1" ] );
-    int variant2 = find_variant_index( imputed2.info, options[ "snp2" ] );
+
     if( variant1 == -1 || variant2 == -1 )
     {
         std::cerr << "besiq-imputed: error: Could not find the specified variants: '" << options[ "snp1" ] << "' or '" << options[ "snp2" ] << "'\n";
         exit( 1 );
     }
 
-    std::ifstream pheno_file( parser.args( )[ 2 ] );
-    data->phenotype = parse_phenotypes( pheno_file, data->missing, imputed1.samples, options[ "mpheno" ] );
+    data->phenotype = read_phenotype_file( parser.args( )[ 2 ], data->missing, imputed1.samples, options[ "mpheno" ] );
     if( options.is_set( "cov" ) )
     {
-        std::ifstream covariate_file( options[ "cov" ].c_str( ) );
-        data->covariate_matrix = parse_covariate_matrix( covariate_file, data->missing, imputed1.samples );
+        data->covariate_matrix = read_covariate_file( options[ "cov" ], data->missing, imputed1.samples );
     }
     
     /* XXX: Implement proper log file. */
@@ -106,18 +151,22 @@ main(int argc, char *argv[])
         exit( 1 );
     }
     
-    model_matrix *model_matrix = make_model_matrix( "factor", data->covariate_matrix, data->phenotype.n_elem );
-    method_type *m = NULL;
-    if( options[ "model" ] == "binomial" )
-    {
-        m = new scaleinv_method( data, *model_matrix, false );
-    }
-    else if( options[ "model" ] == "normal" )
+    /*
+     * Each thread has its own method and model matrix. They are created
+     * before the threads start, because the reference count of the shared
+     * data pointer is not thread safe.
+     */
+    bool is_lm = options[ "model" ] == "normal";
+    num_threads = std::max( num_threads, 1 );
+    std::vector<model_matrix *> thread_matrix( num_threads );
+    std::vector<method_type *> thread_method( num_threads );
+    for(int t = 0; t < num_threads; t++)
     {
-        m = new scaleinv_method( data, *model_matrix, true );
+        thread_matrix[ t ] = make_model_matrix( "factor", data->covariate_matrix, data->phenotype.n_elem );
+        thread_method[ t ] = new scaleinv_method( data, *thread_matrix[ t ], is_lm );
     }
 
-    std::vector<std::string> method_header = m->init( );
+    std::vector<std::string> method_header = thread_method[ 0 ]->init( );
     size_t method_size = method_header.size( );
     method_header.push_back( "maf1" );
     method_header.push_back( "maf2" );
@@ -125,50 +174,102 @@ main(int argc, char *argv[])
     method_header.push_back( "info2" );
     method_header.push_back( "N" );
     result_file->set_header( method_header );
+    size_t num_columns = method_header.size( );
 
-    float *output = new float[ method_header.size( ) ];
-
-    int v1_start = std::max( variant1 - window_size, 0 );
-    int v1_end = std::min( variant1 + window_size, (int) imputed1.genotypes->size( ) );
-    int v2_start = std::max( variant2 - window_size, 0 );
-    int v2_end = std::min( variant2 + window_size, (int) imputed2.genotypes->size( ) );
+    int v1_start = imputed1.first;
+    int v1_end = imputed1.first + num_parsed( imputed1, use_dosage );
+    int v2_start = imputed2.first;
+    int v2_end = imputed2.first + num_parsed( imputed2, use_dosage );
 
+    /* Allele frequencies and filters are computed once for each window */
+    std::vector<float> maf1 = window_maf( imputed1, use_dosage );
+    std::vector<int> passed1;
     for(int i = v1_start; i < v1_end; i++)
     {
-        for(int j = v2_start; j < v2_end; j++)
+        if( maf1[ i - v1_start ] > maf_threshold && imputed1.info[ i ].info > info_threshold )
+        {
+            passed1.push_back( i );
+        }
+    }
+    std::vector<float> maf2 = window_maf( imputed2, use_dosage );
+    std::vector<int> passed2;
+    for(int j = v2_start; j < v2_end; j++)
+    {
+        if( maf2[ j - v2_start ] > maf_threshold && imputed2.info[ j ].info > info_threshold )
+        {
+            passed2.push_back( j );
+        }
+    }
+
+    /*
+     * The pairs of each variant in the first window are buffered and
+     * written in order.
+     */
+    #pragma omp parallel num_threads( num_threads )
+    {
+#ifdef _OPENMP
+        method_type *method = thread_method[ omp_get_thread_num( ) ];
+#else
+        method_type *method = thread_method[ 0 ];
+#endif
+        std::vector<float> values;
+        std::vector<int> partners;
+
+        #pragma omp for schedule( dynamic, 1 ) ordered
+        for(int a = 0; a < (int) passed1.size( ); a++)
         {
-            if( imputed1.info[ i ].name == imputed2.info[ j ].name )
+            int i = passed1[ a ];
+            values.clear( );
+            partners.clear( );
+            for(int b = 0; b < passed2.size( ); b++)
             {
-                continue;
-            }
+                int j = passed2[ b ];
+                if( imputed1.info[ i ].name == imputed2.info[ j ].name )
+                {
+                    continue;
+                }
 
-            std::fill( output, output + method_header.size( ), result_get_missing( ) );
-        
+                values.resize( values.size( ) + num_columns, result_get_missing( ) );
+                float *output = &values[ values.size( ) - num_columns ];
 
-            float info1 = imputed1.info[ i ].info;
-            float info2 = imputed2.info[ j ].info;
+                if( use_dosage )
+                {
+                    const dosage_row &row1 = (*imputed1.dosages)[ i - v1_start ];
+                    const dosage_row &row2 = (*imputed2.dosages)[ j - v2_start ];
+                    method->run( row1, row2, output );
+                    output[ method_size + 4 ] = method->num_ok_samples( row1, row2 );
+                }
+                else
+                {
+                    const snp_row &row1 = (*imputed1.genotypes)[ i - v1_start ];
+                    const snp_row &row2 = (*imputed2.genotypes)[ j - v2_start ];
+                    method->run( row1, row2, output );
+                    output[ method_size + 4 ] = method->num_ok_samples( row1, row2 );
+                }
 
-            const snp_row &row1 = (*imputed1.genotypes)[ i ];
-            const snp_row &row2 = (*imputed2.genotypes)[ j ];
-            
-            float maf1 = compute_real_maf( row1 );
-            float maf2 = compute_real_maf( row2 );
+                output[ method_size ] = maf1[ i - v1_start ];
+                output[ method_size + 1 ] = maf2[ j - v2_start ];
+                output[ method_size + 2 ] = imputed1.info[ i ].info;
+                output[ method_size + 3 ] = imputed2.info[ j ].info;
+                partners.push_back( j );
+            }
 
-            if( maf1 > maf_threshold && maf2 > maf_threshold && info1 > info_threshold && info2 > info_threshold )
+            #pragma omp ordered
             {
-                m->run( row1, row2, output );
-            
-                output[ method_size ] = maf1;
-                output[ method_size + 1 ] = maf2;
-                output[ method_size + 2 ] = info1;
-                output[ method_size + 3 ] = info2;
-                output[ method_size + 4 ] = m->num_ok_samples( row1, row2 );
-
-                std::pair<std::string, std::string> pair( imputed1.info[ i ].name, imputed2.info[ j ].name );
-                result_file->write( pair, output );
+                for(int b = 0; b < partners.size( ); b++)
+                {
+                    std::pair<std::string, std::string> pair( imputed1.info[ i ].name, imputed2.info[ partners[ b ] ].name );
+                    result_file->write( pair, &values[ b * num_columns ] );
+                }
             }
         }
     }
 
+    for(int t = 0; t < num_threads; t++)
+    {
+        delete thread_method[ t ];
+        delete thread_matrix[ t ];
+    }
+
     return 0;
 }
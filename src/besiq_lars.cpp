@@ -2,6 +2,8 @@
 #include <sstream>
 #include <cfloat>
 
+#include <stdint.h>
+
 #include <armadillo>
 
 #include <cpp-argparse/OptionParser.h>
@@ -215,6 +217,146 @@ private:
     std::set<unsigned int> m_ignored;
 };
 
+/**
+ * This class is responsible for keeping the standardized columns of the
+ * active variables in the order they entered, together with the Cholesky
+ * factor R of their Gram matrix G = R'R. The factor is updated when a
+ * variable is added or dropped, so G never has to be formed or inverted.
+ */
+class active_matrix
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param n The number of samples.
+     */
+    active_matrix(size_t n)
+        : m_X( n, 0 ),
+          m_R( 0, 0 )
+    {
+    }
+
+    /**
+     * Adds a variable to the end of the active columns.
+     *
+     * @param index Index of the variable.
+     * @param x The standardized variable.
+     *
+     * @return False if the variable is linearly dependent on the
+     *         active variables, in which case it is not added.
+     */
+    bool add(unsigned int index, const arma::vec &x)
+    {
+        size_t k = m_index.size( );
+        double xx = arma::dot( x, x );
+        arma::vec r;
+        double d = xx;
+        if( k > 0 )
+        {
+            arma::mat Rt = m_R.t( );
+            r = arma::solve( arma::trimatl( Rt ), m_X.t( ) * x );
+            d -= arma::dot( r, r );
+        }
+        if( !( d > 1e-10 * xx ) )
+        {
+            return false;
+        }
+
+        m_R.resize( k + 1, k + 1 );
+        m_R.row( k ).zeros( );
+        if( k > 0 )
+        {
+            m_R.submat( 0, k, k - 1, k ) = r;
+        }
+        m_R( k, k ) = sqrt( d );
+
+        m_X.insert_cols( k, x );
+        m_index.push_back( index );
+
+        return true;
+    }
+
+    /**
+     * Removes the active variable at the given position. The remaining
+     * factor is upper Hessenberg from that column, and is restored to
+     * upper triangular with Givens rotations.
+     *
+     * @param pos The position of the variable in the active columns.
+     */
+    void drop(size_t pos)
+    {
+        size_t k = m_index.size( );
+        m_X.shed_col( pos );
+        m_R.shed_col( pos );
+        m_index.erase( m_index.begin( ) + pos );
+
+        for(size_t j = pos; j + 1 < k; j++)
+        {
+            double a = m_R( j, j );
+            double b = m_R( j + 1, j );
+            double h = sqrt( a * a + b * b );
+            double c = a / h;
+            double s = b / h;
+            for(size_t l = j; l + 1 < k; l++)
+            {
+                double t1 = m_R( j, l );
+                double t2 = m_R( j + 1, l );
+                m_R( j, l ) = c * t1 + s * t2;
+                m_R( j + 1, l ) = -s * t1 + c * t2;
+            }
+        }
+        m_R.shed_row( k - 1 );
+    }
+
+    /**
+     * Solves G * x = b with the Cholesky factor.
+     *
+     * @param b The right hand side.
+     *
+     * @return The solution x.
+     */
+    arma::vec solve(const arma::vec &b) const
+    {
+        arma::mat Rt = m_R.t( );
+        arma::vec y = arma::solve( arma::trimatl( Rt ), b );
+        return arma::solve( arma::trimatu( m_R ), y );
+    }
+
+    /**
+     * Returns the standardized active columns.
+     */
+    const arma::mat &get_X() const
+    {
+        return m_X;
+    }
+
+    /**
+     * Returns the indices of the active variables in the order
+     * of the columns.
+     */
+    arma::uvec get_indices() const
+    {
+        return arma::conv_to<arma::uvec>::from( m_index );
+    }
+
+private:
+    /**
+     * The standardized active variables.
+     */
+    arma::mat m_X;
+
+    /**
+     * Upper triangular Cholesky factor of m_X' * m_X.
+     */
+    arma::mat m_R;
+
+    /**
+     * Indices of the active variables.
+     */
+    std::vector<unsigned int> m_index;
+};
+
 /**
  * This class is responsible for both genetic and environmental data, along
  * with computing certain properties of this data that relates to the LARS
@@ -235,7 +377,8 @@ public:
     gene_environment(genotype_matrix_ptr genotypes, const arma::mat &cov, const arma::vec &phenotype, const std::vector<std::string> &cov_names)
         : m_genotypes( genotypes ),
           m_cov( cov ),
-          m_phenotype( phenotype )
+          m_phenotype( phenotype ),
+          m_num_words( 0 )
     {
         
         std::vector<std::string> locus_names = genotypes->get_snp_names( );
@@ -255,6 +398,7 @@ public:
         fill_missing_cov( );
         fill_missing_phenotypes( );
         compute_mean_sd( );
+        compute_masks( );
     }
 
     /**
@@ -311,27 +455,7 @@ public:
     void
     calculate_cor(const arma::vec &residual, arma::vec &c)
     {
-        int var = 0;
-        #pragma omp parallel for
-        for(int i = 0; i < m_genotypes->size( ); i++)
-        {
-            const snp_row &row = m_genotypes->get_row( i );
-            double cor = 0.0;
-            double m = m_mean[ i ];
-            double s = m_sd[ i ];
-            for(int j = 0; j < row.size( ); j++)
-            {
-                cor += ( ( row[ j ] - m ) / s ) * residual[ j ];
-            }
-            c[ i ] = cor;
-        }
-
-        var = m_genotypes->size( );
-        for(int j = 0; j < m_cov.n_cols; j++)
-        {
-            double cor = dot( ( m_cov.col( j ) - m_mean[ var + j ] ) / m_sd[ var + j ],  residual );
-            c[ var + j ] = cor;
-        }
+        variable_products( residual, c, NULL );
     }
     
     /**
@@ -339,31 +463,15 @@ public:
      * vector u.
      *
      * @param u The u-vector from the LARS paper.
+     * @param subset If not NULL, only the elements of a for these
+     *               variables are computed, the rest are zero.
      *
      * @return The a-vector from the LARS paper.
      */
-    arma::vec eig_prod(const arma::vec &u)
+    arma::vec eig_prod(const arma::vec &u, const arma::uvec *subset = NULL)
     {
         arma::vec a = arma::zeros<arma::vec>( get_num_variables( ) );
-
-        size_t var = 0;
-        #pragma omp parallel for
-        for(int i = 0; i < m_genotypes->size( ); i++)
-        {
-            const snp_row &row = m_genotypes->get_row( i );
-            double m = m_mean[ i ];
-            double s = m_sd[ i ];
-            for(int j = 0; j < row.size( ); j++)
-            {
-                a[ i ] += ( ( row[ j ] - m ) / s ) * u[ j ];
-            }
-        }
-
-        var = m_genotypes->size( );
-        for(int i = 0; i < m_cov.n_cols; i++)
-        {
-            a[ var + i ] = dot( ( m_cov.col( i ) - m_mean[ var + i ] ) / m_sd[ var + i ], u );
-        }
+        variable_products( u, a, subset );
 
         return a;
     }
@@ -404,6 +512,160 @@ public:
     }
 
 private:
+    /**
+     * Computes the sum of the elements of v where the bits in the
+     * mask are set, only the set bits are visited. Used for variants
+     * where few samples carry the minor allele.
+     *
+     * @param mask A bit mask with one bit for each sample.
+     * @param v A vector padded with zeros to a multiple of 64.
+     * @param num_words The number of words in the mask.
+     *
+     * @return The masked sum.
+     */
+    static double masked_sum(const uint64_t *mask, const double *v, size_t num_words)
+    {
+        double sum = 0.0;
+        for(size_t w = 0; w < num_words; w++)
+        {
+            uint64_t bits = mask[ w ];
+            const double *block = v + 64 * w;
+            while( bits != 0 )
+            {
+                sum += block[ __builtin_ctzll( bits ) ];
+                bits &= bits - 1;
+            }
+        }
+
+        return sum;
+    }
+
+    /**
+     * Computes the dot product of the genotypes of a variant with v in
+     * a branch free sweep. Four bits of each mask are expanded into the
+     * genotypes of four samples through m_weights, and each lane keeps
+     * its own partial sum.
+     *
+     * @param mask The mask of genotype 1 followed by the mask of genotype 2.
+     * @param v A vector padded with zeros to a multiple of 64.
+     *
+     * @return The sum of genotype times v over all samples.
+     */
+    double masked_product(const uint64_t *mask, const double *v) const
+    {
+        double sum[ 4 ] = { 0.0, 0.0, 0.0, 0.0 };
+        for(size_t w = 0; w < m_num_words; w++)
+        {
+            uint64_t bits1 = mask[ w ];
+            uint64_t bits2 = mask[ m_num_words + w ];
+            const double *block = v + 64 * w;
+            for(unsigned int b = 0; b < 64; b += 4)
+            {
+                const double *weight = &m_weights[ 4 * ( ( ( bits1 >> b ) & 0xf ) | ( ( ( bits2 >> b ) & 0xf ) << 4 ) ) ];
+                for(unsigned int l = 0; l < 4; l++)
+                {
+                    sum[ l ] += weight[ l ] * block[ b + l ];
+                }
+            }
+        }
+
+        return ( sum[ 0 ] + sum[ 1 ] ) + ( sum[ 2 ] + sum[ 3 ] );
+    }
+
+    /**
+     * Computes the dot product of each standardized variable with the
+     * given vector. Since a genotype only takes the values 0, 1 and 2,
+     * the product is computed from the sums of v over the samples with
+     * genotype 1 and 2, and then centered and scaled. The covariates
+     * are centered and scaled after the dot product in the same way.
+     *
+     * @param v A vector with one element for each sample.
+     * @param result The product of variable i is stored at index i.
+     * @param subset If not NULL, only these variables are computed.
+     */
+    void variable_products(const arma::vec &v, arma::vec &result, const arma::uvec *subset)
+    {
+        std::vector<double> padded( 64 * m_num_words, 0.0 );
+        std::copy( v.begin( ), v.end( ), padded.begin( ) );
+        double total = arma::accu( v );
+
+        size_t num_snps = m_genotypes->size( );
+        int num_products = ( subset != NULL ) ? subset->n_elem : get_num_variables( );
+
+        #pragma omp parallel for schedule(dynamic, 64)
+        for(int k = 0; k < num_products; k++)
+        {
+            size_t i = ( subset != NULL ) ? (*subset)[ k ] : k;
+            double product;
+            if( i < num_snps )
+            {
+                const uint64_t *mask = &m_masks[ 2 * i * m_num_words ];
+                if( m_dense[ i ] )
+                {
+                    product = masked_product( mask, &padded[ 0 ] );
+                }
+                else
+                {
+                    double sum1 = masked_sum( mask, &padded[ 0 ], m_num_words );
+                    double sum2 = masked_sum( mask + m_num_words, &padded[ 0 ], m_num_words );
+                    product = sum1 + 2.0 * sum2;
+                }
+            }
+            else
+            {
+                const double *col = m_cov.colptr( i - num_snps );
+                product = 0.0;
+                for(size_t j = 0; j < v.n_elem; j++)
+                {
+                    product += col[ j ] * v[ j ];
+                }
+            }
+
+            result[ i ] = ( product - m_mean[ i ] * total ) / m_sd[ i ];
+        }
+    }
+
+    /**
+     * Packs the samples with genotype 1 and 2 of each variant into
+     * two bit masks, must be called after the missing genotypes have
+     * been imputed. Variants where at least a quarter of the samples
+     * carry the minor allele are marked as dense.
+     */
+    void compute_masks()
+    {
+        size_t n = get_num_samples( );
+        m_num_words = ( n + 63 ) / 64;
+        m_masks.assign( 2 * m_num_words * m_genotypes->size( ), 0 );
+        m_dense.assign( m_genotypes->size( ), 0 );
+
+        m_weights.resize( 256 * 4 );
+        for(unsigned int nibbles = 0; nibbles < 256; nibbles++)
+        {
+            for(unsigned int l = 0; l < 4; l++)
+            {
+                m_weights[ 4 * nibbles + l ] = ( ( nibbles >> l ) & 1 ) + 2 * ( ( nibbles >> ( 4 + l ) ) & 1 );
+            }
+        }
+
+        #pragma omp parallel for
+        for(int i = 0; i < m_genotypes->size( ); i++)
+        {
+            const snp_row &row = m_genotypes->get_row( i );
+            uint64_t *mask = &m_masks[ 2 * i * m_num_words ];
+            size_t num_set = 0;
+            for(int j = 0; j < row.size( ); j++)
+            {
+                unsigned char g = row[ j ];
+                if( g == 1 || g == 2 )
+                {
+                    mask[ ( g - 1 ) * m_num_words + j / 64 ] |= ( (uint64_t) 1 ) << ( j % 64 );
+                    num_set++;
+                }
+            }
+            m_dense[ i ] = 4 * num_set >= n;
+        }
+    }
+
     /**
      * Assigns missing genotypes with genotype mean.
      */
@@ -570,6 +832,25 @@ private:
      * Vector variable names.
      */
     std::vector<std::string> m_names;
+
+    /**
+     * Bit masks of the samples with genotype 1 followed by genotype 2
+     * for each variant, each mask has m_num_words words.
+     */
+    std::vector<uint64_t> m_masks;
+    size_t m_num_words;
+
+    /**
+     * Whether each variant is swept with masked_product instead of
+     * visiting the set bits.
+     */
+    std::vector<char> m_dense;
+
+    /**
+     * The genotypes of four samples for each combination of four bits
+     * of the genotype 1 mask (low nibble) and genotype 2 mask (high nibble).
+     */
+    std::vector<double> m_weights;
 };
 
 arma::vec
@@ -585,28 +866,48 @@ nice_division(arma::vec &a, arma::vec &b)
 /**
  * Solves the lasso problem for a given lambda. Used for computing the
  * null model during significance testing. The algorithm is currently
- * a pathwise coordinate descent.
+ * a pathwise coordinate descent, that updates beta and the residuals
+ * in place.
  *
- * @param X Covariates.
+ * @param X Covariates, only the first num_cols columns are used.
+ * @param num_cols Number of columns of X in the model.
  * @param y Outcome.
  * @param lambda Shrinkage factor.
- * @param start Starting values for beta.
+ * @param beta Starting values for beta, the solution is stored here.
+ * @param r The residuals y - X * beta will be stored here.
  * @max_num_iter Maximum number of iterations before giving up.
  */
-arma::vec optimize_lars_gd(const arma::mat &X, const arma::mat &y, double lambda, const arma::vec &start, size_t max_num_iter = 50)
+void
+optimize_lars_gd(const arma::mat &X, size_t num_cols, const arma::vec &y, double lambda, arma::vec &beta, arma::vec &r, size_t max_num_iter = 50)
 {
-    arma::vec beta = start;
-    arma::vec r = y - X * beta;
+    size_t n = y.n_elem;
+    r.set_size( n );
+    double *res = r.memptr( );
+    std::copy( y.begin( ), y.end( ), res );
+    for(size_t j = 0; j < num_cols; j++)
+    {
+        const double *x = X.colptr( j );
+        for(size_t l = 0; l < n; l++)
+        {
+            res[ l ] -= x[ l ] * beta[ j ];
+        }
+    }
+
     double prev_rss = 0;
-    double cur_rss = sum( r % r );
+    double cur_rss = arma::dot( r, r );
     int num_iter = 0;
 
     while( std::abs( prev_rss - cur_rss ) / prev_rss > 1e-20 && num_iter++ < max_num_iter )
     {
         prev_rss = cur_rss;
-        for(int j = 0; j < X.n_cols; j++)
+        for(size_t j = 0; j < num_cols; j++)
         {
-            double beta_star = arma::dot( X.col( j ), r ) + beta[ j ];
+            const double *x = X.colptr( j );
+            double beta_star = beta[ j ];
+            for(size_t l = 0; l < n; l++)
+            {
+                beta_star += x[ l ] * res[ l ];
+            }
             double update = std::abs( beta_star ) - lambda;
             update = (update > 0) ? update : 0;
 
@@ -617,13 +918,14 @@ arma::vec optimize_lars_gd(const arma::mat &X, const arma::mat &y, double lambda
 
             if( std::abs( beta_increase ) > 0 )
             {
-                r = r - X.col( j ) * beta_increase;
+                for(size_t l = 0; l < n; l++)
+                {
+                    res[ l ] -= x[ l ] * beta_increase;
+                }
             }
         }
-        cur_rss = sum( r % r );
+        cur_rss = arma::dot( r, r );
     }
-
-    return beta;
 }
 
 /**
@@ -653,8 +955,87 @@ find_max(const arma::vec &v, const arma::uvec &inactive, unsigned int *max_index
     return max_value;
 }
 
+/**
+ * Computes the step length from equation 2.13 of the LARS paper, i.e.
+ * the smallest step at which one of the given inactive variables reaches
+ * the same absolute correlation as the active variables.
+ *
+ * @param C The absolute correlation of the active variables.
+ * @param A The normalization constant from equation 2.5.
+ * @param c The correlations of all variables.
+ * @param a The a-vector from equation 2.11.
+ * @param inactive The inactive variables to consider.
+ *
+ * @return The step length, or C / A if inactive is empty.
+ */
+double
+step_length(double C, double A, const arma::vec &c, const arma::vec &a, const arma::uvec &inactive)
+{
+    if( inactive.n_elem == 0 )
+    {
+        return C / A;
+    }
+
+    arma::vec cc = c.elem( inactive );
+    arma::vec ac = a.elem( inactive );
+    
+    arma::vec a1 = C - cc;
+    arma::vec b1 = A - ac;
+    arma::vec gn = nice_division( a1, b1 );
+
+    arma::vec a2 = C + cc;
+    arma::vec b2 = A + ac;
+    arma::vec gp = nice_division( a2, b2 );
+
+    return std::min( gn.min( ), gp.min( ) );
+}
+
+/**
+ * Applies the sequential strong rule to the inactive variables. The
+ * next knot is extrapolated from the previous two, and a variable is
+ * kept if its correlation is at least 2 * next - C.
+ *
+ * @param c The correlations of all variables.
+ * @param inactive The inactive variables.
+ * @param C The absolute correlation at the current knot.
+ * @param prev_C The absolute correlation at the previous knot.
+ *
+ * @return The inactive variables that pass the rule.
+ */
+arma::uvec
+strong_set(const arma::vec &c, const arma::uvec &inactive, double C, double prev_C)
+{
+    double next_C = std::max( 2 * C - prev_C, 0.0 );
+    double cutoff = 2 * next_C - C;
+
+    std::vector<unsigned int> keep;
+    for(int i = 0; i < inactive.n_elem; i++)
+    {
+        if( std::abs( c[ inactive[ i ] ] ) >= cutoff )
+        {
+            keep.push_back( inactive[ i ] );
+        }
+    }
+
+    return arma::conv_to<arma::uvec>::from( keep );
+}
+
+/**
+ * Runs the LARS algorithm and computes the covariance test for each
+ * variable that enters the model.
+ *
+ * @param variable_set The genotypes and covariates.
+ * @param max_vars Maximum number of variables in the model.
+ * @param lasso If true, variables whose coefficient changes sign are dropped.
+ * @param threshold Stop after a variable has a p-value above this threshold.
+ * @param screen If true, the step length is only computed for the inactive
+ *               variables that pass the strong rule, the other variables are
+ *               checked against the correlations after the step.
+ *
+ * @return The path of the coefficients.
+ */
 std::vector<lars_path>
-lars(gene_environment &variable_set, size_t max_vars = 15, bool lasso = true, bool only_p = false, double threshold = 1.0)
+lars(gene_environment &variable_set, size_t max_vars = 15, bool lasso = true, double threshold = 1.0, bool screen = false)
 {
     variable_set.impute_missing( );
     arma::vec phenotype = variable_set.get_centered_phenotype( );
@@ -664,22 +1045,37 @@ lars(gene_environment &variable_set, size_t max_vars = 15, bool lasso = true, bo
     arma::vec mu = arma::zeros<arma::vec>( n );
     arma::vec beta = arma::zeros<arma::vec>( m );
     arma::vec c = arma::zeros<arma::vec>( m );
+    arma::vec next_c = arma::zeros<arma::vec>( m );
     std::vector<lars_path> path;
 
     double pheno_mean = sum( phenotype ) / n;
     double pheno_var = sum( pow( phenotype - pheno_mean, 2 ) ) / (n - 1);
     double base_cor = sum( phenotype * pheno_mean );
+    double pheno_ss = dot( phenotype, phenotype );
 
     active_set active( m );
+    active_matrix active_columns( n );
     arma::uvec inactive;
     arma::uvec drop;
     double eps = 1e-10;
     double last_p = threshold;
 
+    /* Null model of the covariance test, reused between the knots */
+    arma::vec beta_h0;
+    arma::vec residual_h0( n );
+
+    double prev_C = 0.0;
+    bool has_cor = false;
+
     int i = 0;
     while( active.size( ) < std::min( max_vars, m ) && last_p <= threshold )
     {
-        variable_set.calculate_cor( phenotype - mu, c );
+        if( !has_cor )
+        {
+            variable_set.calculate_cor( phenotype - mu, c );
+        }
+        has_cor = false;
+
         arma::vec cabs = abs( c );
         unsigned int max_index;
         double C = find_max( cabs, active.get_inactive( ), &max_index );
@@ -689,56 +1085,55 @@ lars(gene_environment &variable_set, size_t max_vars = 15, bool lasso = true, bo
             break;
         }
        
-        arma::uvec prev_active = active.get_active( ); 
         active.add( max_index );
         inactive = active.get_inactive( );
 
-        /* Create the active matrix */
-        arma::mat X_active = variable_set.get_active( active.get_active( ) );
-
-        /* Equation 2.4 */
-        arma::vec s = sign( c.elem( active.get_active( ) ) );
-
-        /* Equation 2.5 */
-        arma::mat G = X_active.t( ) * X_active;
-        arma::mat Ginv;
-        if( !inv( Ginv, G ) )
+        /* Add the new variable to the active matrix */
+        arma::uvec new_variable( 1 );
+        new_variable[ 0 ] = max_index;
+        if( !active_columns.add( max_index, variable_set.get_active( new_variable ).col( 0 ) ) )
         {
             active.ignore( max_index );
+            has_cor = true;
             continue;
         }
-        double A = 1.0 / sqrt( arma::accu( s.t( ) * Ginv * s ) );
+        arma::uvec active_index = active_columns.get_indices( );
+        const arma::mat &X_active = active_columns.get_X( );
+
+        /* Equation 2.4 */
+        arma::vec s = sign( c.elem( active_index ) );
+
+        /* Equation 2.5 */
+        arma::vec Ginv_s = active_columns.solve( s );
+        double A = 1.0 / sqrt( arma::dot( s, Ginv_s ) );
 
         /* Equation 2.6 */
-        arma::vec w = A * Ginv * s;
+        arma::vec w = A * Ginv_s;
         arma::vec u = X_active * w;
 
+        /* Restrict the step to the variables that pass the strong rule */
+        arma::uvec candidates = inactive;
+        if( screen && prev_C > C )
+        {
+            candidates = strong_set( c, inactive, C, prev_C );
+        }
+        prev_C = C;
+
         double gamma = C / A;
-        if( active.size( ) < m )
+        if( inactive.n_elem > 0 )
         { 
             /* Equation 2.11 */
-            arma::vec a = variable_set.eig_prod( u );
+            arma::vec a = variable_set.eig_prod( u, &candidates );
 
             /* Equation 2.13 */
-            arma::vec cc = c.elem( inactive );
-            arma::vec ac = a.elem( inactive );
-            
-            arma::vec a1 = C - cc;
-            arma::vec b1 = A - ac;
-            arma::vec gn = nice_division( a1, b1 );
-
-            arma::vec a2 = C + cc;
-            arma::vec b2 = A + ac;
-            arma::vec gp = nice_division( a2, b2 );
-
-            gamma = std::min( gn.min( ), gp.min( ) );
+            gamma = step_length( C, A, c, a, candidates );
         }
 
         if( lasso )
         {
             drop.clear( );
             /* Equation 3.4 */
-            arma::vec gammaj = -beta.elem( active.get_active( ) ) / w;
+            arma::vec gammaj = -beta.elem( active_index ) / w;
 
             /* Equation 3.5 */
             arma::uvec valid_elems = arma::find( gammaj > eps );
@@ -754,15 +1149,49 @@ lars(gene_environment &variable_set, size_t max_vars = 15, bool lasso = true, bo
             }
         }
 
-        beta.elem( active.get_active( ) ) = beta.elem( active.get_active( ) ) + w * gamma;
+        if( candidates.n_elem < inactive.n_elem )
+        {
+            /* Check that no screened variable exceeds the correlation after the step */
+            variable_set.calculate_cor( phenotype - mu - gamma * u, next_c );
+
+            double next_C = ( C - gamma * A ) * ( 1.0 + 1e-8 ) + eps;
+            std::vector<unsigned int> violations;
+            for(int j = 0; j < inactive.n_elem; j++)
+            {
+                if( std::abs( next_c[ inactive[ j ] ] ) > next_C )
+                {
+                    violations.push_back( inactive[ j ] );
+                }
+            }
+
+            if( violations.size( ) > 0 )
+            {
+                arma::uvec violated = arma::conv_to<arma::uvec>::from( violations );
+                arma::vec a = variable_set.eig_prod( u, &violated );
+                double violated_gamma = step_length( C, A, c, a, violated );
+                if( violated_gamma < gamma )
+                {
+                    gamma = violated_gamma;
+                    drop.clear( );
+                }
+            }
+            else
+            {
+                c = next_c;
+                has_cor = true;
+            }
+        }
+
+        beta.elem( active_index ) = beta.elem( active_index ) + w * gamma;
         mu = mu + gamma * u;
         double model_var = sum( pow( phenotype - mu, 2 ) ) / (n - 1 - active.size( ) );
 
         if( lasso && drop.n_elem > 0 )
         {
-            beta.elem( active.get_active( ).elem( drop ) ).fill( 0.0 );
+            beta.elem( active_index.elem( drop ) ).fill( 0.0 );
             
-            active.drop( drop[ 0 ] );
+            active.drop( active_index[ drop[ 0 ] ] );
+            active_columns.drop( drop[ 0 ] );
 
             /* Don't report drops */
             continue;
@@ -795,13 +1224,18 @@ lars(gene_environment &variable_set, size_t max_vars = 15, bool lasso = true, bo
         /* Calculate p for new beta and add last component of the path */
         double cur_cor = dot( mu, phenotype );
 
-        /* Compute h0 */
+        /**
+         * Compute h0, the new variable is the last active column so
+         * the null model is fitted on the columns before it, starting
+         * from the current coefficients.
+         */
         double prev_cor = base_cor;
-        if( prev_active.n_elem > 0 )
+        size_t num_h0 = active_index.n_elem - 1;
+        if( num_h0 > 0 )
         {
-            arma::mat X_h0 = variable_set.get_active( prev_active );
-            arma::vec beta_h0 = optimize_lars_gd( X_h0, phenotype, lambda, beta.elem( prev_active ) );
-            prev_cor = dot( X_h0 * beta_h0, phenotype );
+            beta_h0 = beta.elem( active_index.head( num_h0 ) );
+            optimize_lars_gd( X_active, num_h0, phenotype, lambda, beta_h0, residual_h0 );
+            prev_cor = pheno_ss - dot( residual_h0, phenotype );
         }
 
         double T = (cur_cor - prev_cor ) / model_var;
@@ -841,6 +1275,7 @@ main(int argc, char *argv[])
     parser.add_option( "-o", "--out" ).help( "The output file that will contain the results (binary)." );
     parser.add_option( "-m", "--max-variables" ).help( "Maximum number of variables in the model" ).set_default( 10 );
     parser.add_option( "-t", "--threshold" ).help( "Stop after a variable has a p-value less than this threshold." ).set_default( 1.0 );
+    parser.add_option( "--screen" ).help( "Use the strong rule to screen variables before computing each step." ).action( "store_true" );
     parser.add_option( "--only-pvalues" ).help( "Only output the beta that enters in each step along with its p-value." ).action( "store_true" );
 
     Values options = parser.parse_args( argc, argv );
@@ -869,8 +1304,7 @@ main(int argc, char *argv[])
     std::vector<std::string> cov_names;
     if( options.is_set( "pheno" ) )
     {
-        std::ifstream phenotype_file( options[ "pheno" ].c_str( ) );
-        phenotype = parse_phenotypes( phenotype_file, pheno_missing, order, options[ "mpheno" ] );
+        phenotype = read_phenotype_file( options[ "pheno" ], pheno_missing, order, options[ "mpheno" ] );
     }
     else
     {
@@ -878,8 +1312,7 @@ main(int argc, char *argv[])
     }
     if( options.is_set( "cov" ) )
     {
-        std::ifstream covariate_file( options[ "cov" ].c_str( ) );
-        cov = parse_covariate_matrix( covariate_file, cov_missing, order, &cov_names );
+        cov = read_covariate_file( options[ "cov" ], cov_missing, order, NULL, &cov_names );
     }
 
     /* Open output stream */
@@ -893,7 +1326,7 @@ main(int argc, char *argv[])
     bool only_pvalues = options.is_set( "only_pvalues" );
 
     gene_environment variable_set( genotypes, cov, phenotype, cov_names );
-    std::vector<lars_path> path = lars( variable_set, (int) options.get( "max_variables" ), (double) options.get( "threshold" ) );
+    std::vector<lars_path> path = lars( variable_set, (int) options.get( "max_variables" ), true, (double) options.get( "threshold" ), options.is_set( "screen" ) );
     out << "step\tvariable\tbeta\tT\tp\tlambda\tbeta_sum\texplained_var\n";
     for(int i = 0; i < path.size( ); i++)
     {
@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <iostream>
+#include <sstream>
 
 #include <armadillo>
 
@@ -8,6 +10,7 @@
 #include <besiq/method/wald_lm_method.hpp>
 #include <besiq/method/wald_separate_method.hpp>
 #include <besiq/method/method.hpp>
+#include <besiq/io/metaresult.hpp>
 #include <besiq/logp_grid.hpp>
 
 #include <dcdflib/libdcdf.hpp>
@@ -17,10 +20,16 @@
 using namespace arma;
 using namespace optparse;
 
-const std::string USAGE = "besiq-meta [OPTIONS] pairs genotype_prefix1 [genotype_prefix2 ...]";
+const std::string USAGE = "besiq-meta [OPTIONS] pairs genotype_prefix1 [genotype_prefix2 ...]\n       besiq-meta --merge [OPTIONS] stats1 [stats2 ...]";
 const std::string DESCRIPTION = "Meta analysis using wald tests.";
 const std::string VERSION = "Bayesic 0.5.9";
-const std::string EPILOG = "This command assumes that input data has been cleaned and alleles have been flipped consistently.";
+const std::string EPILOG = "This command assumes that input data has been cleaned and alleles have been flipped consistently. With --export-stats each cohort is analyzed separately, and the statistics files can then be combined with --merge, the cohorts must be run on the same pair file and split.";
+
+/**
+ * Number of floats in the exported statistics of a pair: the 4 betas,
+ * the upper triangle of the 4x4 matrix C and the number of samples.
+ */
+const size_t NUM_STATS = 4 + 10 + 1;
 
 std::vector<plink_file_ptr> open_plink_file(const std::vector<std::string> &prefix)
 {
@@ -45,6 +54,286 @@ std::vector<genotype_matrix_ptr> create_genotype_matrices(std::vector<plink_file
     return genotypes;
 }
 
+/**
+ * Returns the header of an exported statistics file.
+ *
+ * @return The column names.
+ */
+std::vector<std::string>
+stats_header()
+{
+    std::vector<std::string> header;
+    for(int i = 0; i < 4; i++)
+    {
+        std::ostringstream name;
+        name << "beta" << i + 1;
+        header.push_back( name.str( ) );
+    }
+    for(int i = 0; i < 4; i++)
+    {
+        for(int j = i; j < 4; j++)
+        {
+            std::ostringstream name;
+            name << "C" << i + 1 << j + 1;
+            header.push_back( name.str( ) );
+        }
+    }
+    header.push_back( "N" );
+
+    return header;
+}
+
+/**
+ * Packs the statistics of a pair in a cohort, see NUM_STATS.
+ *
+ * @param beta The estimated betas.
+ * @param C The symmetric 4x4 weight matrix of the betas.
+ * @param N The number of samples.
+ * @param stats The statistics will be stored here.
+ */
+void
+pack_stats(const arma::vec &beta, const arma::mat &C, size_t N, float *stats)
+{
+    size_t k = 0;
+    for(int i = 0; i < 4; i++)
+    {
+        stats[ k++ ] = beta[ i ];
+    }
+    for(int i = 0; i < 4; i++)
+    {
+        for(int j = i; j < 4; j++)
+        {
+            stats[ k++ ] = C( i, j );
+        }
+    }
+    stats[ k ] = N;
+}
+
+/**
+ * Unpacks the statistics of a pair in a cohort, see pack_stats.
+ *
+ * @param stats The packed statistics.
+ * @param beta The betas will be stored here.
+ * @param C The weight matrix will be stored here.
+ * @param N The number of samples will be stored here.
+ *
+ * @return False if the pair could not be analyzed in the cohort.
+ */
+bool
+unpack_stats(const float *stats, arma::vec &beta, arma::mat &C, size_t &N)
+{
+    if( stats[ NUM_STATS - 1 ] == result_get_missing( ) )
+    {
+        return false;
+    }
+
+    beta.set_size( 4 );
+    C.set_size( 4, 4 );
+    size_t k = 0;
+    for(int i = 0; i < 4; i++)
+    {
+        beta[ i ] = stats[ k++ ];
+    }
+    for(int i = 0; i < 4; i++)
+    {
+        for(int j = i; j < 4; j++)
+        {
+            C( i, j ) = stats[ k ];
+            C( j, i ) = stats[ k ];
+            k++;
+        }
+    }
+    N = (size_t) stats[ k ];
+
+    return true;
+}
+
+/**
+ * Combines the betas of the cohorts under the fixed effect
+ * assumption, and tests whether they are all zero.
+ *
+ * @param betas The betas of each cohort.
+ * @param covs The weight matrix of the betas of each cohort.
+ * @param chi The chi-square statistic will be stored here.
+ * @param p The p-value will be stored here.
+ *
+ * @return False if the combined covariance could not be inverted.
+ */
+bool
+combine_fixed_effect(const std::vector<arma::vec> &betas, const std::vector<arma::mat> &covs, double *chi, double *p)
+{
+    /* Computed weighted average of betas (fixed effect assumption) */
+    arma::mat Csum = arma::zeros<arma::mat>( 4, 4 );
+    for(int i = 0; i < covs.size( ); i++)
+    {
+        Csum += covs[ i ];
+    }
+    arma::mat Csum_inv;
+    if( !arma::inv( Csum_inv, Csum ) )
+    {
+        return false;
+    }
+
+    arma::vec final_beta = arma::zeros<arma::vec>( 4 );
+    arma::mat final_C = arma::zeros<arma::mat>( 4, 4 );
+    for(int i = 0; i < covs.size( ); i++)
+    {
+        final_beta += covs[ i ] * betas[ i ];
+        final_C += covs[ i ] * covs[ i ] * covs[ i ];
+    }
+    final_beta = Csum_inv * final_beta;
+    final_C = Csum_inv * final_C * Csum_inv;
+
+    arma::mat final_C_inv;
+    if( !arma::inv( final_C_inv, final_C ) )
+    {
+        return false;
+    }
+
+    *chi = dot( final_beta, final_C_inv * final_beta );
+    *p = 1.0 - chi_square_cdf( *chi, 4 );
+
+    return true;
+}
+
+/**
+ * Opens the result file given by the options.
+ *
+ * @param options The command line options.
+ * @param loci Names of the variants.
+ * @param header The column names.
+ *
+ * @return The opened result file.
+ */
+resultfile *
+open_output(Values &options, const std::vector<std::string> &loci, const std::vector<std::string> &header)
+{
+    resultfile *result = NULL;
+    if( options.is_set( "out" ) )
+    {
+        result = new bresultfile( options[ "out" ], loci );
+    }
+    else
+    {
+        std::ios_base::sync_with_stdio( false );
+        result = new tresultfile( "-", "w" );
+    }
+    if( result == NULL || !result->open( ) )
+    {
+        std::cerr << "besiq: error: Can not open result file." << std::endl;
+        exit( 1 );
+    }
+    result->set_header( header );
+
+    return result;
+}
+
+/**
+ * Merges exported statistics files by reading them in lockstep and
+ * combining each pair under the fixed effect assumption.
+ *
+ * @param options The command line options.
+ * @param paths Paths to the statistics files.
+ */
+void
+merge_stats(Values &options, const std::vector<std::string> &paths)
+{
+    std::vector<resultfile *> stats_files;
+    try
+    {
+        stats_files = open_result_files( paths );
+    }
+    catch(result_open_error &e)
+    {
+        std::cerr << "besiq: error: Could not open statistics files." << std::endl;
+        exit( 1 );
+    }
+    for(int i = 0; i < stats_files.size( ); i++)
+    {
+        if( stats_files[ i ]->get_header( ) != stats_header( ) )
+        {
+            std::cerr << "besiq: error: " << paths[ i ] << " is not a statistics file from --export-stats." << std::endl;
+            exit( 1 );
+        }
+    }
+
+    std::vector<std::string> header;
+    header.push_back( "W" );
+    header.push_back( "P" );
+    header.push_back( "N" );
+    resultfile *result = open_output( options, stats_files[ 0 ]->get_snp_names( ), header );
+
+    double threshold = (double) options.get( "threshold" );
+    float stats[ NUM_STATS ];
+    float meta_output[ 3 ];
+    std::vector<arma::vec> betas( stats_files.size( ) );
+    std::vector<arma::mat> covs( stats_files.size( ) );
+    std::pair<std::string, std::string> pair;
+    std::pair<std::string, std::string> cur_pair;
+    while( true )
+    {
+        size_t num_read = 0;
+        size_t N = 0;
+        bool all_valid = true;
+        for(int i = 0; i < stats_files.size( ); i++)
+        {
+            if( !stats_files[ i ]->read( &cur_pair, stats ) )
+            {
+                continue;
+            }
+            if( num_read++ == 0 )
+            {
+                pair = cur_pair;
+            }
+            else if( cur_pair != pair )
+            {
+                std::cerr << "besiq: error: The statistics files contain different pairs, they must be run on the same pair file and split." << std::endl;
+                exit( 1 );
+            }
+
+            size_t cur_N = 0;
+            all_valid = unpack_stats( stats, betas[ i ], covs[ i ], cur_N ) && all_valid;
+            N += cur_N;
+        }
+
+        if( num_read == 0 )
+        {
+            break;
+        }
+        else if( num_read != stats_files.size( ) )
+        {
+            std::cerr << "besiq: error: The statistics files contain a different number of pairs." << std::endl;
+            exit( 1 );
+        }
+
+        double chi;
+        double final_p;
+        if( !all_valid || !combine_fixed_effect( betas, covs, &chi, &final_p ) )
+        {
+            continue;
+        }
+
+        if( threshold != -9 && final_p > threshold )
+        {
+            continue;
+        }
+
+        meta_output[ 0 ] = chi;
+        meta_output[ 1 ] = final_p;
+        meta_output[ 2 ] = N;
+
+        result->write( pair, meta_output );
+    }
+
+    result->close( );
+    delete result;
+    for(int i = 0; i < stats_files.size( ); i++)
+    {
+        stats_files[ i ]->close( );
+        delete stats_files[ i ];
+    }
+}
+
 OptionParser
 create_options()
 {
@@ -56,6 +345,9 @@ create_options()
     parser.add_option( "-o", "--out" ).help( "The output file that will contain the results (binary)." );
     parser.add_option( "-t", "--threshold" ).help( "Only output pairs with a p-value less than this." ).set_default( -9 );
     parser.add_option( "-g", "--grid" ).help( "Path to grid file." );
+    parser.add_option( "--binary-grid" ).help( "Write a binary grid of the p-values to this file, that can be merged with the grids of other splits, see besiq view --grid-merge." );
+    parser.add_option( "--export-stats" ).help( "Write the betas and their weight matrix for each pair instead of the meta analysis, requires a single genotype prefix and --out." ).action( "store_true" );
+    parser.add_option( "--merge" ).help( "Combine statistics files written by --export-stats, the arguments are the statistics files." ).action( "store_true" );
     parser.add_option( "--split" ).help( "Runs the analysis on a part of the pair file, and this is part X of 1-<num_splits> parts (default = 1)." ).set_default( 1 );
     parser.add_option( "--num-splits" ).help( "Sets the number of parts to split the pair file in (default = 1)." ).set_default( 1 );
     
@@ -68,11 +360,34 @@ main(int argc, char *argv[])
     OptionParser parser = create_options( );
     
     Values options = parser.parse_args( argc, argv );
+    if( options.is_set( "merge" ) )
+    {
+        if( parser.args( ).size( ) < 1 )
+        {
+            parser.print_help( );
+            exit( 1 );
+        }
+        if( options.is_set( "grid" ) || options.is_set( "binary_grid" ) )
+        {
+            std::cerr << "besiq: error: The grid needs the genotypes and can not be used with --merge." << std::endl;
+            exit( 1 );
+        }
+
+        merge_stats( options, parser.args( ) );
+        return 0;
+    }
+
+    bool export_stats = options.is_set( "export_stats" );
     if( parser.args( ).size( ) < 2 )
     {
         parser.print_help( );
         exit( 1 );
     }
+    if( export_stats && ( parser.args( ).size( ) != 2 || !options.is_set( "out" ) ) )
+    {
+        std::cerr << "besiq: error: --export-stats requires a single genotype prefix and --out." << std::endl;
+        exit( 1 );
+    }
     
     std::vector<plink_file_ptr> plink_files = open_plink_file( parser.args( ) );
     std::vector<genotype_matrix_ptr> genotypes = create_genotype_matrices( plink_files );
@@ -115,33 +430,33 @@ main(int argc, char *argv[])
     /**
      * Open results.
      */
+    std::vector<std::string> header;
+    header.push_back( "W" );
+    header.push_back( "P" );
+    header.push_back( "N" );
     resultfile *result = NULL;
-    if( options.is_set( "out" ) )
+    if( export_stats )
     {
-        result = new bresultfile( options[ "out" ], loci );
+        /*
+         * Every pair must get a record for --merge, so the variants are
+         * indexed by the names in a binary pair file when possible, since
+         * those cover all pairs even if they are missing in this cohort.
+         */
+        bpairfile *binary_pairs = dynamic_cast<bpairfile *>( pairs );
+        const std::vector<std::string> &pair_loci = binary_pairs != NULL ? binary_pairs->get_snp_names( ) : loci;
+        result = open_output( options, pair_loci, stats_header( ) );
     }
     else
     {
-        std::ios_base::sync_with_stdio( false );
-        result = new tresultfile( "-", "w" );
+        result = open_output( options, loci, header );
     }
-    if( result == NULL || !result->open( ) )
-    {
-        std::cerr << "besiq: error: Can not open result file." << std::endl;
-        exit( 1 );
-    }
-    std::vector<std::string> header;
-    header.push_back( "W" );
-    header.push_back( "P" );
-    header.push_back( "N" );
-    result->set_header( header );
 
     /**
      * Run analysis
      */
     std::pair<std::string, std::string> pair;
     float *output = new float[ methods[ 0 ]->init( ).size( ) ];
-    float meta_output[ header.size( ) ];
+    float meta_output[ NUM_STATS ];
     while( pairs->read( pair ) )
     {
         /* Compute betas and covariances */
@@ -149,10 +464,29 @@ main(int argc, char *argv[])
         std::vector<arma::mat> covs( methods.size( ), arma::zeros<arma::mat>( 4, 4 ) );
         size_t N = 0;
         bool all_valid = true;
+        size_t index1 = 0;
+        size_t index2 = 0;
+        bool has_index = genotypes[ 0 ]->get_index( pair.first, index1 ) && genotypes[ 0 ]->get_index( pair.second, index2 );
         for(int i = 0; i < methods.size( ); i++)
         {
-            snp_row const *row1 = genotypes[ i ]->get_row( pair.first );
-            snp_row const *row2 = genotypes[ i ]->get_row( pair.second );
+            /* The grid and the first cohort share the variant indices */
+            snp_row const *row1 = NULL;
+            snp_row const *row2 = NULL;
+            if( i == 0 && has_index )
+            {
+                row1 = &genotypes[ i ]->get_row( index1 );
+                row2 = &genotypes[ i ]->get_row( index2 );
+            }
+            else if( i > 0 )
+            {
+                row1 = genotypes[ i ]->get_row( pair.first );
+                row2 = genotypes[ i ]->get_row( pair.second );
+            }
+            if( row1 == NULL || row2 == NULL )
+            {
+                all_valid = false;
+                continue;
+            }
 
             methods[ i ]->run( *row1, *row2, output );
 
@@ -167,43 +501,34 @@ main(int argc, char *argv[])
             N += methods[ i ]->num_ok_samples( *row1, *row2 );
         }
 
-        if( !all_valid )
+        /* Every pair is exported, so that the cohorts can be merged in lockstep */
+        if( export_stats )
         {
-            continue;
-        }
+            if( all_valid )
+            {
+                pack_stats( betas[ 0 ], covs[ 0 ], N, meta_output );
+            }
+            else
+            {
+                std::fill( meta_output, meta_output + NUM_STATS, result_get_missing( ) );
+            }
 
-        /* Computed weighted average of betas (fixed effect assumption) */
-        arma::mat Csum = arma::zeros<arma::mat>( 4, 4 );
-        for(int i = 0; i < covs.size( ); i++)
-        {
-            Csum += covs[ i ];
-        }
-        arma::mat Csum_inv;
-        if( !arma::inv( Csum_inv, Csum ) )
-        {
+            if( !result->write( pair, meta_output ) )
+            {
+                std::cerr << "besiq: error: Could not export the pair " << pair.first << " " << pair.second << ", all variants of a text pair file must be in the genotype file." << std::endl;
+                exit( 1 );
+            }
             continue;
         }
 
-        arma::vec final_beta = arma::zeros<arma::vec>( 4 );
-        arma::mat final_C = arma::zeros<arma::mat>( 4, 4 );
-        for(int i = 0; i < covs.size( ); i++)
-        {
-            final_beta += covs[ i ] * betas[ i ];
-            final_C += covs[ i ] * covs[ i ] * covs[ i ];
-        }
-        final_beta = Csum_inv * final_beta;
-        final_C = Csum_inv * final_C * Csum_inv;
-
-        arma::mat final_C_inv;
-        if( !arma::inv( final_C_inv, final_C ) )
+        double chi;
+        double final_p;
+        if( !all_valid || !combine_fixed_effect( betas, covs, &chi, &final_p ) )
         {
             continue;
         }
-
-        double chi = dot( final_beta, final_C_inv * final_beta );
-        double final_p = 1.0 - chi_square_cdf( chi, 4 );
         
-        grid.add_pvalue( pair.first, pair.second, final_p );
+        grid.add_pvalue( index1, index2, final_p );
 
         if( threshold != -9 && final_p > threshold )
         {
@@ -221,10 +546,20 @@ main(int argc, char *argv[])
 
     if( options.is_set( "grid" ) )
     {
-        std::ofstream grid_file( options[ "grid" ] );
+        std::ofstream grid_file( options[ "grid" ].c_str( ) );
         grid.write_grid( grid_file );
         grid_file.close( );
     }
+    if( options.is_set( "binary_grid" ) )
+    {
+        std::ofstream grid_file( options[ "binary_grid" ].c_str( ), std::ios::binary );
+        if( !grid.write_binary( grid_file ) )
+        {
+            std::cerr << "besiq: error: Could not write grid file." << std::endl;
+            exit( 1 );
+        }
+        grid_file.close( );
+    }
     /* Delete allocated stuff */
     
     return 0;
@@ -8,6 +8,7 @@
 #include <cpp-argparse/OptionParser.h>
 #include <besiq/io/covariates.hpp>
 #include <besiq/stats/snp_count.hpp>
+#include <besiq/stats/streaming_glm.hpp>
 #include <glm/irls.hpp>
 #include <glm/models/normal.hpp>
 #include <glm/models/binomial.hpp>
@@ -36,61 +37,59 @@ parse_variants(std::ifstream &input_file)
     return variant_set;
 }
 
-std::vector<std::string>
-create_design_matrix(genotype_matrix_ptr genotypes, const arma::mat &cov, const std::set<std::string> &variant_set, arma::uvec &missing, arma::mat &X)
+/**
+ * Selects the variants that are included in the design matrix, a
+ * variant is included if it is in the variant set and its additive
+ * coding is not constant. Samples with a missing genotype in any of
+ * the included variants are marked as missing.
+ *
+ * @param genotypes The genotypes.
+ * @param variant_set Names of the variants to include, all if empty.
+ * @param missing Missing samples will be set to 1.
+ * @param names The names of the included variants will be stored here.
+ *
+ * @return The index of each included variant.
+ */
+std::vector<size_t>
+select_variants(genotype_matrix_ptr genotypes, const std::set<std::string> &variant_set, arma::uvec &missing, std::vector<std::string> &names)
 {
-
     bool all_variants = variant_set.size( ) == 0;
-    size_t num_variants = variant_set.size( );
-    if( all_variants )
-    {
-        num_variants = genotypes->size( );
-    }
-
-    X.resize( missing.n_elem, num_variants + cov.n_cols + 1 );
-
-    std::vector<std::string> names = genotypes->get_snp_names( );
-    std::vector<std::string> valid_names;
-    size_t cur_col = 0;
+    std::vector<std::string> snp_names = genotypes->get_snp_names( );
+    std::vector<size_t> variants;
     for(int i = 0; i < genotypes->size( ); i++)
     {
-        if( !all_variants && variant_set.count( names[ i ] ) <= 0 )
+        if( !all_variants && variant_set.count( snp_names[ i ] ) <= 0 )
         {
             continue;
         }
         
+        /* Missing genotypes are coded as 0 in the design matrix */
         snp_row &cur_row = genotypes->get_row( i );
+        double sum = 0.0;
+        double sum_sq = 0.0;
         for(int j = 0; j < cur_row.size( ); j++)
         {
             if( cur_row[ j ] != 3 )
             {
-                X( j, cur_col ) = cur_row[ j ];   
+                sum += cur_row[ j ];
+                sum_sq += cur_row[ j ] * cur_row[ j ];
             }
             else
             {
-                X( j, cur_col ) = 0;
                 missing[ j ] = 1;
             }
         }
 
-        if( arma::var( X.col( cur_col ) ) > 1e-4 )
+        double n = cur_row.size( );
+        double variance = ( sum_sq - sum * sum / n ) / ( n - 1 );
+        if( variance > 1e-4 )
         {
-            valid_names.push_back( names[ i ] );
-            cur_col++;
+            variants.push_back( i );
+            names.push_back( snp_names[ i ] );
         }
     }
 
-    for(int i = 0; i < cov.n_cols; i++)
-    {
-        X.col( cur_col ) = cov.col( i );
-        cur_col++;
-    }
-
-    X.col( cur_col ) = arma::ones<arma::vec>( missing.n_elem );
-    cur_col++;
-    X.resize( missing.n_elem, cur_col );
-
-    return valid_names;
+    return variants;
 }
 
 int
@@ -110,6 +109,8 @@ main(int argc, char *argv[])
     parser.add_option( "-o", "--out" ).help( "The output file that will contain the results (binary)." );
     parser.add_option( "-t", "--threshold" ).help( "Only output p-values less or equal to this value." ).set_default( 1.0 );
     parser.add_option( "-m", "--model" ).choices( &model_choices[ 0 ], &model_choices[ 2 ] ).metavar( "model" ).help( "The model to use for the phenotype, 'binomial' or 'normal', default = 'binomial'." ).set_default( "binomial" );
+    parser.add_option( "--memory" ).type( "int" ).help( "Memory budget in megabytes for the normal equations and the decoded genotypes (default = 4096)." ).set_default( 4096 );
+    parser.add_option( "--threads" ).type( "int" ).help( "Number of threads used to accumulate the normal equations (default = 1)." ).set_default( 1 );
     parser.add_option( "-l", "--link-function" ).choices( &link_choices[ 0 ], &link_choices[ 5 ] ).metavar( "link" ).help( "The link function, or scale, that is used for the penetrance: 'logit' log(p/(1-p)), 'logc' log(1 - p), 'odds' p/(1-p), 'identity' p, 'log' log(p)." );
 
     Values options = parser.parse_args( argc, argv );
@@ -137,8 +138,7 @@ main(int argc, char *argv[])
     std::vector<std::string> cov_names;
     if( options.is_set( "pheno" ) )
     {
-        std::ifstream phenotype_file( options[ "pheno" ].c_str( ) );
-        phenotype = parse_phenotypes( phenotype_file, missing, order, options[ "mpheno" ] );
+        phenotype = read_phenotype_file( options[ "pheno" ], missing, order, options[ "mpheno" ] );
     }
     else
     {
@@ -146,8 +146,7 @@ main(int argc, char *argv[])
     }
     if( options.is_set( "cov" ) )
     {
-        std::ifstream covariate_file( options[ "cov" ].c_str( ) );
-        cov = parse_covariate_matrix( covariate_file, missing, order, &cov_names );
+        cov = read_covariate_file( options[ "cov" ], missing, order, NULL, &cov_names );
     }
 
     std::set<std::string> variant_set;
@@ -165,8 +164,24 @@ main(int argc, char *argv[])
     }
     std::ostream &out = options.is_set( "out" ) ? output_file : std::cout;
 
-    arma::mat X;
-    std::vector<std::string> variant_names = create_design_matrix( genotypes, cov, variant_set, missing, X );
+    std::vector<std::string> variant_names;
+    std::vector<size_t> variants = select_variants( genotypes, variant_set, missing, variant_names );
+
+    /* The genotypes are decoded in blocks, only the covariates and intercept are stored */
+    arma::mat dense = arma::ones<arma::mat>( missing.n_elem, cov.n_cols + 1 );
+    if( cov.n_cols > 0 )
+    {
+        dense.cols( 0, cov.n_cols - 1 ) = cov;
+    }
+    dense.rows( arma::find( missing ) ).zeros( );
+    int num_threads = (int) options.get( "threads" );
+    size_t block_size = streaming_block_size( missing.n_elem, variants.size( ), dense.n_cols, (int) options.get( "memory" ), num_threads );
+    if( block_size == 0 )
+    {
+        std::cerr << "besiq: error: The normal equations for " << variants.size( ) + dense.n_cols << " parameters do not fit in --memory." << std::endl;
+        exit( 1 );
+    }
+    streaming_design X( genotypes, variants, dense, block_size, num_threads );
     
     glm_model *model = NULL;
     if( options[ "model" ] == "binomial" )
@@ -191,7 +206,7 @@ main(int argc, char *argv[])
     }
 
     glm_info result;
-    arma::vec beta = irls( X, phenotype, missing, *model, result);
+    arma::vec beta = streaming_irls( X, phenotype, missing, *model, result );
 
     /* The design matrix is constructed such that the variants appear first */
     out << "snp\tbeta\tse_beta\tpvalue\n";
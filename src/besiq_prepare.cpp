@@ -0,0 +1,106 @@
+#include <iostream>
+
+#include <armadillo>
+
+#include <cpp-argparse/OptionParser.h>
+#include <besiq/io/bundle.hpp>
+#include <besiq/io/covariates.hpp>
+
+#include <plink/plink_file.hpp>
+#include <plink/shared_genotypes.hpp>
+
+using namespace arma;
+using namespace optparse;
+
+const std::string USAGE = "besiq-prepare [OPTIONS] plink_file bundle\n       besiq-prepare --clean-shm";
+const std::string DESCRIPTION = "Preprocesses genotypes, phenotypes and covariates into a single binary bundle that can be used instead of the plink file by the pairwise commands.";
+const std::string VERSION = "besiq 0.0.1";
+const std::string EPILOG = "";
+
+/**
+ * Parses all columns of a phenotype or covariate file.
+ *
+ * @param path The path to the file.
+ * @param order The order of the samples.
+ *
+ * @return The parsed columns, missing values are NaN.
+ */
+bundle_columns
+parse_all_columns(const std::string &path, const std::vector<std::string> &order)
+{
+    bundle_columns columns;
+    std::vector<std::string> header;
+    arma::uvec missing = arma::zeros<arma::uvec>( order.size( ) );
+    columns.values = read_covariate_file( path, missing, order, NULL, &header );
+    columns.names.assign( header.begin( ) + 2, header.end( ) );
+
+    return columns;
+}
+
+int
+main(int argc, char *argv[])
+{
+    OptionParser parser = OptionParser( ).usage( USAGE )
+                                         .version( VERSION )
+                                         .description( DESCRIPTION )
+                                         .epilog( EPILOG ); 
+ 
+    parser.add_option( "-p", "--pheno" ).help( "Include the phenotypes in this file, otherwise the phenotype in the plink file is used." );
+    parser.add_option( "-c", "--cov" ).action( "store" ).type( "string" ).metavar( "filename" ).help( "Include the covariates in this file, they are used by every analysis of the bundle." );
+    parser.add_option( "--no-mafflip" ).action( "store_true" ).set_default( 0 ).help( "Keep the allele coding of the plink file instead of coding by the minor allele (the pairwise commands require the minor allele coding)." );
+    parser.add_option( "--clean-shm" ).action( "store_true" ).set_default( 0 ).help( "Remove the genotypes that jobs killed while using --shared-memory left in shared memory, and exit. Genotypes that are in use are kept." );
+
+    Values options = parser.parse_args( argc, argv );
+    if( (bool) options.get( "clean_shm" ) )
+    {
+        try
+        {
+            size_t num_removed = remove_stale_shared_genotypes( );
+            std::cout << "besiq: Removed " << num_removed << " unused shared memory segments." << std::endl;
+        }
+        catch(std::runtime_error &e)
+        {
+            std::cerr << "besiq: error: " << e.what( ) << std::endl;
+            exit( 1 );
+        }
+
+        return 0;
+    }
+
+    if( parser.args( ).size( ) != 2 )
+    {
+        parser.print_help( );
+        exit( 1 );
+    }
+
+    bool mafflip = !(bool) options.get( "no_mafflip" );
+    plink_file_ptr genotype_file = open_plink_file( parser.args( )[ 0 ], mafflip );
+    std::vector<std::string> order = genotype_file->get_sample_iids( );
+
+    bundle_columns phenotypes;
+    bundle_columns covariates;
+    try
+    {
+        if( options.is_set( "pheno" ) )
+        {
+            phenotypes = parse_all_columns( options[ "pheno" ], order );
+        }
+        if( options.is_set( "cov" ) )
+        {
+            covariates = parse_all_columns( options[ "cov" ], order );
+        }
+    }
+    catch(std::runtime_error &e)
+    {
+        std::cerr << "besiq: error: " << e.what( ) << std::endl;
+        exit( 1 );
+    }
+
+    if( !write_bundle( parser.args( )[ 1 ], genotype_file, mafflip, phenotypes, covariates ) )
+    {
+        std::cerr << "besiq: error: Could not write the bundle " << parser.args( )[ 1 ] << "." << std::endl;
+        exit( 1 );
+    }
+
+    return 0;
+}
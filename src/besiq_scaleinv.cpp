@@ -34,6 +34,7 @@ main(int argc, char *argv[])
     group.add_option( "--bc-end" ).set_default( 3.0 ).help(  "End lambda for box-cox (default=3.0)." );
     group.add_option( "--bc-step" ).set_default( 0.5 ).help(  "Step lambda for box-cox (default=0.5)." );
     group.add_option( "--power-odds" ).action( "store_true" ).help(  "Use the power-odds family for continuous data." );
+    group.add_option( "--bc-grid" ).action( "store_true" ).help(  "Fit every lambda on the box-cox grid and report the best one, instead of refining the grid." );
     parser.add_option_group( group );
 
     Values options = parser.parse_args( argc, argv );
@@ -68,11 +69,11 @@ main(int argc, char *argv[])
 
         if( options[ "model" ] == "binomial" )
         {
-            m = new boxcox_method( parsed_data->data, *model_matrix, false, lambda_start, lambda_end, lambda_step );
+            m = new boxcox_method( parsed_data->data, *model_matrix, false, lambda_start, lambda_end, lambda_step, false, options.is_set( "bc_grid" ) );
         }
         else if( options[ "model" ] == "normal" )
         {
-            m = new boxcox_method( parsed_data->data, *model_matrix, true, lambda_start, lambda_end, lambda_step, options.is_set( "power_odds" ) );
+            m = new boxcox_method( parsed_data->data, *model_matrix, true, lambda_start, lambda_end, lambda_step, options.is_set( "power_odds" ), options.is_set( "bc_grid" ) );
         }
     }
     
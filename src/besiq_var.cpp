@@ -4,9 +4,10 @@
 
 #include <cpp-argparse/OptionParser.h>
 #include <besiq/io/covariates.hpp>
+#include <besiq/io/resultfile.hpp>
+#include <besiq/method/var_method.hpp>
 
 #include <plink/plink_file.hpp>
-#include <dcdflib/libdcdf.hpp>
 
 using namespace arma;
 using namespace optparse;
@@ -16,80 +17,6 @@ const std::string DESCRIPTION = "Computes variance hetrogenity for single varian
 const std::string VERSION = "besiq 0.0.1";
 const std::string EPILOG = "";
 
-arma::mat
-compute_medians(const snp_row &row, const arma::vec &pheno, const arma::uvec &missing)
-{
-    std::vector<std::vector<double>> groups( 3 );
-    arma::mat medians = arma::zeros<arma::mat>( 3, 2 );
-    for(int i = 0; i < row.size( ); i++)
-    {
-        if( row[ i ] != 3 && missing[ i ] == 0 )
-        {
-            groups[ row[ i ] ].push_back( pheno[ i ] );
-            medians( row[ i ], 1 ) += 1.0;
-        }
-    }
-
-    for(int i = 0; i < 3; i++)
-    {
-        std::sort( groups[ i ].begin( ), groups[ i ].end( ) );
-        if( groups[ i ].size( ) > 0 )
-        {
-            medians( i, 0 ) = groups[ i ][ groups[ i ].size( ) / 2 ];
-        }
-        else
-        {
-            medians( i, 0 ) = 0.0;
-        }
-    }
-
-    return medians;
-}
-
-bool
-compute_brown_forsythe(const snp_row &row, const arma::vec &pheno, const arma::uvec &missing, double *W, double *p, size_t *N)
-{
-    double k = 3;
-    arma::mat medians = compute_medians( row, pheno, missing );
-
-    if( arma::min( medians.col( 1 ) ) <= 20 )
-    {
-        *N = arma::accu( medians.col( 1 ) );
-        return false;
-    }
-    
-    arma::vec z_i = arma::zeros<arma::vec>( 3 );
-    double z = 0.0;
-    *N = arma::accu( medians.col( 1 ) );
-    for(int i = 0; i < row.size( ); i++)
-    {
-        if( row[ i ] != 3 && missing[ i ] == 0 )
-        {
-            double z_ij = std::abs( pheno[ i ] - medians( row[ i ], 0 ) );
-            z_i[ row[ i ] ] += z_ij / medians( row[ i ], 1 );
-            z += z_ij / *N;
-        }
-    }
-
-    double W_sq = 0.0;
-    for(int i = 0; i < row.size( ); i++)
-    {
-        if( row[ i ] != 3 && missing[ i ] == 0 )
-        {
-            double z_ij = std::abs( pheno[ i ] - medians( row[ i ], 0 ) );
-            W_sq += pow( z_ij - z_i[ row[ i ] ], 2 );
-        }
-    }
-
-    double numerator = dot( medians.col( 1 ), pow( z_i - z, 2 ) );
-
-    *W = ( (*N - k) * numerator ) / ( ( k - 1 ) * W_sq );
-    *p = 1 - f_cdf( *W, k - 1, *N - k );
-
-    return true;
-}
-
-
 int
 main(int argc, char *argv[])
 {
@@ -101,6 +28,11 @@ main(int argc, char *argv[])
     parser.add_option( "-p", "--pheno" ).help( "Read phenotypes from this file instead of a plink file." );
     parser.add_option( "-e", "--mpheno" ).help( "Name of the phenotype that you want to read (if there are more than one in the phenotype file)." );
     parser.add_option( "-o", "--out" ).help( "The output file that will contain the results (binary)." );
+    parser.add_option( "--cache" ).action( "store_true" ).set_default( 0 ).help( "Store the parsed phenotypes in a binary file next to them, and read it on later runs." );
+    parser.add_option( "--threshold" ).help( "Only output variants with a p-value less than this." ).set_default( -9 );
+    parser.add_option( "--split" ).help( "Runs the analysis on a part of the variants, and this is part X of 1-<num_splits> parts (default = 1)." ).set_default( 1 );
+    parser.add_option( "--num-splits" ).help( "Sets the number of parts to split the variants in (default = 1)." ).set_default( 1 );
+    parser.add_option( "-t", "--threads" ).type( "int" ).help( "Number of threads used to test the variants (default = 1)." ).set_default( 1 );
 
     Values options = parser.parse_args( argc, argv );
     if( parser.args( ).size( ) != 1 )
@@ -109,6 +41,14 @@ main(int argc, char *argv[])
         exit( 1 );
     }
 
+    size_t split = (size_t) options.get( "split" );
+    size_t num_splits = (size_t) options.get( "num_splits" );
+    if( split > num_splits || split == 0 || num_splits == 0 )
+    {
+        std::cerr << "besiq: error: Num splits and split must be > 0, and split <= num_splits." << std::endl;
+        exit( 1 );
+    }
+
     std::ios_base::sync_with_stdio( false );
     
     /* Read all genotypes */
@@ -117,36 +57,39 @@ main(int argc, char *argv[])
     std::vector<std::string> order = genotype_file->get_sample_iids( );
 
     /* Parse phenotypes */
-    arma::uvec missing = arma::zeros<arma::uvec>( genotype_file->get_samples( ).size( ) );
-    arma::vec phenotypes;
+    method_data_ptr data( new method_data( ) );
+    data->threshold = (double) options.get( "threshold" );
+    data->missing = arma::zeros<arma::uvec>( genotype_file->get_samples( ).size( ) );
     if( options.is_set( "pheno" ) )
     {
-        std::ifstream phenotype_file( options[ "pheno" ].c_str( ) );
-        phenotypes = parse_phenotypes( phenotype_file, missing, order, options[ "mpheno" ] );
+        data->phenotype = read_phenotype_file( options[ "pheno" ], data->missing, order, options[ "mpheno" ], (bool) options.get( "cache" ) );
     }
     else
     {
-        phenotypes = create_phenotype_vector( genotype_file->get_samples( ), missing );
+        data->phenotype = create_phenotype_vector( genotype_file->get_samples( ), data->missing );
     }
 
-
-    std::vector<pio_locus_t> loci = genotype_file->get_loci( );
-    std::cout << "chr\tpos\tsnp\tW\tP\tN\n";
-    for( int i = 0; i < loci.size( ); i++)
+    /* Open results. */
+    resultfile *result_file = NULL;
+    if( options.is_set( "out" ) )
     {
-        const snp_row &row = *genotypes->get_row( loci[ i ].name );
-        double W;
-        double p;
-        size_t N;
-        if( compute_brown_forsythe( row, phenotypes, missing, &W, &p, &N ) )
-        {
-            std::cout << (int) loci[ i ].chromosome << "\t" << loci[ i ].bp_position << "\t"  << loci[ i ].name << "\t" << W << "\t" << p << "\t" << N << "\n";
-        }
-        else
-        {
-            std::cout << (int) loci[ i ].chromosome << "\t" << loci[ i ].bp_position << "\t" << loci[ i ].name << "\t" << "NA" << "\t" << "NA" << "\t" << N << "\n";
-        }
+        result_file = new bresultfile( options[ "out" ], genotype_file->get_locus_names( ) );
     }
+    else
+    {
+        result_file = new tresultfile( "-", "w" );
+    }
+    if( result_file == NULL || !result_file->open( ) )
+    {
+        std::cerr << "besiq: error: Can not open result file." << std::endl;
+        exit( 1 );
+    }
+
+    var_method method( data );
+    run_single_method( method, genotypes, *result_file, split, num_splits, (int) options.get( "threads" ) );
+
+    result_file->close( );
+    delete result_file;
 
     return 0;
 }
@@ -3,11 +3,13 @@
 
 #include <cpp-argparse/OptionParser.h>
 
+#include <plink/plink_file.hpp>
 #include <besiq/io/resultfile.hpp>
+#include <besiq/logp_grid.hpp>
 
 using namespace optparse;
 
-const std::string USAGE = "besiq-view result_file [result_file2 ...]";
+const std::string USAGE = "besiq-view result_file [result_file2 ...]\n       besiq-view --grid-merge [--grid output] grid_file [grid_file2 ...]";
 const std::string VERSION = "besiq 0.0.1";
 const std::string DESCRIPTION = "A tool for viewing binary result file.";
 const std::string EPILOG = "";
@@ -38,6 +40,193 @@ struct greater_equal : comparator
     bool operator()(const float& x, const float&y) const { return x != result_get_missing( ) && x >= y; };
 };
 
+/**
+ * Merges binary grid files and writes the merged grid either as a
+ * binary grid file or as text to stdout.
+ *
+ * @param options The command line options.
+ * @param paths Paths to the grid files.
+ *
+ * @return The exit status.
+ */
+int
+merge_grids(Values &options, const std::vector<std::string> &paths)
+{
+    logp_grid grid;
+    for(int i = 0; i < paths.size( ); i++)
+    {
+        std::ifstream grid_file( paths[ i ].c_str( ), std::ios::binary );
+        logp_grid partial;
+        if( !partial.read_binary( grid_file ) )
+        {
+            std::cerr << "besiq-view: error: Could not read grid file: '" << paths[ i ] << "'." << std::endl;
+            return 1;
+        }
+
+        if( i == 0 )
+        {
+            grid = partial;
+        }
+        else if( !grid.merge( partial ) )
+        {
+            std::cerr << "besiq-view: error: Grid file '" << paths[ i ] << "' has a different layout." << std::endl;
+            return 1;
+        }
+    }
+
+    if( options.is_set( "grid" ) )
+    {
+        std::ofstream grid_file( options[ "grid" ].c_str( ), std::ios::binary );
+        if( !grid.write_binary( grid_file ) )
+        {
+            std::cerr << "besiq-view: error: Could not write grid file." << std::endl;
+            return 1;
+        }
+    }
+    else
+    {
+        grid.write_grid( std::cout );
+    }
+
+    return 0;
+}
+
+/**
+ * Number of p-values a thread buffers before adding them to the grid.
+ */
+const size_t GRID_BUFFER_SIZE = 65536;
+
+/**
+ * Maximum number of grid points along each axis.
+ */
+const size_t GRID_MAX_SIZE = 7000;
+
+/**
+ * Requested size in bp of each grid point.
+ */
+const size_t GRID_BP_WINDOW = 500000;
+
+/**
+ * Adds buffered p-values to the grid and clears the buffers. Only one
+ * thread at a time may add to the grid.
+ *
+ * @param grid The grid.
+ * @param pairs The grid indices of the variants in each pair.
+ * @param pvalues The p-value of each pair.
+ */
+void
+flush_pvalues(logp_grid &grid, std::vector<size_t> &pairs, std::vector<float> &pvalues)
+{
+    #pragma omp critical( grid )
+    {
+        for(size_t i = 0; i < pvalues.size( ); i++)
+        {
+            grid.add_pvalue( pairs[ 2 * i ], pairs[ 2 * i + 1 ], pvalues[ i ] );
+        }
+    }
+
+    pairs.clear( );
+    pvalues.clear( );
+}
+
+/**
+ * Computes a grid of the p-values in the given field of the result
+ * files. The threads read the result files and add the p-values to
+ * a single grid in blocks, so the memory does not grow with the
+ * number of threads.
+ *
+ * @param options The command line options.
+ * @param result_files The result files.
+ * @param field The field that contains the p-values.
+ *
+ * @return The exit status.
+ */
+int
+compute_grid(Values &options, std::vector<bresultfile *> &result_files, size_t field)
+{
+    if( !options.is_set( "plink" ) )
+    {
+        std::cerr << "besiq-view: error: --grid requires the variant positions from --plink." << std::endl;
+        return 1;
+    }
+
+    std::vector<pio_locus_t> loci;
+    try
+    {
+        loci = open_plink_file( options[ "plink" ] )->get_loci( );
+    }
+    catch(plink_error &e)
+    {
+        std::cerr << "besiq-view: error: " << e.what( ) << std::endl;
+        return 1;
+    }
+    logp_grid grid( loci, GRID_MAX_SIZE, GRID_BP_WINDOW );
+    if( grid.get_bp_window( ) != GRID_BP_WINDOW )
+    {
+        std::cerr << "besiq-view: warning: Too many grid points for a window of " << GRID_BP_WINDOW << " bp, using a window of " << grid.get_bp_window( ) << " bp." << std::endl;
+    }
+
+    /* Map the variants of each result file to the grid once */
+    std::vector< std::vector<long long> > grid_index( result_files.size( ) );
+    for(int i = 0; i < result_files.size( ); i++)
+    {
+        const std::vector<std::string> &snp_names = result_files[ i ]->get_snp_names( );
+        grid_index[ i ].resize( snp_names.size( ), -1 );
+        for(int j = 0; j < snp_names.size( ); j++)
+        {
+            size_t index;
+            if( grid.get_index( snp_names[ j ], index ) )
+            {
+                grid_index[ i ][ j ] = index;
+            }
+        }
+    }
+
+    size_t header_size = result_files[ 0 ]->get_header( ).size( );
+    int num_threads = (int) options.get( "threads" );
+    #pragma omp parallel num_threads( num_threads )
+    {
+        std::vector<float> values( header_size );
+        std::vector<size_t> pairs;
+        std::vector<float> pvalues;
+        uint32_t snps[ 2 ];
+
+        #pragma omp for schedule( dynamic, 1 )
+        for(int i = 0; i < result_files.size( ); i++)
+        {
+            const std::vector<long long> &index = grid_index[ i ];
+            while( result_files[ i ]->read( snps, &values[ 0 ] ) )
+            {
+                float p = values[ field ];
+                if( p == result_get_missing( ) || snps[ 0 ] >= index.size( ) || snps[ 1 ] >= index.size( ) ||
+                    index[ snps[ 0 ] ] < 0 || index[ snps[ 1 ] ] < 0 )
+                {
+                    continue;
+                }
+
+                pairs.push_back( index[ snps[ 0 ] ] );
+                pairs.push_back( index[ snps[ 1 ] ] );
+                pvalues.push_back( p );
+                if( pvalues.size( ) >= GRID_BUFFER_SIZE )
+                {
+                    flush_pvalues( grid, pairs, pvalues );
+                }
+            }
+        }
+
+        flush_pvalues( grid, pairs, pvalues );
+    }
+
+    std::ofstream grid_file( options[ "grid" ].c_str( ), std::ios::binary );
+    if( !grid.write_binary( grid_file ) )
+    {
+        std::cerr << "besiq-view: error: Could not write grid file." << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -53,6 +242,10 @@ main(int argc, char *argv[])
     parser.add_option( "-f", "--field" ).set_default( 0 ).help( "The value field to filter on, the field index of the first non snp name is 0." );
     parser.add_option( "-o", "--out" ).help( "Write results to a binary result file." );
     parser.add_option( "--force" ).action( "store_true" ).help( "View possibly corrupted files." );
+    parser.add_option( "--grid" ).help( "Write a binary grid of the p-values in --field to this file instead of viewing the results, requires --plink." );
+    parser.add_option( "--plink" ).help( "Plink file prefix with the variant positions that define the grid." );
+    parser.add_option( "--grid-merge" ).action( "store_true" ).help( "The arguments are binary grid files, that are merged and written to --grid, or printed as text." );
+    parser.add_option( "--threads" ).type( "int" ).set_default( 1 ).help( "Number of threads used to read the result files when computing the grid (default = 1)." );
     
     Values options = parser.parse_args( argc, argv );
     std::vector<std::string> args = parser.args( );
@@ -63,6 +256,11 @@ main(int argc, char *argv[])
         exit( 1 );
     }
 
+    if( options.is_set( "grid_merge" ) )
+    {
+        return merge_grids( options, args );
+    }
+
     std::vector<bresultfile *> result_files;
     for(int i = 0; i < args.size( ); i++)
     {
@@ -102,9 +300,15 @@ main(int argc, char *argv[])
 
     comparator &compare = *op[ (std::string) options.get( "operation" ) ];
 
+    if( result_files.empty( ) )
+    {
+        std::cerr << "besiq-view: error: No result files could be read." << std::endl;
+        return 1;
+    }
+
     std::vector<std::string> header = result_files[ 0 ]->get_header( );
     size_t header_size = header.size( );
-    for(int i = 1; i < result_files.size( ); i++)
+    for(int i = 0; i < result_files.size( ); i++)
     {
         if( result_files[ i ]->get_header( ).size( ) != header_size )
         {
@@ -112,6 +316,16 @@ main(int argc, char *argv[])
             return 1;
         }
     }
+    if( field >= header_size )
+    {
+        std::cerr << "besiq-view: error: Field " << field << " does not exist, the result files have " << header_size << " fields." << std::endl;
+        return 1;
+    }
+
+    if( options.is_set( "grid" ) )
+    {
+        return compute_grid( options, result_files, field );
+    }
     
     resultfile *output_file;
     if( options.is_set( "out" ) )
@@ -20,6 +20,9 @@ create_common_options(const std::string &usage, const std::string &description,
     parser.add_option( "-e", "--mpheno" ).help( "Name of the phenotype that you want to read (if there are more than one in the phenotype file)." );
     parser.add_option( "-o", "--out" ).help( "The output file that will contain the results (binary)." );
     parser.add_option( "-c", "--cov" ).action( "store" ).type( "string" ).metavar( "filename" ).help( "Performs the analysis by including the covariates in this file." );
+    parser.add_option( "--cov-name" ).action( "append" ).metavar( "name" ).help( "Only include this covariate, can be given several times (default = all covariates)." );
+    parser.add_option( "--shared-memory" ).action( "store_true" ).set_default( 0 ).help( "Keep the genotypes in shared memory, so that concurrent jobs on the same machine that use the same plink file share a single copy." );
+    parser.add_option( "--cache" ).action( "store_true" ).set_default( 0 ).help( "Store the parsed phenotypes and covariates in binary files next to them, and read these on later runs." );
     parser.add_option( "-t", "--threshold" ).help( "Only output pairs with a p-value less than this." ).set_default( -9 );
     parser.add_option( "--split" ).help( "Runs the analysis on a part of the pair file, and this is part X of 1-<num_splits> parts (default = 1)." ).set_default( 1 );
     parser.add_option( "--num-splits" ).help( "Sets the number of parts to split the pair file in (default = 1)." ).set_default( 1 );
@@ -37,9 +40,46 @@ parse_common_options(optparse::Values &options, const std::vector<std::string> &
         std::cerr << "besiq: error: Pairs or genetypes is missing." << std::endl;
         exit( 1 );
     }
-    /* Read all genotypes */
-    plink_file_ptr genotype_file = open_plink_file( args[ 1 ], true );
-    genotype_matrix_ptr genotypes = create_genotype_matrix( genotype_file );
+    /* Read all genotypes, either from a prepared bundle or a plink file */
+    plink_file_ptr genotype_file;
+    dataset_bundle_ptr bundle;
+    genotype_matrix_ptr genotypes;
+    if( is_bundle( args[ 1 ] ) )
+    {
+        bundle = dataset_bundle_ptr( new dataset_bundle( args[ 1 ] ) );
+        if( !bundle->is_mafflipped( ) )
+        {
+            std::cerr << "besiq: error: The bundle must be prepared with the minor allele coding." << std::endl;
+            exit( 1 );
+        }
+        genotypes = bundle->get_genotypes( );
+    }
+    else
+    {
+        genotype_file = open_plink_file( args[ 1 ], true );
+        if( (bool) options.get( "shared_memory" ) )
+        {
+            try
+            {
+                genotypes = create_shared_genotype_matrix( genotype_file, args[ 1 ], true );
+            }
+            catch(plink_error &e)
+            {
+                /* The rows have been consumed, so there is nothing to fall back on */
+                std::cerr << "besiq: error: " << e.what( ) << std::endl;
+                exit( 1 );
+            }
+            catch(std::runtime_error &e)
+            {
+                std::cerr << "besiq: warning: " << e.what( ) << " The genotypes are not shared." << std::endl;
+            }
+        }
+        if( genotypes.get( ) == NULL )
+        {
+            genotypes = create_genotype_matrix( genotype_file );
+        }
+    }
+    const std::vector<pio_sample_t> &samples = bundle.get( ) != NULL ? bundle->get_samples( ) : genotype_file->get_samples( );
     
     /* Create pair iterator */
     size_t split = (size_t) options.get( "split" );
@@ -50,32 +90,52 @@ parse_common_options(optparse::Values &options, const std::vector<std::string> &
         exit( 1 );
     }
     
-    pairfile *pairs = open_pair_file( args[ 0 ].c_str( ), genotype_file->get_locus_names( ) );
+    pairfile *pairs = open_pair_file( args[ 0 ].c_str( ), genotypes->get_snp_names( ) );
     if( pairs == NULL || !pairs->open( split, num_splits ) )
     {
         std::cerr << "besiq: error: Could not open pair file." << std::endl;
         exit( 1 );
     }
     
-    /* Read additional data  */
+    /* Read additional data, the bundle provides them unless a file is given */
     method_data_ptr data( new method_data( ) );
     data->threshold = (double) options.get( "threshold" );
     data->print_params = (bool) options.get( "print_params" );
-    data->missing = zeros<uvec>( genotype_file->get_samples( ).size( ) );
-    std::vector<std::string> order = genotype_file->get_sample_iids( );
-    if( options.is_set( "pheno" ) )
+    data->missing = zeros<uvec>( samples.size( ) );
+    std::vector<std::string> order;
+    for(size_t i = 0; i < samples.size( ); i++)
     {
-        std::ifstream phenotype_file( options[ "pheno" ].c_str( ) );
-        data->phenotype = parse_phenotypes( phenotype_file, data->missing, order, options[ "mpheno" ] );
+        order.push_back( samples[ i ].iid );
     }
-    else
+    bool use_cache = (bool) options.get( "cache" );
+    std::vector<std::string> columns( options.all( "cov_name" ).begin( ), options.all( "cov_name" ).end( ) );
+    try
     {
-        data->phenotype = create_phenotype_vector( genotype_file->get_samples( ), data->missing );
+        if( options.is_set( "pheno" ) )
+        {
+            data->phenotype = read_phenotype_file( options[ "pheno" ], data->missing, order, options[ "mpheno" ], use_cache );
+        }
+        else if( bundle.get( ) != NULL && bundle->num_phenotypes( ) > 0 )
+        {
+            data->phenotype = bundle->get_phenotype( options[ "mpheno" ], data->missing );
+        }
+        else
+        {
+            data->phenotype = create_phenotype_vector( samples, data->missing );
+        }
+        if( options.is_set( "cov" ) )
+        {
+            data->covariate_matrix = read_covariate_file( options[ "cov" ], data->missing, order, &columns, NULL, use_cache );
+        }
+        else if( bundle.get( ) != NULL && bundle->num_covariates( ) > 0 )
+        {
+            data->covariate_matrix = bundle->get_covariates( &columns, data->missing );
+        }
     }
-    if( options.is_set( "cov" ) )
+    catch(std::runtime_error &e)
     {
-        std::ifstream covariate_file( options[ "cov" ].c_str( ) );
-        data->covariate_matrix = parse_covariate_matrix( covariate_file, data->missing, order );
+        std::cerr << "besiq: error: " << e.what( ) << std::endl;
+        exit( 1 );
     }
 
     /* XXX: Implement proper log file. */
@@ -86,7 +146,7 @@ parse_common_options(optparse::Values &options, const std::vector<std::string> &
     resultfile *result_file = NULL;
     if( options.is_set( "out" ) )
     {
-        result_file = new bresultfile( options[ "out" ], genotype_file->get_locus_names( ) );
+        result_file = new bresultfile( options[ "out" ], genotypes->get_snp_names( ) );
     }
     else
     {
@@ -6,6 +6,8 @@
 #include <fstream>
 
 #include <plink/plink_file.hpp>
+#include <plink/shared_genotypes.hpp>
+#include <besiq/io/bundle.hpp>
 #include <besiq/io/covariates.hpp>
 #include <besiq/io/pairfile.hpp>
 #include <besiq/io/resultfile.hpp>
@@ -26,6 +28,7 @@ struct common_options
     {
     }
 
+    /* Not set when the genotypes are read from a bundle */
     plink_file_ptr genotype_file;
     genotype_matrix_ptr genotypes;
     method_data_ptr data;
@@ -33,3 +33,30 @@ TEST(BayesicModelsTest, SIndependent)
     log_double likelihood = model.prob( snp1, snp2, phenotype, weight );
     ASSERT_NEAR( likelihood.value( ), 0.09, 0.001 );
 }
+
+TEST(BayesicModelsTest, SIndependentLaplace)
+{
+    arma::vec alpha = 2.0 * arma::ones<arma::vec>( 2 );
+    sindependent mc_model( 1.0, alpha, 200000 );
+    sindependent laplace_model( 1.0, alpha, 200000, INTEGRATOR_LAPLACE, 0.01 );
+
+    size_t n = 60;
+    snp_row snp1;
+    snp_row snp2;
+    snp1.resize( n );
+    snp2.resize( n );
+    arma::vec phenotype = arma::zeros<arma::vec>( n );
+    for(int i = 0; i < n; i++)
+    {
+        snp1.assign( i, ( i * 7 ) % 3 );
+        snp2.assign( i, ( i / 3 + i / 11 ) % 3 );
+        phenotype[ i ] = ( ( i * 13 ) % 5 + snp1[ i ] ) > 3 ? 1.0 : 0.0;
+    }
+    arma::vec weight = arma::ones<arma::vec>( n );
+
+    log_double mc_likelihood = mc_model.prob( snp1, snp2, phenotype, weight );
+    log_double laplace_likelihood = laplace_model.prob( snp1, snp2, phenotype, weight );
+
+    ASSERT_LT( laplace_model.last_error( ), 0.01 );
+    ASSERT_NEAR( laplace_likelihood.log_value( ), mc_likelihood.log_value( ), 0.05 );
+}
@@ -0,0 +1,165 @@
+#include <cmath>
+
+#include <gtest/gtest.h>
+
+#include <glm/models/binomial.hpp>
+#include <glm/models/links/power_odds.hpp>
+#include <besiq/method/boxcox_method.hpp>
+#include <besiq/stats/cell_glm.hpp>
+
+TEST(boxcox_test, StopsAfterDecrease)
+{
+    boxcox_profile profile;
+    ASSERT_TRUE( profile.add( 1.0 ) );
+    ASSERT_TRUE( profile.add( 3.0 ) );
+    ASSERT_FALSE( profile.add( 2.0 ) );
+    ASSERT_FALSE( profile.is_done( ) );
+    ASSERT_FALSE( profile.add( 1.0 ) );
+    ASSERT_TRUE( profile.is_done( ) );
+    ASSERT_DOUBLE_EQ( profile.get_max( ), 3.0 );
+}
+
+TEST(boxcox_test, DipThenLaterMaximum)
+{
+    /* Each dip is followed by a rise, so the later maximum is reached */
+    double logl[] = { 1.0, 3.0, 2.0, 2.5, 2.2, 5.0 };
+    boxcox_profile profile;
+    for(int i = 0; i < 6; i++)
+    {
+        ASSERT_FALSE( profile.is_done( ) );
+        profile.add( logl[ i ] );
+    }
+    ASSERT_DOUBLE_EQ( profile.get_max( ), 5.0 );
+
+    profile.add( 4.0 );
+    ASSERT_FALSE( profile.is_done( ) );
+    profile.add( 4.5 );
+    ASSERT_FALSE( profile.is_done( ) );
+    profile.add( 4.0 );
+    profile.add( 3.0 );
+    ASSERT_TRUE( profile.is_done( ) );
+    ASSERT_DOUBLE_EQ( profile.get_max( ), 5.0 );
+}
+
+/**
+ * Number of samples with each pair of genotypes.
+ */
+const size_t CELL_SIZE = 60;
+
+class boxcox_method_test
+: public ::testing::Test
+{
+protected:
+    /**
+     * Creates two variants where every pair of genotypes has CELL_SIZE
+     * samples, and an empty phenotype.
+     */
+    void create_data()
+    {
+        size_t n = 9 * CELL_SIZE;
+        m_row1.resize( n );
+        m_row2.resize( n );
+        m_data = method_data_ptr( new method_data( ) );
+        m_data->phenotype = arma::zeros<arma::vec>( n );
+        m_data->missing = arma::zeros<arma::uvec>( n );
+        m_data->covariate_matrix = arma::zeros<arma::mat>( n, 0 );
+        for(size_t i = 0; i < n; i++)
+        {
+            m_row1.assign( i, ( i / CELL_SIZE ) / 3 );
+            m_row2.assign( i, ( i / CELL_SIZE ) % 3 );
+        }
+
+        m_model_matrix = make_model_matrix( "factor", m_data->covariate_matrix, n );
+    }
+
+    virtual void SetUp()
+    {
+        m_model_matrix = NULL;
+    }
+
+    virtual void TearDown()
+    {
+        delete m_model_matrix;
+    }
+
+    /**
+     * Runs the method with the given lambda grid, and returns the
+     * best lambda, the likelihood ratio and the p-value.
+     */
+    void run(bool is_lm, float lambda_start, float lambda_end, float lambda_step, bool grid_search, float *output)
+    {
+        boxcox_method method( m_data, *m_model_matrix, is_lm, lambda_start, lambda_end, lambda_step, false, grid_search );
+        method.init( );
+        ASSERT_NE( method.run( m_row1, m_row2, output ), -9 );
+    }
+
+    snp_row m_row1;
+    snp_row m_row2;
+    method_data_ptr m_data;
+    model_matrix *m_model_matrix;
+};
+
+TEST_F(boxcox_method_test, PathReachesGridMaximum)
+{
+    /* The genotypes are additive on the scale of the power link with lambda 0.5 */
+    create_data( );
+    double effect[ 3 ] = { 0.0, 1.5, 4.0 };
+    for(size_t i = 0; i < m_data->phenotype.n_elem; i++)
+    {
+        double eta = 4.0 + effect[ m_row1[ i ] ] + effect[ m_row2[ i ] ];
+        m_data->phenotype[ i ] = 2.0 * ( std::sqrt( eta ) - 1.0 ) + 0.4 * std::sin( 1.7 * i );
+    }
+
+    float grid[ 3 ];
+    run( true, 0.0, 1.5, 0.01, true, grid );
+    ASSERT_GT( grid[ 0 ], 0.1 );
+    ASSERT_LT( grid[ 0 ], 1.4 );
+
+    float path[ 3 ];
+    run( true, 0.0, 1.5, 0.25, false, path );
+    ASSERT_NEAR( path[ 0 ], grid[ 0 ], 0.01 );
+    ASSERT_NEAR( path[ 1 ], grid[ 1 ], 1e-3 * grid[ 1 ] + 1e-3 );
+}
+
+TEST_F(boxcox_method_test, FailedWarmStart)
+{
+    /* The genotypes are additive on the odds scale, and one cell has a very low risk */
+    create_data( );
+    double effect[ 3 ] = { 0.0, 0.3, 1.0 };
+    for(size_t i = 0; i < m_data->phenotype.n_elem; i++)
+    {
+        double odds = 0.01 + effect[ m_row1[ i ] ] + effect[ m_row2[ i ] ];
+        m_data->phenotype[ i ] = ( i % CELL_SIZE ) < CELL_SIZE * odds / ( 1.0 + odds );
+    }
+
+    /* The profile likelihood increases beyond lambda 0.6 */
+    float grid[ 3 ];
+    run( false, 0.0, 1.2, 0.05, true, grid );
+    ASSERT_GT( grid[ 0 ], 0.65 );
+
+    /* The estimate for lambda 0 is outside of the domain of the link for lambda 0.6 */
+    arma::mat null;
+    arma::mat alt;
+    ASSERT_TRUE( m_model_matrix->get_cell_matrices( null, alt ) );
+    size_t num_ok;
+    arma::mat count = cell_count( m_row1, m_row2, m_data->phenotype, m_data->missing, true, num_ok );
+    binomial logit( new power_odds_link( 0.0 ) );
+    binomial power_odds( new power_odds_link( 0.6 ) );
+    glm_info info;
+    arma::vec beta = cell_glm_fit( null, count, logit, info );
+    ASSERT_TRUE( info.success );
+    cell_glm_fit( null, count, power_odds, info, beta );
+    ASSERT_FALSE( info.success );
+
+    /*
+     * The path search fits 0.6 from scratch, so it is the best lambda,
+     * otherwise the golden-section search would end just below it.
+     */
+    run( false, 0.0, 0.65, 0.6, true, grid );
+    ASSERT_FLOAT_EQ( grid[ 0 ], 0.6 );
+
+    float path[ 3 ];
+    run( false, 0.0, 0.65, 0.6, false, path );
+    ASSERT_FLOAT_EQ( path[ 0 ], 0.6 );
+    ASSERT_NEAR( path[ 1 ], grid[ 1 ], 1e-4 * grid[ 1 ] );
+}
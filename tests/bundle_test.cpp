@@ -0,0 +1,267 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <besiq/io/bundle.hpp>
+#include <plink/plink_file.hpp>
+
+const std::string PLINK_PREFIX = "bundle_test_data";
+const std::string BUNDLE_PATH = "bundle_test_data.bundle";
+const size_t NUM_SAMPLES = 6;
+const size_t NUM_VARIANTS = 3;
+
+/**
+ * Byte offsets of fields in the bundle header.
+ */
+const size_t MAGIC_FIELD = 0;
+const size_t GENOTYPE_OFFSET_FIELD = 48;
+const size_t STRING_OFFSET_FIELD = 96;
+
+class bundle_test : public testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        /* Six samples and three variants, with some missing genotypes */
+        std::ofstream fam( ( PLINK_PREFIX + ".fam" ).c_str( ) );
+        for(size_t i = 0; i < NUM_SAMPLES; i++)
+        {
+            fam << "fam" << i << " ind" << i << " 0 0 " << ( i % 2 ) + 1 << " -9\n";
+        }
+        fam.close( );
+
+        std::ofstream bim( ( PLINK_PREFIX + ".bim" ).c_str( ) );
+        bim << "1 rs1 0 1000 A G\n";
+        bim << "1 rs2 0.5 2000 C T\n";
+        bim << "2 rs3 0 3000 G A\n";
+        bim.close( );
+
+        const unsigned char bed[ ] = { 0x6c, 0x1b, 0x01,
+                                       0x1b, 0x0e,
+                                       0xff, 0x02,
+                                       0x88, 0x07 };
+        std::ofstream bed_file( ( PLINK_PREFIX + ".bed" ).c_str( ), std::ios::binary );
+        bed_file.write( (const char *) bed, sizeof( bed ) );
+        bed_file.close( );
+
+        m_phenotypes.names.push_back( "disease" );
+        m_phenotypes.names.push_back( "height" );
+        m_phenotypes.values.set_size( NUM_SAMPLES, 2 );
+        m_covariates.names.push_back( "age" );
+        m_covariates.values.set_size( NUM_SAMPLES, 1 );
+        for(size_t i = 0; i < NUM_SAMPLES; i++)
+        {
+            m_phenotypes.values( i, 0 ) = i % 2;
+            m_phenotypes.values( i, 1 ) = 150.0 + i;
+            m_covariates.values( i, 0 ) = 20.0 + 2 * i;
+        }
+        m_phenotypes.values( 4, 0 ) = arma::datum::nan;
+        m_covariates.values( 1, 0 ) = arma::datum::nan;
+
+        ASSERT_TRUE( write_bundle( BUNDLE_PATH, open_plink_file( PLINK_PREFIX, true ), true, m_phenotypes, m_covariates ) );
+    }
+
+    virtual void TearDown()
+    {
+        std::remove( ( PLINK_PREFIX + ".fam" ).c_str( ) );
+        std::remove( ( PLINK_PREFIX + ".bim" ).c_str( ) );
+        std::remove( ( PLINK_PREFIX + ".bed" ).c_str( ) );
+        std::remove( BUNDLE_PATH.c_str( ) );
+    }
+
+    /**
+     * Reads the written bundle.
+     */
+    std::vector<char> read_bundle()
+    {
+        std::ifstream stream( BUNDLE_PATH.c_str( ), std::ios::binary );
+        return std::vector<char>( ( std::istreambuf_iterator<char>( stream ) ), std::istreambuf_iterator<char>( ) );
+    }
+
+    /**
+     * Overwrites the bundle with the given bytes.
+     */
+    void write_bytes(const std::vector<char> &bytes)
+    {
+        std::ofstream stream( BUNDLE_PATH.c_str( ), std::ios::binary | std::ios::trunc );
+        stream.write( &bytes[ 0 ], bytes.size( ) );
+    }
+
+    /**
+     * Overwrites a 64-bit field of the header.
+     */
+    void corrupt_field(size_t offset, uint64_t value)
+    {
+        std::vector<char> bytes = read_bundle( );
+        std::copy( (const char *) &value, (const char *) &value + sizeof( uint64_t ), bytes.begin( ) + offset );
+        write_bytes( bytes );
+    }
+
+    bundle_columns m_phenotypes;
+    bundle_columns m_covariates;
+};
+
+TEST_F(bundle_test, genotypes)
+{
+    plink_file_ptr plink = open_plink_file( PLINK_PREFIX, true );
+    genotype_matrix_ptr expected = create_genotype_matrix( plink );
+
+    ASSERT_TRUE( is_bundle( BUNDLE_PATH ) );
+    ASSERT_FALSE( is_bundle( PLINK_PREFIX + ".bed" ) );
+
+    dataset_bundle bundle( BUNDLE_PATH );
+    ASSERT_TRUE( bundle.is_mafflipped( ) );
+
+    genotype_matrix_ptr genotypes = bundle.get_genotypes( );
+    ASSERT_EQ( genotypes->size( ), NUM_VARIANTS );
+    ASSERT_TRUE( genotypes->get_snp_names( ) == expected->get_snp_names( ) );
+    for(size_t i = 0; i < NUM_VARIANTS; i++)
+    {
+        const snp_row &row = genotypes->get_row( i );
+        ASSERT_TRUE( row == expected->get_row( i ) );
+
+        unsigned int counts[ 4 ] = { 0, 0, 0, 0 };
+        for(size_t j = 0; j < row.size( ); j++)
+        {
+            counts[ row[ j ] ]++;
+        }
+        for(unsigned char g = 0; g < 4; g++)
+        {
+            ASSERT_EQ( bundle.get_count( i, g ), counts[ g ] );
+        }
+
+        float num_called = counts[ 0 ] + counts[ 1 ] + counts[ 2 ];
+        ASSERT_NEAR( bundle.get_maf( i ), ( counts[ 1 ] + 2.0 * counts[ 2 ] ) / ( 2.0 * num_called ), 1e-6 );
+    }
+}
+
+TEST_F(bundle_test, loci_and_samples)
+{
+    plink_file_ptr plink = open_plink_file( PLINK_PREFIX, true );
+    dataset_bundle bundle( BUNDLE_PATH );
+
+    const std::vector<pio_locus_t> &expected_loci = plink->get_loci( );
+    const std::vector<pio_locus_t> &loci = bundle.get_loci( );
+    ASSERT_EQ( loci.size( ), expected_loci.size( ) );
+    for(size_t i = 0; i < loci.size( ); i++)
+    {
+        ASSERT_EQ( loci[ i ].chromosome, expected_loci[ i ].chromosome );
+        ASSERT_STREQ( loci[ i ].name, expected_loci[ i ].name );
+        ASSERT_FLOAT_EQ( loci[ i ].position, expected_loci[ i ].position );
+        ASSERT_EQ( loci[ i ].bp_position, expected_loci[ i ].bp_position );
+        ASSERT_STREQ( loci[ i ].allele1, expected_loci[ i ].allele1 );
+        ASSERT_STREQ( loci[ i ].allele2, expected_loci[ i ].allele2 );
+    }
+
+    const std::vector<pio_sample_t> &expected_samples = plink->get_samples( );
+    const std::vector<pio_sample_t> &samples = bundle.get_samples( );
+    ASSERT_EQ( samples.size( ), NUM_SAMPLES );
+    for(size_t i = 0; i < samples.size( ); i++)
+    {
+        ASSERT_STREQ( samples[ i ].fid, expected_samples[ i ].fid );
+        ASSERT_STREQ( samples[ i ].iid, expected_samples[ i ].iid );
+        ASSERT_EQ( samples[ i ].sex, expected_samples[ i ].sex );
+        ASSERT_EQ( bundle.get_sample_iids( )[ i ], expected_samples[ i ].iid );
+    }
+}
+
+TEST_F(bundle_test, columns)
+{
+    dataset_bundle bundle( BUNDLE_PATH );
+    ASSERT_EQ( bundle.num_phenotypes( ), 2 );
+    ASSERT_EQ( bundle.num_covariates( ), 1 );
+
+    arma::uvec missing = arma::zeros<arma::uvec>( NUM_SAMPLES );
+    arma::vec height = bundle.get_phenotype( "height", missing );
+    for(size_t i = 0; i < NUM_SAMPLES; i++)
+    {
+        ASSERT_EQ( missing[ i ], 0 );
+        ASSERT_DOUBLE_EQ( height[ i ], m_phenotypes.values( i, 1 ) );
+    }
+
+    arma::vec disease = bundle.get_phenotype( "disease", missing );
+    for(size_t i = 0; i < NUM_SAMPLES; i++)
+    {
+        ASSERT_EQ( missing[ i ], i == 4 );
+        if( i != 4 )
+        {
+            ASSERT_DOUBLE_EQ( disease[ i ], m_phenotypes.values( i, 0 ) );
+        }
+    }
+
+    /* The missing mask is only ever set, never cleared */
+    std::vector<std::string> header;
+    arma::mat covariates = bundle.get_covariates( NULL, missing, &header );
+    ASSERT_EQ( header.size( ), 3 );
+    ASSERT_EQ( header[ 0 ], "FID" );
+    ASSERT_EQ( header[ 1 ], "IID" );
+    ASSERT_EQ( header[ 2 ], "age" );
+    ASSERT_EQ( covariates.n_cols, 1 );
+    for(size_t i = 0; i < NUM_SAMPLES; i++)
+    {
+        ASSERT_EQ( missing[ i ], i == 1 || i == 4 );
+        if( i != 1 )
+        {
+            ASSERT_DOUBLE_EQ( covariates( i, 0 ), m_covariates.values( i, 0 ) );
+        }
+    }
+
+    ASSERT_THROW( bundle.get_phenotype( "", missing ), std::runtime_error );
+    ASSERT_THROW( bundle.get_phenotype( "weight", missing ), std::runtime_error );
+}
+
+TEST_F(bundle_test, rejects_bad_magic)
+{
+    corrupt_field( MAGIC_FIELD, 0 );
+
+    ASSERT_FALSE( is_bundle( BUNDLE_PATH ) );
+    ASSERT_THROW( dataset_bundle bundle( BUNDLE_PATH ), std::runtime_error );
+}
+
+TEST_F(bundle_test, rejects_bad_offset)
+{
+    std::vector<char> bytes = read_bundle( );
+    corrupt_field( GENOTYPE_OFFSET_FIELD, bytes.size( ) + 8 );
+    ASSERT_THROW( dataset_bundle bundle( BUNDLE_PATH ), std::runtime_error );
+
+    write_bytes( bytes );
+    corrupt_field( GENOTYPE_OFFSET_FIELD, 12 );
+    ASSERT_THROW( dataset_bundle bundle( BUNDLE_PATH ), std::runtime_error );
+
+    write_bytes( bytes );
+    corrupt_field( STRING_OFFSET_FIELD, (uint64_t) -8 );
+    ASSERT_THROW( dataset_bundle bundle( BUNDLE_PATH ), std::runtime_error );
+}
+
+TEST_F(bundle_test, rejects_truncated)
+{
+    std::vector<char> bytes = read_bundle( );
+
+    write_bytes( std::vector<char>( bytes.begin( ), bytes.end( ) - 1 ) );
+    ASSERT_THROW( dataset_bundle bundle( BUNDLE_PATH ), std::runtime_error );
+
+    write_bytes( std::vector<char>( bytes.begin( ), bytes.begin( ) + 16 ) );
+    ASSERT_THROW( dataset_bundle bundle( BUNDLE_PATH ), std::runtime_error );
+}
+
+TEST_F(bundle_test, failed_write)
+{
+    /* The rename onto a directory fails, the temporary file is removed */
+    std::string dir_path = BUNDLE_PATH + ".dir";
+    ASSERT_EQ( mkdir( dir_path.c_str( ), 0700 ), 0 );
+    ASSERT_FALSE( write_bundle( dir_path, open_plink_file( PLINK_PREFIX, true ), true, m_phenotypes, m_covariates ) );
+    ASSERT_NE( access( ( dir_path + ".tmp" ).c_str( ), F_OK ), 0 );
+    rmdir( dir_path.c_str( ) );
+
+    ASSERT_NE( access( ( BUNDLE_PATH + ".tmp" ).c_str( ), F_OK ), 0 );
+    ASSERT_TRUE( is_bundle( BUNDLE_PATH ) );
+}
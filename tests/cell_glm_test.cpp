@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+
+#include <armadillo>
+
+#include <glm/glm.hpp>
+#include <glm/models/binomial.hpp>
+#include <glm/models/normal.hpp>
+#include <besiq/model_matrix.hpp>
+#include <besiq/stats/cell_glm.hpp>
+
+class cell_glm_test
+: public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        size_t n = 300;
+        row1.resize( n );
+        row2.resize( n );
+        binary = arma::zeros<arma::vec>( n );
+        continuous = arma::zeros<arma::vec>( n );
+        missing = arma::zeros<arma::uvec>( n );
+        for(int i = 0; i < n; i++)
+        {
+            row1.assign( i, ( i * 7 ) % 3 );
+            row2.assign( i, ( i / 3 + i / 11 ) % 3 );
+            binary[ i ] = ( ( i * 13 ) % 5 + row1[ i ] ) > 3 ? 1.0 : 0.0;
+            continuous[ i ] = 0.3 * row1[ i ] - 0.2 * row2[ i ] + ( ( i * 17 ) % 7 ) / 7.0;
+        }
+        row2.assign( 5, 3 );
+        missing[ 8 ] = 1;
+    }
+
+    /**
+     * Fits the model on all samples and on the cells and
+     * checks that the likelihoods agree.
+     */
+    void compare(const glm_model &model, const arma::vec &phenotype)
+    {
+        factor_matrix matrix( arma::mat( ), phenotype.n_elem );
+
+        arma::uvec sample_missing = missing;
+        matrix.update_matrix( row1, row2, sample_missing );
+        glm_info null_info;
+        glm_fit( matrix.get_null( ), phenotype, sample_missing, model, null_info );
+        glm_info alt_info;
+        glm_fit( matrix.get_alt( ), phenotype, sample_missing, model, alt_info );
+
+        arma::mat cell_null;
+        arma::mat cell_alt;
+        ASSERT_TRUE( matrix.get_cell_matrices( cell_null, cell_alt ) );
+        size_t num_ok = 0;
+        arma::mat count = cell_count( row1, row2, phenotype, missing, model.is_binary( ), num_ok );
+        ASSERT_EQ( num_ok, sample_missing.n_elem - arma::accu( sample_missing ) );
+
+        glm_info cell_null_info;
+        cell_glm_fit( cell_null, count, model, cell_null_info );
+        glm_info cell_alt_info;
+        cell_glm_fit( cell_alt, count, model, cell_alt_info );
+
+        ASSERT_TRUE( null_info.success && cell_null_info.success );
+        ASSERT_TRUE( alt_info.success && cell_alt_info.success );
+        ASSERT_NEAR( null_info.logl, cell_null_info.logl, 1e-4 );
+        ASSERT_NEAR( alt_info.logl, cell_alt_info.logl, 1e-4 );
+    }
+
+    snp_row row1;
+    snp_row row2;
+    arma::vec binary;
+    arma::vec continuous;
+    arma::uvec missing;
+};
+
+TEST_F(cell_glm_test, binomial_logit)
+{
+    binomial model( "logit" );
+    compare( model, binary );
+}
+
+TEST_F(cell_glm_test, normal_identity)
+{
+    normal model( "identity" );
+    compare( model, continuous );
+}
+
+TEST_F(cell_glm_test, normal_log)
+{
+    normal model( "log" );
+    compare( model, continuous + 1.0 );
+}
+
+/**
+ * Converts hard calls to genotype probabilities of 0 or 1.
+ */
+static dosage_row
+certain_dosage(const snp_row &row)
+{
+    dosage_row dosage;
+    dosage.resize( row.size( ) );
+    for(int i = 0; i < row.size( ); i++)
+    {
+        if( row[ i ] != 3 )
+        {
+            dosage.assign( i, row[ i ] == 1, row[ i ] == 2 );
+        }
+    }
+
+    return dosage;
+}
+
+TEST_F(cell_glm_test, dosage_cell_count)
+{
+    dosage_row dosage1 = certain_dosage( row1 );
+    dosage_row dosage2 = certain_dosage( row2 );
+    for(int is_binary = 0; is_binary < 2; is_binary++)
+    {
+        const arma::vec &phenotype = is_binary ? binary : continuous;
+        size_t num_ok = 0;
+        arma::mat count = cell_count( row1, row2, phenotype, missing, is_binary, num_ok );
+        size_t dosage_num_ok = 0;
+        arma::mat dosage_count = cell_count( dosage1, dosage2, phenotype, missing, is_binary, dosage_num_ok );
+
+        ASSERT_EQ( num_ok, dosage_num_ok );
+        ASSERT_LT( arma::abs( count - dosage_count ).max( ), 1e-9 );
+    }
+}
+
+TEST_F(cell_glm_test, dosage_estimators_agree_on_hard_calls)
+{
+    /* The expected cell counts and the expected design give the same fit */
+    dosage_row dosage1 = certain_dosage( row1 );
+    dosage_row dosage2 = certain_dosage( row2 );
+    binomial model( "logit" );
+
+    factor_matrix matrix( arma::mat( ), binary.n_elem );
+    arma::uvec sample_missing = missing;
+    matrix.update_matrix( dosage1, dosage2, sample_missing );
+    glm_info alt_info;
+    glm_fit( matrix.get_alt( ), binary, sample_missing, model, alt_info );
+
+    arma::mat cell_null;
+    arma::mat cell_alt;
+    ASSERT_TRUE( matrix.get_cell_matrices( cell_null, cell_alt ) );
+    size_t num_ok = 0;
+    arma::mat count = cell_count( dosage1, dosage2, binary, missing, true, num_ok );
+    glm_info cell_alt_info;
+    cell_glm_fit( cell_alt, count, model, cell_alt_info );
+
+    ASSERT_EQ( num_ok, sample_missing.n_elem - arma::accu( sample_missing ) );
+    ASSERT_TRUE( alt_info.success && cell_alt_info.success );
+    ASSERT_NEAR( alt_info.logl, cell_alt_info.logl, 1e-4 );
+}
@@ -128,3 +128,66 @@ TEST(snp_count_maf_test, compute_maf)
     ASSERT_NEAR( maf[ 1 ], 0.5, 0.00001 );
     ASSERT_NEAR( maf[ 2 ], 0.25, 0.00001 );
 }
+
+class dosage_count_test
+: public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        /* Sample 2 is missing in the first snp */
+        row1.resize( 3 );
+        row1.assign( 0, 0.5, 0.0 );
+        row1.assign( 1, 0.0, 1.0 );
+
+        row2.resize( 3 );
+        row2.assign( 0, 1.0, 0.0 );
+        row2.assign( 1, 0.75, 0.0 );
+        row2.assign( 2, 0.0, 0.0 );
+
+        phenotype = arma::zeros<arma::vec>( 3 );
+        phenotype[ 0 ] = 1;
+        phenotype[ 1 ] = 0;
+        phenotype[ 2 ] = 1;
+
+        weight = arma::ones<arma::vec>( 3 );
+    }
+
+    dosage_row row1;
+    dosage_row row2;
+    arma::vec phenotype;
+    arma::vec weight;
+};
+
+TEST_F(dosage_count_test, joint_count)
+{
+    arma::mat count = joint_count( row1, row2, phenotype, weight );
+
+    ASSERT_NEAR( count( 1, 1 ), 0.5, 0.0001 );
+    ASSERT_NEAR( count( 4, 1 ), 0.5, 0.0001 );
+    ASSERT_NEAR( count( 6, 0 ), 0.25, 0.0001 );
+    ASSERT_NEAR( count( 7, 0 ), 0.75, 0.0001 );
+    ASSERT_NEAR( arma::accu( count ), 2.0, 0.0001 );
+}
+
+TEST_F(dosage_count_test, joint_count_cont)
+{
+    phenotype[ 0 ] = 2.0;
+    phenotype[ 1 ] = 3.0;
+    arma::mat count = joint_count_cont( row1, row2, phenotype, weight );
+
+    ASSERT_NEAR( count( 1, 0 ), 1.0, 0.0001 );
+    ASSERT_NEAR( count( 4, 0 ), 1.0, 0.0001 );
+    ASSERT_NEAR( count( 6, 0 ), 0.75, 0.0001 );
+    ASSERT_NEAR( count( 7, 0 ), 2.25, 0.0001 );
+    ASSERT_NEAR( arma::accu( count.col( 1 ) ), 2.0, 0.0001 );
+    ASSERT_NEAR( count( 7, 1 ), 0.75, 0.0001 );
+    ASSERT_NEAR( count( 1, 2 ), 2.0, 0.0001 );
+    ASSERT_NEAR( count( 7, 2 ), 6.75, 0.0001 );
+}
+
+TEST_F(dosage_count_test, compute_real_maf)
+{
+    /* The expected dosages of the first snp are 0.5 and 2.0 */
+    ASSERT_NEAR( compute_real_maf( row1 ), 0.375, 0.0001 );
+}
@@ -1,9 +1,18 @@
 #include <armadillo>
+#include <cstdio>
+#include <fstream>
 #include <sstream>
 
+#include <dirent.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
 #include <gtest/gtest.h>
 
 #include <besiq/io/covariates.hpp>
+#include <gzstream/gzutil.hpp>
 
 using namespace arma;
 
@@ -105,3 +114,226 @@ TEST(CovariateTest, ParsePhenos)
     ASSERT_NEAR( pheno[ 2 ], 2.0, 0.0001 );
     ASSERT_NEAR( pheno[ 3 ], 1.0, 0.0001 );
 }
+
+TEST(CovariateTest, SelectColumns)
+{
+    std::stringstream cov_file;
+    cov_file << "FID IID gender age height\n";
+    cov_file << "1 1 0 NA 1.75\n";
+    cov_file << "2 2 NA 35 1.8125\n";
+
+    std::vector<std::string> order;
+    order.push_back( "1" );
+    order.push_back( "2" );
+
+    std::vector<std::string> columns;
+    columns.push_back( "height" );
+    columns.push_back( "gender" );
+
+    arma::uvec missing = arma::zeros<arma::uvec>( 2 );
+    std::vector<std::string> header;
+
+    arma::mat cov = parse_covariate_matrix( cov_file, missing, order, &header, "NA", &columns );
+
+    ASSERT_EQ( cov.n_cols, 2 );
+    ASSERT_EQ( header.size( ), 4 );
+    ASSERT_EQ( header[ 2 ], "height" );
+    ASSERT_EQ( header[ 3 ], "gender" );
+
+    ASSERT_DOUBLE_EQ( cov( 0, 0 ), 1.75 );
+    ASSERT_DOUBLE_EQ( cov( 1, 0 ), 1.8125 );
+    ASSERT_DOUBLE_EQ( cov( 0, 1 ), 0.0 );
+
+    /* The missing age is not selected */
+    ASSERT_EQ( missing[ 0 ], 0 );
+    ASSERT_EQ( missing[ 1 ], 1 );
+}
+
+TEST(CovariateTest, ErrorLineNumber)
+{
+    /* Lines of individuals that are not in the order still count */
+    std::stringstream cov_file;
+    cov_file << "FID IID gender age\n";
+    cov_file << "7 7 0 15\n";
+    cov_file << "\n";
+    cov_file << "1 1 0 hej\n";
+
+    std::vector<std::string> order( 1, "1" );
+    arma::uvec missing = arma::zeros<arma::uvec>( 1 );
+
+    try
+    {
+        parse_covariate_matrix( cov_file, missing, order );
+        FAIL( );
+    }
+    catch(std::runtime_error &e)
+    {
+        ASSERT_NE( std::string( e.what( ) ).find( "line: 4 " ), std::string::npos );
+    }
+}
+
+class covariate_file_test
+: public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        char dir[] = "covariate_test_XXXXXX";
+        ASSERT_TRUE( mkdtemp( dir ) != NULL );
+        m_dir = dir;
+        m_path = m_dir + "/cov.txt";
+
+        m_order.push_back( "1" );
+        m_order.push_back( "2" );
+        m_order.push_back( "3" );
+    }
+
+    virtual void TearDown()
+    {
+        DIR *dir = opendir( m_dir.c_str( ) );
+        struct dirent *entry;
+        while( dir != NULL && ( entry = readdir( dir ) ) != NULL )
+        {
+            std::string name = entry->d_name;
+            if( name != "." && name != ".." )
+            {
+                std::remove( ( m_dir + "/" + name ).c_str( ) );
+            }
+        }
+        closedir( dir );
+        rmdir( m_dir.c_str( ) );
+    }
+
+    /**
+     * Writes the covariate file and sets its modification time. The
+     * ages are the first two characters and the rest of the string.
+     */
+    void write_file(const std::string &ages, time_t mtime)
+    {
+        std::ofstream stream( m_path.c_str( ) );
+        stream << "FID IID gender age\n";
+        stream << "1 1 0 " << ages[ 0 ] << "\n";
+        stream << "2 2 NA " << ages[ 1 ] << "\n";
+        stream << "3 3 1 " << ages.substr( 2 ) << "\n";
+        stream.close( );
+
+        struct utimbuf times;
+        times.actime = mtime;
+        times.modtime = mtime;
+        utime( m_path.c_str( ), &times );
+    }
+
+    /**
+     * Returns the number of cache files in the directory.
+     */
+    size_t num_caches()
+    {
+        size_t num = 0;
+        DIR *dir = opendir( m_dir.c_str( ) );
+        struct dirent *entry;
+        while( dir != NULL && ( entry = readdir( dir ) ) != NULL )
+        {
+            std::string name = entry->d_name;
+            num += name.size( ) > 7 && name.compare( name.size( ) - 7, 7, ".bcache" ) == 0;
+        }
+        closedir( dir );
+
+        return num;
+    }
+
+    std::string m_dir;
+    std::string m_path;
+    std::vector<std::string> m_order;
+};
+
+TEST_F(covariate_file_test, gzip)
+{
+    std::string gz_path = m_dir + "/cov.txt.gz";
+    {
+        shared_ptr<std::ostream> stream = create_possible_gz( gz_path );
+        *stream << "FID IID gender age\n";
+        *stream << "3 3 1 20\n";
+        *stream << "1 1 0 15\n";
+    }
+
+    arma::uvec missing = arma::zeros<arma::uvec>( 3 );
+    std::vector<std::string> header;
+    arma::mat cov = read_covariate_file( gz_path, missing, m_order, NULL, &header );
+
+    ASSERT_EQ( header.size( ), 4 );
+    ASSERT_DOUBLE_EQ( cov( 0, 1 ), 15.0 );
+    ASSERT_DOUBLE_EQ( cov( 2, 1 ), 20.0 );
+    ASSERT_EQ( missing[ 0 ], 0 );
+    ASSERT_EQ( missing[ 1 ], 1 );
+    ASSERT_EQ( missing[ 2 ], 0 );
+}
+
+TEST_F(covariate_file_test, cache_hit)
+{
+    write_file( "123", 1000000 );
+    arma::uvec missing = arma::zeros<arma::uvec>( 3 );
+    arma::mat cov = read_covariate_file( m_path, missing, m_order, NULL, NULL, true );
+    ASSERT_EQ( num_caches( ), 1 );
+    ASSERT_DOUBLE_EQ( cov( 2, 1 ), 3.0 );
+
+    /* Same size and modification time, so the cached values are read */
+    write_file( "456", 1000000 );
+    std::vector<std::string> header;
+    arma::uvec cached_missing = arma::zeros<arma::uvec>( 3 );
+    arma::mat cached = read_covariate_file( m_path, cached_missing, m_order, NULL, &header, true );
+    ASSERT_DOUBLE_EQ( cached( 2, 1 ), 3.0 );
+    ASSERT_EQ( header.size( ), 4 );
+    ASSERT_EQ( header[ 3 ], "age" );
+    ASSERT_EQ( cached_missing[ 1 ], 1 );
+
+    /* Without the cache the file is parsed */
+    arma::uvec parsed_missing = arma::zeros<arma::uvec>( 3 );
+    arma::mat parsed = read_covariate_file( m_path, parsed_missing, m_order );
+    ASSERT_DOUBLE_EQ( parsed( 2, 1 ), 6.0 );
+}
+
+TEST_F(covariate_file_test, cache_invalidation)
+{
+    arma::uvec missing = arma::zeros<arma::uvec>( 3 );
+    write_file( "123", 1000000 );
+    read_covariate_file( m_path, missing, m_order, NULL, NULL, true );
+
+    /* Modification time */
+    write_file( "456", 2000000 );
+    arma::mat cov = read_covariate_file( m_path, missing, m_order, NULL, NULL, true );
+    ASSERT_DOUBLE_EQ( cov( 2, 1 ), 6.0 );
+
+    /* Size */
+    write_file( "4513", 2000000 );
+    cov = read_covariate_file( m_path, missing, m_order, NULL, NULL, true );
+    ASSERT_DOUBLE_EQ( cov( 2, 1 ), 13.0 );
+
+    /* Order */
+    std::vector<std::string> reversed( m_order.rbegin( ), m_order.rend( ) );
+    cov = read_covariate_file( m_path, missing, reversed, NULL, NULL, true );
+    ASSERT_DOUBLE_EQ( cov( 0, 1 ), 13.0 );
+    ASSERT_DOUBLE_EQ( cov( 2, 1 ), 4.0 );
+
+    /* Columns */
+    std::vector<std::string> columns( 1, "gender" );
+    std::vector<std::string> header;
+    cov = read_covariate_file( m_path, missing, m_order, &columns, &header, true );
+    ASSERT_EQ( cov.n_cols, 1 );
+    ASSERT_EQ( header[ 2 ], "gender" );
+    ASSERT_DOUBLE_EQ( cov( 2, 0 ), 1.0 );
+}
+
+TEST_F(covariate_file_test, cache_merges_missing)
+{
+    write_file( "123", 1000000 );
+    arma::uvec missing = arma::zeros<arma::uvec>( 3 );
+    read_covariate_file( m_path, missing, m_order, NULL, NULL, true );
+
+    /* Missing individuals from the cache are added, those already set are kept */
+    missing = arma::zeros<arma::uvec>( 3 );
+    missing[ 2 ] = 1;
+    read_covariate_file( m_path, missing, m_order, NULL, NULL, true );
+    ASSERT_EQ( missing[ 0 ], 0 );
+    ASSERT_EQ( missing[ 1 ], 1 );
+    ASSERT_EQ( missing[ 2 ], 1 );
+}
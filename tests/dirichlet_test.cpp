@@ -34,3 +34,57 @@ TEST(DirichletTest, Binomial)
     ASSERT_NEAR( exp( lbinomial( 4, 2 ) ), 6.0, 0.0001 );
     ASSERT_NEAR( exp( lbinomial( 14, 3 ) ), 364.0, 0.0001 );
 }
+
+TEST(DirichletTest, BetaSampler)
+{
+    dir_generator generator( 1 );
+    size_t n = 100000;
+    std::vector<double> samples( n );
+
+    generator.sample_beta( 2.0, 3.0, n, &samples[ 0 ] );
+    double mean = std::accumulate( samples.begin( ), samples.end( ), 0.0 ) / n;
+    ASSERT_NEAR( mean, 0.4, 0.005 );
+
+    generator.sample_beta( 0.5, 0.5, n, &samples[ 0 ] );
+    mean = std::accumulate( samples.begin( ), samples.end( ), 0.0 ) / n;
+    ASSERT_NEAR( mean, 0.5, 0.005 );
+
+    mat batch( 3, 1000 );
+    vec alpha( 3 );
+    alpha[ 0 ] = 1.0;
+    alpha[ 1 ] = 2.0;
+    alpha[ 2 ] = 7.0;
+    generator.sample( alpha, batch );
+    vec batch_mean = arma::mean( batch, 1 );
+    ASSERT_NEAR( batch_mean[ 0 ], 0.1, 0.01 );
+    ASSERT_NEAR( batch_mean[ 2 ], 0.7, 0.02 );
+}
+
+TEST(DirichletTest, Table)
+{
+    vec alpha( 2 );
+    alpha[ 0 ] = 2.0;
+    alpha[ 1 ] = 0.5;
+    ldirmult_table table( alpha, 10 );
+
+    mat counts( 5, 2 );
+    counts( 0, 0 ) = 3.0;
+    counts( 0, 1 ) = 4.0;
+    counts( 1, 0 ) = 1.5;
+    counts( 1, 1 ) = 2.0;
+    counts( 2, 0 ) = 9.0;
+    counts( 2, 1 ) = 5.0;
+
+    /* Counts that can not be converted to an index fall back to the direct computation */
+    counts( 3, 0 ) = -0.5;
+    counts( 3, 1 ) = 2.0;
+    counts( 4, 0 ) = 1e30;
+    counts( 4, 1 ) = 1.0;
+
+    for(int i = 0; i < counts.n_rows; i++)
+    {
+        vec x = counts.row( i ).t( );
+        ASSERT_NEAR( table.ldirmult( counts, i ), ldirmult( x, alpha ), 1e-10 );
+        ASSERT_NEAR( table.ldirmult( x ), ldirmult( x, alpha ), 1e-10 );
+    }
+}
@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+#include <plink/dosage_row.hpp>
+
+TEST(dosage_row_test, missing)
+{
+    dosage_row row;
+    row.resize( 3 );
+    ASSERT_EQ( row.size( ), 3 );
+    for(int i = 0; i < 3; i++)
+    {
+        ASSERT_TRUE( row.is_missing( i ) );
+        ASSERT_TRUE( std::isnan( row.dosage( i ) ) );
+    }
+
+    row.assign( 1, 0.2, 0.3 );
+    ASSERT_TRUE( row.is_missing( 0 ) );
+    ASSERT_FALSE( row.is_missing( 1 ) );
+}
+
+TEST(dosage_row_test, quantise_round_trip)
+{
+    dosage_row row;
+    row.resize( 4 );
+    row.assign( 0, 0.25, 0.5 );
+    row.assign( 1, 1.0, 0.0 );
+    row.assign( 2, 0.0, 1.0 );
+    row.assign( 3, 0.123456, 0.654321 );
+
+    /* A quantised value is within half a step of the probability */
+    double tolerance = 0.5 / dosage_row::SCALE;
+    double p[ 3 ];
+    row.probabilities( 0, p );
+    ASSERT_NEAR( p[ 0 ], 0.25, 2 * tolerance );
+    ASSERT_NEAR( p[ 1 ], 0.25, tolerance );
+    ASSERT_NEAR( p[ 2 ], 0.5, tolerance );
+    ASSERT_NEAR( row.dosage( 0 ), 1.25, 3 * tolerance );
+
+    row.probabilities( 3, p );
+    ASSERT_NEAR( p[ 1 ], 0.123456, tolerance );
+    ASSERT_NEAR( p[ 2 ], 0.654321, tolerance );
+
+    /* Certain genotypes are represented exactly */
+    row.probabilities( 1, p );
+    ASSERT_EQ( p[ 0 ], 0.0 );
+    ASSERT_EQ( p[ 1 ], 1.0 );
+    ASSERT_EQ( p[ 2 ], 0.0 );
+    row.probabilities( 2, p );
+    ASSERT_EQ( p[ 0 ], 0.0 );
+    ASSERT_EQ( p[ 2 ], 1.0 );
+    ASSERT_EQ( row.dosage( 2 ), 2.0f );
+
+    /* The quantised values can be stored and restored without loss */
+    dosage_row copy;
+    copy.resize( 4 );
+    for(int i = 0; i < 4; i++)
+    {
+        copy.assign_quantised( i, row.het_data( )[ i ], row.hom_data( )[ i ] );
+    }
+    for(int i = 0; i < 4; i++)
+    {
+        ASSERT_EQ( copy.het_data( )[ i ], row.het_data( )[ i ] );
+        ASSERT_EQ( copy.hom_data( )[ i ], row.hom_data( )[ i ] );
+        ASSERT_EQ( copy.dosage( i ), row.dosage( i ) );
+    }
+}
+
+TEST(dosage_row_test, probabilities_sum_to_one)
+{
+    /* Probabilities that sum to more than one are truncated */
+    dosage_row row;
+    row.resize( 1 );
+    row.assign( 0, 0.7, 0.6 );
+
+    double p[ 3 ];
+    row.probabilities( 0, p );
+    ASSERT_GE( p[ 0 ], 0.0 );
+    ASSERT_NEAR( p[ 0 ] + p[ 1 ] + p[ 2 ], 1.0, 1e-12 );
+}
+
+TEST(dosage_row_test, hard_call)
+{
+    dosage_row row;
+    row.resize( 4 );
+    row.assign( 0, 0.05, 0.0 );
+    row.assign( 1, 0.95, 0.05 );
+    row.assign( 2, 0.4, 0.5 );
+
+    snp_row calls = row.hard_call( 0.9 );
+    ASSERT_EQ( calls[ 0 ], 0 );
+    ASSERT_EQ( calls[ 1 ], 1 );
+    ASSERT_EQ( calls[ 2 ], 3 );
+    ASSERT_EQ( calls[ 3 ], 3 );
+
+    calls = row.hard_call( 0.0 );
+    ASSERT_EQ( calls[ 2 ], 2 );
+    ASSERT_EQ( calls[ 3 ], 3 );
+}
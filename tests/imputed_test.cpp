@@ -0,0 +1,325 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+#include <utime.h>
+
+#include <gzstream/gzutil.hpp>
+#include <plink/imputed.hpp>
+
+const std::string GEN_PATH = "imputed_test_data";
+const std::string GZ_PATH = "imputed_test_data_gz.gz";
+const size_t NUM_SAMPLES = 3;
+const size_t NUM_VARIANTS = 8;
+const float CALL_RATE = 0.85f;
+
+/**
+ * Lines of the .gen file, with scientific notation, signs, a leading
+ * decimal point, a malformed field and a carriage return.
+ */
+const char *GEN_LINES[] = {
+    "1 rs0 100 A G 1 0 0 0 1 0 0 0 1",
+    "1 rs1 200 A G 0.9 0.1 0 1e-1 9e-1 0 0 2.5E-1 7.5e-1",
+    "1 rs2 300 A G +0.1 .9 0 0.05 0.05 0.9 1 0 0",
+    "1 rs3 400 A G 1 0 0 x 0 0 0 1 0",
+    "1 rs4 500 A G 0 0 1 1.5e+0 0 0 0.25 0.25 0.5",
+    "1 rs5 600 A G 0.3 0.3 0.4 0 1 0 1 0 0",
+    "1 rs6 700 A G 1 0 0 1 0 0 1 0 0\r",
+    "1 rs7 800 A G 0 1 0 0 1 0 0 0 1"
+};
+
+class imputed_test : public testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        std::ofstream gen( GEN_PATH.c_str( ) );
+        shared_ptr<std::ostream> gz = create_possible_gz( GZ_PATH );
+        for(size_t i = 0; i < NUM_VARIANTS; i++)
+        {
+            gen << GEN_LINES[ i ] << "\n";
+            *gz << GEN_LINES[ i ] << "\n";
+        }
+
+        write_info( "rs" );
+
+        std::ofstream samples( ( GEN_PATH + "_samples" ).c_str( ) );
+        samples << "ID_1 ID_2 missing\n0 0 0\n";
+        for(size_t i = 0; i < NUM_SAMPLES; i++)
+        {
+            samples << "fam" << i << " ind" << i << " 0\n";
+        }
+    }
+
+    virtual void TearDown()
+    {
+        std::remove( GEN_PATH.c_str( ) );
+        std::remove( ( GEN_PATH + ".idx" ).c_str( ) );
+        std::remove( GZ_PATH.c_str( ) );
+        std::remove( ( GEN_PATH + "_info" ).c_str( ) );
+        std::remove( ( GEN_PATH + "_samples" ).c_str( ) );
+        std::remove( imputed_cache_path( GEN_PATH ).c_str( ) );
+    }
+
+    /**
+     * Writes the info file, the variant names start with the given prefix.
+     */
+    void write_info(const std::string &name_prefix)
+    {
+        std::ofstream info( ( GEN_PATH + "_info" ).c_str( ) );
+        info << "snp_id rs_id position exp_freq_a1 info certainty type\n";
+        for(size_t i = 0; i < NUM_VARIANTS; i++)
+        {
+            info << "1 " << name_prefix << i << " " << 100 * ( i + 1 ) << " 0.25 0.9 1 0\n";
+        }
+    }
+
+    /**
+     * Returns true if the cache or its temporary file exists.
+     */
+    bool cache_exists(bool temporary)
+    {
+        std::ostringstream path;
+        path << imputed_cache_path( GEN_PATH );
+        if( temporary )
+        {
+            path << "." << getpid( ) << ".tmp";
+        }
+
+        return access( path.str( ).c_str( ), F_OK ) == 0;
+    }
+
+    /**
+     * Checks that two parsed imputations are identical.
+     */
+    void check_equal(const imputed_data &data1, const imputed_data &data2)
+    {
+        ASSERT_EQ( data1.first, data2.first );
+        ASSERT_TRUE( data1.samples == data2.samples );
+        ASSERT_EQ( data1.info.size( ), data2.info.size( ) );
+        for(size_t i = 0; i < data1.info.size( ); i++)
+        {
+            ASSERT_EQ( data1.info[ i ].name, data2.info[ i ].name );
+            ASSERT_EQ( data1.info[ i ].pos, data2.info[ i ].pos );
+            ASSERT_EQ( data1.info[ i ].maf, data2.info[ i ].maf );
+            ASSERT_EQ( data1.info[ i ].info, data2.info[ i ].info );
+        }
+        check_equal( *data1.genotypes, *data1.dosages, *data2.genotypes, *data2.dosages );
+    }
+
+    /**
+     * Checks that two sets of parsed rows are identical.
+     */
+    void check_equal(const std::vector<snp_row> &genotypes1, const std::vector<dosage_row> &dosages1,
+                     const std::vector<snp_row> &genotypes2, const std::vector<dosage_row> &dosages2)
+    {
+        ASSERT_EQ( genotypes1.size( ), genotypes2.size( ) );
+        ASSERT_EQ( dosages1.size( ), dosages2.size( ) );
+        for(size_t v = 0; v < genotypes1.size( ); v++)
+        {
+            ASSERT_TRUE( genotypes1[ v ] == genotypes2[ v ] );
+        }
+        for(size_t v = 0; v < dosages1.size( ); v++)
+        {
+            for(size_t i = 0; i < NUM_SAMPLES; i++)
+            {
+                ASSERT_EQ( dosages1[ v ].het_data( )[ i ], dosages2[ v ].het_data( )[ i ] );
+                ASSERT_EQ( dosages1[ v ].hom_data( )[ i ], dosages2[ v ].hom_data( )[ i ] );
+            }
+        }
+    }
+};
+
+TEST_F(imputed_test, parse_fields)
+{
+    std::vector<snp_row> genotypes;
+    std::vector<dosage_row> dosages;
+    parse_genotypes( GEN_PATH, CALL_RATE, NUM_SAMPLES, 0, NUM_VARIANTS, &genotypes, &dosages );
+    ASSERT_EQ( genotypes.size( ), NUM_VARIANTS );
+
+    /* Scientific notation and values below the call rate */
+    ASSERT_EQ( genotypes[ 1 ][ 0 ], 0 );
+    ASSERT_EQ( genotypes[ 1 ][ 1 ], 1 );
+    ASSERT_EQ( genotypes[ 1 ][ 2 ], 3 );
+    double p[ 3 ];
+    dosages[ 1 ].probabilities( 2, p );
+    ASSERT_NEAR( p[ 1 ], 0.25, 1e-4 );
+    ASSERT_NEAR( p[ 2 ], 0.75, 1e-4 );
+
+    /* Signs and a leading decimal point */
+    ASSERT_EQ( genotypes[ 2 ][ 0 ], 1 );
+    ASSERT_EQ( genotypes[ 2 ][ 1 ], 2 );
+    dosages[ 2 ].probabilities( 0, p );
+    ASSERT_NEAR( p[ 1 ], 0.9, 1e-4 );
+
+    /* A malformed field makes the rest of the line missing */
+    ASSERT_EQ( genotypes[ 3 ][ 0 ], 0 );
+    ASSERT_EQ( genotypes[ 3 ][ 1 ], 3 );
+    ASSERT_EQ( genotypes[ 3 ][ 2 ], 3 );
+    ASSERT_FALSE( dosages[ 3 ].is_missing( 0 ) );
+    ASSERT_TRUE( dosages[ 3 ].is_missing( 1 ) );
+    ASSERT_TRUE( dosages[ 3 ].is_missing( 2 ) );
+
+    /* Probabilities are normalized by their sum */
+    ASSERT_EQ( genotypes[ 4 ][ 1 ], 0 );
+    dosages[ 4 ].probabilities( 1, p );
+    ASSERT_NEAR( p[ 0 ], 1.0, 1e-4 );
+
+    /* A carriage return ends the last field */
+    ASSERT_EQ( genotypes[ 6 ][ 2 ], 0 );
+}
+
+TEST_F(imputed_test, text_gz_and_index)
+{
+    size_t windows[ 3 ][ 2 ] = { { 2, 6 }, { 0, 3 }, { 6, 100 } };
+    for(int w = 0; w < 3; w++)
+    {
+        size_t first = windows[ w ][ 0 ];
+        size_t last = windows[ w ][ 1 ];
+
+        /* The first read of the text file builds the index, the second uses it */
+        std::remove( ( GEN_PATH + ".idx" ).c_str( ) );
+        std::vector<snp_row> text_genotypes;
+        std::vector<dosage_row> text_dosages;
+        parse_genotypes( GEN_PATH, CALL_RATE, NUM_SAMPLES, first, last, &text_genotypes, &text_dosages );
+        ASSERT_EQ( text_genotypes.size( ), std::min( last, NUM_VARIANTS ) - first );
+
+        std::vector<snp_row> index_genotypes;
+        std::vector<dosage_row> index_dosages;
+        parse_genotypes( GEN_PATH, CALL_RATE, NUM_SAMPLES, first, last, &index_genotypes, &index_dosages, 2 );
+        check_equal( text_genotypes, text_dosages, index_genotypes, index_dosages );
+
+        std::vector<snp_row> gz_genotypes;
+        std::vector<dosage_row> gz_dosages;
+        parse_genotypes( GZ_PATH, CALL_RATE, NUM_SAMPLES, first, last, &gz_genotypes, &gz_dosages );
+        check_equal( text_genotypes, text_dosages, gz_genotypes, gz_dosages );
+
+        /* Only the window is parsed */
+        std::vector<snp_row> all_genotypes;
+        std::vector<dosage_row> all_dosages;
+        parse_genotypes( GEN_PATH, CALL_RATE, NUM_SAMPLES, 0, NUM_VARIANTS, &all_genotypes, &all_dosages );
+        for(size_t v = 0; v < text_genotypes.size( ); v++)
+        {
+            ASSERT_TRUE( text_genotypes[ v ] == all_genotypes[ first + v ] );
+        }
+    }
+}
+
+TEST_F(imputed_test, index_modification_time)
+{
+    std::vector<unsigned long long> offsets = read_gen_index( GEN_PATH );
+    ASSERT_EQ( offsets.size( ), NUM_VARIANTS + 1 );
+    ASSERT_EQ( offsets[ 1 ], strlen( GEN_LINES[ 0 ] ) + 1 );
+
+    /* Same size but different line boundaries and a new modification time */
+    std::ofstream gen( GEN_PATH.c_str( ) );
+    for(size_t i = 0; i < NUM_VARIANTS; i++)
+    {
+        gen << GEN_LINES[ NUM_VARIANTS - 1 - i ] << "\n";
+    }
+    gen.close( );
+    struct utimbuf times;
+    times.actime = 1000000;
+    times.modtime = 1000000;
+    ASSERT_EQ( utime( GEN_PATH.c_str( ), &times ), 0 );
+
+    offsets = read_gen_index( GEN_PATH );
+    ASSERT_EQ( offsets.size( ), NUM_VARIANTS + 1 );
+    ASSERT_EQ( offsets[ 1 ], strlen( GEN_LINES[ NUM_VARIANTS - 1 ] ) + 1 );
+    ASSERT_EQ( offsets[ 2 ], offsets[ 1 ] + strlen( GEN_LINES[ NUM_VARIANTS - 2 ] ) + 1 );
+}
+
+TEST_F(imputed_test, cache_round_trip)
+{
+    /* Parse everything and a few windows, including both ends, without the cache */
+    const char *variants[] = { "rs0", "rs3", "rs7" };
+    std::vector<imputed_data> expected;
+    std::vector<int> expected_index;
+    for(int use_dosage = 0; use_dosage < 2; use_dosage++)
+    {
+        expected.push_back( parse_imputed_data( GEN_PATH, CALL_RATE, use_dosage ) );
+        for(int i = 0; i < 3; i++)
+        {
+            imputed_data window;
+            expected_index.push_back( parse_imputed_window( GEN_PATH, CALL_RATE, variants[ i ], 2, window, 1, use_dosage ) );
+            expected.push_back( window );
+        }
+    }
+    ASSERT_EQ( expected[ 0 ].genotypes->size( ), NUM_VARIANTS );
+    ASSERT_EQ( expected[ 0 ].samples.size( ), NUM_SAMPLES );
+
+    ASSERT_TRUE( build_imputed_cache( GEN_PATH, CALL_RATE ) );
+    ASSERT_TRUE( cache_exists( false ) );
+    ASSERT_FALSE( cache_exists( true ) );
+
+    for(int use_dosage = 0; use_dosage < 2; use_dosage++)
+    {
+        check_equal( expected[ 4 * use_dosage ], parse_imputed_data( GEN_PATH, CALL_RATE, use_dosage ) );
+        for(int i = 0; i < 3; i++)
+        {
+            imputed_data window;
+            ASSERT_EQ( parse_imputed_window( GEN_PATH, CALL_RATE, variants[ i ], 2, window, 1, use_dosage ), expected_index[ 3 * use_dosage + i ] );
+            check_equal( expected[ 4 * use_dosage + i + 1 ], window );
+        }
+    }
+}
+
+TEST_F(imputed_test, cache_call_rate)
+{
+    ASSERT_TRUE( build_imputed_cache( GEN_PATH, CALL_RATE ) );
+
+    /* A cache built with another call rate is ignored */
+    imputed_data data = parse_imputed_data( GEN_PATH, 0.95f );
+    ASSERT_EQ( ( *data.genotypes )[ 1 ][ 0 ], 3 );
+    ASSERT_EQ( ( *data.genotypes )[ 0 ][ 0 ], 0 );
+
+    data = parse_imputed_data( GEN_PATH, CALL_RATE );
+    ASSERT_EQ( ( *data.genotypes )[ 1 ][ 0 ], 0 );
+}
+
+TEST_F(imputed_test, cache_invalidation)
+{
+    ASSERT_TRUE( build_imputed_cache( GEN_PATH, CALL_RATE ) );
+
+    /* New variant names of the same length, with the old modification time */
+    struct stat info_stat;
+    ASSERT_EQ( stat( ( GEN_PATH + "_info" ).c_str( ), &info_stat ), 0 );
+    write_info( "sn" );
+    struct utimbuf times;
+    times.actime = info_stat.st_mtime;
+    times.modtime = info_stat.st_mtime;
+    ASSERT_EQ( utime( ( GEN_PATH + "_info" ).c_str( ), &times ), 0 );
+    ASSERT_EQ( parse_imputed_data( GEN_PATH, CALL_RATE ).info[ 0 ].name, "rs0" );
+
+    /* A new modification time of the info file invalidates the cache */
+    times.actime = info_stat.st_mtime + 10;
+    times.modtime = info_stat.st_mtime + 10;
+    ASSERT_EQ( utime( ( GEN_PATH + "_info" ).c_str( ), &times ), 0 );
+    ASSERT_EQ( parse_imputed_data( GEN_PATH, CALL_RATE ).info[ 0 ].name, "sn0" );
+
+    /* As does a new size of the sample file */
+    ASSERT_TRUE( build_imputed_cache( GEN_PATH, CALL_RATE ) );
+    std::ofstream samples( ( GEN_PATH + "_samples" ).c_str( ), std::ios::app );
+    samples << "fam3 ind3 0\n";
+    samples.close( );
+    ASSERT_EQ( parse_imputed_data( GEN_PATH, CALL_RATE ).samples.size( ), NUM_SAMPLES + 1 );
+}
+
+TEST_F(imputed_test, cache_truncated_gen)
+{
+    /* The info file lists more variants than the .gen file has, no cache is left behind */
+    std::ofstream info( ( GEN_PATH + "_info" ).c_str( ), std::ios::app );
+    info << "1 rs8 900 0.25 0.9 1 0\n";
+    info.close( );
+
+    ASSERT_FALSE( build_imputed_cache( GEN_PATH, CALL_RATE ) );
+    ASSERT_FALSE( cache_exists( false ) );
+    ASSERT_FALSE( cache_exists( true ) );
+}
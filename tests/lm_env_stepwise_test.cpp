@@ -0,0 +1,204 @@
+#include <cmath>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <dcdflib/libdcdf.hpp>
+#include <glm/glm.hpp>
+#include <glm/models/normal.hpp>
+#include <besiq/env_method/lm_env_stepwise.hpp>
+
+/**
+ * Number of samples.
+ */
+const size_t NUM_SAMPLES = 400;
+
+/**
+ * Fits the 5 models with glm_fit on explicit design matrices, in the
+ * same way as lm_env_stepwise did before it used cross products.
+ */
+bool
+reference_stepwise(const snp_row &row, const method_data &data, const arma::mat &E, double *p)
+{
+    size_t n = row.size( );
+    size_t num_env = E.n_cols;
+
+    /* Missing samples are zero, so that they do not affect the weighted fit */
+    arma::uvec missing = data.missing;
+    arma::vec y = data.phenotype;
+    arma::mat cov = data.covariate_matrix;
+    arma::mat env = E;
+    for(size_t i = 0; i < n; i++)
+    {
+        if( row[ i ] == 3 )
+        {
+            missing[ i ] = 1;
+        }
+        if( missing[ i ] != 0 )
+        {
+            y[ i ] = 0.0;
+            cov.row( i ).zeros( );
+            env.row( i ).zeros( );
+        }
+    }
+
+    arma::mat snp = arma::zeros<arma::mat>( n, 2 );
+    arma::mat interaction = arma::zeros<arma::mat>( n, 2 * num_env );
+    for(size_t i = 0; i < n; i++)
+    {
+        if( row[ i ] == 1 || row[ i ] == 2 )
+        {
+            snp( i, row[ i ] - 1 ) = 1.0;
+            for(size_t j = 0; j < num_env; j++)
+            {
+                interaction( i, ( row[ i ] - 1 ) * num_env + j ) = env( i, j );
+            }
+        }
+    }
+
+    arma::mat intercept = arma::ones<arma::mat>( n, 1 );
+    arma::mat null_matrix = arma::join_rows( intercept, cov );
+    arma::mat snp_matrix = arma::join_rows( null_matrix, snp );
+    arma::mat env_matrix = arma::join_rows( null_matrix, env );
+    arma::mat add_matrix = arma::join_rows( env_matrix, snp );
+    arma::mat alt_matrix = arma::join_rows( add_matrix, interaction );
+
+    const arma::mat *models[ 4 ] = { &null_matrix, &snp_matrix, &env_matrix, &add_matrix };
+    normal model( "identity" );
+    glm_info alt_info;
+    glm_fit( alt_matrix, y, missing, model, alt_info );
+    bool success = alt_info.success;
+    for(int i = 0; i < 4; i++)
+    {
+        glm_info info;
+        glm_fit( *models[ i ], y, missing, model, info );
+        success = success && info.success;
+        if( success )
+        {
+            double LR = -2 * ( info.logl - alt_info.logl );
+            p[ i ] = 1.0 - chi_square_cdf( LR, alt_matrix.n_cols - models[ i ]->n_cols );
+        }
+    }
+
+    return success;
+}
+
+class lm_env_stepwise_test
+: public ::testing::Test
+{
+protected:
+    /**
+     * Creates a variant, environment factors and a covariate, and a
+     * phenotype with a genotype by environment interaction.
+     */
+    void create_data(size_t num_env)
+    {
+        m_row.resize( NUM_SAMPLES );
+        m_E.set_size( NUM_SAMPLES, num_env );
+        m_data = method_data_ptr( new method_data( ) );
+        m_data->phenotype.set_size( NUM_SAMPLES );
+        m_data->missing = arma::zeros<arma::uvec>( NUM_SAMPLES );
+        m_data->covariate_matrix.set_size( NUM_SAMPLES, 1 );
+        for(size_t i = 0; i < NUM_SAMPLES; i++)
+        {
+            unsigned char g = ( i * 7 ) % 3;
+            m_row.assign( i, g );
+            for(size_t j = 0; j < num_env; j++)
+            {
+                m_E( i, j ) = ( ( i / 3 + j ) % ( 2 + j ) ) == 0 ? 1.0 : 0.0;
+            }
+            double age = 20.0 + ( i * 13 ) % 50;
+            m_data->covariate_matrix( i, 0 ) = age;
+            m_data->phenotype[ i ] = 1.0 + 0.01 * age + 0.1 * g + 0.1 * m_E( i, 0 ) + 0.2 * g * m_E( i, 0 ) + 2.0 * std::sin( 2.3 * i );
+        }
+    }
+
+    /**
+     * Checks that lm_env_stepwise gives the same p-values as glm_fit.
+     */
+    void check_reference()
+    {
+        double expected[ 4 ];
+        ASSERT_TRUE( reference_stepwise( m_row, *m_data, m_E, expected ) );
+
+        lm_env_stepwise method( m_data, m_E );
+        ASSERT_EQ( method.init( ).size( ), 4 );
+        float output[ 4 ];
+        ASSERT_NE( method.run( m_row, output ), -9 );
+        for(int i = 0; i < 4; i++)
+        {
+            ASSERT_NEAR( output[ i ], expected[ i ], 1e-4 * expected[ i ] + 1e-7 );
+        }
+    }
+
+    snp_row m_row;
+    arma::mat m_E;
+    method_data_ptr m_data;
+};
+
+TEST_F(lm_env_stepwise_test, single_environment)
+{
+    create_data( 1 );
+    check_reference( );
+}
+
+TEST_F(lm_env_stepwise_test, missing_genotypes)
+{
+    /* The samples with a missing genotype are removed from the precomputed cross products */
+    create_data( 1 );
+    m_row.assign( 3, 3 );
+    m_row.assign( 100, 3 );
+    m_row.assign( 250, 3 );
+    check_reference( );
+}
+
+TEST_F(lm_env_stepwise_test, missing_phenotypes_and_covariates)
+{
+    create_data( 1 );
+    m_data->phenotype[ 5 ] = arma::datum::nan;
+    m_data->missing[ 5 ] = 1;
+    m_data->covariate_matrix( 17, 0 ) = arma::datum::nan;
+    m_data->missing[ 17 ] = 1;
+
+    /* A sample may be missing for both reasons */
+    m_row.assign( 17, 3 );
+    m_row.assign( 42, 3 );
+    check_reference( );
+}
+
+TEST_F(lm_env_stepwise_test, multiple_environments)
+{
+    create_data( 3 );
+    m_row.assign( 8, 3 );
+    m_data->missing[ 9 ] = 1;
+    check_reference( );
+}
+
+TEST_F(lm_env_stepwise_test, collinear_design)
+{
+    /* The covariate is a copy of the environment, so no model can be fitted, as with glm_fit */
+    create_data( 1 );
+    m_data->covariate_matrix.col( 0 ) = m_E.col( 0 );
+
+    lm_env_stepwise method( m_data, m_E );
+    float output[ 4 ];
+    ASSERT_EQ( method.run( m_row, output ), -9 );
+}
+
+TEST_F(lm_env_stepwise_test, too_few_samples)
+{
+    /* Fewer than 20 samples have the second genotype and the environment */
+    create_data( 1 );
+    size_t num_left = 0;
+    for(size_t i = 0; i < NUM_SAMPLES; i++)
+    {
+        if( m_row[ i ] == 2 && m_E( i, 0 ) != 0.0 && num_left++ >= 19 )
+        {
+            m_E( i, 0 ) = 0.0;
+        }
+    }
+
+    lm_env_stepwise method( m_data, m_E );
+    float output[ 4 ];
+    ASSERT_EQ( method.run( m_row, output ), -9 );
+}
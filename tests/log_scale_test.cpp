@@ -151,3 +151,16 @@ TEST(log_scale_test, FromLog)
     ASSERT_NEAR( a.value( ), 2.5, 0.00001 );
 }
 
+
+TEST(log_scale_test, LogSumExp)
+{
+    double values[] = { log( 0.1 ), log( 0.2 ), log( 0.0 ), -6542.0 };
+    ASSERT_NEAR( logsumexp( values, 4 ).value( ), 0.3, 0.00001 );
+
+    double zeros[] = { log( 0.0 ), log( 0.0 ) };
+    ASSERT_TRUE( logsumexp( zeros, 2 ).is_zero( ) );
+
+    log_double a = log_double::from_log( log( 0.0 ) );
+    a += a;
+    ASSERT_TRUE( a.is_zero( ) );
+}
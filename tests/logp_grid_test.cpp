@@ -0,0 +1,112 @@
+#include <sstream>
+#include <cstring>
+
+#include <gtest/gtest.h>
+
+#include <besiq/logp_grid.hpp>
+
+class logp_grid_test
+: public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        const char *names[] = { "rs1", "rs2", "rs3", "rs4" };
+        unsigned char chromosomes[] = { 1, 1, 2, 1 };
+        long long positions[] = { 100, 2000000, 100, 150 };
+        for(int i = 0; i < 4; i++)
+        {
+            pio_locus_t locus;
+            memset( &locus, 0, sizeof( pio_locus_t ) );
+            locus.chromosome = chromosomes[ i ];
+            locus.name = (char *) names[ i ];
+            locus.bp_position = positions[ i ];
+            loci.push_back( locus );
+        }
+    }
+
+    std::vector<pio_locus_t> loci;
+};
+
+TEST_F(logp_grid_test, merge_and_binary)
+{
+    logp_grid grid( loci );
+    logp_grid partial( grid );
+    partial.clear( );
+
+    ASSERT_TRUE( grid.add_pvalue( "rs1", "rs2", 0.01 ) );
+    ASSERT_TRUE( partial.add_pvalue( 1, 3, 0.1 ) );
+    ASSERT_FALSE( partial.add_pvalue( 1, 4, 0.1 ) );
+    ASSERT_TRUE( grid.merge( partial ) );
+
+    std::stringstream binary;
+    ASSERT_TRUE( grid.write_binary( binary ) );
+    logp_grid read_grid;
+    ASSERT_TRUE( read_grid.read_binary( binary ) );
+
+    std::ostringstream expected;
+    grid.write_grid( expected );
+    std::ostringstream actual;
+    read_grid.write_grid( actual );
+    ASSERT_EQ( expected.str( ), actual.str( ) );
+
+    /* rs1 and rs4 share a grid point, so both pairs are in the same symmetric cell */
+    std::string text = actual.str( );
+    ASSERT_NE( text.find( "0\t1\t4.60517\t6.90776\t26.5095\t2\n" ), std::string::npos );
+    ASSERT_NE( text.find( "1\t0\t4.60517\t6.90776\t26.5095\t2\n" ), std::string::npos );
+}
+
+TEST_F(logp_grid_test, bp_window)
+{
+    logp_grid grid( loci );
+    ASSERT_EQ( grid.get_bp_window( ), 500000 );
+
+    /* Three grid points do not fit in two, so the window is doubled until rs1 and rs2 share a point */
+    logp_grid small_grid( loci, 2, 500000 );
+    ASSERT_EQ( small_grid.get_bp_window( ), 2000000 );
+}
+
+TEST_F(logp_grid_test, rejects_corrupt_binary)
+{
+    logp_grid grid( loci );
+    ASSERT_TRUE( grid.add_pvalue( "rs1", "rs2", 0.01 ) );
+    std::stringstream binary;
+    ASSERT_TRUE( grid.write_binary( binary ) );
+    const std::string bytes = binary.str( );
+
+    /* Offsets of the header fields and the grid point of the first variant */
+    const size_t num_variants_offset = 4;
+    const size_t num_points_offset = 12;
+    const size_t first_point_offset = 20;
+
+    std::istringstream truncated( bytes.substr( 0, bytes.size( ) - 1 ) );
+    logp_grid read_grid;
+    ASSERT_FALSE( read_grid.read_binary( truncated ) );
+
+    std::string large = bytes;
+    uint64_t num_points = 1ULL << 40;
+    large.replace( num_points_offset, sizeof( uint64_t ), (const char *) &num_points, sizeof( uint64_t ) );
+    std::istringstream large_points( large );
+    ASSERT_FALSE( read_grid.read_binary( large_points ) );
+
+    large = bytes;
+    uint64_t num_variants = 1ULL << 62;
+    large.replace( num_variants_offset, sizeof( uint64_t ), (const char *) &num_variants, sizeof( uint64_t ) );
+    std::istringstream large_variants( large );
+    ASSERT_FALSE( read_grid.read_binary( large_variants ) );
+
+    std::string bad_point = bytes;
+    uint32_t point = 3;
+    bad_point.replace( first_point_offset, sizeof( uint32_t ), (const char *) &point, sizeof( uint32_t ) );
+    std::istringstream bad_point_stream( bad_point );
+    ASSERT_FALSE( read_grid.read_binary( bad_point_stream ) );
+
+    /* A failed read leaves the grid unchanged */
+    std::istringstream valid( bytes );
+    ASSERT_TRUE( read_grid.read_binary( valid ) );
+    std::ostringstream expected;
+    grid.write_grid( expected );
+    std::ostringstream actual;
+    read_grid.write_grid( actual );
+    ASSERT_EQ( expected.str( ), actual.str( ) );
+}
@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+
+#include <armadillo>
+
+#include <besiq/model_matrix.hpp>
+
+class model_matrix_test
+: public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        row1.resize( 5 );
+        row1.assign( 0, 0 );
+        row1.assign( 1, 1 );
+        row1.assign( 2, 2 );
+        row1.assign( 3, 1 );
+        row1.assign( 4, 3 );
+
+        row2.resize( 5 );
+        row2.assign( 0, 1 );
+        row2.assign( 1, 3 );
+        row2.assign( 2, 2 );
+        row2.assign( 3, 0 );
+        row2.assign( 4, 1 );
+
+        row3.resize( 5 );
+        row3.assign( 0, 2 );
+        row3.assign( 1, 1 );
+        row3.assign( 2, 0 );
+        row3.assign( 3, 1 );
+        row3.assign( 4, 2 );
+
+        cov = arma::zeros<arma::mat>( 5, 1 );
+        cov[ 3 ] = 1.5;
+    }
+
+    snp_row row1;
+    snp_row row2;
+    snp_row row3;
+    arma::mat cov;
+};
+
+TEST_F(model_matrix_test, factor_encoding)
+{
+    factor_matrix matrix( cov, 5 );
+    arma::uvec missing = arma::zeros<arma::uvec>( 5 );
+    matrix.update_matrix( row1, row2, missing );
+
+    const arma::mat &alt = matrix.get_alt( );
+    ASSERT_EQ( missing[ 1 ], 1 );
+    ASSERT_EQ( missing[ 4 ], 1 );
+    ASSERT_EQ( arma::accu( missing ), 2 );
+
+    /* Sample 2 is 2/2 */
+    ASSERT_DOUBLE_EQ( alt( 2, 0 ), 0.0 );
+    ASSERT_DOUBLE_EQ( alt( 2, 1 ), 1.0 );
+    ASSERT_DOUBLE_EQ( alt( 2, 3 ), 1.0 );
+    ASSERT_DOUBLE_EQ( alt( 2, 7 ), 1.0 );
+    ASSERT_DOUBLE_EQ( alt( 2, 8 ), 1.0 );
+
+    /* Sample 1 is missing in the second snp */
+    for(int j = 0; j < 8; j++)
+    {
+        ASSERT_DOUBLE_EQ( alt( 1, j ), 0.0 );
+    }
+    ASSERT_DOUBLE_EQ( alt( 3, 9 ), 1.5 );
+}
+
+TEST_F(model_matrix_test, reuse_first_snp)
+{
+    factor_matrix reused( cov, 5 );
+    arma::uvec missing = arma::zeros<arma::uvec>( 5 );
+    reused.update_matrix( row1, row2, missing );
+    missing = arma::zeros<arma::uvec>( 5 );
+    reused.update_matrix( row1, row3, missing );
+
+    factor_matrix fresh( cov, 5 );
+    arma::uvec fresh_missing = arma::zeros<arma::uvec>( 5 );
+    fresh.update_matrix( row1, row3, fresh_missing );
+
+    ASSERT_EQ( arma::accu( missing != fresh_missing ), 0 );
+    ASSERT_DOUBLE_EQ( arma::accu( arma::abs( reused.get_alt( ) - fresh.get_alt( ) ) ), 0.0 );
+    ASSERT_DOUBLE_EQ( arma::accu( arma::abs( reused.get_null( ) - fresh.get_null( ) ) ), 0.0 );
+}
+
+TEST_F(model_matrix_test, dosage_matches_hard_calls)
+{
+    dosage_row dosage1;
+    dosage_row dosage2;
+    dosage1.resize( 5 );
+    dosage2.resize( 5 );
+    for(int i = 0; i < 5; i++)
+    {
+        if( row1[ i ] != 3 )
+        {
+            dosage1.assign( i, row1[ i ] == 1, row1[ i ] == 2 );
+        }
+        if( row2[ i ] != 3 )
+        {
+            dosage2.assign( i, row2[ i ] == 1, row2[ i ] == 2 );
+        }
+    }
+
+    factor_matrix hard( cov, 5 );
+    arma::uvec hard_missing = arma::zeros<arma::uvec>( 5 );
+    hard.update_matrix( row1, row2, hard_missing );
+
+    factor_matrix expected( cov, 5 );
+    arma::uvec expected_missing = arma::zeros<arma::uvec>( 5 );
+    expected.update_matrix( dosage1, dosage2, expected_missing );
+
+    ASSERT_EQ( arma::accu( hard_missing != expected_missing ), 0 );
+    ASSERT_LT( arma::abs( hard.get_alt( ) - expected.get_alt( ) ).max( ), 1e-12 );
+    ASSERT_LT( arma::abs( hard.get_null( ) - expected.get_null( ) ).max( ), 1e-12 );
+
+    /* The hard calls must be fully rewritten after a dosage update */
+    hard_missing = arma::zeros<arma::uvec>( 5 );
+    expected_missing = arma::zeros<arma::uvec>( 5 );
+    hard.update_matrix( row1, row3, hard_missing );
+    expected.update_matrix( row1, row3, expected_missing );
+    ASSERT_LT( arma::abs( hard.get_alt( ) - expected.get_alt( ) ).max( ), 1e-12 );
+}
@@ -0,0 +1,248 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <plink/plink_file.hpp>
+#include <plink/shared_genotypes.hpp>
+
+const std::string PLINK_PREFIX = "shared_genotypes_test_data";
+const size_t NUM_SAMPLES = 6;
+const size_t NUM_VARIANTS = 3;
+
+/**
+ * Returns true if a segment with the given name exists.
+ */
+bool
+segment_exists(const std::string &name)
+{
+    int fd = shm_open( name.c_str( ), O_RDONLY, 0 );
+    if( fd != -1 )
+    {
+        close( fd );
+    }
+
+    return fd != -1;
+}
+
+/**
+ * Creates a segment that was allocated but never written and that no
+ * process uses, as left behind by a creator that was killed.
+ */
+void
+create_unready_segment(const std::string &name)
+{
+    int fd = shm_open( name.c_str( ), O_RDWR | O_CREAT | O_EXCL, 0600 );
+    ASSERT_TRUE( fd != -1 );
+
+    /* magic, ready, num_samples, num_variants and row_words */
+    uint32_t flags[ 2 ] = { 0x4f4e4547, 0 };
+    uint64_t sizes[ 3 ] = { NUM_SAMPLES, NUM_VARIANTS, snp_row::num_words( NUM_SAMPLES ) };
+    ASSERT_EQ( ftruncate( fd, 64 + NUM_VARIANTS * sizes[ 2 ] * sizeof( unsigned int ) ), 0 );
+    ASSERT_EQ( pwrite( fd, flags, sizeof( flags ), 0 ), (ssize_t) sizeof( flags ) );
+    ASSERT_EQ( pwrite( fd, sizes, sizeof( sizes ), sizeof( flags ) ), (ssize_t) sizeof( sizes ) );
+    close( fd );
+}
+
+/**
+ * Creates an empty segment, as seen by other processes between the
+ * creator opening it and taking its exclusive lock.
+ */
+void
+create_empty_segment(const std::string &name)
+{
+    int fd = shm_open( name.c_str( ), O_RDWR | O_CREAT | O_EXCL, 0600 );
+    ASSERT_TRUE( fd != -1 );
+    close( fd );
+}
+
+class shared_genotypes_test : public testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        std::ofstream fam( ( PLINK_PREFIX + ".fam" ).c_str( ) );
+        for(size_t i = 0; i < NUM_SAMPLES; i++)
+        {
+            fam << "fam" << i << " ind" << i << " 0 0 1 -9\n";
+        }
+        fam.close( );
+
+        std::ofstream bim( ( PLINK_PREFIX + ".bim" ).c_str( ) );
+        bim << "1 rs1 0 1000 A G\n";
+        bim << "1 rs2 0 2000 C T\n";
+        bim << "2 rs3 0 3000 G A\n";
+        bim.close( );
+
+        const unsigned char bed[ ] = { 0x6c, 0x1b, 0x01,
+                                       0x1b, 0x0e,
+                                       0xff, 0x02,
+                                       0x88, 0x07 };
+        std::ofstream bed_file( ( PLINK_PREFIX + ".bed" ).c_str( ), std::ios::binary );
+        bed_file.write( (const char *) bed, sizeof( bed ) );
+        bed_file.close( );
+
+        std::ostringstream name;
+        name << "/besiq-test-" << getpid( );
+        m_name = name.str( );
+        shm_unlink( m_name.c_str( ) );
+
+        m_expected = create_genotype_matrix( open_plink_file( PLINK_PREFIX, true ) );
+    }
+
+    virtual void TearDown()
+    {
+        shm_unlink( m_name.c_str( ) );
+        std::remove( ( PLINK_PREFIX + ".fam" ).c_str( ) );
+        std::remove( ( PLINK_PREFIX + ".bim" ).c_str( ) );
+        std::remove( ( PLINK_PREFIX + ".bed" ).c_str( ) );
+    }
+
+    /**
+     * Checks that the segment contains the genotypes of the plink file.
+     */
+    void check_rows(const shared_genotypes &segment)
+    {
+        ASSERT_EQ( segment.num_variants( ), NUM_VARIANTS );
+        for(size_t i = 0; i < NUM_VARIANTS; i++)
+        {
+            snp_row row;
+            row.wrap( segment.get_row( i ), NUM_SAMPLES );
+            ASSERT_TRUE( row == m_expected->get_row( i ) );
+        }
+    }
+
+    std::string m_name;
+    genotype_matrix_ptr m_expected;
+};
+
+TEST_F(shared_genotypes_test, create_and_attach)
+{
+    shared_genotypes created( m_name, open_plink_file( PLINK_PREFIX, true ) );
+    check_rows( created );
+
+    /* Attaching maps the written segment and leaves the plink file unread */
+    plink_file_ptr genotype_file = open_plink_file( PLINK_PREFIX, true );
+    shared_genotypes attached( m_name, genotype_file );
+    check_rows( attached );
+
+    snp_row row;
+    ASSERT_TRUE( genotype_file->next_row( row ) );
+    ASSERT_TRUE( row == m_expected->get_row( 0 ) );
+}
+
+TEST_F(shared_genotypes_test, last_user_removes)
+{
+    shared_genotypes *created = new shared_genotypes( m_name, open_plink_file( PLINK_PREFIX, true ) );
+    shared_genotypes *attached = new shared_genotypes( m_name, open_plink_file( PLINK_PREFIX, true ) );
+
+    delete created;
+    ASSERT_TRUE( segment_exists( m_name ) );
+    check_rows( *attached );
+
+    delete attached;
+    ASSERT_FALSE( segment_exists( m_name ) );
+}
+
+TEST_F(shared_genotypes_test, unready_segment)
+{
+    /* A segment that was never written is removed and created again */
+    create_unready_segment( m_name );
+    shared_genotypes *segment = new shared_genotypes( m_name, open_plink_file( PLINK_PREFIX, true ) );
+    check_rows( *segment );
+
+    delete segment;
+    ASSERT_FALSE( segment_exists( m_name ) );
+}
+
+TEST_F(shared_genotypes_test, empty_segment)
+{
+    /* An empty segment may still be written by its creator, so it is never removed on open */
+    create_empty_segment( m_name );
+    ASSERT_THROW( shared_genotypes segment( m_name, open_plink_file( PLINK_PREFIX, true ) ), std::runtime_error );
+    ASSERT_TRUE( segment_exists( m_name ) );
+}
+
+TEST_F(shared_genotypes_test, concurrent_attach)
+{
+    const int num_jobs = 4;
+    for(int round = 0; round < 20; round++)
+    {
+        /* The jobs block on the pipe until it is closed, so they all open the segment at once */
+        int start[ 2 ];
+        ASSERT_EQ( pipe( start ), 0 );
+
+        pid_t jobs[ num_jobs ];
+        for(int i = 0; i < num_jobs; i++)
+        {
+            jobs[ i ] = fork( );
+            ASSERT_NE( jobs[ i ], -1 );
+            if( jobs[ i ] == 0 )
+            {
+                close( start[ 1 ] );
+                char c;
+                read( start[ 0 ], &c, 1 );
+
+                int status = 1;
+                try
+                {
+                    shared_genotypes segment( m_name, open_plink_file( PLINK_PREFIX, true ) );
+                    status = 0;
+                    for(size_t j = 0; j < NUM_VARIANTS; j++)
+                    {
+                        snp_row row;
+                        row.wrap( segment.get_row( j ), NUM_SAMPLES );
+                        status |= !( row == m_expected->get_row( j ) );
+                    }
+                }
+                catch(std::exception &e)
+                {
+                    status = 2;
+                }
+                _exit( status );
+            }
+        }
+        close( start[ 0 ] );
+        close( start[ 1 ] );
+
+        for(int i = 0; i < num_jobs; i++)
+        {
+            int status = -1;
+            ASSERT_EQ( waitpid( jobs[ i ], &status, 0 ), jobs[ i ] );
+            ASSERT_TRUE( WIFEXITED( status ) );
+            ASSERT_EQ( WEXITSTATUS( status ), 0 );
+        }
+        ASSERT_FALSE( segment_exists( m_name ) );
+    }
+}
+
+TEST_F(shared_genotypes_test, remove_stale)
+{
+    std::string used_name = m_name + "-used";
+    shm_unlink( used_name.c_str( ) );
+    shared_genotypes *used = new shared_genotypes( used_name, open_plink_file( PLINK_PREFIX, true ) );
+
+    std::string empty_name = m_name + "-empty";
+    shm_unlink( empty_name.c_str( ) );
+    create_empty_segment( empty_name );
+
+    create_unready_segment( m_name );
+    ASSERT_TRUE( remove_stale_shared_genotypes( ) >= 1 );
+    ASSERT_FALSE( segment_exists( m_name ) );
+    ASSERT_TRUE( segment_exists( used_name ) );
+    ASSERT_TRUE( segment_exists( empty_name ) );
+    shm_unlink( empty_name.c_str( ) );
+    check_rows( *used );
+
+    delete used;
+    ASSERT_FALSE( segment_exists( used_name ) );
+}
@@ -20,3 +20,55 @@ TEST(snp_row_test, test_assign)
         ASSERT_EQ( row[ i ], i % 4 );
     }
 }
+
+TEST(snp_row_test, test_wrap)
+{
+    snp_row row;
+    row.resize( 50 );
+    for(int i = 0; i < 50; i++)
+    {
+        row.assign( i, ( i * 7 ) % 4 );
+    }
+
+    /* A wrapped row reads the external words, and copies them when modified */
+    snp_row wrapped;
+    wrapped.wrap( row.data( ), row.size( ) );
+    ASSERT_TRUE( wrapped.data( ) == row.data( ) );
+    ASSERT_TRUE( wrapped == row );
+
+    wrapped.assign( 3, 0 );
+    ASSERT_FALSE( wrapped.data( ) == row.data( ) );
+    ASSERT_EQ( wrapped[ 3 ], 0 );
+    ASSERT_EQ( row[ 3 ], ( 3 * 7 ) % 4 );
+    for(int i = 4; i < 50; i++)
+    {
+        ASSERT_EQ( wrapped[ i ], row[ i ] );
+    }
+}
+
+TEST(snp_row_test, test_copy_wrapped)
+{
+    /* A copy of a wrapped row must not refer to the external words */
+    snp_row *row = new snp_row( );
+    row->resize( 50 );
+    for(int i = 0; i < 50; i++)
+    {
+        row->assign( i, ( i * 5 ) % 4 );
+    }
+
+    snp_row wrapped;
+    wrapped.wrap( row->data( ), row->size( ) );
+    snp_row copy = wrapped;
+    snp_row assigned;
+    assigned = wrapped;
+    ASSERT_FALSE( copy.data( ) == row->data( ) );
+    ASSERT_FALSE( assigned.data( ) == row->data( ) );
+    ASSERT_TRUE( copy == *row );
+
+    delete row;
+    for(int i = 0; i < 50; i++)
+    {
+        ASSERT_EQ( copy[ i ], ( i * 5 ) % 4 );
+        ASSERT_EQ( assigned[ i ], ( i * 5 ) % 4 );
+    }
+}
@@ -0,0 +1,56 @@
+#include <armadillo>
+#include <gtest/gtest.h>
+
+#include <glm/irls.hpp>
+#include <glm/models/binomial.hpp>
+#include <besiq/stats/streaming_glm.hpp>
+
+using namespace arma;
+
+TEST(StreamingGLMTest, MatchesIRLS)
+{
+    size_t n = 200;
+    size_t num_variants = 5;
+    shared_ptr<std::vector<snp_row> > rows( new std::vector<snp_row>( num_variants ) );
+    std::vector<std::string> names;
+    std::vector<size_t> variants;
+    mat X = ones<mat>( n, num_variants + 2 );
+    vec y = zeros<vec>( n );
+    uvec missing = zeros<uvec>( n );
+    for(size_t k = 0; k < num_variants; k++)
+    {
+        ( *rows )[ k ].resize( n );
+        for(size_t i = 0; i < n; i++)
+        {
+            unsigned char g = ( i * ( k + 3 ) + i / ( k + 2 ) ) % 3;
+            ( *rows )[ k ].assign( i, g );
+            X( i, k ) = g;
+        }
+        names.push_back( "snp" );
+        variants.push_back( k );
+    }
+    for(size_t i = 0; i < n; i++)
+    {
+        X( i, num_variants ) = ( ( i * 7 ) % 11 ) / 11.0;
+        y[ i ] = ( ( i * 13 ) % 5 + X( i, 0 ) ) > 3 ? 1.0 : 0.0;
+    }
+    missing[ 3 ] = 1;
+
+    genotype_matrix_ptr genotypes( new genotype_matrix( rows, names ) );
+    binomial model( "logit" );
+
+    glm_info dense_info;
+    vec dense_beta = irls( X, y, missing, model, dense_info );
+
+    /* Blocks of two variants so that several blocks are combined */
+    streaming_design design( genotypes, variants, X.cols( num_variants, num_variants + 1 ), 2 );
+    glm_info streaming_info;
+    vec streaming_beta = streaming_irls( design, y, missing, model, streaming_info );
+
+    ASSERT_TRUE( dense_info.success && streaming_info.success );
+    for(size_t i = 0; i < dense_beta.n_elem; i++)
+    {
+        ASSERT_NEAR( dense_beta[ i ], streaming_beta[ i ], 1e-6 );
+        ASSERT_NEAR( dense_info.se_beta[ i ], streaming_info.se_beta[ i ], 1e-6 );
+    }
+}
@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <dcdflib/libdcdf.hpp>
+#include <besiq/method/var_method.hpp>
+
+/**
+ * Computes the Brown-Forsythe test by sorting the phenotypes of each
+ * genotype, the median is the element of rank n / 2.
+ */
+void
+reference_brown_forsythe(const snp_row &row, const arma::vec &pheno, const arma::uvec &missing, double *W, double *p)
+{
+    std::vector<std::vector<double> > groups( 3 );
+    for(size_t i = 0; i < row.size( ); i++)
+    {
+        if( row[ i ] != 3 && missing[ i ] == 0 )
+        {
+            groups[ row[ i ] ].push_back( pheno[ i ] );
+        }
+    }
+
+    std::vector<std::vector<double> > z( 3 );
+    double z_i[ 3 ];
+    double z_all = 0.0;
+    double N = 0.0;
+    for(int g = 0; g < 3; g++)
+    {
+        std::sort( groups[ g ].begin( ), groups[ g ].end( ) );
+        double median = groups[ g ][ groups[ g ].size( ) / 2 ];
+        z_i[ g ] = 0.0;
+        for(size_t j = 0; j < groups[ g ].size( ); j++)
+        {
+            z[ g ].push_back( std::abs( groups[ g ][ j ] - median ) );
+            z_i[ g ] += z[ g ][ j ];
+        }
+        z_all += z_i[ g ];
+        N += groups[ g ].size( );
+        z_i[ g ] /= groups[ g ].size( );
+    }
+    z_all /= N;
+
+    double numerator = 0.0;
+    double W_sq = 0.0;
+    for(int g = 0; g < 3; g++)
+    {
+        numerator += groups[ g ].size( ) * ( z_i[ g ] - z_all ) * ( z_i[ g ] - z_all );
+        for(size_t j = 0; j < z[ g ].size( ); j++)
+        {
+            W_sq += ( z[ g ][ j ] - z_i[ g ] ) * ( z[ g ][ j ] - z_i[ g ] );
+        }
+    }
+
+    *W = ( ( N - 3 ) * numerator ) / ( 2 * W_sq );
+    *p = 1 - f_cdf( *W, 2, N - 3 );
+}
+
+class var_method_test
+: public ::testing::Test
+{
+protected:
+    /**
+     * Creates a variant with the given number of samples of each genotype,
+     * followed by a missing genotype and a missing phenotype.
+     */
+    void create_data(const size_t *sizes, double offset)
+    {
+        size_t n = sizes[ 0 ] + sizes[ 1 ] + sizes[ 2 ] + 2;
+        m_row.resize( n );
+        m_data = method_data_ptr( new method_data( ) );
+        m_data->phenotype = arma::zeros<arma::vec>( n );
+        m_data->missing = arma::zeros<arma::uvec>( n );
+
+        size_t i = 0;
+        for(unsigned char g = 0; g < 3; g++)
+        {
+            for(size_t j = 0; j < sizes[ g ]; j++)
+            {
+                /* Deviations of very different size around a large offset, with ties */
+                m_row.assign( i, g );
+                m_data->phenotype[ i ] = offset * ( j % 2 == 0 ? 1.0 : -1.0 ) + ( g + 1 ) * ( ( 7 * j + 3 * g ) % 11 );
+                i++;
+            }
+        }
+
+        m_row.assign( i, 3 );
+        m_data->phenotype[ i++ ] = 1e9;
+        m_row.assign( i, 1 );
+        m_data->phenotype[ i ] = -1e9;
+        m_data->missing[ i ] = 1;
+    }
+
+    /**
+     * Checks that var_method gives the same W and p as the reference.
+     */
+    void check_reference()
+    {
+        double W;
+        double p;
+        reference_brown_forsythe( m_row, m_data->phenotype, m_data->missing, &W, &p );
+
+        var_method method( m_data );
+        float output[ 2 ];
+        ASSERT_NE( method.run( m_row, output ), -9 );
+        ASSERT_NEAR( output[ 0 ], W, 1e-5 * std::abs( W ) );
+        ASSERT_NEAR( output[ 1 ], p, 1e-6 );
+    }
+
+    snp_row m_row;
+    method_data_ptr m_data;
+};
+
+TEST_F(var_method_test, odd_group_sizes)
+{
+    size_t sizes[ 3 ] = { 21, 35, 27 };
+    create_data( sizes, 0.0 );
+    check_reference( );
+}
+
+TEST_F(var_method_test, even_group_sizes)
+{
+    size_t sizes[ 3 ] = { 22, 40, 24 };
+    create_data( sizes, 0.0 );
+    check_reference( );
+}
+
+TEST_F(var_method_test, large_deviations)
+{
+    /* The phenotypes form two clusters far apart, so half of the deviations are about 1e7 */
+    size_t sizes[ 3 ] = { 30, 26, 23 };
+    create_data( sizes, 5e6 );
+    check_reference( );
+}
+
+TEST_F(var_method_test, too_few_samples)
+{
+    size_t sizes[ 3 ] = { 30, 20, 23 };
+    create_data( sizes, 0.0 );
+
+    var_method method( m_data );
+    float output[ 2 ];
+    ASSERT_EQ( method.run( m_row, output ), -9 );
+}
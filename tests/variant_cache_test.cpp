@@ -0,0 +1,224 @@
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <glm/models/binomial.hpp>
+#include <glm/models/normal.hpp>
+#include <plink/plink_file.hpp>
+#include <besiq/model_matrix.hpp>
+#include <besiq/variant_cache.hpp>
+#include <besiq/method/besiq_method.hpp>
+#include <besiq/method/glm_method.hpp>
+#include <besiq/method/loglinear_method.hpp>
+#include <besiq/method/stagewise_method.hpp>
+#include <besiq/stats/snp_count.hpp>
+
+/**
+ * Number of samples.
+ */
+const size_t NUM_SAMPLES = 600;
+
+/**
+ * Number of variants.
+ */
+const size_t NUM_VARIANTS = 4;
+
+class variant_cache_test
+: public ::testing::Test
+{
+protected:
+    /**
+     * Creates variants with a few missing genotypes each, and a
+     * phenotype that is either binary or a multiple of 0.25, so that
+     * the cached and the joint sums are exact.
+     */
+    void create_data(bool is_binary)
+    {
+        shared_ptr<std::vector<snp_row> > rows( new std::vector<snp_row>( NUM_VARIANTS ) );
+        std::vector<std::string> names;
+        for(size_t j = 0; j < NUM_VARIANTS; j++)
+        {
+            snp_row &row = ( *rows )[ j ];
+            row.resize( NUM_SAMPLES );
+            for(size_t i = 0; i < NUM_SAMPLES; i++)
+            {
+                unsigned char g = ( ( i * ( 2 * j + 3 ) + i / ( j + 5 ) ) % 7 ) % 3;
+                if( ( i + 11 * j ) % 53 == 0 )
+                {
+                    g = 3;
+                }
+                row.assign( i, g );
+            }
+            names.push_back( std::string( "rs" ) + (char) ( '1' + j ) );
+        }
+        m_genotypes = genotype_matrix_ptr( new genotype_matrix( rows, names ) );
+
+        m_data = method_data_ptr( new method_data( ) );
+        m_data->phenotype.set_size( NUM_SAMPLES );
+        m_data->missing = arma::zeros<arma::uvec>( NUM_SAMPLES );
+        m_data->covariate_matrix.set_size( NUM_SAMPLES, 1 );
+        m_data->num_interactions = 1;
+        m_data->num_single = NUM_VARIANTS;
+        m_data->single_prior = -1.0;
+        for(size_t i = 0; i < NUM_SAMPLES; i++)
+        {
+            m_data->covariate_matrix( i, 0 ) = 0.5 * ( i % 7 );
+            if( is_binary )
+            {
+                m_data->phenotype[ i ] = ( ( i * 7 ) % 5 ) < 2 ? 1.0 : 0.0;
+            }
+            else
+            {
+                m_data->phenotype[ i ] = 0.25 * ( ( i * 5 ) % 17 ) + 0.5 * ( *rows )[ 0 ][ i ];
+            }
+
+            /* Missing samples have a finite phenotype, as set when the phenotypes are read */
+            if( i % 41 == 7 )
+            {
+                m_data->missing[ i ] = 1;
+                m_data->phenotype[ i ] = 0.0;
+            }
+        }
+    }
+
+    /**
+     * Runs the method on a list of pairs, once with the variant cache and
+     * once without, and checks that the outputs are identical. The pairs
+     * repeat and alternate the first variant to cover the reuse of the
+     * columns of the first variant in the model matrix.
+     */
+    void check_cached(method_type &cached, method_type &uncached)
+    {
+        std::vector<std::string> header = cached.init( );
+        ASSERT_EQ( uncached.init( ).size( ), header.size( ) );
+        ASSERT_TRUE( cached.use_variant_cache( ) );
+        cached.set_variant_cache( cached.make_variant_cache( m_genotypes ) );
+
+        const size_t pairs[][ 2 ] = { { 0, 1 }, { 0, 2 }, { 0, 3 }, { 1, 2 }, { 2, 0 }, { 0, 1 }, { 3, 1 }, { 3, 2 }, { 1, 3 } };
+        size_t num_pairs = sizeof( pairs ) / sizeof( pairs[ 0 ] );
+        size_t num_computed = 0;
+        for(size_t p = 0; p < num_pairs; p++)
+        {
+            const snp_row &row1 = m_genotypes->get_row( pairs[ p ][ 0 ] );
+            const snp_row &row2 = m_genotypes->get_row( pairs[ p ][ 1 ] );
+            std::vector<float> cached_output( header.size( ), -9.0f );
+            std::vector<float> uncached_output( header.size( ), -9.0f );
+
+            double cached_statistic = cached.run( pairs[ p ][ 0 ], pairs[ p ][ 1 ], &cached_output[ 0 ] );
+            double uncached_statistic = uncached.run( row1, row2, &uncached_output[ 0 ] );
+
+            ASSERT_EQ( cached_statistic, uncached_statistic );
+            ASSERT_EQ( cached.num_ok_samples( row1, row2 ), uncached.num_ok_samples( row1, row2 ) );
+            for(size_t k = 0; k < header.size( ); k++)
+            {
+                ASSERT_EQ( cached_output[ k ], uncached_output[ k ] );
+            }
+            num_computed += uncached_statistic != -9;
+        }
+
+        /* Make sure that the comparison is not vacuous */
+        ASSERT_EQ( num_computed, num_pairs );
+    }
+
+    genotype_matrix_ptr m_genotypes;
+    method_data_ptr m_data;
+};
+
+TEST_F(variant_cache_test, marginals)
+{
+    create_data( true );
+    arma::vec weight = 1.0 - arma::conv_to<arma::vec>::from( m_data->missing );
+    variant_cache_ptr cache = create_variant_cache( m_genotypes, m_data->phenotype, weight );
+    ASSERT_EQ( cache->size( ), NUM_VARIANTS );
+
+    for(size_t j = 0; j < NUM_VARIANTS; j++)
+    {
+        const snp_row &row = m_genotypes->get_row( j );
+        const variant_info &info = cache->get( j );
+        ASSERT_EQ( info.maf, compute_real_maf( row ) );
+        ASSERT_TRUE( info.genotypes.empty( ) );
+
+        size_t num_missing = 0;
+        for(size_t i = 0; i < NUM_SAMPLES; i++)
+        {
+            if( row[ i ] == 3 )
+            {
+                ASSERT_LT( num_missing, info.missing_samples.size( ) );
+                ASSERT_EQ( info.missing_samples[ num_missing++ ], i );
+            }
+        }
+        ASSERT_EQ( num_missing, info.missing_samples.size( ) );
+
+        arma::mat counts = single_count( row, row, m_data->phenotype, weight );
+        arma::mat sums = joint_count_cont( row, row, m_data->phenotype, weight );
+        for(int g = 0; g < 3; g++)
+        {
+            for(int k = 0; k < 2; k++)
+            {
+                ASSERT_EQ( info.counts[ g ][ k ], counts( g, k ) );
+            }
+            for(int k = 0; k < 3; k++)
+            {
+                ASSERT_EQ( info.sums[ g ][ k ], sums( 4 * g, k ) );
+            }
+        }
+
+        /* The marginals over the non-missing samples of another variant */
+        for(size_t l = 0; l < NUM_VARIANTS; l++)
+        {
+            arma::mat pair_counts = single_count( row, m_genotypes->get_row( l ), m_data->phenotype, weight );
+            ASSERT_TRUE( arma::accu( arma::abs( cache->pair_marginal( j, l, true ) - pair_counts ) ) == 0.0 );
+        }
+    }
+}
+
+TEST_F(variant_cache_test, besiq_method)
+{
+    /* Without covariates the weights are integers, so the cached counts are exact */
+    create_data( true );
+    m_data->covariate_matrix = arma::mat( );
+    besiq_method cached( m_data );
+    besiq_method uncached( m_data );
+    check_cached( cached, uncached );
+}
+
+TEST_F(variant_cache_test, loglinear_method)
+{
+    create_data( true );
+    loglinear_method cached( m_data );
+    loglinear_method uncached( m_data );
+    check_cached( cached, uncached );
+}
+
+TEST_F(variant_cache_test, stagewise_binomial)
+{
+    create_data( true );
+    stagewise_method cached( m_data, "binomial" );
+    stagewise_method uncached( m_data, "binomial" );
+    check_cached( cached, uncached );
+}
+
+TEST_F(variant_cache_test, stagewise_normal)
+{
+    create_data( false );
+    stagewise_method cached( m_data, "normal" );
+    stagewise_method uncached( m_data, "normal" );
+    check_cached( cached, uncached );
+}
+
+TEST_F(variant_cache_test, glm_method)
+{
+    /* The covariate makes the method use the model matrix */
+    create_data( false );
+    normal model( "identity" );
+    model_matrix *cached_matrix = make_model_matrix( "factor", m_data->covariate_matrix, NUM_SAMPLES );
+    model_matrix *uncached_matrix = make_model_matrix( "factor", m_data->covariate_matrix, NUM_SAMPLES );
+    glm_method cached( m_data, model, *cached_matrix );
+    glm_method uncached( m_data, model, *uncached_matrix );
+    check_cached( cached, uncached );
+
+    delete cached_matrix;
+    delete uncached_matrix;
+}